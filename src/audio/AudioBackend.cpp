@@ -0,0 +1,76 @@
+#include "AudioBackend.hpp"
+#include "AudioLog.hpp"
+#include "NullBackend.hpp"
+#include "PulseBackend.hpp"
+#ifdef FUNNYPAD_HAVE_PIPEWIRE
+#include "PipeWireBackend.hpp"
+#endif
+#include <QDebug>
+#include <QMutexLocker>
+#include <QString>
+#include <QtGlobal>
+
+namespace soundpad {
+
+std::unique_ptr<AudioBackend> AudioBackend::create(Kind kind)
+{
+    switch (kind) {
+    case Kind::Pulse:
+        return std::make_unique<PulseBackend>("FunnyPad");
+    case Kind::PipeWire:
+#ifdef FUNNYPAD_HAVE_PIPEWIRE
+        return std::make_unique<PipeWireBackend>("FunnyPad");
+#else
+        return nullptr;
+#endif
+    case Kind::Null:
+        return std::make_unique<NullBackend>();
+    }
+    return nullptr;
+}
+
+std::unique_ptr<AudioBackend> AudioBackend::createDefault()
+{
+    const QString choice = qEnvironmentVariable("FUNNYPAD_AUDIO_BACKEND").toLower();
+    std::unique_ptr<AudioBackend> backend;
+    if (choice == "null") {
+        NullBackend::Options options;
+        bool ok = false;
+        const double speed = qEnvironmentVariable("FUNNYPAD_NULL_SPEED").toDouble(&ok);
+        if (ok) {
+            options.speed = speed;
+        }
+        options.wavPath = qEnvironmentVariable("FUNNYPAD_NULL_WAV").toStdString();
+        backend = std::make_unique<NullBackend>(options);
+    } else if (choice == "pipewire") {
+        backend = create(Kind::PipeWire);
+        if (!backend) {
+            qCDebug(lcAudio) << "[AudioBackend] Built without PipeWire, using PulseAudio";
+        }
+    } else if (!choice.isEmpty() && choice != "pulse") {
+        qCDebug(lcAudio) << "[AudioBackend] Unknown backend" << choice << "- using PulseAudio";
+    }
+    if (!backend) {
+        backend = create(Kind::Pulse);
+    }
+    qCDebug(lcAudio) << "[AudioBackend] Using" << backend->name();
+    return backend;
+}
+
+void AudioBackend::setDeviceListener(DeviceListener listener)
+{
+    QMutexLocker locker(&listenerMutex_);
+    listener_ = std::move(listener);
+}
+
+// Under the mutex: the listener can be taken away while the backend's
+// thread is in the middle of reporting
+void AudioBackend::notifyDevice(DeviceChange change, const AudioDevice& device)
+{
+    QMutexLocker locker(&listenerMutex_);
+    if (listener_) {
+        listener_(change, device);
+    }
+}
+
+} // namespace soundpad
@@ -0,0 +1,153 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <QMetaType>
+#include <QMutex>
+#include <QtGlobal>
+#include "PcmSource.hpp"
+
+namespace soundpad {
+
+// A sink or source as last reported by the sound server
+struct AudioDevice {
+    enum Kind { Sink, Source };
+    Kind kind = Sink;
+    uint32_t index = UINT32_MAX; // the server's, new whenever the device is recreated
+    std::string name;
+    std::string description;
+    bool monitor = false;        // a source mirroring a sink
+};
+
+enum class DeviceChange { Added, Removed, Changed };
+
+// Playback stream of a backend. Construction and destruction take the
+// backend lock themselves, everything else is called with it held.
+class OutputStream {
+public:
+    virtual ~OutputStream() = default;
+
+    virtual bool isReady() const = 0;
+    virtual size_t writableSize() const = 0;
+    virtual bool write(const void *data, size_t bytes) = 0;
+    virtual void flush() = 0;   // drop queued audio (instant stop)
+    // Non-blocking drain: isDrained() turns true and the backend's waiters
+    // are woken once everything written so far has been played.
+    virtual void beginDrain() = 0;
+    virtual void cancelDrain() = 0;
+    virtual bool isDrained() const = 0;
+    // Time until audio written now is heard, 0 if not known yet
+    virtual uint64_t latencyUs() const = 0;
+    // Times the device ran out of data to play / was sent more than it could hold
+    virtual quint64 underflows() const = 0;
+    virtual quint64 overflows() const = 0;
+
+    virtual const std::string& deviceName() const = 0;
+    virtual const PcmFormat& format() const = 0;
+    virtual uint64_t targetLatencyUs() const = 0;
+};
+
+// Float record stream of a backend. isReady() is called with the backend
+// lock held; the rest is the consumer side of a ring, for one thread and
+// without the lock. Counts are in frames.
+class InputStream {
+public:
+    virtual ~InputStream() = default;
+
+    virtual bool isReady() const = 0;
+    virtual size_t available() const = 0;
+    virtual size_t read(float *out, size_t frames) = 0;
+    virtual size_t discard(size_t frames) = 0;
+    // Times captured audio was lost
+    virtual quint64 overflows() const = 0;
+
+    virtual const std::string& deviceName() const = 0;
+    virtual int rate() const = 0;
+    virtual uint64_t fragmentUs() const = 0;
+    virtual size_t fragmentFrames() const = 0;
+};
+
+// Everything the engine needs from a sound server: one lock the audio
+// worker sleeps on, streams to devices, the virtual mic and the device
+// lists. SoundpadAudio only talks to this interface, so it runs on
+// PulseAudio, natively on PipeWire or headless on the null backend.
+class AudioBackend {
+public:
+    enum class Kind { Pulse, PipeWire, Null };
+    using DeviceListener = std::function<void(DeviceChange, const AudioDevice&)>;
+
+    virtual ~AudioBackend() = default;
+
+    // The backend picked by FUNNYPAD_AUDIO_BACKEND (pulse, pipewire or
+    // null), PulseAudio when it is unset or names one that was not built.
+    // The null backend reads FUNNYPAD_NULL_SPEED and FUNNYPAD_NULL_WAV.
+    static std::unique_ptr<AudioBackend> createDefault();
+    // Null if the kind was not built in
+    static std::unique_ptr<AudioBackend> create(Kind kind);
+
+    virtual const char *name() const = 0;
+
+    // RAII lock of the backend. Every stream call but construction and
+    // destruction is made while holding it.
+    class Lock {
+    public:
+        explicit Lock(AudioBackend& backend) : backend_(backend) { backend_.lock(); }
+        ~Lock() { backend_.unlock(); }
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    private:
+        AudioBackend& backend_;
+    };
+    virtual void lock() = 0;
+    virtual void unlock() = 0;
+    // Sleep until signal() or a stream event (data wanted, drained). Lock held.
+    virtual void wait() = 0;
+    // Wake every thread sleeping in wait(). Lock held.
+    virtual void signal() = 0;
+
+    // Connect, or reconnect after the server went away. Must NOT be called
+    // with the lock held.
+    virtual bool ensureConnected() = 0;
+
+    // Output device list and the sources a mic can be merged from. The
+    // first call waits for the server to report them.
+    virtual std::vector<AudioDevice> sinks() = 0;
+    virtual std::vector<AudioDevice> sources() = 0;
+    virtual bool hasSink(const std::string& name) = 0;
+    virtual bool hasSource(const std::string& name) = 0;
+    // Called for every device plugged in, unplugged or renamed while
+    // running, on the backend's own thread. Null to stop.
+    void setDeviceListener(DeviceListener listener);
+
+    // The stream whose audio other applications record as the virtual mic.
+    // `sinkName` names the device it is played into, if the backend needs
+    // one; created on first use and released by releaseVirtualDevices().
+    virtual std::unique_ptr<OutputStream> openVirtualOutput(const std::string& sinkName, const PcmFormat& format,
+                                                            uint64_t targetLatencyUs) = 0;
+    virtual std::unique_ptr<OutputStream> openOutput(const std::string& sinkName, const std::string& streamName,
+                                                     const PcmFormat& format, uint64_t targetLatencyUs) = 0;
+    // Records a source as float at `rate`, converted by the server
+    virtual std::unique_ptr<InputStream> openInput(const std::string& sourceName, const std::string& streamName,
+                                                   int rate, int channels, uint64_t fragmentUs) = 0;
+    // Warn about whatever else routes a source into the virtual mic, e.g.
+    // the loopback modules older versions merged the mic with. Nothing is
+    // unloaded: they cannot be told apart from ones the user set up.
+    virtual void checkMicRoutes(const std::string& sinkName) { Q_UNUSED(sinkName); }
+    // Undo what openVirtualOutput() set up in the server, at shutdown.
+    // Without the lock, after every stream is gone.
+    virtual void releaseVirtualDevices() {}
+
+protected:
+    void notifyDevice(DeviceChange change, const AudioDevice& device);
+
+private:
+    QMutex listenerMutex_;
+    DeviceListener listener_;
+};
+
+} // namespace soundpad
+
+Q_DECLARE_METATYPE(soundpad::AudioDevice)
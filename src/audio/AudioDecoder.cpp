@@ -0,0 +1,248 @@
+#include "AudioDecoder.hpp"
+#include "AudioLog.hpp"
+#include <algorithm>
+#include <cstring>
+#include <QDebug>
+#include <QString>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libswresample/swresample.h>
+}
+
+namespace soundpad {
+
+static QString avError(int err)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(err, buf, sizeof(buf));
+    return QString::fromUtf8(buf);
+}
+
+AudioDecoder::AudioDecoder(int outRate, int outChannels)
+    : outRate_(outRate), outChannels_(outChannels)
+{
+}
+
+AudioDecoder::~AudioDecoder()
+{
+    close();
+}
+
+bool AudioDecoder::open(const std::string& path)
+{
+    close();
+
+    int ret = avformat_open_input(&format_, path.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        qCDebug(lcAudio) << "[AudioDecoder] Failed to open" << QString::fromStdString(path) << ":" << avError(ret);
+        return false;
+    }
+    if ((ret = avformat_find_stream_info(format_, nullptr)) < 0) {
+        qCDebug(lcAudio) << "[AudioDecoder] No stream info in" << QString::fromStdString(path) << ":" << avError(ret);
+        close();
+        return false;
+    }
+
+    const AVCodec *codec = nullptr;
+    streamIndex_ = av_find_best_stream(format_, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    if (streamIndex_ < 0 || !codec) {
+        qCDebug(lcAudio) << "[AudioDecoder] No audio stream in" << QString::fromStdString(path);
+        close();
+        return false;
+    }
+
+    codecCtx_ = avcodec_alloc_context3(codec);
+    if (!codecCtx_
+        || avcodec_parameters_to_context(codecCtx_, format_->streams[streamIndex_]->codecpar) < 0
+        || (ret = avcodec_open2(codecCtx_, codec, nullptr)) < 0) {
+        qCDebug(lcAudio) << "[AudioDecoder] Failed to open codec for" << QString::fromStdString(path) << ":" << avError(ret);
+        close();
+        return false;
+    }
+
+    // Some containers only carry the channel count
+    if (codecCtx_->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+        int channels = codecCtx_->ch_layout.nb_channels;
+        av_channel_layout_uninit(&codecCtx_->ch_layout);
+        av_channel_layout_default(&codecCtx_->ch_layout, channels);
+    }
+
+    AVChannelLayout outLayout;
+    av_channel_layout_default(&outLayout, outChannels_);
+    ret = swr_alloc_set_opts2(&swr_, &outLayout, AV_SAMPLE_FMT_S16, outRate_,
+                              &codecCtx_->ch_layout, codecCtx_->sample_fmt, codecCtx_->sample_rate,
+                              0, nullptr);
+    av_channel_layout_uninit(&outLayout);
+    if (ret < 0 || (ret = swr_init(swr_)) < 0) {
+        qCDebug(lcAudio) << "[AudioDecoder] Failed to set up resampler:" << avError(ret);
+        close();
+        return false;
+    }
+
+    packet_ = av_packet_alloc();
+    frame_ = av_frame_alloc();
+    return true;
+}
+
+void AudioDecoder::close()
+{
+    av_frame_free(&frame_);
+    av_packet_free(&packet_);
+    swr_free(&swr_);
+    avcodec_free_context(&codecCtx_);
+    avformat_close_input(&format_);
+    streamIndex_ = -1;
+    pending_.clear();
+    pendingPos_ = 0;
+    skipFrames_ = 0;
+    seekTargetMs_ = -1;
+    drainSent_ = false;
+    eof_ = false;
+}
+
+qint64 AudioDecoder::durationMs() const
+{
+    if (!format_ || format_->duration == AV_NOPTS_VALUE) {
+        return -1;
+    }
+    return av_rescale(format_->duration, 1000, AV_TIME_BASE);
+}
+
+bool AudioDecoder::decodeNextFrame()
+{
+    while (!eof_) {
+        int ret = avcodec_receive_frame(codecCtx_, frame_);
+        if (ret == 0) {
+            // First frame after a seek: drop the part before the requested position
+            if (seekTargetMs_ >= 0) {
+                const AVStream *stream = format_->streams[streamIndex_];
+                int64_t pts = frame_->best_effort_timestamp;
+                if (pts != AV_NOPTS_VALUE) {
+                    if (stream->start_time != AV_NOPTS_VALUE) {
+                        pts -= stream->start_time;
+                    }
+                    qint64 frameMs = av_rescale_q(pts, stream->time_base, AVRational{1, 1000});
+                    skipFrames_ = std::max<qint64>(0, (seekTargetMs_ - frameMs) * outRate_ / 1000);
+                }
+                seekTargetMs_ = -1;
+            }
+
+            int maxOut = swr_get_out_samples(swr_, frame_->nb_samples);
+            pending_.resize(static_cast<size_t>(std::max(maxOut, 0)) * frameBytes());
+            uint8_t *out = reinterpret_cast<uint8_t*>(pending_.data());
+            int converted = swr_convert(swr_, &out, maxOut,
+                                        const_cast<const uint8_t**>(frame_->extended_data),
+                                        frame_->nb_samples);
+            av_frame_unref(frame_);
+            if (converted < 0) {
+                qCDebug(lcAudio) << "[AudioDecoder] swr_convert failed:" << avError(converted);
+                continue;
+            }
+            pending_.resize(static_cast<size_t>(converted) * frameBytes());
+            pendingPos_ = 0;
+            if (skipFrames_ > 0) {
+                qint64 drop = std::min<qint64>(skipFrames_, converted);
+                pendingPos_ = static_cast<size_t>(drop) * frameBytes();
+                skipFrames_ -= drop;
+            }
+            if (pendingPos_ < pending_.size()) {
+                return true;
+            }
+            continue;
+        }
+
+        if (ret == AVERROR_EOF) {
+            // Flush what the resampler still holds
+            eof_ = true;
+            int maxOut = swr_get_out_samples(swr_, 0);
+            if (maxOut <= 0) {
+                return false;
+            }
+            pending_.resize(static_cast<size_t>(maxOut) * frameBytes());
+            uint8_t *out = reinterpret_cast<uint8_t*>(pending_.data());
+            int converted = swr_convert(swr_, &out, maxOut, nullptr, 0);
+            pending_.resize(static_cast<size_t>(std::max(converted, 0)) * frameBytes());
+            pendingPos_ = 0;
+            return !pending_.empty();
+        }
+
+        if (ret != AVERROR(EAGAIN)) {
+            qCDebug(lcAudio) << "[AudioDecoder] Decode error:" << avError(ret);
+            eof_ = true;
+            return false;
+        }
+
+        // Decoder wants more input
+        ret = av_read_frame(format_, packet_);
+        if (ret < 0) {
+            if (drainSent_) {
+                eof_ = true;
+                return false;
+            }
+            avcodec_send_packet(codecCtx_, nullptr); // enter draining mode
+            drainSent_ = true;
+            continue;
+        }
+        if (packet_->stream_index == streamIndex_) {
+            ret = avcodec_send_packet(codecCtx_, packet_);
+            if (ret < 0) {
+                qCDebug(lcAudio) << "[AudioDecoder] Skipping bad packet:" << avError(ret);
+            }
+        }
+        av_packet_unref(packet_);
+    }
+    return false;
+}
+
+size_t AudioDecoder::read(char *dst, size_t bytes)
+{
+    if (!isOpen()) {
+        return 0;
+    }
+
+    size_t produced = 0;
+    while (produced < bytes) {
+        if (pendingPos_ >= pending_.size() && !decodeNextFrame()) {
+            break;
+        }
+        size_t n = std::min(bytes - produced, pending_.size() - pendingPos_);
+        std::memcpy(dst + produced, pending_.data() + pendingPos_, n);
+        pendingPos_ += n;
+        produced += n;
+    }
+    return produced;
+}
+
+bool AudioDecoder::seek(qint64 ms)
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    const AVStream *stream = format_->streams[streamIndex_];
+    int64_t ts = av_rescale_q(ms, AVRational{1, 1000}, stream->time_base);
+    if (stream->start_time != AV_NOPTS_VALUE) {
+        ts += stream->start_time;
+    }
+    int ret = avformat_seek_file(format_, streamIndex_, INT64_MIN, ts, ts, 0);
+    if (ret < 0) {
+        qCDebug(lcAudio) << "[AudioDecoder] Seek to" << ms << "ms failed:" << avError(ret);
+        return false;
+    }
+
+    avcodec_flush_buffers(codecCtx_);
+    swr_init(swr_); // drop samples buffered for the old position
+    pending_.clear();
+    pendingPos_ = 0;
+    skipFrames_ = 0;
+    seekTargetMs_ = ms;
+    drainSent_ = false;
+    eof_ = false;
+    return true;
+}
+
+} // namespace soundpad
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <QtGlobal>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVPacket;
+struct AVFrame;
+struct SwrContext;
+
+namespace soundpad {
+
+// In-process decoder (libavformat/libavcodec + libswresample) producing
+// interleaved signed 16-bit PCM at a fixed rate and channel count.
+// Not thread-safe: one thread owns an instance at a time.
+class AudioDecoder {
+public:
+    explicit AudioDecoder(int outRate = 44100, int outChannels = 2);
+    ~AudioDecoder();
+
+    AudioDecoder(const AudioDecoder&) = delete;
+    AudioDecoder& operator=(const AudioDecoder&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return codecCtx_ != nullptr; }
+
+    qint64 durationMs() const;
+    int outputRate() const { return outRate_; }
+    int outputChannels() const { return outChannels_; }
+    int frameBytes() const { return outChannels_ * 2; }
+
+    // Decode up to `bytes` (frame aligned) into dst. Returns 0 at end of stream.
+    size_t read(char *dst, size_t bytes);
+    // Sample-accurate seek; decoded audio before the target is discarded.
+    bool seek(qint64 ms);
+
+private:
+    bool decodeNextFrame();
+
+    int outRate_;
+    int outChannels_;
+    int streamIndex_ = -1;
+    AVFormatContext *format_ = nullptr;
+    AVCodecContext *codecCtx_ = nullptr;
+    AVPacket *packet_ = nullptr;
+    AVFrame *frame_ = nullptr;
+    SwrContext *swr_ = nullptr;
+
+    std::vector<char> pending_; // converted PCM not yet handed out
+    size_t pendingPos_ = 0;
+    qint64 skipFrames_ = 0;     // output frames to drop after a seek
+    qint64 seekTargetMs_ = -1;
+    bool drainSent_ = false;
+    bool eof_ = false;
+};
+
+} // namespace soundpad
@@ -0,0 +1,3 @@
+#include "AudioLog.hpp"
+
+Q_LOGGING_CATEGORY(lcAudio, "funnypad.audio", QtInfoMsg)
@@ -0,0 +1,7 @@
+#pragma once
+#include <QLoggingCategory>
+
+// Debug output of the audio library. Off by default, so nothing is logged
+// from the mixing, stream and backend threads unless asked for with
+// QT_LOGGING_RULES="funnypad.audio.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(lcAudio)
@@ -0,0 +1,278 @@
+#include "DeviceRegistry.hpp"
+#include "AudioLog.hpp"
+#include <algorithm>
+#include <QDebug>
+#include <QString>
+
+namespace soundpad {
+
+static AudioDevice fromSink(const pa_sink_info *info)
+{
+    AudioDevice device;
+    device.kind = AudioDevice::Sink;
+    device.index = info->index;
+    device.name = info->name ? info->name : "";
+    device.description = info->description ? info->description : "";
+    return device;
+}
+
+static AudioDevice fromSource(const pa_source_info *info)
+{
+    AudioDevice device;
+    device.kind = AudioDevice::Source;
+    device.index = info->index;
+    device.name = info->name ? info->name : "";
+    device.description = info->description ? info->description : "";
+    device.monitor = info->monitor_of_sink != PA_INVALID_INDEX;
+    return device;
+}
+
+DeviceRegistry::DeviceRegistry(PulseContext& pulse, Listener listener)
+    : pulse_(pulse), listener_(std::move(listener))
+{
+    PulseContext::Lock lock(pulse_);
+    pulse_.setReadyCallback([this]() {
+        onReady();
+    });
+    if (pulse_.isReady()) {
+        onReady();
+    }
+}
+
+DeviceRegistry::~DeviceRegistry()
+{
+    PulseContext::Lock lock(pulse_);
+    pulse_.setReadyCallback(nullptr);
+    if (pulse_.context()) {
+        pa_context_set_subscribe_callback(pulse_.context(), nullptr, nullptr);
+    }
+    // Their callbacks point at this object
+    for (pa_operation *op : pending_) {
+        pa_operation_cancel(op);
+        pa_operation_unref(op);
+    }
+}
+
+bool DeviceRegistry::ensureSynced()
+{
+    if (synced_) {
+        return true;
+    }
+    if (!pulse_.ensureConnected()) {
+        return false;
+    }
+    PulseContext::Lock lock(pulse_);
+    while (!synced_ && pulse_.isReady()) {
+        pulse_.wait();
+    }
+    return synced_;
+}
+
+std::vector<AudioDevice> DeviceRegistry::sinks() const
+{
+    return list(AudioDevice::Sink);
+}
+
+std::vector<AudioDevice> DeviceRegistry::sources() const
+{
+    return list(AudioDevice::Source);
+}
+
+std::vector<AudioDevice> DeviceRegistry::list(AudioDevice::Kind kind) const
+{
+    std::vector<AudioDevice> devices;
+    {
+        QMutexLocker locker(&mutex_);
+        const Table& entries = table(kind);
+        devices.reserve(entries.byIndex.size());
+        for (const auto& entry : entries.byIndex) {
+            devices.push_back(entry.second.device);
+        }
+    }
+    std::sort(devices.begin(), devices.end(), [](const AudioDevice& a, const AudioDevice& b) {
+        return a.index < b.index;
+    });
+    return devices;
+}
+
+bool DeviceRegistry::hasSink(const std::string& name) const
+{
+    QMutexLocker locker(&mutex_);
+    return sinks_.byName.count(name) > 0;
+}
+
+bool DeviceRegistry::hasSource(const std::string& name) const
+{
+    QMutexLocker locker(&mutex_);
+    return sources_.byName.count(name) > 0;
+}
+
+// A new context: indices of the old one mean nothing, fetch everything again.
+// Devices the new lists do not contain are dropped in listDone().
+void DeviceRegistry::onReady()
+{
+    pa_context *c = pulse_.context();
+    ++generation_;
+    listsPending_ = 2;
+    synced_ = false;
+    pa_context_set_subscribe_callback(c, &DeviceRegistry::subscribeCallback, this);
+    track(pa_context_subscribe(c, static_cast<pa_subscription_mask_t>(PA_SUBSCRIPTION_MASK_SINK
+                                                                       | PA_SUBSCRIPTION_MASK_SOURCE),
+                               nullptr, nullptr));
+    track(pa_context_get_sink_info_list(c, &DeviceRegistry::sinkListCallback, this));
+    track(pa_context_get_source_info_list(c, &DeviceRegistry::sourceListCallback, this));
+}
+
+void DeviceRegistry::track(pa_operation *op)
+{
+    if (!op) {
+        qCDebug(lcAudio) << "[DeviceRegistry] Request failed:" << pa_strerror(pa_context_errno(pulse_.context()));
+        return;
+    }
+    pending_.erase(std::remove_if(pending_.begin(), pending_.end(), [](pa_operation *done) {
+        if (pa_operation_get_state(done) == PA_OPERATION_RUNNING) {
+            return false;
+        }
+        pa_operation_unref(done);
+        return true;
+    }), pending_.end());
+    pending_.push_back(op);
+}
+
+void DeviceRegistry::upsert(const AudioDevice& device)
+{
+    std::vector<std::pair<Change, AudioDevice>> changes;
+    {
+        QMutexLocker locker(&mutex_);
+        Table& entries = table(device.kind);
+        const AudioDevice *previous = nullptr;
+        AudioDevice replaced;
+        // Same device under a new index after a reconnect or a module reload
+        auto named = entries.byName.find(device.name);
+        if (named != entries.byName.end() && named->second != device.index) {
+            replaced = entries.byIndex[named->second].device;
+            previous = &replaced;
+            entries.byIndex.erase(named->second);
+        }
+        auto it = entries.byIndex.find(device.index);
+        if (it != entries.byIndex.end()) {
+            replaced = it->second.device;
+            previous = &replaced;
+        }
+
+        if (previous && previous->name != device.name) {
+            // Renamed: to a listener keyed by name that is a different device
+            entries.byName.erase(previous->name);
+            changes.emplace_back(Change::Removed, *previous);
+            changes.emplace_back(Change::Added, device);
+        } else if (!previous) {
+            changes.emplace_back(Change::Added, device);
+        } else if (previous->description != device.description || previous->monitor != device.monitor) {
+            changes.emplace_back(Change::Changed, device);
+        }
+        // Volume changes and the like arrive as change events too and end here silently
+        entries.byIndex[device.index] = Entry{device, generation_};
+        entries.byName[device.name] = device.index;
+    }
+    for (const auto& change : changes) {
+        listener_(change.first, change.second);
+    }
+}
+
+void DeviceRegistry::remove(AudioDevice::Kind kind, uint32_t index)
+{
+    AudioDevice removed;
+    {
+        QMutexLocker locker(&mutex_);
+        Table& entries = table(kind);
+        auto it = entries.byIndex.find(index);
+        if (it == entries.byIndex.end()) {
+            return;
+        }
+        removed = it->second.device;
+        entries.byName.erase(removed.name);
+        entries.byIndex.erase(it);
+    }
+    listener_(Change::Removed, removed);
+}
+
+void DeviceRegistry::listDone(AudioDevice::Kind kind)
+{
+    std::vector<AudioDevice> stale;
+    {
+        QMutexLocker locker(&mutex_);
+        Table& entries = table(kind);
+        for (auto it = entries.byIndex.begin(); it != entries.byIndex.end();) {
+            if (it->second.generation != generation_) {
+                stale.push_back(it->second.device);
+                entries.byName.erase(it->second.device.name);
+                it = entries.byIndex.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto& device : stale) {
+        listener_(Change::Removed, device);
+    }
+    if (--listsPending_ == 0) {
+        synced_ = true;
+        pulse_.signal();
+    }
+}
+
+void DeviceRegistry::subscribeCallback(pa_context *c, pa_subscription_event_type_t type, uint32_t index,
+                                       void *userdata)
+{
+    auto *self = static_cast<DeviceRegistry*>(userdata);
+    const auto facility = type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK;
+    const auto event = type & PA_SUBSCRIPTION_EVENT_TYPE_MASK;
+    if (facility != PA_SUBSCRIPTION_EVENT_SINK && facility != PA_SUBSCRIPTION_EVENT_SOURCE) {
+        return;
+    }
+    const AudioDevice::Kind kind = facility == PA_SUBSCRIPTION_EVENT_SINK ? AudioDevice::Sink : AudioDevice::Source;
+    if (event == PA_SUBSCRIPTION_EVENT_REMOVE) {
+        self->remove(kind, index);
+    } else if (kind == AudioDevice::Sink) {
+        self->track(pa_context_get_sink_info_by_index(c, index, &DeviceRegistry::sinkCallback, self));
+    } else {
+        self->track(pa_context_get_source_info_by_index(c, index, &DeviceRegistry::sourceCallback, self));
+    }
+}
+
+void DeviceRegistry::sinkListCallback(pa_context *, const pa_sink_info *info, int eol, void *userdata)
+{
+    auto *self = static_cast<DeviceRegistry*>(userdata);
+    if (eol) {
+        self->listDone(AudioDevice::Sink);
+    } else if (info) {
+        self->upsert(fromSink(info));
+    }
+}
+
+void DeviceRegistry::sourceListCallback(pa_context *, const pa_source_info *info, int eol, void *userdata)
+{
+    auto *self = static_cast<DeviceRegistry*>(userdata);
+    if (eol) {
+        self->listDone(AudioDevice::Source);
+    } else if (info) {
+        self->upsert(fromSource(info));
+    }
+}
+
+// A device that is gone again by the time we ask just reports eol
+void DeviceRegistry::sinkCallback(pa_context *, const pa_sink_info *info, int eol, void *userdata)
+{
+    if (!eol && info) {
+        static_cast<DeviceRegistry*>(userdata)->upsert(fromSink(info));
+    }
+}
+
+void DeviceRegistry::sourceCallback(pa_context *, const pa_source_info *info, int eol, void *userdata)
+{
+    if (!eol && info) {
+        static_cast<DeviceRegistry*>(userdata)->upsert(fromSource(info));
+    }
+}
+
+} // namespace soundpad
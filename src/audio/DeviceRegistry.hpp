@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <QMutex>
+#include <pulse/pulseaudio.h>
+#include "AudioBackend.hpp"
+#include "PulseContext.hpp"
+
+namespace soundpad {
+
+// Sinks and sources of the server, kept up to date by pa_context_subscribe
+// events instead of being asked for on every query. The full lists are
+// fetched whenever the context (re)connects; after that a device that
+// appears or changes costs one small request and a removal none. Queries
+// are answered from memory and may come from any thread; the listener is
+// called on the PulseAudio thread for every difference.
+class DeviceRegistry {
+public:
+    using Change = DeviceChange;
+    using Listener = std::function<void(Change, const AudioDevice&)>;
+
+    DeviceRegistry(PulseContext& pulse, Listener listener);
+    ~DeviceRegistry();
+
+    DeviceRegistry(const DeviceRegistry&) = delete;
+    DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+
+    // Connect and wait for the first full lists; false without a server.
+    // Must NOT be called with the PulseContext lock held.
+    bool ensureSynced();
+
+    // In the server's order
+    std::vector<AudioDevice> sinks() const;
+    std::vector<AudioDevice> sources() const;
+    bool hasSink(const std::string& name) const;
+    bool hasSource(const std::string& name) const;
+
+private:
+    struct Entry {
+        AudioDevice device;
+        quint64 generation = 0; // connection that last reported it
+    };
+    struct Table {
+        std::unordered_map<uint32_t, Entry> byIndex;
+        std::unordered_map<std::string, uint32_t> byName;
+    };
+
+    // PulseAudio thread
+    void onReady();
+    void upsert(const AudioDevice& device);
+    void remove(AudioDevice::Kind kind, uint32_t index);
+    void listDone(AudioDevice::Kind kind);
+    void track(pa_operation *op);
+
+    static void subscribeCallback(pa_context *c, pa_subscription_event_type_t type, uint32_t index, void *userdata);
+    static void sinkListCallback(pa_context *c, const pa_sink_info *info, int eol, void *userdata);
+    static void sourceListCallback(pa_context *c, const pa_source_info *info, int eol, void *userdata);
+    static void sinkCallback(pa_context *c, const pa_sink_info *info, int eol, void *userdata);
+    static void sourceCallback(pa_context *c, const pa_source_info *info, int eol, void *userdata);
+
+    Table& table(AudioDevice::Kind kind) { return kind == AudioDevice::Sink ? sinks_ : sources_; }
+    const Table& table(AudioDevice::Kind kind) const { return kind == AudioDevice::Sink ? sinks_ : sources_; }
+    std::vector<AudioDevice> list(AudioDevice::Kind kind) const;
+
+    PulseContext& pulse_;
+    Listener listener_;
+    mutable QMutex mutex_; // guards the tables
+    Table sinks_;
+    Table sources_;
+    quint64 generation_ = 0;           // PulseAudio thread only
+    int listsPending_ = 0;             // full lists still arriving
+    std::atomic<bool> synced_{false};
+    std::vector<pa_operation*> pending_; // cancelled on destruction, lock held
+};
+
+} // namespace soundpad
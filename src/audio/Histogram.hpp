@@ -0,0 +1,136 @@
+#pragma once
+#include <QtGlobal>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace soundpad {
+
+// Lock-free histogram of non-negative integer samples (microseconds, say).
+// Buckets are logarithmic with four per power of two, so a percentile is
+// exact to within a quarter octave at any magnitude. record() is a handful
+// of relaxed atomic ops and may run on any number of threads; snapshot()
+// never stops the writers, it may just miss a sample recorded meanwhile.
+class Histogram {
+public:
+    static constexpr int kSubBuckets = 4;
+    static constexpr int kOctaves = 40; // up to ~12 days in microseconds
+    static constexpr int kBuckets = kOctaves * kSubBuckets + 1;
+
+    struct Snapshot {
+        quint64 count = 0;
+        quint64 min = 0;
+        quint64 max = 0;
+        quint64 last = 0;
+        double mean = 0;
+        std::array<quint64, kBuckets> buckets{};
+
+        // Upper edge of the bucket holding the p-th percentile (0..100), capped at max
+        double percentile(double p) const
+        {
+            if (count == 0) {
+                return 0;
+            }
+            const auto rank = static_cast<quint64>(std::clamp(p, 0.0, 100.0) / 100.0 * static_cast<double>(count - 1)) + 1;
+            quint64 seen = 0;
+            for (int i = 0; i < kBuckets; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) {
+                    return std::min(upperBound(i), static_cast<double>(max));
+                }
+            }
+            return static_cast<double>(max);
+        }
+    };
+
+    // Bucket i covers [lowerBound(i), upperBound(i))
+    static double lowerBound(int index)
+    {
+        if (index == 0) {
+            return 0;
+        }
+        const int octave = (index - 1) / kSubBuckets;
+        const int sub = (index - 1) % kSubBuckets;
+        return static_cast<double>(kSubBuckets + sub) * static_cast<double>(1ull << octave) / kSubBuckets;
+    }
+
+    static double upperBound(int index)
+    {
+        return index + 1 < kBuckets ? lowerBound(index + 1) : std::numeric_limits<double>::infinity();
+    }
+
+    void record(quint64 value)
+    {
+        buckets_[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        last_.store(value, std::memory_order_relaxed);
+        quint64 seen = min_.load(std::memory_order_relaxed);
+        while (value < seen && !min_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+        seen = max_.load(std::memory_order_relaxed);
+        while (value > seen && !max_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+        }
+        count_.fetch_add(1, std::memory_order_release);
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot snapshot;
+        snapshot.count = count_.load(std::memory_order_acquire);
+        if (snapshot.count == 0) {
+            return snapshot;
+        }
+        quint64 total = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += snapshot.buckets[i];
+        }
+        // Buckets recorded after count was read are part of the snapshot too
+        snapshot.count = std::max(snapshot.count, total);
+        snapshot.min = min_.load(std::memory_order_relaxed);
+        snapshot.max = max_.load(std::memory_order_relaxed);
+        snapshot.last = last_.load(std::memory_order_relaxed);
+        snapshot.mean = static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(snapshot.count);
+        return snapshot;
+    }
+
+    // Not atomic as a whole: samples recorded during a reset may survive it
+    void reset()
+    {
+        count_.store(0, std::memory_order_relaxed);
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        sum_.store(0, std::memory_order_relaxed);
+        last_.store(0, std::memory_order_relaxed);
+        min_.store(std::numeric_limits<quint64>::max(), std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static int bucketOf(quint64 value)
+    {
+        if (value == 0) {
+            return 0;
+        }
+        const int octave = std::bit_width(value) - 1;
+        if (octave >= kOctaves) {
+            return kBuckets - 1;
+        }
+        // The two bits below the leading one pick the quarter of the octave
+        const int sub = static_cast<int>(((value << 2) >> octave) & (kSubBuckets - 1));
+        return 1 + octave * kSubBuckets + sub;
+    }
+
+    std::array<std::atomic<quint64>, kBuckets> buckets_{};
+    std::atomic<quint64> count_{0};
+    std::atomic<quint64> sum_{0};
+    std::atomic<quint64> last_{0};
+    std::atomic<quint64> min_{std::numeric_limits<quint64>::max()};
+    std::atomic<quint64> max_{0};
+};
+
+} // namespace soundpad
@@ -0,0 +1,152 @@
+#include "LoudnessMeter.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace soundpad {
+
+// 48-tap interpolation filter of BS.1770-4 Annex 2, split into its four phases
+static const float kOversample[4][12] = {
+    { 0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f, -0.0594482421875f, 0.1373291015625f,
+      0.9721679687500f, -0.1022949218750f, 0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f },
+    { -0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f, -0.1665039062500f, 0.4650878906250f,
+      0.7797851562500f, -0.2003173828125f, 0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f },
+    { -0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f, -0.2003173828125f, 0.7797851562500f,
+      0.4650878906250f, -0.1665039062500f, 0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f },
+    { -0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f, -0.1022949218750f, 0.9721679687500f,
+      0.1373291015625f, -0.0594482421875f, 0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f },
+};
+
+static double lufs(double meanSquare)
+{
+    return meanSquare > 0.0 ? -0.691 + 10.0 * std::log10(meanSquare) : -HUGE_VAL;
+}
+
+void LoudnessMeter::begin(int sampleRate)
+{
+    // K-weighting for any rate: the high shelf and high pass of BS.1770,
+    // derived from their analogue prototypes (the 48 kHz coefficients of the
+    // standard come out of the same formulas)
+    const double rate = sampleRate > 0 ? sampleRate : 44100;
+    double k = std::tan(M_PI * 1681.974450955533 / rate);
+    const double q = 0.7071752369554196;
+    const double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    const double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    stages_[0].b0 = (vh + vb * k / q + k * k) / a0;
+    stages_[0].b1 = 2.0 * (k * k - vh) / a0;
+    stages_[0].b2 = (vh - vb * k / q + k * k) / a0;
+    stages_[0].a1 = 2.0 * (k * k - 1.0) / a0;
+    stages_[0].a2 = (1.0 - k / q + k * k) / a0;
+
+    k = std::tan(M_PI * 38.13547087602444 / rate);
+    const double q2 = 0.5003270373238773;
+    a0 = 1.0 + k / q2 + k * k;
+    stages_[1].b0 = 1.0;
+    stages_[1].b1 = -2.0;
+    stages_[1].b2 = 1.0;
+    stages_[1].a1 = 2.0 * (k * k - 1.0) / a0;
+    stages_[1].a2 = (1.0 - k / q2 + k * k) / a0;
+
+    state_ = mix::CascadeState();
+    subBlockFrames_ = std::max<size_t>(1, static_cast<size_t>(rate) / 10);
+    subBlockFilled_ = 0;
+    subBlockEnergy_ = 0.0;
+    subBlocks_.clear();
+    totalEnergy_ = 0.0;
+    totalFrames_ = 0;
+    std::fill(&history_[0][0], &history_[0][0] + 2 * 2 * kTaps, 0.0f);
+    historyPos_ = 0;
+    truePeak_ = 0.0f;
+    integrated_ = kSilenceLufs;
+    truePeakDb_ = -120.0;
+}
+
+void LoudnessMeter::append(const float *stereo, size_t frames)
+{
+    trackTruePeak(stereo, frames);
+    while (frames > 0) {
+        const size_t n = std::min(frames, subBlockFrames_ - subBlockFilled_);
+        const double energy = mix::filterEnergy(stages_, state_, stereo, n);
+        subBlockEnergy_ += energy;
+        totalEnergy_ += energy;
+        totalFrames_ += static_cast<qint64>(n);
+        subBlockFilled_ += n;
+        stereo += n * 2;
+        frames -= n;
+        if (subBlockFilled_ == subBlockFrames_) {
+            endSubBlock();
+        }
+    }
+}
+
+void LoudnessMeter::endSubBlock()
+{
+    subBlocks_.push_back(subBlockEnergy_ / static_cast<double>(subBlockFrames_));
+    subBlockEnergy_ = 0.0;
+    subBlockFilled_ = 0;
+}
+
+void LoudnessMeter::trackTruePeak(const float *stereo, size_t frames)
+{
+    float peak = truePeak_;
+    for (size_t i = 0; i < frames; ++i) {
+        historyPos_ = historyPos_ == kTaps - 1 ? 0 : historyPos_ + 1;
+        for (int ch = 0; ch < 2; ++ch) {
+            float *h = history_[ch];
+            h[historyPos_] = h[historyPos_ + kTaps] = stereo[2 * i + ch];
+            // Oldest to newest, the newest meets tap 0
+            const float *window = h + historyPos_ + 1;
+            for (int p = 0; p < kPhases; ++p) {
+                float y = 0.0f;
+                for (int t = 0; t < kTaps; ++t) {
+                    y += kOversample[p][t] * window[kTaps - 1 - t];
+                }
+                peak = std::max(peak, std::fabs(y));
+            }
+        }
+    }
+    truePeak_ = peak;
+}
+
+void LoudnessMeter::finish()
+{
+    truePeakDb_ = truePeak_ > 0.0f ? 20.0 * std::log10(truePeak_) : -120.0;
+
+    std::vector<double> blocks;
+    for (size_t j = 3; j < subBlocks_.size(); ++j) {
+        blocks.push_back((subBlocks_[j - 3] + subBlocks_[j - 2] + subBlocks_[j - 1] + subBlocks_[j]) / 4.0);
+    }
+    if (blocks.empty()) {
+        // Short pads: one block over everything there is, the trailing
+        // partial sub-block included
+        double all = totalFrames_ > 0 ? totalEnergy_ / static_cast<double>(totalFrames_) : 0.0;
+        integrated_ = std::max(lufs(all), kSilenceLufs);
+        return;
+    }
+
+    double sum = 0.0;
+    size_t count = 0;
+    for (double block : blocks) {
+        if (lufs(block) > kSilenceLufs) {
+            sum += block;
+            ++count;
+        }
+    }
+    if (count == 0) {
+        integrated_ = kSilenceLufs;
+        return;
+    }
+    const double relativeGate = lufs(sum / static_cast<double>(count)) - 10.0;
+    sum = 0.0;
+    count = 0;
+    for (double block : blocks) {
+        const double l = lufs(block);
+        if (l > kSilenceLufs && l > relativeGate) {
+            sum += block;
+            ++count;
+        }
+    }
+    integrated_ = count > 0 ? lufs(sum / static_cast<double>(count)) : kSilenceLufs;
+}
+
+} // namespace soundpad
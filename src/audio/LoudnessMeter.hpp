@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <QtGlobal>
+#include "MixKernels.hpp"
+
+namespace soundpad {
+
+// Integrated loudness (EBU R128 / ITU-R BS.1770-4) and true peak of a whole
+// track, fed the interleaved stereo float the mixer plays. K-weighting runs
+// through mix::filterEnergy; loudness is gated over 400 ms blocks with 75%
+// overlap, true peak is the largest sample of a 4x oversampled signal.
+// Mono sources arrive duplicated and are measured the way they are heard.
+class LoudnessMeter {
+public:
+    // Loudness reported for silence, the absolute gate of BS.1770
+    static constexpr double kSilenceLufs = -70.0;
+
+    // begin(), append() the whole track, finish()
+    void begin(int sampleRate);
+    void append(const float *stereo, size_t frames);
+    void finish();
+
+    // LUFS; clips shorter than one block are measured as a single block
+    double integratedLufs() const { return integrated_; }
+    // dBTP
+    double truePeakDb() const { return truePeakDb_; }
+
+private:
+    static constexpr int kTaps = 12;   // per phase of the oversampling filter
+    static constexpr int kPhases = 4;
+
+    void endSubBlock();
+    void trackTruePeak(const float *stereo, size_t frames);
+
+    mix::Biquad stages_[2];
+    mix::CascadeState state_;
+    size_t subBlockFrames_ = 0;        // 100 ms
+    size_t subBlockFilled_ = 0;
+    double subBlockEnergy_ = 0.0;
+    std::vector<double> subBlocks_;    // mean square per 100 ms
+    double totalEnergy_ = 0.0;
+    qint64 totalFrames_ = 0;
+
+    // Latest kTaps samples per channel, stored twice so that the window
+    // ending at the newest one is always contiguous
+    float history_[2][2 * kTaps] = {};
+    int historyPos_ = 0;
+    float truePeak_ = 0.0f;            // linear
+
+    double integrated_ = kSilenceLufs;
+    double truePeakDb_ = -120.0;
+};
+
+} // namespace soundpad
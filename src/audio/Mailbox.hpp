@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace soundpad {
+
+// Bounded lock-free multi-producer/single-consumer queue for commands sent to
+// the audio thread (Vyukov's sequence-numbered cells). Producers never wait
+// on each other or on the consumer; push() fails instead when it is full.
+template <typename T>
+class Mailbox {
+public:
+    explicit Mailbox(size_t minCapacity)
+    {
+        size_t capacity = 2;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        cells_ = std::make_unique<Cell[]>(capacity);
+        mask_ = capacity - 1;
+        for (size_t i = 0; i < capacity; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    Mailbox(const Mailbox&) = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+
+    // Any thread
+    bool push(T value)
+    {
+        size_t position = enqueue_.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells_[position & mask_];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                position = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool pop(T& out)
+    {
+        Cell& cell = cells_[dequeue_ & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != dequeue_ + 1) {
+            return false;
+        }
+        out = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(dequeue_ + mask_ + 1, std::memory_order_release);
+        ++dequeue_;
+        return true;
+    }
+
+    bool empty() const
+    {
+        return cells_[dequeue_ & mask_].sequence.load(std::memory_order_acquire) != dequeue_ + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> enqueue_{0};
+    alignas(64) size_t dequeue_ = 0;
+};
+
+} // namespace soundpad
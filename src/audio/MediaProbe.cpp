@@ -0,0 +1,87 @@
+#include "MediaProbe.hpp"
+#include "AudioLog.hpp"
+#include <QDebug>
+#include <QString>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/dict.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace soundpad {
+
+// Stream tags (Vorbis comments in Ogg) win over container tags
+static std::string tag(const AVFormatContext *format, const AVStream *stream, const char *key)
+{
+    const AVDictionaryEntry *entry = stream ? av_dict_get(stream->metadata, key, nullptr, 0) : nullptr;
+    if (!entry) {
+        entry = av_dict_get(format->metadata, key, nullptr, 0);
+    }
+    return entry && entry->value ? std::string(entry->value) : std::string();
+}
+
+static bool headersComplete(const AVFormatContext *format, int streamIndex)
+{
+    if (streamIndex < 0) {
+        return false;
+    }
+    const AVCodecParameters *par = format->streams[streamIndex]->codecpar;
+    return par->sample_rate > 0 && par->ch_layout.nb_channels > 0
+        && (format->duration != AV_NOPTS_VALUE || format->streams[streamIndex]->duration != AV_NOPTS_VALUE);
+}
+
+bool probeMedia(const std::string& path, MediaInfo& info)
+{
+    info = MediaInfo();
+    AVFormatContext *format = nullptr;
+    if (avformat_open_input(&format, path.c_str(), nullptr, nullptr) < 0) {
+        qCDebug(lcAudio) << "[MediaProbe] Cannot open" << QString::fromStdString(path);
+        return false;
+    }
+
+    int streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (!headersComplete(format, streamIndex)) {
+        // Raw MP3/AAC and friends: look at a few packets, still without decoding much
+        format->probesize = 256 * 1024;
+        format->max_analyze_duration = 2 * AV_TIME_BASE;
+        if (avformat_find_stream_info(format, nullptr) < 0) {
+            qCDebug(lcAudio) << "[MediaProbe] No stream info in" << QString::fromStdString(path);
+        }
+        streamIndex = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    }
+    if (streamIndex < 0) {
+        qCDebug(lcAudio) << "[MediaProbe] No audio stream in" << QString::fromStdString(path);
+        avformat_close_input(&format);
+        return false;
+    }
+
+    const AVStream *stream = format->streams[streamIndex];
+    const AVCodecParameters *par = stream->codecpar;
+    if (format->duration != AV_NOPTS_VALUE) {
+        info.durationMs = av_rescale(format->duration, 1000, AV_TIME_BASE);
+    } else if (stream->duration != AV_NOPTS_VALUE) {
+        info.durationMs = av_rescale_q(stream->duration, stream->time_base, AVRational{1, 1000});
+    }
+    info.sampleRate = par->sample_rate;
+    info.channels = par->ch_layout.nb_channels;
+    if (par->ch_layout.order != AV_CHANNEL_ORDER_UNSPEC) {
+        char layout[64] = {0};
+        if (av_channel_layout_describe(&par->ch_layout, layout, sizeof(layout)) > 0) {
+            info.channelLayout = layout;
+        }
+    }
+    if (const char *name = avcodec_get_name(par->codec_id)) {
+        info.codec = name;
+    }
+    info.title = tag(format, stream, "title");
+    info.artist = tag(format, stream, "artist");
+    info.album = tag(format, stream, "album");
+
+    avformat_close_input(&format);
+    return true;
+}
+
+} // namespace soundpad
@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <QtGlobal>
+
+namespace soundpad {
+
+struct MediaInfo {
+    qint64 durationMs = -1; // -1 if the container does not say
+    int sampleRate = 0;
+    int channels = 0;
+    std::string channelLayout; // "stereo", "5.1(side)", ...
+    std::string codec;
+    std::string title;  // tags, empty if absent
+    std::string artist;
+    std::string album;
+};
+
+// Reads the container and stream headers of the audio file at `path`
+// (libavformat, no decoder is opened). Stream info is only searched for,
+// with a small probe budget, when the headers leave the rate, channels or
+// duration open. Safe to call from any thread.
+bool probeMedia(const std::string& path, MediaInfo& info);
+
+} // namespace soundpad
@@ -0,0 +1,594 @@
+#include "MixKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOUNDPAD_X86 1
+#endif
+
+namespace soundpad {
+namespace mix {
+
+// Soft clip knee: below it samples pass untouched, above it they are bent
+// with a rational tanh approximation that reaches 1.0 at kKnee + 3 * kRange.
+static constexpr float kKnee = 0.75f;
+static constexpr float kRange = 1.0f - kKnee;
+static constexpr float kInvRange = 1.0f / kRange;
+
+static inline float clipSample(float x)
+{
+    float a = std::fabs(x);
+    if (a <= kKnee) {
+        return x;
+    }
+    float u = std::min((a - kKnee) * kInvRange, 3.0f);
+    float u2 = u * u;
+    float y = kKnee + kRange * (u * (27.0f + u2) / (27.0f + 9.0f * u2));
+    return std::copysign(y, x);
+}
+
+static void accumulateScalar(float *dst, const float *src, float gain, size_t samples)
+{
+    for (size_t i = 0; i < samples; ++i) {
+        dst[i] += src[i] * gain;
+    }
+}
+
+static void accumulateFadeScalar(float *dst, const float *src, float gain, size_t frames, float phase, float step)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        const float w = gain * std::sin(phase + step * static_cast<float>(i));
+        dst[2 * i] += src[2 * i] * w;
+        dst[2 * i + 1] += src[2 * i + 1] * w;
+    }
+}
+
+static void accumulateRampScalar(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        const float g = gain + step * static_cast<float>(i);
+        dst[2 * i] += src[2 * i] * g;
+        dst[2 * i + 1] += src[2 * i + 1] * g;
+    }
+}
+
+static void softClipScalar(float *buf, size_t samples)
+{
+    for (size_t i = 0; i < samples; ++i) {
+        buf[i] = clipSample(buf[i]);
+    }
+}
+
+static void gainClipScalar(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        const float g = gain + step * static_cast<float>(i);
+        dst[2 * i] = clipSample(src[2 * i] * g);
+        dst[2 * i + 1] = clipSample(src[2 * i + 1] * g);
+    }
+}
+
+static void peakRangeScalar(const float *src, size_t samples, float *lo, float *hi)
+{
+    float l = *lo;
+    float h = *hi;
+    for (size_t i = 0; i < samples; ++i) {
+        l = std::min(l, src[i]);
+        h = std::max(h, src[i]);
+    }
+    *lo = l;
+    *hi = h;
+}
+
+static double filterEnergyScalar(const Biquad stages[2], CascadeState& state, const float *src, size_t frames)
+{
+    double energy = 0.0;
+    for (int ch = 0; ch < 2; ++ch) {
+        double (&z0)[2] = state.z[0][ch];
+        double (&z1)[2] = state.z[1][ch];
+        const Biquad& f = stages[0];
+        const Biquad& g = stages[1];
+        for (size_t i = 0; i < frames; ++i) {
+            const double x = src[2 * i + ch];
+            const double y = f.b0 * x + z0[0];
+            z0[0] = f.b1 * x - f.a1 * y + z0[1];
+            z0[1] = f.b2 * x - f.a2 * y;
+            const double w = g.b0 * y + z1[0];
+            z1[0] = g.b1 * y - g.a1 * w + z1[1];
+            z1[1] = g.b2 * y - g.a2 * w;
+            energy += w * w;
+        }
+    }
+    return energy;
+}
+
+static void s16StereoScalar(const int16_t *src, float *dst, size_t frames)
+{
+    for (size_t i = 0; i < frames * 2; ++i) {
+        dst[i] = src[i] * (1.0f / 32768.0f);
+    }
+}
+
+#if defined(SOUNDPAD_X86) && defined(__SSE2__)
+static void accumulateSse2(float *dst, const float *src, float gain, size_t samples)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        __m128 d = _mm_loadu_ps(dst + i);
+        _mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + i), g)));
+    }
+    accumulateScalar(dst + i, src + i, gain, samples - i);
+}
+
+// Four frames per iteration. Lane k holds sin/cos of the ramp at frame i + k
+// and all lanes are rotated by 4 * step at once, so the loop needs no sin().
+static void accumulateFadeSse2(float *dst, const float *src, float gain, size_t frames, float phase, float step)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    __m128 s = _mm_setr_ps(std::sin(phase), std::sin(phase + step),
+                           std::sin(phase + 2 * step), std::sin(phase + 3 * step));
+    __m128 c = _mm_setr_ps(std::cos(phase), std::cos(phase + step),
+                           std::cos(phase + 2 * step), std::cos(phase + 3 * step));
+    const __m128 rotS = _mm_set1_ps(std::sin(4 * step));
+    const __m128 rotC = _mm_set1_ps(std::cos(4 * step));
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 w = _mm_mul_ps(s, g);
+        float *d = dst + 2 * i;
+        const float *x = src + 2 * i;
+        _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_mul_ps(_mm_loadu_ps(x), _mm_unpacklo_ps(w, w))));
+        _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_mul_ps(_mm_loadu_ps(x + 4), _mm_unpackhi_ps(w, w))));
+        __m128 next = _mm_add_ps(_mm_mul_ps(s, rotC), _mm_mul_ps(c, rotS));
+        c = _mm_sub_ps(_mm_mul_ps(c, rotC), _mm_mul_ps(s, rotS));
+        s = next;
+    }
+    accumulateFadeScalar(dst + 2 * i, src + 2 * i, gain, frames - i, phase + step * static_cast<float>(i), step);
+}
+
+// Two frames per iteration; the gain vector is {g, g, g + step, g + step}
+static void accumulateRampSse2(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    __m128 g = _mm_setr_ps(gain, gain, gain + step, gain + step);
+    const __m128 advance = _mm_set1_ps(2 * step);
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        __m128 d = _mm_loadu_ps(dst + 2 * i);
+        _mm_storeu_ps(dst + 2 * i, _mm_add_ps(d, _mm_mul_ps(_mm_loadu_ps(src + 2 * i), g)));
+        g = _mm_add_ps(g, advance);
+    }
+    accumulateRampScalar(dst + 2 * i, src + 2 * i, gain + step * static_cast<float>(i), step, frames - i);
+}
+
+static inline __m128 clipSse2(__m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 knee = _mm_set1_ps(kKnee);
+    __m128 sign = _mm_and_ps(x, signMask);
+    __m128 a = _mm_andnot_ps(signMask, x);
+    __m128 u = _mm_min_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(a, knee), _mm_setzero_ps()), _mm_set1_ps(kInvRange)),
+                          _mm_set1_ps(3.0f));
+    __m128 u2 = _mm_mul_ps(u, u);
+    const __m128 c27 = _mm_set1_ps(27.0f);
+    __m128 r = _mm_div_ps(_mm_mul_ps(u, _mm_add_ps(c27, u2)), _mm_add_ps(c27, _mm_mul_ps(_mm_set1_ps(9.0f), u2)));
+    __m128 y = _mm_add_ps(knee, _mm_mul_ps(_mm_set1_ps(kRange), r));
+    __m128 over = _mm_cmpgt_ps(a, knee);
+    __m128 out = _mm_or_ps(_mm_and_ps(over, y), _mm_andnot_ps(over, a));
+    return _mm_or_ps(out, sign);
+}
+
+static void softClipSse2(float *buf, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        _mm_storeu_ps(buf + i, clipSse2(_mm_loadu_ps(buf + i)));
+    }
+    softClipScalar(buf + i, samples - i);
+}
+
+static void gainClipSse2(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    __m128 g = _mm_setr_ps(gain, gain, gain + step, gain + step);
+    const __m128 advance = _mm_set1_ps(2 * step);
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        _mm_storeu_ps(dst + 2 * i, clipSse2(_mm_mul_ps(_mm_loadu_ps(src + 2 * i), g)));
+        g = _mm_add_ps(g, advance);
+    }
+    gainClipScalar(dst + 2 * i, src + 2 * i, gain + step * static_cast<float>(i), step, frames - i);
+}
+
+static void peakRangeSse2(const float *src, size_t samples, float *lo, float *hi)
+{
+    __m128 l = _mm_set1_ps(*lo);
+    __m128 h = _mm_set1_ps(*hi);
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        __m128 x = _mm_loadu_ps(src + i);
+        l = _mm_min_ps(l, x);
+        h = _mm_max_ps(h, x);
+    }
+    // Fold the lanes: swap pairs, then halves
+    l = _mm_min_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 3, 0, 1)));
+    l = _mm_min_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 0, 3, 2)));
+    h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1)));
+    h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 0, 3, 2)));
+    _mm_store_ss(lo, l);
+    _mm_store_ss(hi, h);
+    peakRangeScalar(src + i, samples - i, lo, hi);
+}
+
+// One frame per iteration, left and right in the two double lanes. An IIR
+// cannot be vectorised along time, but both channels share the coefficients.
+static double filterEnergySse2(const Biquad stages[2], CascadeState& state, const float *src, size_t frames)
+{
+    __m128d b[2][3], a[2][2], z[2][2];
+    for (int s = 0; s < 2; ++s) {
+        b[s][0] = _mm_set1_pd(stages[s].b0);
+        b[s][1] = _mm_set1_pd(stages[s].b1);
+        b[s][2] = _mm_set1_pd(stages[s].b2);
+        a[s][0] = _mm_set1_pd(stages[s].a1);
+        a[s][1] = _mm_set1_pd(stages[s].a2);
+        z[s][0] = _mm_setr_pd(state.z[s][0][0], state.z[s][1][0]);
+        z[s][1] = _mm_setr_pd(state.z[s][0][1], state.z[s][1][1]);
+    }
+    __m128d energy = _mm_setzero_pd();
+    for (size_t i = 0; i < frames; ++i) {
+        __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 2 * i))));
+        for (int s = 0; s < 2; ++s) {
+            __m128d y = _mm_add_pd(_mm_mul_pd(b[s][0], x), z[s][0]);
+            z[s][0] = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b[s][1], x), _mm_mul_pd(a[s][0], y)), z[s][1]);
+            z[s][1] = _mm_sub_pd(_mm_mul_pd(b[s][2], x), _mm_mul_pd(a[s][1], y));
+            x = y;
+        }
+        energy = _mm_add_pd(energy, _mm_mul_pd(x, x));
+    }
+    double lanes[2];
+    for (int s = 0; s < 2; ++s) {
+        _mm_storeu_pd(lanes, z[s][0]);
+        state.z[s][0][0] = lanes[0];
+        state.z[s][1][0] = lanes[1];
+        _mm_storeu_pd(lanes, z[s][1]);
+        state.z[s][0][1] = lanes[0];
+        state.z[s][1][1] = lanes[1];
+    }
+    _mm_storeu_pd(lanes, energy);
+    return lanes[0] + lanes[1];
+}
+
+static void s16StereoSse2(const int16_t *src, float *dst, size_t frames)
+{
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    const size_t samples = frames * 2;
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // Duplicate each 16-bit lane and shift back down to sign-extend it
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    s16StereoScalar(src + i, dst + i, (samples - i) / 2);
+}
+#endif
+
+#if defined(SOUNDPAD_X86) && defined(__GNUC__)
+__attribute__((target("avx2")))
+static void accumulateAvx2(float *dst, const float *src, float gain, size_t samples)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256 d = _mm256_loadu_ps(dst + i);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src + i), g)));
+    }
+    accumulateScalar(dst + i, src + i, gain, samples - i);
+}
+
+// Four frames per iteration
+__attribute__((target("avx2")))
+static void accumulateRampAvx2(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    __m256 g = _mm256_setr_ps(gain, gain, gain + step, gain + step,
+                              gain + 2 * step, gain + 2 * step, gain + 3 * step, gain + 3 * step);
+    const __m256 advance = _mm256_set1_ps(4 * step);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m256 d = _mm256_loadu_ps(dst + 2 * i);
+        _mm256_storeu_ps(dst + 2 * i, _mm256_add_ps(d, _mm256_mul_ps(_mm256_loadu_ps(src + 2 * i), g)));
+        g = _mm256_add_ps(g, advance);
+    }
+    accumulateRampScalar(dst + 2 * i, src + 2 * i, gain + step * static_cast<float>(i), step, frames - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 clipAvx2(__m256 x)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 knee = _mm256_set1_ps(kKnee);
+    __m256 sign = _mm256_and_ps(x, signMask);
+    __m256 a = _mm256_andnot_ps(signMask, x);
+    __m256 u = _mm256_min_ps(_mm256_mul_ps(_mm256_max_ps(_mm256_sub_ps(a, knee), _mm256_setzero_ps()),
+                                           _mm256_set1_ps(kInvRange)),
+                             _mm256_set1_ps(3.0f));
+    __m256 u2 = _mm256_mul_ps(u, u);
+    const __m256 c27 = _mm256_set1_ps(27.0f);
+    __m256 r = _mm256_div_ps(_mm256_mul_ps(u, _mm256_add_ps(c27, u2)),
+                             _mm256_add_ps(c27, _mm256_mul_ps(_mm256_set1_ps(9.0f), u2)));
+    __m256 y = _mm256_add_ps(knee, _mm256_mul_ps(_mm256_set1_ps(kRange), r));
+    __m256 out = _mm256_blendv_ps(a, y, _mm256_cmp_ps(a, knee, _CMP_GT_OQ));
+    return _mm256_or_ps(out, sign);
+}
+
+__attribute__((target("avx2")))
+static void softClipAvx2(float *buf, size_t samples)
+{
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        _mm256_storeu_ps(buf + i, clipAvx2(_mm256_loadu_ps(buf + i)));
+    }
+    softClipScalar(buf + i, samples - i);
+}
+
+__attribute__((target("avx2")))
+static void gainClipAvx2(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    __m256 g = _mm256_setr_ps(gain, gain, gain + step, gain + step,
+                              gain + 2 * step, gain + 2 * step, gain + 3 * step, gain + 3 * step);
+    const __m256 advance = _mm256_set1_ps(4 * step);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        _mm256_storeu_ps(dst + 2 * i, clipAvx2(_mm256_mul_ps(_mm256_loadu_ps(src + 2 * i), g)));
+        g = _mm256_add_ps(g, advance);
+    }
+    gainClipScalar(dst + 2 * i, src + 2 * i, gain + step * static_cast<float>(i), step, frames - i);
+}
+
+__attribute__((target("avx2")))
+static void peakRangeAvx2(const float *src, size_t samples, float *lo, float *hi)
+{
+    __m256 l = _mm256_set1_ps(*lo);
+    __m256 h = _mm256_set1_ps(*hi);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256 x = _mm256_loadu_ps(src + i);
+        l = _mm256_min_ps(l, x);
+        h = _mm256_max_ps(h, x);
+    }
+    __m128 l4 = _mm_min_ps(_mm256_castps256_ps128(l), _mm256_extractf128_ps(l, 1));
+    __m128 h4 = _mm_max_ps(_mm256_castps256_ps128(h), _mm256_extractf128_ps(h, 1));
+    l4 = _mm_min_ps(l4, _mm_shuffle_ps(l4, l4, _MM_SHUFFLE(2, 3, 0, 1)));
+    l4 = _mm_min_ps(l4, _mm_shuffle_ps(l4, l4, _MM_SHUFFLE(1, 0, 3, 2)));
+    h4 = _mm_max_ps(h4, _mm_shuffle_ps(h4, h4, _MM_SHUFFLE(2, 3, 0, 1)));
+    h4 = _mm_max_ps(h4, _mm_shuffle_ps(h4, h4, _MM_SHUFFLE(1, 0, 3, 2)));
+    _mm_store_ss(lo, l4);
+    _mm_store_ss(hi, h4);
+    peakRangeScalar(src + i, samples - i, lo, hi);
+}
+
+__attribute__((target("avx2")))
+static void s16StereoAvx2(const int16_t *src, float *dst, size_t frames)
+{
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    const size_t samples = frames * 2;
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s16StereoScalar(src + i, dst + i, (samples - i) / 2);
+}
+#endif
+
+namespace {
+
+struct Kernels {
+    void (*accumulate)(float*, const float*, float, size_t) = accumulateScalar;
+    // Short ramps only; AVX2 keeps the SSE2 variant
+    void (*accumulateFade)(float*, const float*, float, size_t, float, float) = accumulateFadeScalar;
+    void (*accumulateRamp)(float*, const float*, float, float, size_t) = accumulateRampScalar;
+    void (*softClip)(float*, size_t) = softClipScalar;
+    void (*gainClip)(float*, const float*, float, float, size_t) = gainClipScalar;
+    void (*s16Stereo)(const int16_t*, float*, size_t) = s16StereoScalar;
+    void (*peakRange)(const float*, size_t, float*, float*) = peakRangeScalar;
+    // Two lanes are all it can use; AVX2 keeps the SSE2 variant
+    double (*filterEnergy)(const Biquad*, CascadeState&, const float*, size_t) = filterEnergyScalar;
+    const char *name = "scalar";
+};
+
+Kernels selectKernels()
+{
+    Kernels k;
+#if defined(SOUNDPAD_X86) && defined(__SSE2__)
+    k.accumulate = accumulateSse2;
+    k.accumulateFade = accumulateFadeSse2;
+    k.accumulateRamp = accumulateRampSse2;
+    k.softClip = softClipSse2;
+    k.gainClip = gainClipSse2;
+    k.s16Stereo = s16StereoSse2;
+    k.peakRange = peakRangeSse2;
+    k.filterEnergy = filterEnergySse2;
+    k.name = "sse2";
+#endif
+#if defined(SOUNDPAD_X86) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) {
+        k.accumulate = accumulateAvx2;
+        k.accumulateRamp = accumulateRampAvx2;
+        k.softClip = softClipAvx2;
+        k.gainClip = gainClipAvx2;
+        k.s16Stereo = s16StereoAvx2;
+        k.peakRange = peakRangeAvx2;
+        k.name = "avx2";
+    }
+#endif
+    return k;
+}
+
+const Kernels& kernels()
+{
+    static const Kernels k = selectKernels();
+    return k;
+}
+
+// One sample of any supported format as float in [-1, 1)
+inline float sampleAt(SampleFormat format, const uint8_t *p)
+{
+    switch (format) {
+    case SampleFormat::U8:
+        return (static_cast<int>(p[0]) - 128) * (1.0f / 128.0f);
+    case SampleFormat::S16: {
+        int16_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v * (1.0f / 32768.0f);
+    }
+    case SampleFormat::S24: {
+        int32_t v = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) |
+                                         (static_cast<uint32_t>(p[1]) << 16) |
+                                         (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+        return v * (1.0f / 8388608.0f);
+    }
+    case SampleFormat::S32: {
+        int32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return static_cast<float>(v) * (1.0f / 2147483648.0f);
+    }
+    case SampleFormat::F32: {
+        float v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    }
+    return 0.0f;
+}
+
+// Left/right weights of each channel for the downmix to stereo, in the
+// order WAVE files without a channel mask use for that many channels
+struct Downmix {
+    float weight[8][2];
+};
+
+constexpr float kMinus3dB = 0.70710678f;
+
+Downmix downmixFor(int channels)
+{
+    enum Speaker { FL, FR, FC, LFE, BL, BR, BC, SL, SR };
+    static const Speaker layouts[6][8] = {
+        { FL, FR, FC },                          // 3.0
+        { FL, FR, BL, BR },                      // quad
+        { FL, FR, FC, BL, BR },                  // 5.0
+        { FL, FR, FC, LFE, BL, BR },             // 5.1
+        { FL, FR, FC, LFE, BC, SL, SR },         // 6.1
+        { FL, FR, FC, LFE, BL, BR, SL, SR },     // 7.1
+    };
+    Downmix downmix = {};
+    const Speaker *layout = layouts[std::clamp(channels, 3, 8) - 3];
+    for (int c = 0; c < std::min(channels, 8); ++c) {
+        float *w = downmix.weight[c];
+        switch (layout[c]) {
+        case FL: w[0] = 1.0f; break;
+        case FR: w[1] = 1.0f; break;
+        case FC: w[0] = w[1] = kMinus3dB; break;
+        case LFE: break;
+        case BL: case SL: w[0] = kMinus3dB; break;
+        case BR: case SR: w[1] = kMinus3dB; break;
+        case BC: w[0] = w[1] = 0.5f; break; // both surrounds, -3 dB each
+        }
+    }
+    return downmix;
+}
+
+} // namespace
+
+void accumulate(float *dst, const float *src, float gain, size_t samples)
+{
+    kernels().accumulate(dst, src, gain, samples);
+}
+
+void accumulateFade(float *dst, const float *src, float gain, size_t frames, float phase, float step)
+{
+    kernels().accumulateFade(dst, src, gain, frames, phase, step);
+}
+
+void accumulateRamp(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    kernels().accumulateRamp(dst, src, gain, step, frames);
+}
+
+void softClip(float *buf, size_t samples)
+{
+    kernels().softClip(buf, samples);
+}
+
+void gainClip(float *dst, const float *src, float gain, float step, size_t frames)
+{
+    kernels().gainClip(dst, src, gain, step, frames);
+}
+
+void toStereoFloat(const PcmFormat& format, const char *src, float *dst, size_t frames)
+{
+    if (format.sampleFormat == SampleFormat::S16 && format.channels == 2) {
+        // Decoder output and cache entries, the common case
+        int16_t aligned[512];
+        while (frames > 0) {
+            size_t n = std::min<size_t>(frames, sizeof(aligned) / sizeof(aligned[0]) / 2);
+            std::memcpy(aligned, src, n * 4);
+            kernels().s16Stereo(aligned, dst, n);
+            src += n * 4;
+            dst += n * 2;
+            frames -= n;
+        }
+        return;
+    }
+    if (format.sampleFormat == SampleFormat::F32 && format.channels == 2) {
+        std::memcpy(dst, src, frames * 2 * sizeof(float));
+        return;
+    }
+
+    const int sampleBytes = format.bytesPerSample();
+    const int frameBytes = format.frameBytes();
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(src);
+    if (format.channels <= 2) {
+        const int right = format.channels > 1 ? sampleBytes : 0;
+        for (size_t i = 0; i < frames; ++i, p += frameBytes) {
+            dst[2 * i] = sampleAt(format.sampleFormat, p);
+            dst[2 * i + 1] = sampleAt(format.sampleFormat, p + right);
+        }
+        return;
+    }
+
+    const int channels = std::min(format.channels, 8);
+    const Downmix downmix = downmixFor(channels);
+    for (size_t i = 0; i < frames; ++i, p += frameBytes) {
+        float left = 0.0f;
+        float right = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            const float v = sampleAt(format.sampleFormat, p + c * sampleBytes);
+            left += v * downmix.weight[c][0];
+            right += v * downmix.weight[c][1];
+        }
+        dst[2 * i] = left;
+        dst[2 * i + 1] = right;
+    }
+}
+
+void peakRange(const float *src, size_t samples, float *lo, float *hi)
+{
+    kernels().peakRange(src, samples, lo, hi);
+}
+
+double filterEnergy(const Biquad stages[2], CascadeState& state, const float *src, size_t frames)
+{
+    return kernels().filterEnergy(stages, state, src, frames);
+}
+
+const char *kernelName()
+{
+    return kernels().name;
+}
+
+} // namespace mix
+} // namespace soundpad
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include "PcmSource.hpp"
+
+namespace soundpad {
+
+// Vector kernels used by the mixer. On x86 the widest supported variant
+// (AVX2, SSE2) is picked once at startup; other targets use plain loops.
+namespace mix {
+
+// dst[i] += src[i] * gain
+void accumulate(float *dst, const float *src, float gain, size_t samples);
+
+// Crossfade ramp over interleaved stereo frames:
+// dst[frame i] += src[frame i] * gain * sin(phase + i * step).
+// Running the phase from 0 to pi/2 fades in, from pi/2 to 0 fades out; two
+// voices ramped over the same span that way keep constant power.
+void accumulateFade(float *dst, const float *src, float gain, size_t frames, float phase, float step);
+
+// accumulate() over interleaved stereo frames with a linear gain ramp:
+// dst[frame i] += src[frame i] * (gain + i * step), for click-free gain changes.
+void accumulateRamp(float *dst, const float *src, float gain, float step, size_t frames);
+
+// Smooth saturation towards +-1: transparent for quiet signals, no hard edge
+// when several loud voices overlap.
+void softClip(float *buf, size_t samples);
+
+// Output stage of a bus in one pass: dst[frame i] = softClip(src[frame i] *
+// (gain + i * step)) over interleaved stereo. step 0 holds the gain.
+void gainClip(float *dst, const float *src, float gain, float step, size_t frames);
+
+// Convert interleaved PCM of any supported format to interleaved stereo float.
+// Mono is duplicated. 3-8 channels, in the default WAVE order for their
+// count, are downmixed ITU-R BS.775 style: centre and surrounds join L/R at
+// -3 dB, LFE is left out.
+void toStereoFloat(const PcmFormat& format, const char *src, float *dst, size_t frames);
+
+// Widen [*lo, *hi] to cover every sample in src (waveform peaks)
+void peakRange(const float *src, size_t samples, float *lo, float *hi);
+
+// Direct form II transposed biquad, a0 normalised to 1
+struct Biquad {
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+};
+
+// Memory of a two-stage biquad cascade over a stereo signal
+struct CascadeState {
+    double z[2][2][2] = {}; // [stage][channel][delay]
+};
+
+// Run interleaved stereo through the cascade `stages[0]` -> `stages[1]`
+// (in double precision, both channels side by side) and return the sum of
+// squares of the output over both channels. Used for K-weighted loudness.
+double filterEnergy(const Biquad stages[2], CascadeState& state, const float *src, size_t frames);
+
+// Name of the selected kernel set, for logs
+const char *kernelName();
+
+} // namespace mix
+} // namespace soundpad
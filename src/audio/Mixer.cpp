@@ -0,0 +1,482 @@
+#include "Mixer.hpp"
+#include "AudioLog.hpp"
+#include "MixKernels.hpp"
+#include <algorithm>
+#include <QDebug>
+
+namespace soundpad {
+
+static constexpr size_t kBlockFrames = 1024;
+// Resampler input of a voice: one frame carried over plus a block read
+static constexpr size_t kMaxPending = (kBlockFrames + 1) * Mixer::kChannels;
+static constexpr size_t kMaxFrameBytes = 8 * 4; // 8 channels of 32-bit samples
+static constexpr float kHalfPi = 1.57079632679f;
+
+Mixer::Mixer(int rate)
+    : rate_(rate), mailbox_(256), retireQueue_(256), readBuffer_(kBlockFrames * kMaxFrameBytes), voiceBuffer_(kBlockFrames * kChannels)
+{
+    finished_.reserve(kMaxVoices);
+    started_.reserve(kMaxVoices);
+    // render() keeps at most one frame before reading a block, so `pending`
+    // never outgrows this and the mixing thread never allocates for it
+    for (auto& voice : voices_) {
+        voice.pending.reserve(kMaxPending);
+    }
+    qCDebug(lcAudio) << "[Mixer] Using" << mix::kernelName() << "mix kernels";
+}
+
+PcmFormat Mixer::format() const
+{
+    PcmFormat format;
+    format.sampleFormat = SampleFormat::F32;
+    format.rate = rate_;
+    format.channels = kChannels;
+    return format;
+}
+
+void Mixer::post(Request request)
+{
+    if (!mailbox_.push(std::move(request))) {
+        qCDebug(lcAudio) << "[Mixer] Command mailbox is full, dropping a command";
+    }
+}
+
+int Mixer::addVoice(std::shared_ptr<PcmSource> source, float gain, Clock::time_point triggered)
+{
+    Request request(Request::Add);
+    request.id = nextId_.fetch_add(1, std::memory_order_relaxed);
+    request.source = std::move(source);
+    request.gain = gain;
+    request.triggered = triggered;
+    const int id = request.id;
+    if (!mailbox_.push(std::move(request))) {
+        qCDebug(lcAudio) << "[Mixer] Command mailbox is full, dropping voice" << id;
+        return -1;
+    }
+    return id;
+}
+
+int Mixer::queueVoice(int after, std::shared_ptr<PcmSource> source, int crossfadeMs, float gain)
+{
+    Request request(Request::Queue);
+    request.id = nextId_.fetch_add(1, std::memory_order_relaxed);
+    request.after = after;
+    request.source = std::move(source);
+    request.gain = gain;
+    request.ms = std::max(0, crossfadeMs);
+    request.triggered = Clock::now();
+    const int id = request.id;
+    if (!mailbox_.push(std::move(request))) {
+        qCDebug(lcAudio) << "[Mixer] Command mailbox is full, dropping queued voice" << id;
+        return -1;
+    }
+    return id;
+}
+
+void Mixer::stopVoice(int id)
+{
+    Request request(Request::Stop);
+    request.id = id;
+    post(std::move(request));
+}
+
+void Mixer::stopAll()
+{
+    post(Request(Request::StopAll));
+}
+
+void Mixer::seekVoice(int id, qint64 ms)
+{
+    Request request(Request::Seek);
+    request.id = id;
+    request.ms = ms;
+    post(std::move(request));
+}
+
+void Mixer::setVoiceGain(int id, float gain)
+{
+    Request request(Request::Gain);
+    request.id = id;
+    request.gain = gain;
+    post(std::move(request));
+}
+
+// Mixing thread. Should the queue ever be full the source is dropped here
+// after all, it is never kept alive past its voice.
+void Mixer::retire(std::shared_ptr<PcmSource>& source)
+{
+    if (source) {
+        retireQueue_.push(std::move(source));
+        source.reset();
+        ++retired_;
+    }
+}
+
+void Mixer::releaseRetired()
+{
+    std::shared_ptr<PcmSource> source;
+    while (retireQueue_.pop(source)) {
+        source.reset();
+    }
+}
+
+Mixer::Voice *Mixer::find(int id)
+{
+    for (auto& voice : voices_) {
+        if (voice.id == id && id >= 0) {
+            return &voice;
+        }
+    }
+    return nullptr;
+}
+
+const Mixer::Voice *Mixer::find(int id) const
+{
+    return const_cast<Mixer*>(this)->find(id);
+}
+
+Mixer::Voice *Mixer::follower(int id)
+{
+    for (auto& voice : voices_) {
+        if (voice.id >= 0 && voice.after == id && !voice.ended) {
+            return &voice;
+        }
+    }
+    return nullptr;
+}
+
+void Mixer::applyRequests()
+{
+    Request request;
+    while (mailbox_.pop(request)) {
+        switch (request.type) {
+        case Request::Add:
+            startVoice(request);
+            break;
+        case Request::Queue:
+            if (Voice *queued = follower(request.after)) {
+                queued->ended = queued->stopped = true;
+            }
+            startVoice(request);
+            break;
+        case Request::Stop:
+            if (Voice *voice = find(request.id)) {
+                voice->ended = voice->stopped = true;
+                if (Voice *queued = follower(request.id)) {
+                    queued->ended = queued->stopped = true;
+                }
+            }
+            break;
+        case Request::StopAll:
+            for (auto& voice : voices_) {
+                voice.ended = voice.stopped = true;
+            }
+            break;
+        case Request::Seek:
+            if (Voice *voice = find(request.id)) {
+                seek(*voice, request.ms);
+            }
+            break;
+        case Request::Gain:
+            if (Voice *voice = find(request.id)) {
+                voice->targetGain = request.gain;
+            }
+            break;
+        }
+        request = Request();
+    }
+}
+
+void Mixer::startVoice(Request& request)
+{
+    Voice *slot = nullptr;
+    for (auto& voice : voices_) {
+        if (voice.id < 0) {
+            slot = &voice;
+            break;
+        }
+    }
+    if (!slot) {
+        slot = &*std::min_element(voices_.begin(), voices_.end(),
+                                  [](const Voice& a, const Voice& b) { return a.id < b.id; });
+        qCDebug(lcAudio) << "[Mixer] Voice pool full, stealing voice" << slot->id;
+    }
+
+    slot->id = request.id;
+    retire(slot->source);
+    slot->source = std::move(request.source);
+    slot->format = slot->source->format();
+    slot->gain = slot->targetGain = request.gain;
+    slot->step = static_cast<double>(slot->format.rate) / rate_;
+    slot->phase = 0.0;
+    slot->pending.clear();
+    slot->baseMs = 0;
+    slot->framesOut = 0;
+    slot->triggered = request.triggered;
+    // Queued behind a voice that is already gone: start right away
+    slot->after = request.type == Request::Queue && find(request.after) ? request.after : -1;
+    slot->crossfade = static_cast<size_t>(request.ms * rate_ / 1000);
+    slot->fade = 0;
+    slot->fadePos = 0;
+    slot->fadeLength = 0;
+    slot->mixedBlock = 0;
+    slot->rendered = false;
+    slot->ended = false;
+    slot->stopped = false;
+}
+
+void Mixer::seek(Voice& voice, qint64 ms)
+{
+    const qint64 bytesPerSec = voice.format.bytesPerSecond();
+    const qint64 blockAlign = voice.format.frameBytes();
+    const qint64 dataSize = voice.source->totalBytes();
+    qint64 seekByte = std::max<qint64>(0, ms) * bytesPerSec / 1000;
+    if (dataSize >= 0) {
+        seekByte = std::min(seekByte, dataSize);
+    }
+    seekByte = (seekByte / blockAlign) * blockAlign;
+    voice.source->seekToByte(seekByte);
+    voice.pending.clear();
+    voice.phase = 0.0;
+    voice.baseMs = seekByte * 1000 / bytesPerSec;
+    voice.framesOut = 0;
+    // Seeking to or past the end ends the voice
+    voice.ended = dataSize >= 0 && seekByte >= dataSize;
+}
+
+// Pull up to `frames` source frames and convert them to stereo float
+size_t Mixer::readConverted(Voice& voice, float *out, size_t frames)
+{
+    const size_t frameBytes = static_cast<size_t>(voice.format.frameBytes());
+    const size_t want = std::min(frames, kBlockFrames) * frameBytes;
+    // Memory-mapped sources are converted straight from the mapping
+    const char *data = readBuffer_.data();
+    size_t n = voice.source->supportsView()
+        ? voice.source->readView(&data, want)
+        : voice.source->read(readBuffer_.data(), want);
+    size_t got = n / frameBytes;
+    mix::toStereoFloat(voice.format, data, out, got);
+    return got;
+}
+
+// A source that ran dry before its end is padded with silence for the rest
+// of the block and stays alive; anything else that reads nothing has ended
+size_t Mixer::padStarved(Voice& voice, float *out, size_t produced, size_t frames)
+{
+    if (!voice.source->starved()) {
+        voice.ended = true;
+        return produced;
+    }
+    std::fill(out + produced * kChannels, out + frames * kChannels, 0.0f);
+    voice.silent = frames - produced;
+    return frames;
+}
+
+// Render up to `frames` output frames of one voice, fewer only at its end.
+// Never waits for the source.
+size_t Mixer::render(Voice& voice, float *out, size_t frames)
+{
+    size_t produced = 0;
+    voice.silent = 0;
+    if (voice.step == 1.0) {
+        while (produced < frames) {
+            size_t n = readConverted(voice, out + produced * kChannels, frames - produced);
+            if (n == 0) {
+                return padStarved(voice, out, produced, frames);
+            }
+            produced += n;
+        }
+        return produced;
+    }
+
+    // Linear resampling for sources that are not at the mix rate
+    while (produced < frames) {
+        size_t available = voice.pending.size() / kChannels;
+        size_t index = static_cast<size_t>(voice.phase);
+        if (index + 1 >= available) {
+            size_t consumed = std::min(index, available);
+            voice.pending.erase(voice.pending.begin(), voice.pending.begin() + consumed * kChannels);
+            voice.phase -= static_cast<double>(consumed);
+
+            size_t old = voice.pending.size();
+            voice.pending.resize(old + kBlockFrames * kChannels);
+            size_t n = readConverted(voice, voice.pending.data() + old, kBlockFrames);
+            voice.pending.resize(old + n * kChannels);
+            if (n == 0) {
+                return padStarved(voice, out, produced, frames);
+            }
+            continue;
+        }
+        const float t = static_cast<float>(voice.phase - static_cast<double>(index));
+        const float *a = voice.pending.data() + index * kChannels;
+        out[produced * kChannels] = a[0] + (a[2] - a[0]) * t;
+        out[produced * kChannels + 1] = a[1] + (a[3] - a[1]) * t;
+        voice.phase += voice.step;
+        ++produced;
+    }
+    return produced;
+}
+
+// Output frames left until the voice's end, -1 if its length is unknown
+qint64 Mixer::remainingFrames(const Voice& voice) const
+{
+    const qint64 total = voice.source->totalBytes();
+    if (total < 0) {
+        return -1;
+    }
+    const auto totalOut = static_cast<qint64>(static_cast<double>(total / voice.format.frameBytes()) / voice.step);
+    const qint64 position = voice.baseMs * rate_ / 1000 + voice.framesOut;
+    return std::max<qint64>(0, totalOut - position);
+}
+
+// Render up to `frames` frames of one voice and add them to `dst` with its
+// gain and fade. A voice fading out ends with the fade. A new gain is ramped
+// to over the rest of the block instead of jumping.
+size_t Mixer::renderInto(Voice& voice, float *dst, size_t frames)
+{
+    voice.mixedBlock = blockSerial_;
+    const size_t produced = render(voice, voiceBuffer_.data(), frames);
+    size_t ramped = 0;
+    bool fadedOut = false;
+    if (voice.fade != 0) {
+        ramped = std::min(produced, voice.fadeLength - voice.fadePos);
+        const float step = kHalfPi / static_cast<float>(voice.fadeLength);
+        const float phase = step * static_cast<float>(voice.fadePos);
+        if (voice.fade > 0) {
+            mix::accumulateFade(dst, voiceBuffer_.data(), voice.gain, ramped, phase, step);
+        } else {
+            mix::accumulateFade(dst, voiceBuffer_.data(), voice.gain, ramped, kHalfPi - phase, -step);
+        }
+        voice.fadePos += ramped;
+        if (voice.fadePos >= voice.fadeLength) {
+            fadedOut = voice.fade < 0;
+            voice.ended = voice.ended || fadedOut;
+            voice.fade = 0;
+        }
+    }
+    if (!fadedOut && voice.gain != voice.targetGain && produced > ramped) {
+        const size_t length = produced - ramped;
+        const float step = (voice.targetGain - voice.gain) / static_cast<float>(length);
+        mix::accumulateRamp(dst + ramped * kChannels, voiceBuffer_.data() + ramped * kChannels, voice.gain, step,
+                            length);
+        voice.gain = voice.targetGain;
+    } else if (!fadedOut) {
+        mix::accumulate(dst + ramped * kChannels, voiceBuffer_.data() + ramped * kChannels, voice.gain,
+                        (produced - ramped) * kChannels);
+    }
+    // Silence padded in while the source was starved does not move the playhead
+    voice.framesOut += static_cast<qint64>(produced - voice.silent);
+    if (produced > voice.silent && !voice.rendered) {
+        voice.rendered = true;
+        started_.push_back({voice.id, voice.triggered});
+    }
+    return produced;
+}
+
+size_t Mixer::mix(float *out, size_t frames)
+{
+    retired_ = 0;
+    applyRequests();
+    std::fill(out, out + frames * kChannels, 0.0f);
+    started_.clear();
+
+    for (size_t offset = 0; offset < frames; offset += kBlockFrames) {
+        const size_t block = std::min(kBlockFrames, frames - offset);
+        float *dst = out + offset * kChannels;
+        ++blockSerial_;
+        for (auto& voice : voices_) {
+            if (voice.id < 0 || voice.ended || voice.after >= 0 || voice.mixedBlock == blockSerial_) {
+                continue;
+            }
+            Voice *next = follower(voice.id);
+
+            // Frame of this block where a crossfade into the queued voice begins
+            size_t fadeAt = block;
+            qint64 fadeLength = 0;
+            if (next && next->crossfade > 0 && voice.fade == 0) {
+                const qint64 remaining = remainingFrames(voice);
+                fadeLength = std::min<qint64>(static_cast<qint64>(next->crossfade), remaining);
+                if (fadeLength > 0 && remaining - fadeLength < static_cast<qint64>(block)) {
+                    fadeAt = static_cast<size_t>(remaining - fadeLength);
+                }
+            }
+
+            size_t produced = renderInto(voice, dst, fadeAt);
+            if (fadeAt < block && !voice.ended) {
+                voice.fade = -1;
+                next->fade = 1;
+                voice.fadePos = next->fadePos = 0;
+                voice.fadeLength = next->fadeLength = static_cast<size_t>(fadeLength);
+                next->after = -1;
+                renderInto(voice, dst + fadeAt * kChannels, block - fadeAt);
+                renderInto(*next, dst + fadeAt * kChannels, block - fadeAt);
+            } else if (voice.ended && !voice.stopped && next) {
+                // Gapless: the queued voice continues on the very next frame
+                next->after = -1;
+                renderInto(*next, dst + produced * kChannels, block - produced);
+            }
+        }
+    }
+    // A voice that ended without reaching its splice point (seeked to its
+    // end, say) hands over at the next mix
+    for (auto& voice : voices_) {
+        if (voice.id >= 0 && voice.after >= 0) {
+            const Voice *previous = find(voice.after);
+            if (!previous || previous->ended) {
+                voice.after = -1;
+            }
+        }
+    }
+
+    active_ = 0;
+    finished_.clear();
+    for (auto& voice : voices_) {
+        if (voice.id < 0) {
+            continue;
+        }
+        if (voice.ended) {
+            if (!voice.stopped) {
+                finished_.push_back(voice.id);
+            }
+            voice.id = -1;
+            retire(voice.source);
+            voice.pending.clear();
+        } else {
+            ++active_;
+        }
+    }
+    return active_;
+}
+
+bool Mixer::isActive(int id) const
+{
+    return find(id) != nullptr;
+}
+
+qint64 Mixer::positionMs(int id) const
+{
+    const Voice *voice = find(id);
+    if (!voice) {
+        return 0;
+    }
+    return voice->baseMs + voice->framesOut * 1000 / rate_;
+}
+
+qint64 Mixer::decodeAheadUs() const
+{
+    qint64 shortest = -1;
+    for (const auto& voice : voices_) {
+        if (voice.id < 0 || voice.ended || voice.after >= 0) {
+            continue;
+        }
+        const qint64 bytes = voice.source->bufferedBytes();
+        if (bytes < 0) {
+            continue;
+        }
+        const qint64 us = bytes * 1000000 / voice.format.bytesPerSecond();
+        shortest = shortest < 0 ? us : std::min(shortest, us);
+    }
+    return shortest;
+}
+
+} // namespace soundpad
@@ -0,0 +1,144 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "Mailbox.hpp"
+#include "PcmSource.hpp"
+
+namespace soundpad {
+
+// Sums a fixed pool of voices into one interleaved stereo float buffer.
+// The sum is not clipped: each output applies its own gain first (see
+// mix::gainClip).
+//
+// addVoice/stopVoice/stopAll/seekVoice/setVoiceGain may be called from any
+// thread: they post a command to a lock-free mailbox that the mixing thread
+// drains at the start of the next mix(), so a caller never waits for the
+// mixing thread and the mixing thread never waits for a caller. Sources the
+// mixing thread is done with go the other way: they are parked in a retire
+// queue and destroyed by releaseRetired() on another thread, since dropping
+// the last reference may join a decode thread or unmap a file. Everything
+// else belongs to the mixing thread.
+class Mixer {
+public:
+    static constexpr int kMaxVoices = 32;
+    static constexpr int kChannels = 2;
+
+    using Clock = std::chrono::steady_clock;
+
+    struct StartedVoice {
+        int id;
+        Clock::time_point triggered;
+    };
+
+    explicit Mixer(int rate = 44100);
+
+    PcmFormat format() const; // F32 stereo at the mix rate
+
+    // Returns the voice id, -1 if the mailbox is full. When the pool is full
+    // the oldest voice is stolen. `triggered` is when the request for the
+    // sound arrived, for latency stats.
+    int addVoice(std::shared_ptr<PcmSource> source, float gain = 1.0f,
+                 Clock::time_point triggered = Clock::now());
+    // Queue `source` to follow voice `after` without a gap: it starts on the
+    // frame after the last one of `after`. With crossfadeMs > 0 it starts
+    // that much earlier instead and the two are crossfaded (sources of
+    // unknown length are spliced without one). Replaces a voice queued
+    // earlier for `after`; stopping `after` drops it. Returns the voice id,
+    // -1 if the mailbox is full.
+    int queueVoice(int after, std::shared_ptr<PcmSource> source, int crossfadeMs, float gain = 1.0f);
+    void stopVoice(int id);
+    void stopAll();
+    void seekVoice(int id, qint64 ms);
+    void setVoiceGain(int id, float gain);
+    // Destroys the sources retired by mix() so far. One non-realtime thread
+    // at a time.
+    void releaseRetired();
+
+    // Mixing thread only
+    size_t mix(float *out, size_t frames); // returns the number of voices still playing
+    bool hasRequests() const { return !mailbox_.empty(); } // posted, not yet applied by mix()
+    bool isActive(int id) const;
+    qint64 positionMs(int id) const;
+    // Shortest decode-ahead of the playing voices in microseconds, -1 if
+    // none of them decodes ahead
+    qint64 decodeAheadUs() const;
+    // Voices that played to their end during the last mix(), stopped ones excluded
+    const std::vector<int>& finishedVoices() const { return finished_; }
+    // Voices whose first frames were rendered by the last mix(), including
+    // queued ones that took over from their predecessor
+    const std::vector<StartedVoice>& startedVoices() const { return started_; }
+    // Sources the last mix() handed to the retire queue
+    size_t retiredSources() const { return retired_; }
+
+private:
+    struct Voice {
+        int id = -1;
+        std::shared_ptr<PcmSource> source;
+        PcmFormat format;
+        float gain = 1.0f;
+        float targetGain = 1.0f;    // setVoiceGain(), reached over the next block
+        double step = 1.0;          // source frames per output frame
+        double phase = 0.0;         // resampler position inside `pending`
+        std::vector<float> pending; // converted stereo frames awaiting resampling, reserved up front
+        qint64 baseMs = 0;          // position of the last seek
+        qint64 framesOut = 0;       // output frames rendered since then
+        size_t silent = 0;          // frames of silence the last render() padded a starved source with
+        Clock::time_point triggered;
+        int after = -1;             // queued behind this voice, silent until it ends
+        size_t crossfade = 0;       // output frames a queued voice overlaps its predecessor
+        int fade = 0;               // +1 fading in, -1 fading out (ends with the fade)
+        size_t fadePos = 0;
+        size_t fadeLength = 0;
+        quint64 mixedBlock = 0;     // last block it was rendered into
+        bool rendered = false;      // produced its first frames
+        bool ended = false;
+        bool stopped = false;
+    };
+
+    struct Request {
+        enum Type { Add, Queue, Stop, StopAll, Seek, Gain };
+        explicit Request(Type t = Add) : type(t) {}
+
+        Type type;
+        int id = -1;
+        std::shared_ptr<PcmSource> source;
+        float gain = 1.0f;
+        qint64 ms = 0; // seek target, crossfade length for Queue
+        int after = -1;
+        Clock::time_point triggered;
+    };
+
+    void post(Request request);
+    void retire(std::shared_ptr<PcmSource>& source);
+    void applyRequests();
+    void startVoice(Request& request);
+    void seek(Voice& voice, qint64 ms);
+    size_t render(Voice& voice, float *out, size_t frames);
+    size_t padStarved(Voice& voice, float *out, size_t produced, size_t frames);
+    size_t renderInto(Voice& voice, float *dst, size_t frames);
+    qint64 remainingFrames(const Voice& voice) const;
+    Voice *follower(int id);
+    size_t readConverted(Voice& voice, float *out, size_t frames);
+    Voice *find(int id);
+    const Voice *find(int id) const;
+
+    const int rate_;
+
+    Mailbox<Request> mailbox_;
+    Mailbox<std::shared_ptr<PcmSource>> retireQueue_;
+    size_t retired_ = 0;
+    std::atomic<int> nextId_{0};
+
+    std::array<Voice, kMaxVoices> voices_;
+    size_t active_ = 0;
+    quint64 blockSerial_ = 0;
+    std::vector<int> finished_;
+    std::vector<StartedVoice> started_;
+    std::vector<char> readBuffer_;
+    std::vector<float> voiceBuffer_;
+};
+
+} // namespace soundpad
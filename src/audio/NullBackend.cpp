@@ -0,0 +1,247 @@
+#include "NullBackend.hpp"
+#include "AudioLog.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <QDebug>
+#include <QFile>
+#include <QString>
+#include <QtEndian>
+
+namespace soundpad {
+
+// Output that consumes at the backend's clock. The clock only advances
+// when the stream is looked at, all under the backend lock.
+class NullOutputStream : public OutputStream {
+public:
+    NullOutputStream(NullBackend& backend, const std::string& name, const PcmFormat& format,
+                     uint64_t targetLatencyUs, bool recorded)
+        : backend_(backend), name_(name), format_(format), targetLatencyUs_(targetLatencyUs),
+          targetFrames_(std::max<uint64_t>(1, targetLatencyUs * static_cast<uint64_t>(format.rate) / 1000000)),
+          recorded_(recorded), last_(Clock::now())
+    {
+        AudioBackend::Lock lock(backend_);
+        backend_.outputs_.push_back(this);
+    }
+
+    ~NullOutputStream() override
+    {
+        {
+            AudioBackend::Lock lock(backend_);
+            auto& outputs = backend_.outputs_;
+            outputs.erase(std::remove(outputs.begin(), outputs.end(), this), outputs.end());
+        }
+    }
+
+    bool isReady() const override { return true; }
+
+    size_t writableSize() const override
+    {
+        const uint64_t queued = queuedFrames();
+        const uint64_t free = queued < targetFrames_ ? targetFrames_ - queued : 0;
+        return static_cast<size_t>(free) * static_cast<size_t>(format_.frameBytes());
+    }
+
+    bool write(const void *data, size_t bytes) override
+    {
+        if (bytes > writableSize()) {
+            ++overflows_;
+        }
+        written_ += bytes / static_cast<size_t>(format_.frameBytes());
+        dry_ = false;
+        if (recorded_) {
+            backend_.record(format_, data, bytes);
+        }
+        return true;
+    }
+
+    void flush() override
+    {
+        advance();
+        played_ = static_cast<double>(written_);
+    }
+
+    void beginDrain() override {}
+    void cancelDrain() override {}
+    bool isDrained() const override { return queuedFrames() == 0; }
+
+    uint64_t latencyUs() const override
+    {
+        const double speed = backend_.options_.speed;
+        if (speed <= 0.0) {
+            return 0;
+        }
+        return static_cast<uint64_t>(static_cast<double>(queuedFrames()) * 1e6 / format_.rate / speed);
+    }
+
+    quint64 underflows() const override { return underflows_; }
+    quint64 overflows() const override { return overflows_; }
+
+    const std::string& deviceName() const override { return name_; }
+    const PcmFormat& format() const override { return format_; }
+    uint64_t targetLatencyUs() const override { return targetLatencyUs_; }
+
+    uint64_t queuedFrames() const
+    {
+        advance();
+        return written_ - static_cast<uint64_t>(played_);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void advance() const
+    {
+        const auto now = Clock::now();
+        const double speed = backend_.options_.speed;
+        if (speed <= 0.0) {
+            played_ = static_cast<double>(written_);
+        } else {
+            played_ += std::chrono::duration<double>(now - last_).count() * format_.rate * speed;
+        }
+        last_ = now;
+        if (played_ >= static_cast<double>(written_)) {
+            // Ran dry: count it once, the device plays silence from here
+            if (!dry_ && written_ > 0 && speed > 0.0) {
+                ++underflows_;
+            }
+            dry_ = true;
+            played_ = static_cast<double>(written_);
+        }
+    }
+
+    NullBackend& backend_;
+    std::string name_;
+    PcmFormat format_;
+    uint64_t targetLatencyUs_;
+    uint64_t targetFrames_;
+    bool recorded_;
+    uint64_t written_ = 0;
+    mutable double played_ = 0.0;
+    mutable Clock::time_point last_;
+    mutable bool dry_ = true;
+    mutable quint64 underflows_ = 0;
+    quint64 overflows_ = 0;
+};
+
+// There is nothing to record: never ready, so the engine mixes no mic
+class NullInputStream : public InputStream {
+public:
+    NullInputStream(const std::string& name, int rate, uint64_t fragmentUs)
+        : name_(name), rate_(rate), fragmentUs_(fragmentUs) {}
+
+    bool isReady() const override { return false; }
+    size_t available() const override { return 0; }
+    size_t read(float *, size_t) override { return 0; }
+    size_t discard(size_t) override { return 0; }
+    quint64 overflows() const override { return 0; }
+
+    const std::string& deviceName() const override { return name_; }
+    int rate() const override { return rate_; }
+    uint64_t fragmentUs() const override { return fragmentUs_; }
+    size_t fragmentFrames() const override { return static_cast<size_t>(fragmentUs_ * rate_ / 1000000); }
+
+private:
+    std::string name_;
+    int rate_;
+    uint64_t fragmentUs_;
+};
+
+NullBackend::NullBackend() : NullBackend(Options()) {}
+
+NullBackend::NullBackend(const Options& options)
+    : options_(options)
+{
+    qCDebug(lcAudio) << "[NullBackend] speed" << options_.speed << "wav" << QString::fromStdString(options_.wavPath);
+}
+
+NullBackend::~NullBackend()
+{
+    if (!wav_.isOpen()) {
+        return;
+    }
+    // Sizes of the RIFF and data chunks
+    const qint64 size = wav_.size();
+    char field[4];
+    qToLittleEndian<quint32>(static_cast<quint32>(size - 8), field);
+    wav_.seek(4);
+    wav_.write(field, 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(size - 44), field);
+    wav_.seek(40);
+    wav_.write(field, 4);
+    wav_.close();
+}
+
+// One file for the whole run: the virtual output is reopened whenever the
+// mic latency changes. Lock held.
+void NullBackend::record(const PcmFormat& format, const void *data, size_t bytes)
+{
+    if (options_.wavPath.empty()) {
+        return;
+    }
+    if (!wav_.isOpen()) {
+        wav_.setFileName(QString::fromStdString(options_.wavPath));
+        if (!wav_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qCDebug(lcAudio) << "[NullBackend] Cannot write" << wav_.fileName();
+            options_.wavPath.clear();
+            return;
+        }
+        // RIFF/WAVE with the sizes left open, patched on destruction
+        wavFormat_ = format;
+        char header[44] = {};
+        memcpy(header, "RIFF", 4);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        qToLittleEndian<quint32>(16, header + 16);
+        qToLittleEndian<quint16>(format.sampleFormat == SampleFormat::F32 ? 3 : 1, header + 20);
+        qToLittleEndian<quint16>(static_cast<quint16>(format.channels), header + 22);
+        qToLittleEndian<quint32>(static_cast<quint32>(format.rate), header + 24);
+        qToLittleEndian<quint32>(static_cast<quint32>(format.bytesPerSecond()), header + 28);
+        qToLittleEndian<quint16>(static_cast<quint16>(format.frameBytes()), header + 32);
+        qToLittleEndian<quint16>(static_cast<quint16>(format.bytesPerSample() * 8), header + 34);
+        memcpy(header + 36, "data", 4);
+        wav_.write(header, sizeof(header));
+    }
+    if (format == wavFormat_) {
+        wav_.write(static_cast<const char*>(data), static_cast<qint64>(bytes));
+    }
+}
+
+// While an output has audio queued the worker is woken as the clock frees
+// room in it, otherwise only by signal()
+void NullBackend::wait()
+{
+    uint64_t tickUs = 0;
+    if (options_.speed > 0.0) {
+        for (NullOutputStream *output : outputs_) {
+            if (output->queuedFrames() > 0) {
+                const auto us = static_cast<uint64_t>(output->targetLatencyUs() / 4 / options_.speed);
+                tickUs = tickUs == 0 ? us : std::min(tickUs, us);
+            }
+        }
+    }
+    if (tickUs == 0) {
+        wake_.wait(&mutex_);
+    } else {
+        wake_.wait(&mutex_, static_cast<unsigned long>(std::max<uint64_t>(1, tickUs / 1000)));
+    }
+}
+
+std::unique_ptr<OutputStream> NullBackend::openVirtualOutput(const std::string& sinkName, const PcmFormat& format,
+                                                             uint64_t targetLatencyUs)
+{
+    return std::make_unique<NullOutputStream>(*this, sinkName, format, targetLatencyUs, true);
+}
+
+std::unique_ptr<OutputStream> NullBackend::openOutput(const std::string& sinkName, const std::string&,
+                                                      const PcmFormat& format, uint64_t targetLatencyUs)
+{
+    return std::make_unique<NullOutputStream>(*this, sinkName, format, targetLatencyUs, false);
+}
+
+std::unique_ptr<InputStream> NullBackend::openInput(const std::string& sourceName, const std::string&,
+                                                    int rate, int, uint64_t fragmentUs)
+{
+    return std::make_unique<NullInputStream>(sourceName, rate, fragmentUs);
+}
+
+} // namespace soundpad
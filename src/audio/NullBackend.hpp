@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <QFile>
+#include <QMutex>
+#include <QWaitCondition>
+#include "AudioBackend.hpp"
+
+namespace soundpad {
+
+class NullOutputStream;
+
+// Backend without a sound server, for headless runs, tests and benchmarks.
+// Its outputs play what is written against a clock: real time, `speed`
+// times faster or slower, or with speed 0 as fast as it is written. The
+// virtual mic's audio can be kept as a WAV file. There are no devices and
+// nothing to record from.
+class NullBackend : public AudioBackend {
+public:
+    struct Options {
+        double speed = 1.0;  // 0: no clock, every write is consumed at once
+        std::string wavPath; // where the virtual mic output goes, empty for nowhere
+    };
+
+    NullBackend();
+    explicit NullBackend(const Options& options);
+    ~NullBackend() override;
+
+    const char *name() const override { return "null"; }
+
+    void lock() override { mutex_.lock(); }
+    void unlock() override { mutex_.unlock(); }
+    void wait() override;
+    void signal() override { wake_.wakeAll(); }
+    bool ensureConnected() override { return true; }
+
+    std::vector<AudioDevice> sinks() override { return {}; }
+    std::vector<AudioDevice> sources() override { return {}; }
+    bool hasSink(const std::string&) override { return false; }
+    bool hasSource(const std::string&) override { return false; }
+
+    std::unique_ptr<OutputStream> openVirtualOutput(const std::string& sinkName, const PcmFormat& format,
+                                                    uint64_t targetLatencyUs) override;
+    std::unique_ptr<OutputStream> openOutput(const std::string& sinkName, const std::string& streamName,
+                                             const PcmFormat& format, uint64_t targetLatencyUs) override;
+    std::unique_ptr<InputStream> openInput(const std::string& sourceName, const std::string& streamName,
+                                           int rate, int channels, uint64_t fragmentUs) override;
+
+    const Options& options() const { return options_; }
+
+private:
+    friend class NullOutputStream;
+
+    void record(const PcmFormat& format, const void *data, size_t bytes);
+
+    Options options_;
+    QMutex mutex_;
+    QWaitCondition wake_;
+    std::vector<NullOutputStream*> outputs_; // lock held
+    QFile wav_;
+    PcmFormat wavFormat_;
+};
+
+} // namespace soundpad
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <QtGlobal>
+
+namespace soundpad {
+
+enum class SampleFormat { U8, S16, S24, S32, F32 };
+
+// Layout of interleaved PCM as it is handed to the output streams
+struct PcmFormat {
+    SampleFormat sampleFormat = SampleFormat::S16;
+    int rate = 44100;
+    int channels = 2;
+
+    int bytesPerSample() const {
+        switch (sampleFormat) {
+        case SampleFormat::U8:  return 1;
+        case SampleFormat::S16: return 2;
+        case SampleFormat::S24: return 3;
+        case SampleFormat::S32:
+        case SampleFormat::F32: return 4;
+        }
+        return 2;
+    }
+    int frameBytes() const { return bytesPerSample() * channels; }
+    qint64 bytesPerSecond() const { return static_cast<qint64>(rate) * frameBytes(); }
+
+    bool operator==(const PcmFormat& other) const {
+        return sampleFormat == other.sampleFormat && rate == other.rate && channels == other.channels;
+    }
+    bool operator!=(const PcmFormat& other) const { return !(*this == other); }
+};
+
+// Source of interleaved PCM for the playback thread.
+class PcmSource {
+public:
+    virtual ~PcmSource() = default;
+
+    virtual PcmFormat format() const = 0;
+    // Total PCM size in bytes, -1 if unknown
+    virtual qint64 totalBytes() const = 0;
+    // Copy up to `bytes` of PCM into dst. Never waits: returns 0 at end of
+    // stream or, for sources that decode ahead, when nothing is decoded yet
+    // (see starved()).
+    virtual size_t read(char *dst, size_t bytes) = 0;
+    // Position the next read() at the given PCM byte offset (frame aligned)
+    virtual bool seekToByte(qint64 byte) = 0;
+
+    // Memory-backed sources can hand out their own memory instead of copying:
+    // points *data at up to `bytes` of PCM and advances the read position.
+    // The pointer stays valid for the lifetime of the source.
+    virtual bool supportsView() const { return false; }
+    virtual size_t readView(const char **data, size_t bytes) { (void)data; (void)bytes; return 0; }
+
+    // Sources that decode ahead: bytes ready to be read without waiting,
+    // -1 for sources that never make the reader wait. Reader thread only.
+    virtual qint64 bufferedBytes() const { return -1; }
+    // True if the last read() returned 0 because the source ran dry, not
+    // because it ended; the reader plays silence and tries again later.
+    virtual bool starved() const { return false; }
+};
+
+} // namespace soundpad
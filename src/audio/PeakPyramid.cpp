@@ -0,0 +1,156 @@
+#include "PeakPyramid.hpp"
+#include "MixKernels.hpp"
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace soundpad {
+
+static_assert(sizeof(PeakPyramid::Peak) == 2, "peaks are stored as raw byte pairs");
+
+// Levels stop shrinking once they are this short
+static const size_t kTopPeaks = 8;
+// rate, base frames, frames, level 0 peak count
+static const size_t kHeaderBytes = 4 + 4 + 8 + 4;
+
+static qint8 quantizeDown(float v)
+{
+    return static_cast<qint8>(std::clamp(std::floor(v * 127.0f), -127.0f, 127.0f));
+}
+
+static qint8 quantizeUp(float v)
+{
+    return static_cast<qint8>(std::clamp(std::ceil(v * 127.0f), -127.0f, 127.0f));
+}
+
+static PeakPyramid::Peak merge(PeakPyramid::Peak a, PeakPyramid::Peak b)
+{
+    return { std::min(a.min, b.min), std::max(a.max, b.max) };
+}
+
+void PeakPyramid::begin(int sampleRate)
+{
+    sampleRate_ = sampleRate;
+    frames_ = 0;
+    levels_.assign(1, {});
+    bucketFrames_ = 0;
+}
+
+void PeakPyramid::append(const float *stereo, size_t frames)
+{
+    frames_ += static_cast<qint64>(frames);
+    while (frames > 0) {
+        if (bucketFrames_ == 0) {
+            bucketMin_ = bucketMax_ = stereo[0];
+        }
+        size_t n = std::min(frames, static_cast<size_t>(kBaseFrames - bucketFrames_));
+        mix::peakRange(stereo, n * 2, &bucketMin_, &bucketMax_);
+        bucketFrames_ += static_cast<int>(n);
+        stereo += n * 2;
+        frames -= n;
+        if (bucketFrames_ == kBaseFrames) {
+            flushBucket();
+        }
+    }
+}
+
+void PeakPyramid::flushBucket()
+{
+    levels_[0].push_back({ quantizeDown(bucketMin_), quantizeUp(bucketMax_) });
+    bucketFrames_ = 0;
+}
+
+void PeakPyramid::finish()
+{
+    if (levels_.empty()) {
+        levels_.assign(1, {});
+    }
+    if (bucketFrames_ > 0) {
+        flushBucket();
+    }
+    levels_.resize(1);
+    while (levels_.back().size() > kTopPeaks) {
+        const std::vector<Peak>& below = levels_.back();
+        std::vector<Peak> level((below.size() + 1) / 2);
+        for (size_t i = 0; i < level.size(); ++i) {
+            level[i] = 2 * i + 1 < below.size() ? merge(below[2 * i], below[2 * i + 1]) : below[2 * i];
+        }
+        levels_.push_back(std::move(level));
+    }
+}
+
+void PeakPyramid::render(qint64 startFrame, qint64 endFrame, int columns, Peak *out) const
+{
+    if (columns <= 0) {
+        return;
+    }
+    std::fill(out, out + columns, Peak());
+    if (isEmpty() || endFrame <= startFrame) {
+        return;
+    }
+
+    const double framesPerColumn = static_cast<double>(endFrame - startFrame) / columns;
+    int level = 0;
+    while (level + 1 < levelCount() && (static_cast<qint64>(kBaseFrames) << (level + 1)) <= framesPerColumn) {
+        ++level;
+    }
+    const std::vector<Peak>& peaks = levels_[static_cast<size_t>(level)];
+    const double bucketFrames = static_cast<double>(static_cast<qint64>(kBaseFrames) << level);
+    const qint64 count = static_cast<qint64>(peaks.size());
+
+    for (int c = 0; c < columns; ++c) {
+        const double from = startFrame + c * framesPerColumn;
+        const double to = from + framesPerColumn;
+        qint64 first = static_cast<qint64>(std::floor(from / bucketFrames));
+        qint64 last = std::max(first + 1, static_cast<qint64>(std::ceil(to / bucketFrames)));
+        first = std::max<qint64>(first, 0);
+        last = std::min(last, count);
+        if (first >= last) {
+            continue;
+        }
+        Peak peak = peaks[static_cast<size_t>(first)];
+        for (qint64 i = first + 1; i < last; ++i) {
+            peak = merge(peak, peaks[static_cast<size_t>(i)]);
+        }
+        out[c] = peak;
+    }
+}
+
+// Only level 0 is stored, the coarser levels are rebuilt on load
+std::vector<char> PeakPyramid::serialize() const
+{
+    const size_t count = isEmpty() ? 0 : levels_[0].size();
+    std::vector<char> data(kHeaderBytes + count * 2);
+    char *p = data.data();
+    qToLittleEndian<quint32>(static_cast<quint32>(sampleRate_), p);
+    qToLittleEndian<quint32>(kBaseFrames, p + 4);
+    qToLittleEndian<qint64>(frames_, p + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(count), p + 16);
+    if (count > 0) {
+        std::memcpy(p + kHeaderBytes, levels_[0].data(), count * 2);
+    }
+    return data;
+}
+
+bool PeakPyramid::deserialize(const char *data, size_t size)
+{
+    if (size < kHeaderBytes || qFromLittleEndian<quint32>(data + 4) != static_cast<quint32>(kBaseFrames)) {
+        return false;
+    }
+    const size_t count = qFromLittleEndian<quint32>(data + 16);
+    if (size != kHeaderBytes + count * 2) {
+        return false;
+    }
+    sampleRate_ = static_cast<int>(qFromLittleEndian<quint32>(data));
+    frames_ = qFromLittleEndian<qint64>(data + 8);
+    levels_.assign(1, std::vector<Peak>(count));
+    if (count > 0) {
+        std::memcpy(levels_[0].data(), data + kHeaderBytes, count * 2);
+    }
+    bucketFrames_ = 0;
+    finish();
+    return true;
+}
+
+} // namespace soundpad
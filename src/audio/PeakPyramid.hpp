@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <QtGlobal>
+
+namespace soundpad {
+
+// Min/max envelope of a whole track for waveform drawing. Level 0 holds one
+// peak per kBaseFrames frames (both channels folded together), every further
+// level halves the resolution of the one below, down to a handful of peaks.
+// Peaks are 8-bit, so a three minute clip takes about 60 KiB in total and
+// any zoom level is drawn from a few peaks per pixel without touching PCM.
+class PeakPyramid {
+public:
+    static constexpr int kBaseFrames = 512;
+
+    struct Peak {
+        qint8 min = 0; // sample * 127, rounded outwards
+        qint8 max = 0;
+    };
+
+    // Incremental build from interleaved stereo float, as produced by
+    // mix::toStereoFloat: begin(), append() the whole track, finish().
+    void begin(int sampleRate);
+    void append(const float *stereo, size_t frames);
+    void finish();
+
+    bool isEmpty() const { return levels_.empty() || levels_[0].empty(); }
+    int sampleRate() const { return sampleRate_; }
+    qint64 frames() const { return frames_; }
+    int levelCount() const { return static_cast<int>(levels_.size()); }
+
+    // One peak per column for the frames [startFrame, endFrame), read from
+    // the coarsest level that still has at least one peak per column.
+    void render(qint64 startFrame, qint64 endFrame, int columns, Peak *out) const;
+
+    // Compact little-endian encoding for sidecar files
+    std::vector<char> serialize() const;
+    bool deserialize(const char *data, size_t size);
+
+private:
+    void flushBucket();
+
+    int sampleRate_ = 0;
+    qint64 frames_ = 0;
+    std::vector<std::vector<Peak>> levels_;
+
+    // Bucket being filled by append()
+    float bucketMin_ = 0.0f;
+    float bucketMax_ = 0.0f;
+    int bucketFrames_ = 0;
+};
+
+} // namespace soundpad
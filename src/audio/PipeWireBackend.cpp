@@ -0,0 +1,610 @@
+#include "PipeWireBackend.hpp"
+#include "AudioLog.hpp"
+#include "SpscRing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QString>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/builder.h>
+
+namespace soundpad {
+
+// EnumFormat of float audio; the adapter converts to whatever the node at
+// the other end runs at
+static const spa_pod *floatFormat(spa_pod_builder *builder, int rate, int channels)
+{
+    spa_audio_info_raw info;
+    memset(&info, 0, sizeof(info));
+    info.format = SPA_AUDIO_FORMAT_F32;
+    info.rate = static_cast<uint32_t>(rate);
+    info.channels = static_cast<uint32_t>(channels);
+    if (channels == 2) {
+        info.position[0] = SPA_AUDIO_CHANNEL_FL;
+        info.position[1] = SPA_AUDIO_CHANNEL_FR;
+    }
+    return spa_format_audio_raw_build(builder, SPA_PARAM_EnumFormat, &info);
+}
+
+// Lets the session manager link the stream to exactly this device, and
+// not to the default one when it goes away
+static void setTarget(pw_properties *props, const std::string& target)
+{
+    if (!target.empty()) {
+        pw_properties_set(props, "target.object", target.c_str());
+        pw_properties_set(props, PW_KEY_NODE_DONT_RECONNECT, "true");
+    }
+}
+
+static bool isConnected(pw_stream *stream)
+{
+    const pw_stream_state state = pw_stream_get_state(stream, nullptr);
+    return state == PW_STREAM_STATE_PAUSED || state == PW_STREAM_STATE_STREAMING;
+}
+
+// Until the node exists (paused) or the stream failed. Lock held.
+static void waitConnected(PipeWireBackend& backend, pw_stream *stream, const std::string& target)
+{
+    while (true) {
+        const char *error = nullptr;
+        const pw_stream_state state = pw_stream_get_state(stream, &error);
+        if (state == PW_STREAM_STATE_PAUSED || state == PW_STREAM_STATE_STREAMING) {
+            return;
+        }
+        if (state == PW_STREAM_STATE_ERROR || state == PW_STREAM_STATE_UNCONNECTED) {
+            qCDebug(lcAudio) << "[PipeWireBackend] Stream failed for" << QString::fromStdString(target)
+                     << ":" << (error ? error : "disconnected");
+            return;
+        }
+        backend.wait();
+    }
+}
+
+// Playback stream. The worker fills a ring up to the target latency, the
+// process callback (on the loop thread, lock held) empties it into the
+// buffers the graph asks for and wakes the worker. While the graph does not
+// run the stream (not linked, device suspended) writes are dropped, as a
+// sink playing nowhere would, so it never holds back the other output.
+class PipeWireOutputStream : public OutputStream {
+public:
+    PipeWireOutputStream(PipeWireBackend& backend, const std::string& target, const std::string& streamName,
+                         const PcmFormat& format, uint64_t targetLatencyUs, pw_properties *props, bool autoconnect)
+        : backend_(backend), target_(target), format_(format), targetLatencyUs_(targetLatencyUs),
+          targetFrames_(std::max<size_t>(1, static_cast<size_t>(targetLatencyUs * format.rate / 1000000))),
+          ring_(std::max<size_t>(targetFrames_ * 4, 8192) * static_cast<size_t>(format.channels))
+    {
+        if (format.sampleFormat != SampleFormat::F32 || !backend_.ensureConnected()) {
+            pw_properties_free(props);
+            return;
+        }
+        pw_properties_set(props, PW_KEY_MEDIA_TYPE, "Audio");
+        // A graph quantum of half the target keeps the ring from running dry between cycles
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%zu/%d", std::max<size_t>(targetFrames_ / 2, 32), format.rate);
+
+        AudioBackend::Lock lock(backend_);
+        stream_ = pw_stream_new(backend_.core(), streamName.c_str(), props);
+        if (!stream_) {
+            qCDebug(lcAudio) << "[PipeWireBackend] pw_stream_new failed:" << strerror(errno);
+            return;
+        }
+        static const pw_stream_events events = [] {
+            pw_stream_events e;
+            memset(&e, 0, sizeof(e));
+            e.version = PW_VERSION_STREAM_EVENTS;
+            e.state_changed = [](void *data, pw_stream_state, pw_stream_state, const char *) {
+                static_cast<PipeWireOutputStream*>(data)->backend_.signal();
+            };
+            e.process = [](void *data) {
+                static_cast<PipeWireOutputStream*>(data)->process();
+            };
+            return e;
+        }();
+        memset(&listener_, 0, sizeof(listener_));
+        pw_stream_add_listener(stream_, &listener_, &events, this);
+
+        uint8_t buffer[1024];
+        spa_pod_builder builder;
+        spa_pod_builder_init(&builder, buffer, sizeof(buffer));
+        const spa_pod *params[1] = { floatFormat(&builder, format.rate, format.channels) };
+        const auto flags = static_cast<pw_stream_flags>(PW_STREAM_FLAG_MAP_BUFFERS
+                                                        | (autoconnect ? PW_STREAM_FLAG_AUTOCONNECT : 0));
+        if (pw_stream_connect(stream_, PW_DIRECTION_OUTPUT, PW_ID_ANY, flags, params, 1) < 0) {
+            qCDebug(lcAudio) << "[PipeWireBackend] Failed to connect stream to" << QString::fromStdString(target_);
+            return;
+        }
+        waitConnected(backend_, stream_, target_);
+    }
+
+    ~PipeWireOutputStream() override
+    {
+        if (!stream_) {
+            return;
+        }
+        AudioBackend::Lock lock(backend_);
+        spa_hook_remove(&listener_);
+        pw_stream_destroy(stream_);
+    }
+
+    bool isReady() const override { return stream_ && isConnected(stream_); }
+
+    size_t writableSize() const override
+    {
+        if (!isReady()) {
+            return 0;
+        }
+        const size_t queued = running() ? queuedFrames() : 0;
+        return (queued < targetFrames_ ? targetFrames_ - queued : 0) * static_cast<size_t>(format_.frameBytes());
+    }
+
+    bool write(const void *data, size_t bytes) override
+    {
+        if (!running()) {
+            return isReady();
+        }
+        const size_t samples = bytes / sizeof(float);
+        if (ring_.push(static_cast<const float*>(data), samples) < samples) {
+            ++overflows_;
+        }
+        dry_ = false;
+        return true;
+    }
+
+    // The consumer runs under the same lock, so the ring may be emptied from here
+    void flush() override
+    {
+        ring_.discard(ring_.readAvailable());
+        if (isReady()) {
+            pw_stream_flush(stream_, false);
+        }
+    }
+
+    // Drained once the ring is empty; the graph still plays its last quantum
+    void beginDrain() override {}
+    void cancelDrain() override {}
+    bool isDrained() const override { return !running() || ring_.readAvailable() == 0; }
+
+    uint64_t latencyUs() const override
+    {
+        if (!isReady()) {
+            return 0;
+        }
+        uint64_t graphUs = 0;
+        pw_time time;
+        memset(&time, 0, sizeof(time));
+        if (pw_stream_get_time_n(stream_, &time, sizeof(time)) == 0 && time.rate.denom > 0 && time.delay > 0) {
+            graphUs = static_cast<uint64_t>(time.delay) * 1000000 * time.rate.num / time.rate.denom;
+        }
+        return graphUs + queuedFrames() * 1000000 / static_cast<uint64_t>(format_.rate);
+    }
+
+    quint64 underflows() const override { return underflows_; }
+    quint64 overflows() const override { return overflows_; }
+
+    const std::string& deviceName() const override { return target_; }
+    const PcmFormat& format() const override { return format_; }
+    uint64_t targetLatencyUs() const override { return targetLatencyUs_; }
+
+private:
+    bool running() const
+    {
+        return stream_ && pw_stream_get_state(stream_, nullptr) == PW_STREAM_STATE_STREAMING;
+    }
+
+    size_t queuedFrames() const { return ring_.readAvailable() / static_cast<size_t>(format_.channels); }
+
+    void process()
+    {
+        pw_buffer *b = pw_stream_dequeue_buffer(stream_);
+        if (!b) {
+            return;
+        }
+        spa_data& d = b->buffer->datas[0];
+        if (d.data) {
+            const size_t channels = static_cast<size_t>(format_.channels);
+            const uint32_t stride = static_cast<uint32_t>(sizeof(float) * channels);
+            size_t frames = d.maxsize / stride;
+            if (b->requested > 0) {
+                frames = std::min<size_t>(frames, b->requested);
+            }
+            auto *dst = static_cast<float*>(d.data);
+            const size_t got = ring_.pop(dst, frames * channels) / channels;
+            if (got < frames) {
+                std::fill(dst + got * channels, dst + frames * channels, 0.0f);
+                // Once per time it runs dry, like a server-side underflow
+                if (!dry_) {
+                    ++underflows_;
+                }
+                dry_ = true;
+            }
+            d.chunk->offset = 0;
+            d.chunk->stride = static_cast<int32_t>(stride);
+            d.chunk->size = static_cast<uint32_t>(frames * stride);
+        }
+        pw_stream_queue_buffer(stream_, b);
+        backend_.signal();
+    }
+
+    PipeWireBackend& backend_;
+    std::string target_;
+    PcmFormat format_;
+    uint64_t targetLatencyUs_;
+    size_t targetFrames_;
+    pw_stream *stream_ = nullptr;
+    spa_hook listener_;
+    SpscRing<float> ring_;
+    bool dry_ = true;
+    quint64 underflows_ = 0;
+    quint64 overflows_ = 0;
+};
+
+// Record stream: the process callback pushes each buffer into a ring, the
+// worker takes frames out without the lock. The quantum asked for is the
+// fragment size.
+class PipeWireInputStream : public InputStream {
+public:
+    PipeWireInputStream(PipeWireBackend& backend, const std::string& source, const std::string& streamName,
+                        int rate, int channels, uint64_t fragmentUs)
+        : backend_(backend), source_(source), rate_(rate), channels_(channels), fragmentUs_(fragmentUs),
+          fragmentFrames_(std::max<size_t>(1, static_cast<size_t>(fragmentUs * static_cast<uint64_t>(rate) / 1000000))),
+          ring_(std::max(fragmentFrames_ * 8, static_cast<size_t>(rate) / 2) * static_cast<size_t>(channels))
+    {
+        if (!backend_.ensureConnected()) {
+            return;
+        }
+        pw_properties *props = pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_CATEGORY, "Capture",
+                                                 nullptr);
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%zu/%d", fragmentFrames_, rate);
+        setTarget(props, source_);
+
+        AudioBackend::Lock lock(backend_);
+        stream_ = pw_stream_new(backend_.core(), streamName.c_str(), props);
+        if (!stream_) {
+            qCDebug(lcAudio) << "[PipeWireBackend] pw_stream_new failed:" << strerror(errno);
+            return;
+        }
+        static const pw_stream_events events = [] {
+            pw_stream_events e;
+            memset(&e, 0, sizeof(e));
+            e.version = PW_VERSION_STREAM_EVENTS;
+            e.state_changed = [](void *data, pw_stream_state, pw_stream_state, const char *) {
+                static_cast<PipeWireInputStream*>(data)->backend_.signal();
+            };
+            e.process = [](void *data) {
+                static_cast<PipeWireInputStream*>(data)->process();
+            };
+            return e;
+        }();
+        memset(&listener_, 0, sizeof(listener_));
+        pw_stream_add_listener(stream_, &listener_, &events, this);
+
+        uint8_t buffer[1024];
+        spa_pod_builder builder;
+        spa_pod_builder_init(&builder, buffer, sizeof(buffer));
+        const spa_pod *params[1] = { floatFormat(&builder, rate, channels) };
+        const auto flags = static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS);
+        if (pw_stream_connect(stream_, PW_DIRECTION_INPUT, PW_ID_ANY, flags, params, 1) < 0) {
+            qCDebug(lcAudio) << "[PipeWireBackend] Failed to connect stream to" << QString::fromStdString(source_);
+            return;
+        }
+        waitConnected(backend_, stream_, source_);
+    }
+
+    ~PipeWireInputStream() override
+    {
+        if (!stream_) {
+            return;
+        }
+        AudioBackend::Lock lock(backend_);
+        spa_hook_remove(&listener_);
+        pw_stream_destroy(stream_);
+    }
+
+    bool isReady() const override { return stream_ && isConnected(stream_); }
+
+    size_t available() const override { return ring_.readAvailable() / static_cast<size_t>(channels_); }
+
+    size_t read(float *out, size_t frames) override
+    {
+        const size_t channels = static_cast<size_t>(channels_);
+        return ring_.pop(out, frames * channels) / channels;
+    }
+
+    size_t discard(size_t frames) override
+    {
+        const size_t channels = static_cast<size_t>(channels_);
+        return ring_.discard(frames * channels) / channels;
+    }
+
+    quint64 overflows() const override { return overflows_; }
+
+    const std::string& deviceName() const override { return source_; }
+    int rate() const override { return rate_; }
+    uint64_t fragmentUs() const override { return fragmentUs_; }
+    size_t fragmentFrames() const override { return fragmentFrames_; }
+
+private:
+    void process()
+    {
+        pw_buffer *b = pw_stream_dequeue_buffer(stream_);
+        if (!b) {
+            return;
+        }
+        const spa_data& d = b->buffer->datas[0];
+        if (d.data && d.chunk->size > 0) {
+            const auto *src = reinterpret_cast<const float*>(static_cast<const char*>(d.data) + d.chunk->offset);
+            const size_t samples = std::min(d.chunk->size, d.maxsize - d.chunk->offset) / sizeof(float);
+            if (ring_.push(src, samples) < samples) {
+                ++overflows_;
+            }
+        }
+        pw_stream_queue_buffer(stream_, b);
+    }
+
+    PipeWireBackend& backend_;
+    std::string source_;
+    int rate_;
+    int channels_;
+    uint64_t fragmentUs_;
+    size_t fragmentFrames_;
+    pw_stream *stream_ = nullptr;
+    spa_hook listener_;
+    SpscRing<float> ring_;
+    std::atomic<quint64> overflows_{0};
+};
+
+PipeWireBackend::PipeWireBackend(const std::string& clientName)
+    : clientName_(clientName)
+{
+    pw_init(nullptr, nullptr);
+    loop_ = pw_thread_loop_new("funnypad-pipewire", nullptr);
+    context_ = pw_context_new(pw_thread_loop_get_loop(loop_), nullptr, 0);
+    if (pw_thread_loop_start(loop_) < 0) {
+        qCDebug(lcAudio) << "[PipeWireBackend] Failed to start thread loop";
+    }
+}
+
+PipeWireBackend::~PipeWireBackend()
+{
+    // No callbacks from here on
+    pw_thread_loop_stop(loop_);
+    if (core_) {
+        retireCore();
+    }
+    for (pw_core *core : retired_) {
+        pw_core_disconnect(core);
+    }
+    pw_context_destroy(context_);
+    pw_thread_loop_destroy(loop_);
+    pw_deinit();
+}
+
+// Lock held
+void PipeWireBackend::retireCore()
+{
+    spa_hook_remove(&registryListener_);
+    spa_hook_remove(&coreListener_);
+    pw_proxy_destroy(reinterpret_cast<pw_proxy*>(registry_));
+    retired_.push_back(core_);
+    registry_ = nullptr;
+    core_ = nullptr;
+    synced_ = false;
+
+    // Ids of the old connection mean nothing to the new one
+    std::vector<AudioDevice> gone;
+    {
+        QMutexLocker locker(&devicesMutex_);
+        for (const auto& entry : devices_) {
+            gone.push_back(entry.second);
+        }
+        devices_.clear();
+    }
+    for (const auto& device : gone) {
+        notifyDevice(DeviceChange::Removed, device);
+    }
+}
+
+bool PipeWireBackend::ensureConnected()
+{
+    Lock lock(*this);
+    if (core_ && !broken_) {
+        return true;
+    }
+    if (core_) {
+        qCDebug(lcAudio) << "[PipeWireBackend] Connection lost, reconnecting";
+        retireCore();
+    }
+
+    core_ = pw_context_connect(context_, pw_properties_new(PW_KEY_APP_NAME, clientName_.c_str(), nullptr), 0);
+    if (!core_) {
+        qCDebug(lcAudio) << "[PipeWireBackend] Failed to connect:" << strerror(errno);
+        return false;
+    }
+    broken_ = false;
+
+    static const pw_core_events coreEvents = [] {
+        pw_core_events e;
+        memset(&e, 0, sizeof(e));
+        e.version = PW_VERSION_CORE_EVENTS;
+        e.done = &PipeWireBackend::coreDone;
+        e.error = &PipeWireBackend::coreError;
+        return e;
+    }();
+    static const pw_registry_events registryEvents = [] {
+        pw_registry_events e;
+        memset(&e, 0, sizeof(e));
+        e.version = PW_VERSION_REGISTRY_EVENTS;
+        e.global = &PipeWireBackend::registryGlobal;
+        e.global_remove = &PipeWireBackend::registryGlobalRemove;
+        return e;
+    }();
+    memset(&coreListener_, 0, sizeof(coreListener_));
+    pw_core_add_listener(core_, &coreListener_, &coreEvents, this);
+    registry_ = pw_core_get_registry(core_, PW_VERSION_REGISTRY, 0);
+    memset(&registryListener_, 0, sizeof(registryListener_));
+    pw_registry_add_listener(registry_, &registryListener_, &registryEvents, this);
+    // Answered after every global that exists now has been announced
+    syncSeq_ = pw_core_sync(core_, PW_ID_CORE, 0);
+    return true;
+}
+
+bool PipeWireBackend::waitSynced()
+{
+    if (!ensureConnected()) {
+        return false;
+    }
+    Lock lock(*this);
+    while (!synced_ && !broken_) {
+        wait();
+    }
+    return synced_;
+}
+
+void PipeWireBackend::coreDone(void *data, uint32_t id, int seq)
+{
+    auto *self = static_cast<PipeWireBackend*>(data);
+    if (id == PW_ID_CORE && seq == self->syncSeq_) {
+        self->synced_ = true;
+        self->signal();
+    }
+}
+
+void PipeWireBackend::coreError(void *data, uint32_t id, int, int res, const char *message)
+{
+    auto *self = static_cast<PipeWireBackend*>(data);
+    qCDebug(lcAudio) << "[PipeWireBackend] Error on" << id << ":" << (message ? message : "");
+    if (id == PW_ID_CORE && res == -EPIPE) {
+        self->broken_ = true;
+    }
+    self->signal();
+}
+
+void PipeWireBackend::registryGlobal(void *data, uint32_t id, uint32_t, const char *type, uint32_t,
+                                     const spa_dict *props)
+{
+    auto *self = static_cast<PipeWireBackend*>(data);
+    if (!props || strcmp(type, PW_TYPE_INTERFACE_Node) != 0) {
+        return;
+    }
+    const char *mediaClass = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
+    const char *name = spa_dict_lookup(props, PW_KEY_NODE_NAME);
+    if (!mediaClass || !name) {
+        return;
+    }
+    AudioDevice device;
+    if (strcmp(mediaClass, "Audio/Sink") == 0) {
+        device.kind = AudioDevice::Sink;
+    } else if (strcmp(mediaClass, "Audio/Source") == 0 || strcmp(mediaClass, "Audio/Source/Virtual") == 0) {
+        device.kind = AudioDevice::Source;
+    } else {
+        return;
+    }
+    const char *description = spa_dict_lookup(props, PW_KEY_NODE_DESCRIPTION);
+    if (!description) {
+        description = spa_dict_lookup(props, PW_KEY_NODE_NICK);
+    }
+    device.index = id;
+    device.name = name;
+    device.description = description ? description : name;
+    {
+        QMutexLocker locker(&self->devicesMutex_);
+        self->devices_[id] = device;
+    }
+    self->notifyDevice(DeviceChange::Added, device);
+}
+
+void PipeWireBackend::registryGlobalRemove(void *data, uint32_t id)
+{
+    auto *self = static_cast<PipeWireBackend*>(data);
+    AudioDevice removed;
+    {
+        QMutexLocker locker(&self->devicesMutex_);
+        auto it = self->devices_.find(id);
+        if (it == self->devices_.end()) {
+            return;
+        }
+        removed = it->second;
+        self->devices_.erase(it);
+    }
+    self->notifyDevice(DeviceChange::Removed, removed);
+}
+
+std::vector<AudioDevice> PipeWireBackend::list(AudioDevice::Kind kind)
+{
+    waitSynced();
+    std::vector<AudioDevice> devices;
+    {
+        QMutexLocker locker(&devicesMutex_);
+        for (const auto& entry : devices_) {
+            if (entry.second.kind == kind) {
+                devices.push_back(entry.second);
+            }
+        }
+    }
+    std::sort(devices.begin(), devices.end(), [](const AudioDevice& a, const AudioDevice& b) {
+        return a.index < b.index;
+    });
+    return devices;
+}
+
+bool PipeWireBackend::has(AudioDevice::Kind kind, const std::string& name)
+{
+    waitSynced();
+    QMutexLocker locker(&devicesMutex_);
+    return std::any_of(devices_.begin(), devices_.end(), [&](const auto& entry) {
+        return entry.second.kind == kind && entry.second.name == name;
+    });
+}
+
+std::vector<AudioDevice> PipeWireBackend::sinks()
+{
+    return list(AudioDevice::Sink);
+}
+
+std::vector<AudioDevice> PipeWireBackend::sources()
+{
+    return list(AudioDevice::Source);
+}
+
+bool PipeWireBackend::hasSink(const std::string& name)
+{
+    return has(AudioDevice::Sink, name);
+}
+
+bool PipeWireBackend::hasSource(const std::string& name)
+{
+    return has(AudioDevice::Source, name);
+}
+
+// The stream itself is the source applications record: it lives as long
+// as the engine keeps it open. always-process keeps it scheduled while
+// nobody records, so the mix keeps flowing through it.
+std::unique_ptr<OutputStream> PipeWireBackend::openVirtualOutput(const std::string&, const PcmFormat& format,
+                                                                 uint64_t targetLatencyUs)
+{
+    pw_properties *props = pw_properties_new(PW_KEY_MEDIA_CLASS, "Audio/Source",
+                                             PW_KEY_NODE_NAME, "VirtualMic",
+                                             PW_KEY_NODE_DESCRIPTION, "VirtualMic",
+                                             "node.always-process", "true",
+                                             nullptr);
+    return std::make_unique<PipeWireOutputStream>(*this, "VirtualMic", "virtual-playback", format, targetLatencyUs,
+                                                  props, false);
+}
+
+std::unique_ptr<OutputStream> PipeWireBackend::openOutput(const std::string& sinkName, const std::string& streamName,
+                                                          const PcmFormat& format, uint64_t targetLatencyUs)
+{
+    pw_properties *props = pw_properties_new(PW_KEY_MEDIA_CATEGORY, "Playback", nullptr);
+    setTarget(props, sinkName);
+    return std::make_unique<PipeWireOutputStream>(*this, sinkName, streamName, format, targetLatencyUs, props, true);
+}
+
+std::unique_ptr<InputStream> PipeWireBackend::openInput(const std::string& sourceName, const std::string& streamName,
+                                                        int rate, int channels, uint64_t fragmentUs)
+{
+    return std::make_unique<PipeWireInputStream>(*this, sourceName, streamName, rate, channels, fragmentUs);
+}
+
+} // namespace soundpad
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <QMutex>
+#include <pipewire/pipewire.h>
+#include "AudioBackend.hpp"
+
+namespace soundpad {
+
+// Native PipeWire client on a pw_thread_loop. The virtual mic is our own
+// stream published as an Audio/Source node, so nothing sits between the
+// mix and the applications recording it: no null sink, no remap, no
+// server-side buffering of its own. Sinks and sources come from the
+// registry as they appear and go; description changes are not followed.
+class PipeWireBackend : public AudioBackend {
+public:
+    explicit PipeWireBackend(const std::string& clientName);
+    ~PipeWireBackend() override;
+
+    const char *name() const override { return "pipewire"; }
+
+    void lock() override { pw_thread_loop_lock(loop_); }
+    void unlock() override { pw_thread_loop_unlock(loop_); }
+    void wait() override { pw_thread_loop_wait(loop_); }
+    void signal() override { pw_thread_loop_signal(loop_, false); }
+    bool ensureConnected() override;
+
+    std::vector<AudioDevice> sinks() override;
+    std::vector<AudioDevice> sources() override;
+    bool hasSink(const std::string& name) override;
+    bool hasSource(const std::string& name) override;
+
+    std::unique_ptr<OutputStream> openVirtualOutput(const std::string& sinkName, const PcmFormat& format,
+                                                    uint64_t targetLatencyUs) override;
+    std::unique_ptr<OutputStream> openOutput(const std::string& sinkName, const std::string& streamName,
+                                             const PcmFormat& format, uint64_t targetLatencyUs) override;
+    std::unique_ptr<InputStream> openInput(const std::string& sourceName, const std::string& streamName,
+                                           int rate, int channels, uint64_t fragmentUs) override;
+
+    pw_core *core() const { return core_; } // lock held
+    pw_thread_loop *loop() const { return loop_; }
+
+private:
+    // Loop thread
+    static void coreDone(void *data, uint32_t id, int seq);
+    static void coreError(void *data, uint32_t id, int seq, int res, const char *message);
+    static void registryGlobal(void *data, uint32_t id, uint32_t permissions, const char *type,
+                               uint32_t version, const spa_dict *props);
+    static void registryGlobalRemove(void *data, uint32_t id);
+
+    bool waitSynced();
+    std::vector<AudioDevice> list(AudioDevice::Kind kind);
+    bool has(AudioDevice::Kind kind, const std::string& name);
+    void retireCore(); // lock held
+
+    std::string clientName_;
+    pw_thread_loop *loop_ = nullptr;
+    pw_context *context_ = nullptr;
+    pw_core *core_ = nullptr;
+    pw_registry *registry_ = nullptr;
+    spa_hook coreListener_;
+    spa_hook registryListener_;
+    // Cores of earlier connections: streams made on them may still be
+    // alive, they are disconnected on destruction
+    std::vector<pw_core*> retired_;
+    int syncSeq_ = 0;
+    bool synced_ = false; // first registry listing complete
+    bool broken_ = false; // the server went away, reconnect on next use
+    mutable QMutex devicesMutex_;
+    std::unordered_map<uint32_t, AudioDevice> devices_; // by global id
+};
+
+} // namespace soundpad
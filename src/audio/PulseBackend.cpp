@@ -0,0 +1,160 @@
+#include "PulseBackend.hpp"
+#include "AudioLog.hpp"
+#include "PulseInputStream.hpp"
+#include "PulseOutputStream.hpp"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QString>
+
+namespace soundpad {
+
+PulseBackend::PulseBackend(const std::string& clientName)
+    : pulse_(clientName)
+{
+    devices_ = std::make_unique<DeviceRegistry>(pulse_, [this](DeviceChange change, const AudioDevice& device) {
+        notifyDevice(change, device);
+    });
+}
+
+PulseBackend::~PulseBackend()
+{
+    // Before the context its callbacks run on
+    devices_.reset();
+}
+
+void PulseBackend::lock()
+{
+    pa_threaded_mainloop_lock(pulse_.mainloop());
+}
+
+void PulseBackend::unlock()
+{
+    pa_threaded_mainloop_unlock(pulse_.mainloop());
+}
+
+std::vector<AudioDevice> PulseBackend::sinks()
+{
+    devices_->ensureSynced();
+    return devices_->sinks();
+}
+
+std::vector<AudioDevice> PulseBackend::sources()
+{
+    devices_->ensureSynced();
+    return devices_->sources();
+}
+
+// The registry may not have heard of a sink we just created yet, so only
+// a hit is trusted
+bool PulseBackend::hasSink(const std::string& name)
+{
+    qCDebug(lcAudio) << "[PulseBackend] Checking if sink exists:" << QString::fromStdString(name);
+    return devices_->hasSink(name) || pulse_.hasSink(name);
+}
+
+bool PulseBackend::hasSource(const std::string& name)
+{
+    qCDebug(lcAudio) << "[PulseBackend] Checking if source exists:" << QString::fromStdString(name);
+    return devices_->hasSource(name) || pulse_.hasSource(name);
+}
+
+// Value of `key` in a module argument string ("source=a sink=b ..."), empty if absent
+static std::string moduleArgument(const std::string& argument, const std::string& key)
+{
+    const std::string prefix = key + "=";
+    size_t start = 0;
+    while (start < argument.size()) {
+        size_t end = argument.find(' ', start);
+        if (end == std::string::npos) {
+            end = argument.size();
+        }
+        if (argument.compare(start, prefix.size(), prefix) == 0) {
+            return argument.substr(start + prefix.size(), end - start - prefix.size());
+        }
+        start = end + 1;
+    }
+    return std::string();
+}
+
+// modulesMutex_ held
+void PulseBackend::createNullSink(const std::string& sinkName)
+{
+    qCDebug(lcAudio) << "[PulseBackend] Creating null sink:" << QString::fromStdString(sinkName);
+    nullSinkModule_.index = pulse_.loadModule("module-null-sink",
+                                              "sink_name=" + sinkName + " sink_properties=device.description=" + sinkName);
+    nullSinkModule_.connection = pulse_.connectionId();
+}
+
+// modulesMutex_ held
+void PulseBackend::createRemapSource(const std::string& masterMonitor, const std::string& sourceName)
+{
+    qCDebug(lcAudio) << "[PulseBackend] Creating remap source:" << QString::fromStdString(sourceName)
+             << "from master:" << QString::fromStdString(masterMonitor);
+    remapModule_.index = pulse_.loadModule("module-remap-source",
+                                           "master=" + masterMonitor +
+                                           " source_name=" + sourceName +
+                                           " source_properties=device.description=" + sourceName);
+    remapModule_.connection = pulse_.connectionId();
+}
+
+// Serialised, so that two threads never both create the sink
+void PulseBackend::ensureVirtualDevices(const std::string& sinkName)
+{
+    qCDebug(lcAudio) << "[PulseBackend] Ensuring audio objects exist for sink:" << QString::fromStdString(sinkName);
+    QMutexLocker locker(&modulesMutex_);
+    if (!hasSink(sinkName)) {
+        createNullSink(sinkName);
+    }
+    if (!hasSource("VirtualMic")) {
+        createRemapSource(sinkName + ".monitor", "VirtualMic");
+    }
+}
+
+std::unique_ptr<OutputStream> PulseBackend::openVirtualOutput(const std::string& sinkName, const PcmFormat& format,
+                                                              uint64_t targetLatencyUs)
+{
+    ensureVirtualDevices(sinkName);
+    return std::make_unique<PulseOutputStream>(pulse_, sinkName, "virtual-playback", format, targetLatencyUs);
+}
+
+std::unique_ptr<OutputStream> PulseBackend::openOutput(const std::string& sinkName, const std::string& streamName,
+                                                       const PcmFormat& format, uint64_t targetLatencyUs)
+{
+    return std::make_unique<PulseOutputStream>(pulse_, sinkName, streamName, format, targetLatencyUs);
+}
+
+std::unique_ptr<InputStream> PulseBackend::openInput(const std::string& sourceName, const std::string& streamName,
+                                                     int rate, int channels, uint64_t fragmentUs)
+{
+    return std::make_unique<PulseInputStream>(pulse_, sourceName, streamName, rate, channels, fragmentUs);
+}
+
+// Older versions merged the mic with a pactl-loaded module-loopback that
+// outlived the app; left in place it plays the mic twice. This process never
+// loads one, so any loopback into the sink is someone else's to remove.
+void PulseBackend::checkMicRoutes(const std::string& sinkName)
+{
+    for (const auto& module : pulse_.moduleList()) {
+        if (module.name == "module-loopback" && moduleArgument(module.argument, "sink") == sinkName) {
+            qWarning() << "[PulseBackend] Loopback module" << module.index << "also feeds" << QString::fromStdString(sinkName)
+                       << "(" << QString::fromStdString(module.argument) << "), unload it with pactl if the mic is heard twice";
+        }
+    }
+}
+
+// The remap source reading the sink first, the sink last
+void PulseBackend::releaseVirtualDevices()
+{
+    QMutexLocker locker(&modulesMutex_);
+    for (OwnedModule *module : { &remapModule_, &nullSinkModule_ }) {
+        // Indices of a connection that has since been replaced may name other modules now
+        if (module->index != PA_INVALID_INDEX && pulse_.ensureConnected()
+            && module->connection == pulse_.connectionId()) {
+            qCDebug(lcAudio) << "[PulseBackend] Unloading module" << module->index;
+            pulse_.unloadModule(module->index);
+        }
+        *module = OwnedModule();
+    }
+}
+
+} // namespace soundpad
@@ -0,0 +1,59 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <QMutex>
+#include "AudioBackend.hpp"
+#include "DeviceRegistry.hpp"
+#include "PulseContext.hpp"
+
+namespace soundpad {
+
+// PulseAudio (or pipewire-pulse) through one shared PulseContext. The
+// virtual mic is a null sink the mix is played into plus a remap source of
+// its monitor, both loaded as modules on first use.
+class PulseBackend : public AudioBackend {
+public:
+    explicit PulseBackend(const std::string& clientName);
+    ~PulseBackend() override;
+
+    const char *name() const override { return "pulse"; }
+
+    void lock() override;
+    void unlock() override;
+    void wait() override { pulse_.wait(); }
+    void signal() override { pulse_.signal(); }
+    bool ensureConnected() override { return pulse_.ensureConnected(); }
+
+    std::vector<AudioDevice> sinks() override;
+    std::vector<AudioDevice> sources() override;
+    bool hasSink(const std::string& name) override;
+    bool hasSource(const std::string& name) override;
+
+    std::unique_ptr<OutputStream> openVirtualOutput(const std::string& sinkName, const PcmFormat& format,
+                                                    uint64_t targetLatencyUs) override;
+    std::unique_ptr<OutputStream> openOutput(const std::string& sinkName, const std::string& streamName,
+                                             const PcmFormat& format, uint64_t targetLatencyUs) override;
+    std::unique_ptr<InputStream> openInput(const std::string& sourceName, const std::string& streamName,
+                                           int rate, int channels, uint64_t fragmentUs) override;
+    void checkMicRoutes(const std::string& sinkName) override;
+    void releaseVirtualDevices() override;
+
+private:
+    void ensureVirtualDevices(const std::string& sinkName);
+    void createNullSink(const std::string& sinkName);
+    void createRemapSource(const std::string& masterMonitor, const std::string& sourceName);
+
+    PulseContext pulse_;
+    std::unique_ptr<DeviceRegistry> devices_;
+    // Modules this instance loaded, unloaded on exit. Ones that already
+    // existed, e.g. set up with pactl, are left alone.
+    struct OwnedModule {
+        uint32_t index = PA_INVALID_INDEX;
+        uint64_t connection = 0; // PulseContext::connectionId() it belongs to
+    };
+    QMutex modulesMutex_; // never taken with the PulseContext lock held
+    OwnedModule nullSinkModule_;
+    OwnedModule remapModule_;
+};
+
+} // namespace soundpad
@@ -0,0 +1,217 @@
+#include "PulseContext.hpp"
+#include "AudioLog.hpp"
+#include <QDebug>
+#include <QString>
+
+namespace soundpad {
+
+PulseContext::PulseContext(const std::string& clientName)
+    : clientName_(clientName)
+{
+    mainloop_ = pa_threaded_mainloop_new();
+    if (pa_threaded_mainloop_start(mainloop_) < 0) {
+        qCDebug(lcAudio) << "[PulseContext] Failed to start threaded mainloop";
+    }
+}
+
+PulseContext::~PulseContext()
+{
+    {
+        Lock lock(*this);
+        if (context_) {
+            pa_context_set_state_callback(context_, nullptr, nullptr);
+            pa_context_disconnect(context_);
+            pa_context_unref(context_);
+            context_ = nullptr;
+        }
+    }
+    pa_threaded_mainloop_stop(mainloop_);
+    pa_threaded_mainloop_free(mainloop_);
+}
+
+void PulseContext::stateCallback(pa_context *c, void *userdata)
+{
+    auto *self = static_cast<PulseContext*>(userdata);
+    if (pa_context_get_state(c) == PA_CONTEXT_READY && self->readyCallback_) {
+        self->readyCallback_();
+    }
+    self->signal();
+}
+
+void PulseContext::setReadyCallback(std::function<void()> callback)
+{
+    readyCallback_ = std::move(callback);
+}
+
+bool PulseContext::ensureConnected()
+{
+    Lock lock(*this);
+
+    if (context_ && !PA_CONTEXT_IS_GOOD(pa_context_get_state(context_))) {
+        qCDebug(lcAudio) << "[PulseContext] Context is dead, reconnecting";
+        pa_context_set_state_callback(context_, nullptr, nullptr);
+        pa_context_unref(context_);
+        context_ = nullptr;
+    }
+
+    if (!context_) {
+        context_ = pa_context_new(pa_threaded_mainloop_get_api(mainloop_), clientName_.c_str());
+        ++connectionId_;
+        pa_context_set_state_callback(context_, &PulseContext::stateCallback, this);
+        if (pa_context_connect(context_, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
+            qCDebug(lcAudio) << "[PulseContext] Failed to connect context:" << pa_strerror(pa_context_errno(context_));
+            pa_context_unref(context_);
+            context_ = nullptr;
+            return false;
+        }
+    }
+
+    while (true) {
+        pa_context_state_t state = pa_context_get_state(context_);
+        if (state == PA_CONTEXT_READY) {
+            return true;
+        }
+        if (!PA_CONTEXT_IS_GOOD(state)) {
+            qCDebug(lcAudio) << "[PulseContext] Context failed:" << pa_strerror(pa_context_errno(context_));
+            return false;
+        }
+        wait();
+    }
+}
+
+bool PulseContext::isReady() const
+{
+    return context_ && pa_context_get_state(context_) == PA_CONTEXT_READY;
+}
+
+void PulseContext::signal()
+{
+    pa_threaded_mainloop_signal(mainloop_, 0);
+}
+
+void PulseContext::wait()
+{
+    pa_threaded_mainloop_wait(mainloop_);
+}
+
+void PulseContext::waitForOperation(pa_operation *op)
+{
+    if (!op) {
+        return;
+    }
+    pa_operation_set_state_callback(op, [](pa_operation *, void *userdata) {
+        static_cast<PulseContext*>(userdata)->signal();
+    }, this);
+    while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) {
+        wait();
+    }
+    pa_operation_set_state_callback(op, nullptr, nullptr);
+    pa_operation_unref(op);
+}
+
+bool PulseContext::hasSink(const std::string& sinkName)
+{
+    if (!ensureConnected()) {
+        return false;
+    }
+
+    bool found = false;
+    Lock lock(*this);
+    waitForOperation(pa_context_get_sink_info_by_name(
+        context_, sinkName.c_str(),
+        [](pa_context *, const pa_sink_info *info, int eol, void *userdata) {
+            if (!eol && info) {
+                *static_cast<bool*>(userdata) = true;
+            }
+        },
+        &found
+    ));
+    return found;
+}
+
+bool PulseContext::hasSource(const std::string& sourceName)
+{
+    if (!ensureConnected()) {
+        return false;
+    }
+
+    bool found = false;
+    Lock lock(*this);
+    waitForOperation(pa_context_get_source_info_by_name(
+        context_, sourceName.c_str(),
+        [](pa_context *, const pa_source_info *info, int eol, void *userdata) {
+            if (!eol && info) {
+                *static_cast<bool*>(userdata) = true;
+            }
+        },
+        &found
+    ));
+    return found;
+}
+
+std::vector<PulseContext::ModuleInfo> PulseContext::moduleList()
+{
+    std::vector<ModuleInfo> modules;
+    if (!ensureConnected()) {
+        return modules;
+    }
+
+    Lock lock(*this);
+    waitForOperation(pa_context_get_module_info_list(
+        context_,
+        [](pa_context *, const pa_module_info *info, int eol, void *userdata) {
+            if (eol || !info) {
+                return;
+            }
+            auto *list = static_cast<std::vector<ModuleInfo>*>(userdata);
+            list->push_back({ info->index, info->name ? info->name : "", info->argument ? info->argument : "" });
+        },
+        &modules
+    ));
+    return modules;
+}
+
+uint32_t PulseContext::loadModule(const std::string& name, const std::string& args)
+{
+    if (!ensureConnected()) {
+        return PA_INVALID_INDEX;
+    }
+
+    uint32_t index = PA_INVALID_INDEX;
+    Lock lock(*this);
+    waitForOperation(pa_context_load_module(
+        context_, name.c_str(), args.c_str(),
+        [](pa_context *, uint32_t idx, void *userdata) {
+            *static_cast<uint32_t*>(userdata) = idx;
+        },
+        &index
+    ));
+    if (index == PA_INVALID_INDEX) {
+        qCDebug(lcAudio) << "[PulseContext] Failed to load" << QString::fromStdString(name)
+                 << ":" << pa_strerror(pa_context_errno(context_));
+    }
+    return index;
+}
+
+bool PulseContext::unloadModule(uint32_t index)
+{
+    if (!ensureConnected()) {
+        return false;
+    }
+
+    int success = 0;
+    Lock lock(*this);
+    waitForOperation(pa_context_unload_module(
+        context_, index,
+        [](pa_context *, int ok, void *userdata) {
+            *static_cast<int*>(userdata) = ok;
+        },
+        &success
+    ));
+    if (!success) {
+        qCDebug(lcAudio) << "[PulseContext] Failed to unload module" << index << ":" << pa_strerror(pa_context_errno(context_));
+    }
+    return success != 0;
+}
+
+} // namespace soundpad
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <pulse/pulseaudio.h>
+
+namespace soundpad {
+
+// Долгоживущее подключение к PulseAudio: один pa_threaded_mainloop + pa_context
+// на всё приложение вместо отдельного mainloop на каждый запрос.
+class PulseContext {
+public:
+    explicit PulseContext(const std::string& clientName);
+    ~PulseContext();
+
+    PulseContext(const PulseContext&) = delete;
+    PulseContext& operator=(const PulseContext&) = delete;
+
+    // RAII lock of the threaded mainloop. Every pa_* call outside of
+    // PulseAudio callbacks must be made while holding it.
+    class Lock {
+    public:
+        explicit Lock(PulseContext& ctx) : ml_(ctx.mainloop_) { pa_threaded_mainloop_lock(ml_); }
+        ~Lock() { pa_threaded_mainloop_unlock(ml_); }
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    private:
+        pa_threaded_mainloop *ml_;
+    };
+
+    // Connect (or reconnect after a server restart). Must NOT be called with the lock held.
+    bool ensureConnected();
+    bool isReady() const; // lock must be held
+    // Bumped for every new context. Indices handed out by an earlier one
+    // (modules, devices) mean nothing to the current server.
+    uint64_t connectionId() const { return connectionId_; }
+
+    pa_threaded_mainloop *mainloop() const { return mainloop_; }
+    pa_context *context() const { return context_; }
+
+    // Wake every thread sleeping in wait(). Safe to call from PulseAudio callbacks.
+    void signal();
+    // Sleep until signal() is called. Lock must be held.
+    void wait();
+
+    // Called on the mainloop thread each time a context (re)connects, e.g. to
+    // subscribe to events. Lock must be held to set it.
+    void setReadyCallback(std::function<void()> callback);
+
+    // Wait for an operation to finish and release it. Lock must be held.
+    void waitForOperation(pa_operation *op);
+
+    // Introspection, each call is a single round-trip on the shared context.
+    // Device lists are kept by the DeviceRegistry instead.
+    bool hasSink(const std::string& sinkName);
+    bool hasSource(const std::string& sourceName);
+
+    struct ModuleInfo {
+        uint32_t index;
+        std::string name;
+        std::string argument;
+    };
+    std::vector<ModuleInfo> moduleList();
+
+    // Returns module index or PA_INVALID_INDEX on failure.
+    uint32_t loadModule(const std::string& name, const std::string& args);
+    bool unloadModule(uint32_t index);
+
+private:
+    static void stateCallback(pa_context *c, void *userdata);
+
+    std::string clientName_;
+    std::function<void()> readyCallback_;
+    std::atomic<uint64_t> connectionId_{0};
+    pa_threaded_mainloop *mainloop_ = nullptr;
+    pa_context *context_ = nullptr;
+};
+
+} // namespace soundpad
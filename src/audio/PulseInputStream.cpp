@@ -0,0 +1,154 @@
+#include "PulseInputStream.hpp"
+#include "AudioLog.hpp"
+#include <algorithm>
+#include <QDebug>
+#include <QString>
+
+namespace soundpad {
+
+static size_t ringCapacity(int rate, int channels, size_t fragmentFrames)
+{
+    // Room for a hiccup of the consumer; the backlog it keeps is far smaller
+    const size_t frames = std::max(fragmentFrames * 8, static_cast<size_t>(rate) / 2);
+    return frames * static_cast<size_t>(channels);
+}
+
+// Construction and destruction take the PulseContext lock themselves.
+PulseInputStream::PulseInputStream(PulseContext& pulse, const std::string& sourceName,
+                                   const std::string& streamName, int rate, int channels, pa_usec_t fragmentUs)
+    : pulse_(pulse), sourceName_(sourceName), rate_(rate), channels_(channels), fragmentUs_(fragmentUs),
+      fragmentFrames_(std::max<size_t>(1, static_cast<size_t>(fragmentUs * static_cast<pa_usec_t>(rate) / PA_USEC_PER_SEC))),
+      ring_(ringCapacity(rate, channels, fragmentFrames_)),
+      silence_(fragmentFrames_ * static_cast<size_t>(channels), 0.0f)
+{
+    if (!pulse_.ensureConnected()) {
+        return;
+    }
+
+    // Float at the mix rate: the server converts whatever the source
+    // delivers, the consumer adds it to the mix as is
+    pa_sample_spec spec;
+    spec.format = PA_SAMPLE_FLOAT32LE;
+    spec.rate = static_cast<uint32_t>(rate);
+    spec.channels = static_cast<uint8_t>(channels);
+
+    PulseContext::Lock lock(pulse_);
+    stream_ = pa_stream_new(pulse_.context(), streamName.c_str(), &spec, nullptr);
+    if (!stream_) {
+        qCDebug(lcAudio) << "[PulseInputStream] pa_stream_new failed:" << pa_strerror(pa_context_errno(pulse_.context()));
+        return;
+    }
+
+    pa_stream_set_state_callback(stream_, [](pa_stream *, void *userdata) {
+        static_cast<PulseContext*>(userdata)->signal();
+    }, &pulse_);
+    pa_stream_set_read_callback(stream_, [](pa_stream *, size_t, void *userdata) {
+        static_cast<PulseInputStream*>(userdata)->onReadable();
+    }, this);
+    pa_stream_set_overflow_callback(stream_, [](pa_stream *, void *userdata) {
+        ++static_cast<PulseInputStream*>(userdata)->overflows_;
+    }, this);
+
+    // Without fragsize the server batches a record stream into fragments of
+    // up to two seconds; with ADJUST_LATENCY it also sizes the source's own
+    // buffer to match.
+    pa_buffer_attr attr;
+    attr.maxlength = static_cast<uint32_t>(-1);
+    attr.tlength = static_cast<uint32_t>(-1);
+    attr.prebuf = static_cast<uint32_t>(-1);
+    attr.minreq = static_cast<uint32_t>(-1);
+    attr.fragsize = static_cast<uint32_t>(pa_usec_to_bytes(fragmentUs, &spec));
+
+    // Unplugging the source ends the stream instead of moving it to the
+    // default one, the same as an explicitly chosen output
+    pa_stream_flags_t flags = static_cast<pa_stream_flags_t>(PA_STREAM_ADJUST_LATENCY | PA_STREAM_DONT_MOVE);
+
+    if (pa_stream_connect_record(stream_, sourceName_.empty() ? nullptr : sourceName_.c_str(), &attr, flags) < 0) {
+        qCDebug(lcAudio) << "[PulseInputStream] Failed to connect stream to" << QString::fromStdString(sourceName_)
+                 << ":" << pa_strerror(pa_context_errno(pulse_.context()));
+        return;
+    }
+
+    while (true) {
+        pa_stream_state_t state = pa_stream_get_state(stream_);
+        if (state == PA_STREAM_READY) {
+            break;
+        }
+        if (!PA_STREAM_IS_GOOD(state)) {
+            qCDebug(lcAudio) << "[PulseInputStream] Stream failed for source" << QString::fromStdString(sourceName_)
+                     << ":" << pa_strerror(pa_context_errno(pulse_.context()));
+            break;
+        }
+        pulse_.wait();
+    }
+}
+
+PulseInputStream::~PulseInputStream()
+{
+    if (!stream_) {
+        return;
+    }
+    PulseContext::Lock lock(pulse_);
+    pa_stream_set_state_callback(stream_, nullptr, nullptr);
+    pa_stream_set_read_callback(stream_, nullptr, nullptr);
+    pa_stream_set_overflow_callback(stream_, nullptr, nullptr);
+    if (PA_STREAM_IS_GOOD(pa_stream_get_state(stream_))) {
+        pa_stream_disconnect(stream_);
+    }
+    pa_stream_unref(stream_);
+}
+
+bool PulseInputStream::isReady() const
+{
+    return stream_ && pa_stream_get_state(stream_) == PA_STREAM_READY;
+}
+
+size_t PulseInputStream::read(float *out, size_t frames)
+{
+    const size_t channels = static_cast<size_t>(channels_);
+    return ring_.pop(out, frames * channels) / channels;
+}
+
+size_t PulseInputStream::discard(size_t frames)
+{
+    const size_t channels = static_cast<size_t>(channels_);
+    return ring_.discard(frames * channels) / channels;
+}
+
+// Everything the server has, fragment by fragment. The worker is not woken:
+// it is paced by the sink it writes to and picks the frames up there.
+void PulseInputStream::onReadable()
+{
+    while (pa_stream_readable_size(stream_) > 0) {
+        const void *data = nullptr;
+        size_t bytes = 0;
+        if (pa_stream_peek(stream_, &data, &bytes) < 0) {
+            qCDebug(lcAudio) << "[PulseInputStream] pa_stream_peek failed:" << pa_strerror(pa_context_errno(pulse_.context()));
+            return;
+        }
+        if (bytes == 0) {
+            break;
+        }
+        const size_t samples = bytes / sizeof(float);
+        if (data) {
+            push(static_cast<const float*>(data), samples);
+        } else {
+            // A hole: the source skipped ahead, keep the timeline with silence
+            for (size_t done = 0; done < samples;) {
+                const size_t n = std::min(samples - done, silence_.size());
+                push(silence_.data(), n);
+                done += n;
+            }
+        }
+        pa_stream_drop(stream_);
+    }
+}
+
+void PulseInputStream::push(const float *data, size_t samples)
+{
+    if (ring_.push(data, samples) < samples) {
+        ++overflows_;
+    }
+}
+
+} // namespace soundpad
@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <pulse/pulseaudio.h>
+#include <QtGlobal>
+#include "AudioBackend.hpp"
+#include "PulseContext.hpp"
+#include "SpscRing.hpp"
+
+namespace soundpad {
+
+// Persistent float record stream on a shared PulseContext. The server hands
+// over a fragment as soon as one is complete; the read callback copies it
+// into a ring on the PulseAudio thread and the consumer takes frames out
+// without the lock. The fragment size is negotiated explicitly, it bounds
+// how long a sample waits in the server before we see it.
+class PulseInputStream : public InputStream {
+public:
+    PulseInputStream(PulseContext& pulse, const std::string& sourceName, const std::string& streamName,
+                     int rate, int channels, pa_usec_t fragmentUs);
+    ~PulseInputStream() override;
+
+    PulseInputStream(const PulseInputStream&) = delete;
+    PulseInputStream& operator=(const PulseInputStream&) = delete;
+
+    // With the PulseContext lock held
+    bool isReady() const override;
+
+    // Consumer side: one thread, no lock. Counts are in frames.
+    size_t available() const override { return ring_.readAvailable() / static_cast<size_t>(channels_); }
+    size_t read(float *out, size_t frames) override;
+    size_t discard(size_t frames) override;
+    // The ring was full or the server's buffer overflowed
+    quint64 overflows() const override { return overflows_; }
+
+    const std::string& deviceName() const override { return sourceName_; }
+    int rate() const override { return rate_; }
+    uint64_t fragmentUs() const override { return fragmentUs_; }
+    size_t fragmentFrames() const override { return fragmentFrames_; }
+
+private:
+    void onReadable(); // PulseAudio thread
+    void push(const float *data, size_t samples);
+
+    PulseContext& pulse_;
+    std::string sourceName_;
+    int rate_;
+    int channels_;
+    pa_usec_t fragmentUs_;
+    size_t fragmentFrames_;
+    pa_stream *stream_ = nullptr;
+    SpscRing<float> ring_;
+    std::vector<float> silence_; // written for holes in the capture
+    std::atomic<quint64> overflows_{0};
+};
+
+} // namespace soundpad
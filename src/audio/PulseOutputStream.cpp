@@ -0,0 +1,176 @@
+#include "PulseOutputStream.hpp"
+#include "AudioLog.hpp"
+#include <QDebug>
+#include <QString>
+
+namespace soundpad {
+
+static pa_sample_spec toSampleSpec(const PcmFormat& format)
+{
+    pa_sample_spec spec;
+    switch (format.sampleFormat) {
+    case SampleFormat::U8:  spec.format = PA_SAMPLE_U8; break;
+    case SampleFormat::S16: spec.format = PA_SAMPLE_S16LE; break;
+    case SampleFormat::S24: spec.format = PA_SAMPLE_S24LE; break;
+    case SampleFormat::S32: spec.format = PA_SAMPLE_S32LE; break;
+    case SampleFormat::F32: spec.format = PA_SAMPLE_FLOAT32LE; break;
+    }
+    spec.rate = static_cast<uint32_t>(format.rate);
+    spec.channels = static_cast<uint8_t>(format.channels);
+    return spec;
+}
+
+// Construction and destruction take the PulseContext lock themselves.
+PulseOutputStream::PulseOutputStream(PulseContext& pulse, const std::string& sinkName,
+                                     const std::string& streamName, const PcmFormat& format,
+                                     pa_usec_t targetLatencyUs)
+    : pulse_(pulse), sinkName_(sinkName), format_(format), targetLatencyUs_(targetLatencyUs)
+{
+    const pa_sample_spec spec = toSampleSpec(format);
+    if (!pulse_.ensureConnected()) {
+        return;
+    }
+
+    PulseContext::Lock lock(pulse_);
+    stream_ = pa_stream_new(pulse_.context(), streamName.c_str(), &spec, nullptr);
+    if (!stream_) {
+        qCDebug(lcAudio) << "[PulseOutputStream] pa_stream_new failed:" << pa_strerror(pa_context_errno(pulse_.context()));
+        return;
+    }
+
+    auto wake = [](pa_stream *, void *userdata) {
+        static_cast<PulseContext*>(userdata)->signal();
+    };
+    pa_stream_set_state_callback(stream_, wake, &pulse_);
+    pa_stream_set_write_callback(stream_, [](pa_stream *, size_t, void *userdata) {
+        static_cast<PulseContext*>(userdata)->signal();
+    }, &pulse_);
+    pa_stream_set_underflow_callback(stream_, [](pa_stream *, void *userdata) {
+        ++static_cast<PulseOutputStream*>(userdata)->underflows_;
+    }, this);
+    pa_stream_set_overflow_callback(stream_, [](pa_stream *, void *userdata) {
+        ++static_cast<PulseOutputStream*>(userdata)->overflows_;
+    }, this);
+
+    // Small target buffer: the feeder is woken on every request, so there is no
+    // need for the multi-second default buffer of pa_simple.
+    pa_buffer_attr attr;
+    attr.maxlength = static_cast<uint32_t>(-1);
+    attr.tlength = static_cast<uint32_t>(pa_usec_to_bytes(targetLatencyUs, &spec));
+    attr.prebuf = static_cast<uint32_t>(-1);
+    attr.minreq = static_cast<uint32_t>(-1);
+    attr.fragsize = static_cast<uint32_t>(-1);
+
+    pa_stream_flags_t flags = static_cast<pa_stream_flags_t>(
+        PA_STREAM_ADJUST_LATENCY | PA_STREAM_AUTO_TIMING_UPDATE | PA_STREAM_INTERPOLATE_TIMING);
+
+    if (pa_stream_connect_playback(stream_, sinkName_.empty() ? nullptr : sinkName_.c_str(),
+                                   &attr, flags, nullptr, nullptr) < 0) {
+        qCDebug(lcAudio) << "[PulseOutputStream] Failed to connect stream to" << QString::fromStdString(sinkName_)
+                 << ":" << pa_strerror(pa_context_errno(pulse_.context()));
+        return;
+    }
+
+    while (true) {
+        pa_stream_state_t state = pa_stream_get_state(stream_);
+        if (state == PA_STREAM_READY) {
+            break;
+        }
+        if (!PA_STREAM_IS_GOOD(state)) {
+            qCDebug(lcAudio) << "[PulseOutputStream] Stream failed for sink" << QString::fromStdString(sinkName_)
+                     << ":" << pa_strerror(pa_context_errno(pulse_.context()));
+            break;
+        }
+        pulse_.wait();
+    }
+}
+
+PulseOutputStream::~PulseOutputStream()
+{
+    if (!stream_) {
+        return;
+    }
+    PulseContext::Lock lock(pulse_);
+    cancelDrain();
+    pa_stream_set_state_callback(stream_, nullptr, nullptr);
+    pa_stream_set_write_callback(stream_, nullptr, nullptr);
+    pa_stream_set_underflow_callback(stream_, nullptr, nullptr);
+    pa_stream_set_overflow_callback(stream_, nullptr, nullptr);
+    if (PA_STREAM_IS_GOOD(pa_stream_get_state(stream_))) {
+        pa_stream_disconnect(stream_);
+    }
+    pa_stream_unref(stream_);
+}
+
+bool PulseOutputStream::isReady() const
+{
+    return stream_ && pa_stream_get_state(stream_) == PA_STREAM_READY;
+}
+
+size_t PulseOutputStream::writableSize() const
+{
+    if (!isReady()) {
+        return 0;
+    }
+    size_t size = pa_stream_writable_size(stream_);
+    return size == static_cast<size_t>(-1) ? 0 : size;
+}
+
+bool PulseOutputStream::write(const void *data, size_t bytes)
+{
+    if (!isReady()) {
+        return false;
+    }
+    if (pa_stream_write(stream_, data, bytes, nullptr, 0, PA_SEEK_RELATIVE) < 0) {
+        qCDebug(lcAudio) << "[PulseOutputStream] pa_stream_write failed:" << pa_strerror(pa_context_errno(pulse_.context()));
+        return false;
+    }
+    return true;
+}
+
+void PulseOutputStream::flush()
+{
+    if (isReady()) {
+        pulse_.waitForOperation(pa_stream_flush(stream_, nullptr, nullptr));
+    }
+}
+
+void PulseOutputStream::beginDrain()
+{
+    cancelDrain();
+    drained_ = true;
+    if (!isReady()) {
+        return;
+    }
+    drainOp_ = pa_stream_drain(stream_, [](pa_stream *, int, void *userdata) {
+        auto *self = static_cast<PulseOutputStream*>(userdata);
+        self->drained_ = true;
+        self->pulse_.signal();
+    }, this);
+    drained_ = drainOp_ == nullptr;
+}
+
+// Only forgets the callback, the server keeps playing what is queued
+void PulseOutputStream::cancelDrain()
+{
+    if (!drainOp_) {
+        return;
+    }
+    if (pa_operation_get_state(drainOp_) == PA_OPERATION_RUNNING) {
+        pa_operation_cancel(drainOp_);
+    }
+    pa_operation_unref(drainOp_);
+    drainOp_ = nullptr;
+}
+
+uint64_t PulseOutputStream::latencyUs() const
+{
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if (!isReady() || pa_stream_get_latency(stream_, &latency, &negative) < 0 || negative) {
+        return 0;
+    }
+    return latency;
+}
+
+} // namespace soundpad
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <pulse/pulseaudio.h>
+#include <QtGlobal>
+#include "AudioBackend.hpp"
+#include "PulseContext.hpp"
+
+namespace soundpad {
+
+// Persistent playback stream on a shared PulseContext. The server's
+// write-request callback wakes the mainloop waiters, so the feeding thread
+// writes exactly as much as the server asks for instead of sleeping.
+class PulseOutputStream : public OutputStream {
+public:
+    PulseOutputStream(PulseContext& pulse, const std::string& sinkName,
+                      const std::string& streamName, const PcmFormat& format,
+                      pa_usec_t targetLatencyUs = 50000);
+    ~PulseOutputStream() override;
+
+    PulseOutputStream(const PulseOutputStream&) = delete;
+    PulseOutputStream& operator=(const PulseOutputStream&) = delete;
+
+    // All of the following must be called with the PulseContext lock held.
+    bool isReady() const override;
+    size_t writableSize() const override;
+    bool write(const void *data, size_t bytes) override;
+    void flush() override;
+    void beginDrain() override;
+    void cancelDrain() override;
+    bool isDrained() const override { return drained_; }
+    // 0 if the server has not reported timing yet
+    uint64_t latencyUs() const override;
+    quint64 underflows() const override { return underflows_; }
+    quint64 overflows() const override { return overflows_; }
+
+    const std::string& deviceName() const override { return sinkName_; }
+    const PcmFormat& format() const override { return format_; }
+    uint64_t targetLatencyUs() const override { return targetLatencyUs_; }
+
+private:
+    PulseContext& pulse_;
+    std::string sinkName_;
+    PcmFormat format_;
+    pa_usec_t targetLatencyUs_;
+    pa_stream *stream_ = nullptr;
+    pa_operation *drainOp_ = nullptr;
+    bool drained_ = true;
+    quint64 underflows_ = 0;
+    quint64 overflows_ = 0;
+};
+
+} // namespace soundpad
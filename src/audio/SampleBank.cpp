@@ -0,0 +1,266 @@
+#include "SampleBank.hpp"
+#include "AudioLog.hpp"
+#include "AudioDecoder.hpp"
+#include "WavFileSource.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QString>
+
+namespace soundpad {
+
+struct SampleBank::Sample {
+    PcmFormat format;
+    char *data = nullptr;
+    size_t bytes = 0;
+    size_t mapped = 0; // bytes rounded up to whole pages
+    bool locked = false;
+
+    explicit Sample(size_t size)
+    {
+        static const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        mapped = std::max<size_t>(pageSize, (size + pageSize - 1) / pageSize * pageSize);
+        void *p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            mapped = 0;
+            return;
+        }
+        data = static_cast<char*>(p);
+        bytes = size;
+    }
+
+    ~Sample()
+    {
+        if (data) {
+            munmap(data, mapped); // also drops the lock
+        }
+    }
+};
+
+// Several voices may play the same sample; each gets its own read position
+class SampleBank::Source : public PcmSource {
+public:
+    explicit Source(std::shared_ptr<const Sample> sample) : sample_(std::move(sample)) {}
+
+    PcmFormat format() const override { return sample_->format; }
+    qint64 totalBytes() const override { return static_cast<qint64>(sample_->bytes); }
+
+    size_t read(char *dst, size_t bytes) override
+    {
+        const char *src = nullptr;
+        size_t n = readView(&src, bytes);
+        std::memcpy(dst, src, n);
+        return n;
+    }
+
+    bool seekToByte(qint64 byte) override
+    {
+        position_ = static_cast<size_t>(std::clamp<qint64>(byte, 0, totalBytes()));
+        return true;
+    }
+
+    bool supportsView() const override { return true; }
+
+    size_t readView(const char **data, size_t bytes) override
+    {
+        size_t n = std::min(bytes, sample_->bytes - position_);
+        *data = sample_->data + position_;
+        position_ += n;
+        return n;
+    }
+
+private:
+    std::shared_ptr<const Sample> sample_;
+    size_t position_ = 0;
+};
+
+SampleBank::SampleBank()
+{
+    // Preloads are rare and large, one at a time keeps the disk and the CPU free for playback
+    pool_.setMaxThreadCount(1);
+}
+
+SampleBank::~SampleBank()
+{
+    pool_.clear();
+    pool_.waitForDone();
+}
+
+void SampleBank::setByteBudget(qint64 bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+}
+
+void SampleBank::setLocked(bool locked)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    locked_ = locked;
+    for (auto& entry : samples_) {
+        Sample& sample = *entry.second;
+        if (locked && !sample.locked) {
+            lock(sample);
+        } else if (!locked && sample.locked) {
+            munlock(sample.data, sample.mapped);
+            sample.locked = false;
+        }
+    }
+}
+
+bool SampleBank::lock(Sample& sample) const
+{
+    if (mlock(sample.data, sample.mapped) != 0) {
+        qCDebug(lcAudio) << "[SampleBank] mlock failed, keeping the sample unlocked:" << strerror(errno);
+        return false;
+    }
+    sample.locked = true;
+    return true;
+}
+
+void SampleBank::preload(const std::string& key, const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wanted_.insert(key);
+        if (samples_.count(key) || loading_.count(key)) {
+            return;
+        }
+        loading_.insert(key);
+    }
+
+    pool_.start([this, key, path]() {
+        std::shared_ptr<Sample> sample = load(path);
+
+        std::lock_guard<std::mutex> guard(mutex_);
+        loading_.erase(key);
+        if (!sample) {
+            qCDebug(lcAudio) << "[SampleBank] Failed to load" << QString::fromStdString(path);
+            return;
+        }
+        if (!wanted_.count(key)) {
+            return; // unloaded while it was decoding
+        }
+        qint64 bytes = static_cast<qint64>(sample->bytes);
+        if (resident_ + bytes > budget_) {
+            qCDebug(lcAudio) << "[SampleBank] Not keeping" << QString::fromStdString(path)
+                     << "in memory:" << bytes << "bytes would exceed the budget of" << budget_;
+            return;
+        }
+        if (locked_) {
+            lock(*sample);
+        }
+        resident_ += bytes;
+        samples_[key] = std::move(sample);
+    });
+}
+
+// Decode the whole file into one anonymous mapping. WAVs keep their own
+// sample format, anything else is decoded to the decoder's S16 output.
+std::shared_ptr<SampleBank::Sample> SampleBank::load(const std::string& path) const
+{
+    WavFileSource wav;
+    if (wav.open(path)) {
+        auto sample = std::make_shared<Sample>(static_cast<size_t>(wav.totalBytes()));
+        if (!sample->data) {
+            return nullptr;
+        }
+        sample->format = wav.format();
+        size_t done = 0;
+        while (done < sample->bytes) {
+            size_t n = wav.read(sample->data + done, sample->bytes - done);
+            if (n == 0) {
+                break;
+            }
+            done += n;
+        }
+        sample->bytes = done;
+        return sample;
+    }
+
+    AudioDecoder decoder;
+    if (!decoder.open(path)) {
+        return nullptr;
+    }
+    std::vector<char> pcm;
+    qint64 ms = decoder.durationMs();
+    if (ms > 0) {
+        pcm.reserve(static_cast<size_t>(ms * decoder.outputRate() / 1000 * decoder.frameBytes()));
+    }
+    std::vector<char> chunk(65536);
+    while (size_t n = decoder.read(chunk.data(), chunk.size())) {
+        pcm.insert(pcm.end(), chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(n));
+    }
+    if (pcm.empty()) {
+        return nullptr;
+    }
+
+    auto sample = std::make_shared<Sample>(pcm.size());
+    if (!sample->data) {
+        return nullptr;
+    }
+    sample->format.sampleFormat = SampleFormat::S16;
+    sample->format.rate = decoder.outputRate();
+    sample->format.channels = decoder.outputChannels();
+    std::memcpy(sample->data, pcm.data(), pcm.size());
+    return sample;
+}
+
+void SampleBank::unload(const std::string& key)
+{
+    std::shared_ptr<Sample> sample; // freed outside the lock, voices may still hold it
+    std::lock_guard<std::mutex> lock(mutex_);
+    wanted_.erase(key);
+    auto it = samples_.find(key);
+    if (it == samples_.end()) {
+        return;
+    }
+    sample = std::move(it->second);
+    resident_ -= static_cast<qint64>(sample->bytes);
+    samples_.erase(it);
+}
+
+bool SampleBank::contains(const std::string& key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return samples_.count(key) != 0;
+}
+
+std::shared_ptr<PcmSource> SampleBank::acquire(const std::string& key)
+{
+    std::shared_ptr<const Sample> sample;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = samples_.find(key);
+        if (it == samples_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        sample = it->second;
+    }
+    return std::make_shared<Source>(std::move(sample));
+}
+
+SampleBank::Stats SampleBank::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.residentBytes = resident_;
+    stats.budgetBytes = budget_;
+    stats.samples = static_cast<int>(samples_.size());
+    stats.loading = static_cast<int>(loading_.size());
+    stats.hits = hits_;
+    stats.misses = misses_;
+    for (const auto& entry : samples_) {
+        if (entry.second->locked) {
+            stats.lockedBytes += static_cast<qint64>(entry.second->bytes);
+        }
+    }
+    return stats;
+}
+
+} // namespace soundpad
@@ -0,0 +1,70 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <QThreadPool>
+#include "PcmSource.hpp"
+
+namespace soundpad {
+
+// Fully decoded PCM of "hot" pads kept resident in RAM, so triggering one is
+// a pointer hand-off to the mixer instead of a file open and page faults.
+// Every sample lives in its own anonymous mapping that can be mlock()ed.
+// Loading happens on a background thread; a sample that would push the bank
+// over its byte budget is not kept.
+class SampleBank {
+public:
+    struct Stats {
+        qint64 residentBytes = 0;
+        qint64 lockedBytes = 0;
+        qint64 budgetBytes = 0;
+        int samples = 0;
+        int loading = 0;
+        quint64 hits = 0;
+        quint64 misses = 0;
+    };
+
+    SampleBank();
+    ~SampleBank();
+
+    SampleBank(const SampleBank&) = delete;
+    SampleBank& operator=(const SampleBank&) = delete;
+
+    // Lowering the budget does not drop resident samples, it only refuses new ones
+    void setByteBudget(qint64 bytes);
+    // Pin resident samples with mlock; falls back to unlocked if RLIMIT_MEMLOCK is too low
+    void setLocked(bool locked);
+
+    // Decode `path` into the bank under `key` (asynchronous, no-op if already there)
+    void preload(const std::string& key, const std::string& path);
+    void unload(const std::string& key);
+    bool contains(const std::string& key) const;
+
+    // Source reading straight from the resident PCM, nullptr if the key is not
+    // resident. Counted as a hit or a miss.
+    std::shared_ptr<PcmSource> acquire(const std::string& key);
+
+    Stats stats() const;
+
+private:
+    struct Sample;
+    class Source;
+
+    std::shared_ptr<Sample> load(const std::string& path) const;
+    bool lock(Sample& sample) const;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Sample>> samples_;
+    std::unordered_set<std::string> wanted_;  // preloaded and not unloaded since
+    std::unordered_set<std::string> loading_;
+    qint64 budget_ = 256LL * 1024 * 1024;
+    qint64 resident_ = 0;
+    bool locked_ = false;
+    quint64 hits_ = 0;
+    quint64 misses_ = 0;
+    QThreadPool pool_;
+};
+
+} // namespace soundpad
@@ -1,575 +1,722 @@
 #include "SoundpadAudio.hpp"
-#include <pulse/pulseaudio.h>
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <cstdlib>
+#include "AudioLog.hpp"
+#include "MixKernels.hpp"
+#include "StreamingDecoder.hpp"
+#include "WavFileSource.hpp"
+#include <algorithm>
 #include <QDebug>
-#include <fstream>
-#include <iostream>
 #include <vector>
-#include <QTimer>
 #include <QFileInfo>
 #include <QMetaObject>
-#include <thread>
 #include <chrono>
 
 namespace soundpad {
 
-// Helper: Check if a sink exists
-bool SoundpadAudio::sinkExists(const std::string& sinkName) {
-    qDebug() << "[SoundpadAudio] Checking if sink exists:" << QString::fromStdString(sinkName);
-    pa_mainloop *ml = pa_mainloop_new();
-    pa_context *ctx = pa_context_new(pa_mainloop_get_api(ml), "SoundpadCheckSink");
-
-    struct SinkCheckContext {
-        std::string name;
-        bool found = false;
-        bool done = false;
-    } context{sinkName};
-
-    pa_context_set_state_callback(ctx, [](pa_context *c, void *userdata) {
-        auto *ctxData = static_cast<SinkCheckContext*>(userdata);
-        if (pa_context_get_state(c) == PA_CONTEXT_READY) {
-            pa_operation *op = pa_context_get_sink_info_list(
-                c,
-                [](pa_context *, const pa_sink_info *info, int eol, void *userdata) {
-                    auto *ctxData = static_cast<SinkCheckContext*>(userdata);
-                    if (eol > 0) {
-                        ctxData->done = true;
-                        return;
-                    }
-                    if (info && info->name) {
-                        if (ctxData->name == info->name) {
-                            ctxData->found = true;
-                        }
-                    }
-                },
-                userdata
-            );
-            if (op) pa_operation_unref(op);
-        }
-    }, &context);
-
-    pa_context_connect(ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr);
-    while (!context.done) pa_mainloop_iterate(ml, 1, nullptr);
-
-    pa_context_disconnect(ctx);
-    pa_context_unref(ctx);
-    pa_mainloop_free(ml);
-
-    return context.found;
-}
-
-// Helper: Check if a source exists
-bool SoundpadAudio::sourceExists(const std::string& sourceName) {
-    qDebug() << "[SoundpadAudio] Checking if source exists:" << QString::fromStdString(sourceName);
-    pa_mainloop *ml = pa_mainloop_new();
-    pa_context *ctx = pa_context_new(pa_mainloop_get_api(ml), "SoundpadCheckSource");
-
-    struct SourceCheckContext {
-        std::string name;
-        bool found = false;
-        bool done = false;
-    } context{sourceName};
-
-    pa_context_set_state_callback(ctx, [](pa_context *c, void *userdata) {
-        auto *ctxData = static_cast<SourceCheckContext*>(userdata);
-        if (pa_context_get_state(c) == PA_CONTEXT_READY) {
-            pa_operation *op = pa_context_get_source_info_list(
-                c,
-                [](pa_context *, const pa_source_info *info, int eol, void *userdata) {
-                    auto *ctxData = static_cast<SourceCheckContext*>(userdata);
-                    if (eol > 0) {
-                        ctxData->done = true;
-                        return;
-                    }
-                    if (info && info->name) {
-                        if (ctxData->name == info->name) {
-                            ctxData->found = true;
-                        }
-                    }
-                },
-                userdata
-            );
-            if (op) pa_operation_unref(op);
-        }
-    }, &context);
-
-    pa_context_connect(ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr);
-    while (!context.done) pa_mainloop_iterate(ml, 1, nullptr);
-
-    pa_context_disconnect(ctx);
-    pa_context_unref(ctx);
-    pa_mainloop_free(ml);
-
-    return context.found;
-}
-
-// Helper: Create null sink
-void SoundpadAudio::createNullSink(const std::string& sinkName) {
-    qDebug() << "[SoundpadAudio] Creating null sink:" << QString::fromStdString(sinkName);
-    pa_mainloop *ml = pa_mainloop_new();
-    pa_context *ctx = pa_context_new(pa_mainloop_get_api(ml), "SoundpadCreateSink");
-
-    struct SinkCreateContext {
-        std::string name;
-        bool done = false;
-    } context{sinkName};
-
-    pa_context_set_state_callback(ctx, [](pa_context *c, void *userdata) {
-        auto *ctxData = static_cast<SinkCreateContext*>(userdata);
-        if (pa_context_get_state(c) == PA_CONTEXT_READY) {
-            std::string args = "sink_name=" + ctxData->name +
-                               " sink_properties=device.description=" + ctxData->name;
-            pa_operation *op = pa_context_load_module(
-                c, "module-null-sink", args.c_str(),
-                [](pa_context *, uint32_t, void *userdata) {
-                    auto *ctxData = static_cast<SinkCreateContext*>(userdata);
-                    ctxData->done = true;
-                }, userdata
-            );
-            if (op) pa_operation_unref(op);
+SoundpadAudio::SoundpadAudio(const std::string& sinkName, std::unique_ptr<AudioBackend> backend)
+    : QObject(nullptr), sinkName_(sinkName), outputSinkName_(""),
+      backend_(backend ? std::move(backend) : AudioBackend::createDefault())
+{
+    qCDebug(lcAudio) << "[SoundpadAudio] Constructor called, backend" << backend_->name();
+    backend_->setDeviceListener([this](DeviceChange change, const AudioDevice& device) {
+        // Our own sink is not offered as an output, see getSinkList()
+        if (device.kind == AudioDevice::Sink && device.name == sinkName_) {
+            return;
         }
-    }, &context);
-
-    pa_context_connect(ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr);
-    while (!context.done) pa_mainloop_iterate(ml, 1, nullptr);
-
-    pa_context_disconnect(ctx);
-    pa_context_unref(ctx);
-    pa_mainloop_free(ml);
-}
-
-// Helper: Create remap source
-void SoundpadAudio::createRemapSource(const std::string& masterMonitor, const std::string& sourceName) {
-    qDebug() << "[SoundpadAudio] Creating remap source:" << QString::fromStdString(sourceName)
-             << "from master:" << QString::fromStdString(masterMonitor);
-    pa_mainloop *ml = pa_mainloop_new();
-    pa_context *ctx = pa_context_new(pa_mainloop_get_api(ml), "SoundpadCreateSource");
-
-    struct SourceCreateContext {
-        std::string master;
-        std::string name;
-        bool done = false;
-    } context{masterMonitor, sourceName};
-
-    pa_context_set_state_callback(ctx, [](pa_context *c, void *userdata) {
-        auto *ctxData = static_cast<SourceCreateContext*>(userdata);
-        if (pa_context_get_state(c) == PA_CONTEXT_READY) {
-            std::string args = "master=" + ctxData->master +
-                               " source_name=" + ctxData->name +
-                               " source_properties=device.description=" + ctxData->name;
-            pa_operation *op = pa_context_load_module(
-                c, "module-remap-source", args.c_str(),
-                [](pa_context *, uint32_t, void *userdata) {
-                    auto *ctxData = static_cast<SourceCreateContext*>(userdata);
-                    ctxData->done = true;
-                }, userdata
-            );
-            if (op) pa_operation_unref(op);
+        switch (change) {
+        case DeviceChange::Added:
+            emit deviceAdded(device);
+            break;
+        case DeviceChange::Removed:
+            emit deviceRemoved(device);
+            break;
+        case DeviceChange::Changed:
+            emit deviceChanged(device);
+            break;
         }
-    }, &context);
+    });
+    // The worker sets up the virtual mic before it first sleeps
+    worker_ = std::thread([this]() {
+        workerLoop();
+    });
+    qCDebug(lcAudio) << "SoundpadAudio created with sink:" << QString::fromStdString(sinkName_);
+}
+
+SoundpadAudio::~SoundpadAudio()
+{
+    qCDebug(lcAudio) << "[SoundpadAudio] Destructor called";
+    stop();
+    quit_ = true;
+    wakeWorker();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    mixer_.releaseRetired();
+    // No more device signals from the backend's thread
+    backend_->setDeviceListener(nullptr);
+    virtualStream_.reset();
+    headphonesStream_.reset();
+    micStream_.reset();
+    backend_->releaseVirtualDevices();
+    qCDebug(lcAudio) << "SoundpadAudio destroyed";
+}
+
+// (Re)open the persistent streams if they are missing, dead, point to a
+// different device than the one currently selected or carry another format
+// or latency. A mic that cannot be recorded does not fail the outputs.
+bool SoundpadAudio::ensureStreams(const PcmFormat& format) {
+    std::shared_ptr<OutputStream> virtualStream;
+    std::shared_ptr<OutputStream> headphonesStream;
+    std::shared_ptr<InputStream> micStream;
+    std::string headphonesSink;
+    std::string micSource;
+    {
+        QMutexLocker locker(&mutex_);
+        virtualStream = virtualStream_;
+        headphonesStream = headphonesStream_;
+        micStream = micStream_;
+        headphonesSink = outputSinkName_;
+        micSource = micSourceName_;
+    }
+    // With a mic merged the virtual sink carries our voice: its buffer is
+    // the second half of the delay we add
+    const uint64_t micFragmentUs = static_cast<uint64_t>(micLatencyMs_) * 1000 / 2;
+    const uint64_t virtualLatencyUs = micSource.empty() ? 50000 : micFragmentUs;
+
+    bool virtualReady = false;
+    bool headphonesReady = false;
+    bool micReady = false;
+    if (backend_->ensureConnected()) {
+        AudioBackend::Lock lock(*backend_);
+        virtualReady = virtualStream && virtualStream->isReady()
+                       && virtualStream->format() == format
+                       && virtualStream->targetLatencyUs() == virtualLatencyUs;
+        headphonesReady = headphonesStream && headphonesStream->isReady()
+                          && headphonesStream->deviceName() == headphonesSink
+                          && headphonesStream->format() == format;
+        micReady = micStream && micStream->isReady()
+                   && micStream->deviceName() == micSource
+                   && micStream->rate() == format.rate
+                   && micStream->fragmentUs() == micFragmentUs;
+    }
+
+    if (!virtualReady) {
+        virtualStream = backend_->openVirtualOutput(sinkName_, format, virtualLatencyUs);
+        AudioBackend::Lock lock(*backend_);
+        virtualReady = virtualStream->isReady();
+    }
+    if (headphonesSink.empty()) {
+        headphonesStream.reset();
+    } else if (!headphonesReady) {
+        qCDebug(lcAudio) << "[SoundpadAudio] Connecting to headphones sink:" << QString::fromStdString(headphonesSink);
+        headphonesStream = backend_->openOutput(headphonesSink, "headphones-playback", format, 50000);
+    }
+    if (micSource.empty()) {
+        micStream.reset();
+    } else if (!micReady) {
+        qCDebug(lcAudio) << "[SoundpadAudio] Recording mic source:" << QString::fromStdString(micSource);
+        micStream = backend_->openInput(micSource, "mic-capture", format.rate, format.channels, micFragmentUs);
+    }
 
-    pa_context_connect(ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr);
-    while (!context.done) pa_mainloop_iterate(ml, 1, nullptr);
+    QMutexLocker locker(&mutex_);
+    if (virtualStream_ != virtualStream || headphonesStream_ != headphonesStream || micStream_ != micStream) {
+        virtualStream_ = virtualStream;
+        headphonesStream_ = headphonesStream;
+        micStream_ = micStream;
+        streamsVersion_.fetch_add(1);
+    }
+    return virtualReady;
+}
 
-    pa_context_disconnect(ctx);
-    pa_context_unref(ctx);
-    pa_mainloop_free(ml);
+bool SoundpadAudio::playWav(const std::string& wavFilePath, bool overlay, float gain) {
+    qCDebug(lcAudio) << "[SoundpadAudio] playWav called for file:" << QString::fromStdString(wavFilePath);
+    auto source = std::make_shared<WavFileSource>();
+    if (!source->open(wavFilePath)) {
+        qCDebug(lcAudio) << "[SoundpadAudio] Не удалось открыть WAV файл:" << QString::fromStdString(wavFilePath);
+        return false;
+    }
+    return startPlayback(source, wavFilePath, overlay, gain);
+}
+
+bool SoundpadAudio::playFile(const std::string& filePath, bool overlay, float gain) {
+    qCDebug(lcAudio) << "[SoundpadAudio] playFile called for file:" << QString::fromStdString(filePath);
+    auto source = openFile(filePath);
+    if (!source) {
+        return false;
+    }
+    return startPlayback(source, filePath, overlay, gain);
 }
 
-// Call this before playback or merging
-void SoundpadAudio::ensureAudioObjectsExist(const std::string& sinkName) {
-    qDebug() << "[SoundpadAudio] Ensuring audio objects exist for sink:" << QString::fromStdString(sinkName);
-    if (!sinkExists(sinkName)) {
-        createNullSink(sinkName);
+// WAVs the parser understands are mixed straight from the mapping,
+// anything else is decoded ahead on the decoder's own thread
+std::shared_ptr<PcmSource> SoundpadAudio::openFile(const std::string& filePath) {
+    auto wav = std::make_shared<WavFileSource>();
+    if (wav->open(filePath)) {
+        return wav;
     }
-    std::string monitorName = sinkName + ".monitor";
-    if (!sourceExists("VirtualMic")) {
-        createRemapSource(monitorName, "VirtualMic");
+    auto decoder = std::make_shared<StreamingDecoder>();
+    if (!decoder->open(filePath)) {
+        qCDebug(lcAudio) << "[SoundpadAudio] Failed to open file for decoding:" << QString::fromStdString(filePath);
+        return nullptr;
     }
+    return decoder;
 }
 
-SoundpadAudio::SoundpadAudio(const std::string& sinkName)
-    : QObject(nullptr), sinkName_(sinkName), outputSinkName_("")
-{
-    qDebug() << "[SoundpadAudio] Constructor called";
-    ensureAudioObjectsExist(sinkName_);
-    qDebug() << "SoundpadAudio created with sink:" << QString::fromStdString(sinkName_);
+bool SoundpadAudio::playSample(const std::string& key, bool overlay, float gain) {
+    auto source = bank_.acquire(key);
+    if (!source) {
+        return false;
+    }
+    return startPlayback(source, key, overlay, gain);
 }
 
-SoundpadAudio::~SoundpadAudio()
-{
-    qDebug() << "[SoundpadAudio] Destructor called";
-    stop();
-    if (workerThread_.isRunning()) {
-        workerThread_.quit();
-        workerThread_.wait();
+bool SoundpadAudio::triggerPad(const std::string& key, const std::string& path, Mixer::Clock::time_point pressed,
+                               float gain) {
+    auto source = bank_.acquire(key);
+    if (!source) {
+        source = openFile(path);
+    }
+    if (!source) {
+        return false;
     }
-    qDebug() << "SoundpadAudio destroyed";
+    return startPlayback(source, path, true, gain, pressed);
 }
 
-bool SoundpadAudio::playWav(const std::string& wavFilePath) {
-    qDebug() << "[SoundpadAudio] playWav called for file:" << QString::fromStdString(wavFilePath);
-    ensureAudioObjectsExist(sinkName_);
-    stop();
-    currentFile_ = wavFilePath;
-    stopRequested_ = false;
-    seekToMs_ = -1;
-    std::thread([this, wavFilePath]() {
-        playbackThreadFunc(wavFilePath);
-    }).detach();
+// The source is opened by the caller; the worker connects the streams if
+// needed, so a retrigger costs one mailbox post and a wakeup.
+bool SoundpadAudio::startPlayback(std::shared_ptr<PcmSource> source, const std::string& filePath, bool overlay,
+                                  float gain, Mixer::Clock::time_point triggered) {
+    const PcmFormat format = source->format();
+    const qint64 dataSize = source->totalBytes(); // -1 for streams of unknown length
+    const qint64 totalMs = dataSize > 0 ? (dataSize * 1000) / format.bytesPerSecond() : 0;
+
+    if (overlay) {
+        mixer_.addVoice(std::move(source), gain, triggered);
+    } else {
+        // The previous track stops, overlaid sounds keep playing
+        // Stopping it also drops the track queued behind it
+        int previous = mainVoice_.exchange(-1);
+        nextVoice_ = -1;
+        if (previous >= 0) {
+            mixer_.stopVoice(previous);
+        }
+        currentFile_ = filePath;
+        totalMs_ = totalMs;
+        currentMs_ = 0;
+        mainVoice_ = mixer_.addVoice(std::move(source), gain, triggered);
+        emit playbackStarted(totalMs);
+    }
+    wakeWorker();
     return true;
 }
 
-void SoundpadAudio::stop() {
-    qDebug() << "[SoundpadAudio] stop called";
-    QMutexLocker locker(&mutex_);
-    stopRequested_ = true;
-    seekCond_.wakeAll();
+bool SoundpadAudio::queueFile(const std::string& filePath, float gain) {
+    qCDebug(lcAudio) << "[SoundpadAudio] queueFile called for file:" << QString::fromStdString(filePath);
+    auto source = openFile(filePath);
+    return source && queuePlayback(source, gain);
 }
 
-void SoundpadAudio::seek(qint64 ms) {
-    qDebug() << "[SoundpadAudio] seek called to ms:" << ms;
-    QMutexLocker locker(&mutex_);
-    seekToMs_ = ms;
-    seekCond_.wakeAll();
+bool SoundpadAudio::queueSample(const std::string& key, float gain) {
+    auto source = bank_.acquire(key);
+    return source && queuePlayback(source, gain);
 }
 
-qint64 SoundpadAudio::currentTime() const {
-    qDebug() << "[SoundpadAudio] currentTime called";
-    QMutexLocker locker(&mutex_);
-    return currentMs_;
+// The decoder starts filling its ring as soon as it is opened, so by the
+// time the current track ends the next one is ready to be mixed.
+bool SoundpadAudio::queuePlayback(std::shared_ptr<PcmSource> source, float gain) {
+    const int main = mainVoice_;
+    if (main < 0) {
+        return false;
+    }
+    const qint64 dataSize = source->totalBytes();
+    nextTotalMs_ = dataSize > 0 ? (dataSize * 1000) / source->format().bytesPerSecond() : 0;
+    const int id = mixer_.queueVoice(main, std::move(source), crossfadeMs_, gain);
+    if (id < 0) {
+        return false;
+    }
+    nextVoice_ = id;
+    wakeWorker();
+    return true;
 }
 
-qint64 SoundpadAudio::totalTime() const {
-    qDebug() << "[SoundpadAudio] totalTime called";
-    QMutexLocker locker(&mutex_);
-    return totalMs_;
+void SoundpadAudio::clearQueue() {
+    int next = nextVoice_.exchange(-1);
+    if (next >= 0) {
+        mixer_.stopVoice(next);
+    }
 }
 
-std::vector<std::pair<std::string, std::string>> SoundpadAudio::getSourceList()
-{
-    qDebug() << "[SoundpadAudio] getSourceList called";
-
-    pa_mainloop *ml = pa_mainloop_new();
-    pa_context *ctx = pa_context_new(pa_mainloop_get_api(ml), "SoundpadContext");
-
-    struct SourceListContext {
-        std::vector<std::pair<std::string, std::string>> sources;
-        bool done = false;
-    } context;
-
-    pa_context_set_state_callback(ctx, [](pa_context *c, void *userdata) {
-        if (pa_context_get_state(c) == PA_CONTEXT_READY) {
-            pa_operation *op = pa_context_get_source_info_list(
-                c,
-                [](pa_context *, const pa_source_info *info, int eol, void *userdata) {
-                    auto *data = static_cast<SourceListContext*>(userdata);
-                    if (eol > 0) {
-                        data->done = true;
-                        return;
-                    }
-                    if (info) {
-                        std::string name = info->name ? info->name : "";
-                        std::string desc = info->description ? info->description : "";
+void SoundpadAudio::setCrossfadeMs(int ms) {
+    crossfadeMs_ = std::clamp(ms, 0, 30000);
+}
 
-                        qDebug() << "Found source:" << QString::fromStdString(name)
-                                 << "(" << QString::fromStdString(desc) << ")";
+void SoundpadAudio::wakeWorker() {
+    AudioBackend::Lock lock(*backend_);
+    backend_->signal();
+}
 
-                        data->sources.emplace_back(name, desc);
-                    }
-                },
-                userdata
-            );
-            if (op)
-                pa_operation_unref(op);
-        }
-    }, &context);
+// Sources of finished voices are destroyed on the thread the engine lives
+// on: a decoder joins its thread, a WAV unmaps its file. One release is in
+// flight at a time, it takes whatever was retired until it runs.
+void SoundpadAudio::releaseRetiredSources() {
+    if (mixer_.retiredSources() == 0 || releasePosted_.exchange(true)) {
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this]() {
+        releasePosted_ = false;
+        mixer_.releaseRetired();
+    }, Qt::QueuedConnection);
+}
 
-    if (pa_context_connect(ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
-        qDebug() << "Failed to connect context";
-        pa_context_unref(ctx);
-        pa_mainloop_free(ml);
-        return {};
+void SoundpadAudio::stop() {
+    qCDebug(lcAudio) << "[SoundpadAudio] stop called";
+    mainVoice_ = -1;
+    nextVoice_ = -1;
+    mixer_.stopAll();
+    flushRequested_ = true;
+    wakeWorker();
+}
+
+void SoundpadAudio::seek(qint64 ms) {
+    qCDebug(lcAudio) << "[SoundpadAudio] seek called to ms:" << ms;
+    int voice = mainVoice_;
+    if (voice >= 0) {
+        mixer_.seekVoice(voice, ms);
+        currentMs_ = ms;
     }
+}
 
-    while (!context.done) {
-        pa_mainloop_iterate(ml, 1, nullptr);
+void SoundpadAudio::setTrackGain(float gain) {
+    int voice = mainVoice_;
+    if (voice >= 0) {
+        mixer_.setVoiceGain(voice, gain);
     }
+}
 
-    pa_context_disconnect(ctx);
-    pa_context_unref(ctx);
-    pa_mainloop_free(ml);
+void SoundpadAudio::setMasterGain(float gain) {
+    QMutexLocker locker(&levelsMutex_);
+    levels_.master = std::max(gain, 0.0f);
+    publishLevels();
+}
 
-    qDebug() << "getSourceList() finished. Total:" << context.sources.size();
-    return context.sources;
+void SoundpadAudio::setBusGain(Bus bus, float gain) {
+    QMutexLocker locker(&levelsMutex_);
+    levels_.gain[static_cast<int>(bus)] = std::max(gain, 0.0f);
+    publishLevels();
 }
 
-std::vector<std::pair<std::string, std::string>> SoundpadAudio::getSinkList()
-{
-    qDebug() << "[SoundpadAudio] getSinkList called";
-
-    pa_mainloop *ml = pa_mainloop_new();
-    pa_context *ctx = pa_context_new(pa_mainloop_get_api(ml), "SoundpadContext");
-
-    struct SinkListContext {
-        std::vector<std::pair<std::string, std::string>> sinks;
-        bool done = false;
-    } context;
-
-    pa_context_set_state_callback(ctx, [](pa_context *c, void *userdata) {
-        if (pa_context_get_state(c) == PA_CONTEXT_READY) {
-            qDebug() << "[SoundpadAudio] PA context ready, querying sink list";
-            pa_operation *op = pa_context_get_sink_info_list(
-                c,
-                [](pa_context *, const pa_sink_info *info, int eol, void *userdata) {
-                    auto *data = static_cast<SinkListContext*>(userdata);
-                    if (eol > 0) {
-                        data->done = true;
-                        qDebug() << "[SoundpadAudio] End of sink list";
-                        return;
-                    }
-                    if (info) {
-                        std::string name = info->name ? info->name : "";
-                        std::string desc = info->description ? info->description : "";
-
-                        // Include all sinks except our virtual one
-                        if (name != "SoundpadSink") {
-                            qDebug() << "[SoundpadAudio] Found sink:" << QString::fromStdString(name)
-                                     << "(" << QString::fromStdString(desc) << ")";
-                            data->sinks.emplace_back(name, desc);
-                        }
-                    }
-                },
-                userdata
-            );
-            if (op)
-                pa_operation_unref(op);
-            else
-                qDebug() << "[SoundpadAudio] Failed to create operation for getting sink list";
-        } else if (pa_context_get_state(c) == PA_CONTEXT_FAILED ||
-                   pa_context_get_state(c) == PA_CONTEXT_TERMINATED) {
-            qDebug() << "[SoundpadAudio] PA context failed or terminated";
-            static_cast<SinkListContext*>(userdata)->done = true;
-        }
-    }, &context);
+void SoundpadAudio::setBusMuted(Bus bus, bool muted) {
+    QMutexLocker locker(&levelsMutex_);
+    levels_.muted[static_cast<int>(bus)] = muted;
+    publishLevels();
+}
 
-    if (pa_context_connect(ctx, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0) {
-        qDebug() << "[SoundpadAudio] Failed to connect context:" << pa_strerror(pa_context_errno(ctx));
-        pa_context_unref(ctx);
-        pa_mainloop_free(ml);
-        return {};
-    }
+SoundpadAudio::OutputLevels SoundpadAudio::outputLevels() const {
+    QMutexLocker locker(&levelsMutex_);
+    return levels_;
+}
 
-    // Wait for the operation to complete
-    int ret = 0;
-    while (!context.done && pa_mainloop_iterate(ml, 1, &ret) >= 0) {
-        // Just iterate until done
+void SoundpadAudio::publishLevels() {
+    static_assert(std::atomic<BusGains>::is_always_lock_free, "the audio worker must not take a lock for its gains");
+    BusGains gains;
+    for (int bus = 0; bus < 2; ++bus) {
+        gains.bus[bus] = levels_.muted[bus] ? 0.0f : levels_.master * levels_.gain[bus];
     }
+    busGains_.store(gains, std::memory_order_relaxed);
+}
 
-    pa_context_disconnect(ctx);
-    pa_context_unref(ctx);
-    pa_mainloop_free(ml);
+qint64 SoundpadAudio::currentTime() const {
+    return currentMs_;
+}
 
-    qDebug() << "[SoundpadAudio] getSinkList() finished. Total:" << context.sinks.size();
-    return context.sinks;
+qint64 SoundpadAudio::totalTime() const {
+    return totalMs_;
 }
 
-void SoundpadAudio::setOutputSink(const std::string& sinkName)
+std::vector<std::pair<std::string, std::string>> SoundpadAudio::getSourceList()
 {
-    qDebug() << "[SoundpadAudio] setOutputSink called with:" << QString::fromStdString(sinkName);
-    QMutexLocker locker(&mutex_);
-    outputSinkName_ = sinkName;
+    qCDebug(lcAudio) << "[SoundpadAudio] getSourceList called";
+    std::vector<std::pair<std::string, std::string>> sources;
+    for (auto& source : backend_->sources()) {
+        qCDebug(lcAudio) << "Found source:" << QString::fromStdString(source.name)
+                 << "(" << QString::fromStdString(source.description) << ")";
+        sources.emplace_back(std::move(source.name), std::move(source.description));
+    }
+    qCDebug(lcAudio) << "getSourceList() finished. Total:" << sources.size();
+    return sources;
 }
 
-std::string SoundpadAudio::getOutputSink() const
+std::vector<std::pair<std::string, std::string>> SoundpadAudio::getSinkList()
 {
-    QMutexLocker locker(&mutex_);
-    return outputSinkName_;
+    qCDebug(lcAudio) << "[SoundpadAudio] getSinkList called";
+    std::vector<std::pair<std::string, std::string>> sinks;
+    for (auto& sink : backend_->sinks()) {
+        // Include all sinks except our virtual one
+        if (sink.name != sinkName_) {
+            qCDebug(lcAudio) << "[SoundpadAudio] Found sink:" << QString::fromStdString(sink.name)
+                     << "(" << QString::fromStdString(sink.description) << ")";
+            sinks.emplace_back(std::move(sink.name), std::move(sink.description));
+        }
+    }
+    qCDebug(lcAudio) << "[SoundpadAudio] getSinkList() finished. Total:" << sinks.size();
+    return sinks;
 }
 
-// Modify playbackThreadFunc to use both the selected output sink and the virtual sink
-void SoundpadAudio::playbackThreadFunc(const std::string& wavFilePath) {
-    qDebug() << "[SoundpadAudio] playbackThreadFunc started for file:" << QString::fromStdString(wavFilePath);
-    std::ifstream file(wavFilePath, std::ios::binary);
-    if (!file) {
-        qDebug() << "[SoundpadAudio] Не удалось открыть WAV файл:" << QString::fromStdString(wavFilePath);
-        emit playbackStopped();
-        return;
-    }
-    file.seekg(0, std::ios::end);
-    std::streampos fileSize = file.tellg();
-    file.seekg(44, std::ios::beg); // skip header
-    qint64 dataSize = static_cast<qint64>(fileSize) - 44;
-    qint64 bytesPerSec = 44100 * 2 * 2;
-    const qint64 blockAlign = 4; // 16-bit stereo PCM: 4 bytes per frame
-    qDebug() << "[SoundpadAudio] fileSize:" << static_cast<qint64>(fileSize)
-             << "dataSize:" << dataSize << "bytesPerSec:" << bytesPerSec;
+void SoundpadAudio::setOutputSink(const std::string& sinkName)
+{
+    qCDebug(lcAudio) << "[SoundpadAudio] setOutputSink called with:" << QString::fromStdString(sinkName);
     {
         QMutexLocker locker(&mutex_);
-        totalMs_ = (dataSize * 1000) / bytesPerSec;
-        currentMs_ = 0;
+        outputSinkName_ = sinkName;
     }
-    emit playbackStarted(totalMs_);
+    // Playing sounds move to the new device right away
+    reconfigure_ = true;
+    wakeWorker();
+}
 
-    static const pa_sample_spec ss = {
-        .format = PA_SAMPLE_S16LE,
-        .rate = 44100,
-        .channels = 2
+std::string SoundpadAudio::getOutputSink() const
+{
+    QMutexLocker locker(&mutex_);
+    return outputSinkName_;
+}
+
+// The audio worker, started with the engine and joined by its destructor.
+// It sleeps on the backend in every state, so a play request, stop() and a
+// write request from the server all wake it the same way, and while playing
+// it writes exactly as much as the server asks for. It starts by opening
+// the streams, which sets up the virtual mic.
+void SoundpadAudio::workerLoop() {
+    qCDebug(lcAudio) << "[SoundpadAudio] audio worker started";
+    constexpr size_t kMixFrames = 1024;
+    std::vector<float> buffer(kMixFrames * Mixer::kChannels);
+    // Each bus gets the mix through its own gain stage
+    std::vector<float> busOut[2] = { std::vector<float>(buffer.size()), std::vector<float>(buffer.size()) };
+    BusGains applied = busGains_.load(std::memory_order_relaxed);
+    const size_t frameBytes = static_cast<size_t>(mixer_.format().frameBytes());
+    EngineState state = EngineState::Preparing;
+
+    // Stream pointers are only re-read (under mutex_) when ensureStreams()
+    // actually replaced one, the steady state takes no lock the GUI holds
+    std::shared_ptr<OutputStream> virtualSink;
+    std::shared_ptr<OutputStream> headphonesOutput;
+    std::shared_ptr<InputStream> micInput;
+    quint64 streamsVersion = 0;
+    bool haveStreams = false;
+    // The mic joins the mix once its ring holds a fragment beyond a write,
+    // and again after it ran short: it arrives in whole fragments while the
+    // sink takes small chunks
+    bool micPrimed = false;
+
+    auto forEachStream = [&](auto&& fn) {
+        if (virtualSink) fn(*virtualSink);
+        if (headphonesOutput) fn(*headphonesOutput);
     };
-    
-    int error;
-    
-    // Determine which sink to use for user's headphones
-    std::string headphonesSink;
-    {
-        QMutexLocker locker(&mutex_);
-        headphonesSink = outputSinkName_;
-    }
-    
-    // Create a client for the virtual sink (for mic) and a client for the headphones
-    pa_simple *virtualSink = nullptr;
-    pa_simple *headphonesOutput = nullptr;
-    
-    // Always connect to the virtual sink for mic merging
-    virtualSink = pa_simple_new(
-        nullptr, "SoundpadAppVirtual", PA_STREAM_PLAYBACK, sinkName_.c_str(),
-        "virtual-playback", &ss, nullptr, nullptr, &error
-    );
-    
-    if (!virtualSink) {
-        qDebug() << "[SoundpadAudio] Failed to connect to virtual sink:" << pa_strerror(error);
-        emit playbackStopped();
-        return;
-    }
-    
-    // Connect to the headphones output if specified
-    if (!headphonesSink.empty()) {
-        qDebug() << "[SoundpadAudio] Also connecting to headphones sink:" << QString::fromStdString(headphonesSink);
-        headphonesOutput = pa_simple_new(
-            nullptr, "SoundpadAppHeadphones", PA_STREAM_PLAYBACK, headphonesSink.c_str(),
-            "headphones-playback", &ss, nullptr, nullptr, &error
-        );
-        
-        if (!headphonesOutput) {
-            qDebug() << "[SoundpadAudio] Failed to connect to headphones sink:" << pa_strerror(error);
-            // Continue anyway - we'll still output to the virtual sink
+
+    // Underflows only count while sounds are playing: each burst of sound
+    // also ends in one once the drained stream runs dry. Lock held.
+    quint64 seenUnderflows = 0;
+    quint64 seenOverflows = 0;
+    auto countStreamEvents = [&](bool playing) {
+        quint64 underflows = 0;
+        quint64 overflows = 0;
+        forEachStream([&](OutputStream& stream) {
+            underflows += stream.underflows();
+            overflows += stream.overflows();
+        });
+        // Totals drop when a stream is replaced, that only moves the baseline
+        if (playing && underflows > seenUnderflows) {
+            underruns_ += underflows - seenUnderflows;
         }
-    }
-    
-    constexpr size_t bufferSize = 4096;
-    std::vector<char> buffer(bufferSize);
-    qint64 playedBytes = 0;
+        if (overflows > seenOverflows) {
+            overruns_ += overflows - seenOverflows;
+        }
+        seenUnderflows = underflows;
+        seenOverflows = overflows;
+    };
 
-    while (true) {
-        {
+    while (!quit_) {
+        state_ = state;
+        const quint64 version = streamsVersion_.load();
+        if (!haveStreams || version != streamsVersion) {
             QMutexLocker locker(&mutex_);
-            if (stopRequested_) {
-                qDebug() << "[SoundpadAudio] stopRequested_ set, breaking loop";
-                break;
+            virtualSink = virtualStream_;
+            headphonesOutput = headphonesStream_;
+            micInput = micStream_;
+            micPrimed = false;
+            streamsVersion = version;
+            haveStreams = true;
+        }
+
+        // Stop cuts the queued audio and takes effect without waiting for a write request
+        if (flushRequested_.exchange(false)) {
+            {
+                AudioBackend::Lock lock(*backend_);
+                forEachStream([](OutputStream& stream) {
+                    stream.cancelDrain();
+                    stream.flush();
+                });
             }
-            if (seekToMs_ >= 0) {
-                qint64 seekByte = (seekToMs_ * bytesPerSec) / 1000;
-                seekByte = std::min(seekByte, dataSize);
-                // Align seekByte to blockAlign (round down)
-                seekByte = (seekByte / blockAlign) * blockAlign;
-                file.clear(); // сбросить флаги ошибок
-                file.seekg(44 + seekByte, std::ios::beg);
-                playedBytes = seekByte;
-                currentMs_ = seekToMs_;
-                qDebug() << "[SoundpadAudio] Seek requested to ms:" << seekToMs_
-                         << "seekByte:" << seekByte << "playedBytes:" << playedBytes;
-                seekToMs_ = -1;
-                // Если после seek мы в конце файла — завершить воспроизведение
-                if (playedBytes >= dataSize) {
-                    qDebug() << "[SoundpadAudio] Seeked to end of file, breaking loop";
-                    break;
-                }
+            // Sounds requested right after the stop are kept
+            if (mixer_.mix(buffer.data(), 0) > 0 || state != EngineState::Idle) {
+                state = EngineState::Preparing;
             }
+            releaseRetiredSources();
+            continue;
         }
-        // Проверка конца файла перед чтением
-        if (playedBytes >= dataSize) {
-            qDebug() << "[SoundpadAudio] playedBytes >= dataSize, breaking loop";
+
+        switch (state) {
+        case EngineState::Idle: {
+            AudioBackend::Lock lock(*backend_);
+            if (mixer_.hasRequests() || (micEnabled_ && reconfigure_)) {
+                state = EngineState::Preparing;
+            } else if (!quit_ && !flushRequested_) {
+                backend_->wait();
+            }
             break;
         }
-        // Читаем только оставшееся количество байт
-        size_t bytesLeft = static_cast<size_t>(dataSize - playedBytes);
-        if (bytesLeft == 0) {
-            qDebug() << "[SoundpadAudio] bytesLeft == 0, breaking loop";
+
+        case EngineState::Preparing:
+            {
+                AudioBackend::Lock lock(*backend_);
+                countStreamEvents(false);
+            }
+            reconfigure_ = false;
+            if (ensureStreams(mixer_.format())) {
+                state = EngineState::Playing;
+                break;
+            }
+            qCDebug(lcAudio) << "[SoundpadAudio] Failed to connect to virtual sink, stopping all voices";
+            mixer_.stopAll();
+            mixer_.mix(buffer.data(), 0);
+            releaseRetiredSources();
+            if (mainVoice_.exchange(-1) >= 0) {
+                emit playbackStopped();
+            }
+            state = EngineState::Idle;
+            break;
+
+        case EngineState::Playing: {
+            if (reconfigure_) {
+                state = EngineState::Preparing;
+                break;
+            }
+
+            // Wait until both streams ask for data
+            size_t writable = 0;
+            bool capturing = false;
+            {
+                AudioBackend::Lock lock(*backend_);
+                if (!virtualSink || !virtualSink->isReady()) {
+                    qCDebug(lcAudio) << "[SoundpadAudio] Virtual sink stream is gone, reconnecting";
+                    state = EngineState::Preparing;
+                    break;
+                }
+                writable = virtualSink->writableSize();
+                capturing = micInput && micInput->isReady();
+                if (headphonesOutput && headphonesOutput->isReady()) {
+                    writable = std::min(writable, headphonesOutput->writableSize());
+                }
+                if (writable < frameBytes) {
+                    if (!quit_ && !flushRequested_ && !reconfigure_) {
+                        backend_->wait();
+                    }
+                    break;
+                }
+            }
+
+            const size_t frames = std::min(kMixFrames, writable / frameBytes);
+            const size_t active = mixer_.mix(buffer.data(), frames);
+            releaseRetiredSources();
+
+            // The mic goes out on the virtual bus only, at its own level
+            float *virtualOut = busOut[static_cast<int>(Bus::Virtual)].data();
+            const float *monitorOut = busOut[static_cast<int>(Bus::Monitor)].data();
+            size_t micFrames = 0;
+            if (capturing) {
+                const size_t fragment = micInput->fragmentFrames();
+                const size_t backlog = micInput->available();
+                micPrimed = micPrimed || backlog >= frames + fragment;
+                // Source and sink run on different clocks: frames piling up
+                // beyond the jitter the ring absorbs would only add delay
+                if (micPrimed && backlog > frames + 3 * fragment) {
+                    micInput->discard(backlog - frames - fragment);
+                    ++micDropouts_;
+                }
+                micFrames = micPrimed ? micInput->read(virtualOut, frames) : 0;
+                if (micPrimed && micFrames < frames) {
+                    micPrimed = false;
+                    ++micDropouts_;
+                }
+            } else {
+                micPrimed = false;
+            }
+
+            // Gain changes since the last write are ramped across this one
+            const BusGains target = busGains_.load(std::memory_order_relaxed);
+            for (int bus = 0; bus < 2; ++bus) {
+                const float step = (target.bus[bus] - applied.bus[bus]) / static_cast<float>(frames);
+                if (bus == static_cast<int>(Bus::Virtual) && capturing) {
+                    std::fill(virtualOut + micFrames * Mixer::kChannels, virtualOut + frames * Mixer::kChannels, 0.0f);
+                    mix::accumulateRamp(virtualOut, buffer.data(), applied.bus[bus], step, frames);
+                    mix::softClip(virtualOut, frames * Mixer::kChannels);
+                } else {
+                    mix::gainClip(busOut[bus].data(), buffer.data(), applied.bus[bus], step, frames);
+                }
+            }
+            applied = target;
+
+            uint64_t queuedUs = 0;
+            {
+                AudioBackend::Lock lock(*backend_);
+                // Write to virtual sink (for mic)
+                virtualSink->write(virtualOut, frames * frameBytes);
+                // Write to headphones if connected
+                if (headphonesOutput && headphonesOutput->isReady()) {
+                    headphonesOutput->write(monitorOut, frames * frameBytes);
+                }
+                queuedUs = virtualSink->latencyUs();
+                countStreamEvents(true);
+            }
+
+            const auto written = Mixer::Clock::now();
+            if (queuedUs > 0) {
+                streamLatency_.record(queuedUs);
+            }
+            for (const auto& voice : mixer_.startedVoices()) {
+                const auto us = std::chrono::duration_cast<std::chrono::microseconds>(written - voice.triggered).count();
+                triggerToWrite_.record(static_cast<quint64>(us));
+                triggerToOutput_.record(static_cast<quint64>(us) + queuedUs);
+            }
+            const qint64 decodeAhead = mixer_.decodeAheadUs();
+            if (decodeAhead >= 0) {
+                decodeAhead_.record(static_cast<quint64>(decodeAhead));
+            }
+
+            // The queued track becomes the current one with its first frames
+            int next = nextVoice_;
+            if (next >= 0) {
+                const auto& started = mixer_.startedVoices();
+                const bool advanced = std::any_of(started.begin(), started.end(),
+                                                  [next](const Mixer::StartedVoice& voice) { return voice.id == next; });
+                if (advanced && nextVoice_.compare_exchange_strong(next, -1)) {
+                    qCDebug(lcAudio) << "[SoundpadAudio] Advanced to the queued track";
+                    mainVoice_ = next;
+                    totalMs_ = nextTotalMs_.load();
+                    currentMs_ = 0;
+                    emit trackAdvanced(totalMs_);
+                }
+            }
+
+            int main = mainVoice_;
+            if (main >= 0) {
+                const auto& finished = mixer_.finishedVoices();
+                if (std::find(finished.begin(), finished.end(), main) != finished.end()) {
+                    // Only a natural end is reported, stop() and replacing the track are not.
+                    // A track queued too late to be spliced starts on the next mix.
+                    const int queued = nextVoice_;
+                    const bool handsOver = queued >= 0 && (mixer_.isActive(queued) || mixer_.hasRequests());
+                    if (mainVoice_.compare_exchange_strong(main, -1) && !handsOver) {
+                        qCDebug(lcAudio) << "[SoundpadAudio] Track finished";
+                        emit playbackStopped();
+                    }
+                } else if (mixer_.isActive(main)) {
+                    qint64 nowMs = mixer_.positionMs(main);
+                    currentMs_ = nowMs;
+                    emit playbackProgress(nowMs);
+                }
+            }
+
+            // A merged mic keeps the virtual sink fed even without sounds
+            if (active == 0 && !mixer_.hasRequests() && !capturing) {
+                AudioBackend::Lock lock(*backend_);
+                forEachStream([](OutputStream& stream) {
+                    stream.beginDrain();
+                });
+                state = EngineState::Draining;
+            }
             break;
         }
-        size_t readSize = std::min(buffer.size(), bytesLeft);
-        file.read(buffer.data(), readSize);
-        std::streamsize bytesRead = file.gcount();
-        if (bytesRead <= 0) {
-            qDebug() << "[SoundpadAudio] bytesRead <= 0, breaking loop";
-            break; // конец файла или ошибка
-        }
-        // Если bytesRead < buffer.size(), не отправлять остаток буфера (только bytesRead)
-        size_t toWrite = static_cast<size_t>(bytesRead);
-        if (toWrite > bytesLeft) {
-            toWrite = bytesLeft;
-        }
-        
-        // Write to virtual sink (for mic)
-        if (pa_simple_write(virtualSink, buffer.data(), toWrite, &error) < 0) {
-            qDebug() << "[SoundpadAudio] pa_simple_write to virtual sink failed:" << pa_strerror(error);
-            // Continue anyway, don't break the loop
-        }
-        
-        // Write to headphones if connected
-        if (headphonesOutput) {
-            if (pa_simple_write(headphonesOutput, buffer.data(), toWrite, &error) < 0) {
-                qDebug() << "[SoundpadAudio] pa_simple_write to headphones failed:" << pa_strerror(error);
-                // Continue anyway, don't break the loop
+
+        case EngineState::Draining: {
+            AudioBackend::Lock lock(*backend_);
+            countStreamEvents(false);
+            if (mixer_.hasRequests() || reconfigure_) {
+                // Retriggered while the tail was still playing
+                forEachStream([](OutputStream& stream) {
+                    stream.cancelDrain();
+                });
+                state = EngineState::Playing;
+                break;
+            }
+            bool drained = true;
+            forEachStream([&drained](OutputStream& stream) {
+                drained = drained && (!stream.isReady() || stream.isDrained());
+            });
+            if (drained) {
+                state = EngineState::Idle;
+            } else if (!quit_ && !flushRequested_) {
+                backend_->wait();
             }
+            break;
         }
-        
-        playedBytes += toWrite;
-        {
-            QMutexLocker locker(&mutex_);
-            currentMs_ = (playedBytes * 1000) / bytesPerSec;
         }
-        emit playbackProgress(currentMs_);
-        double msPerBlock = (double)toWrite / (double)bytesPerSec * 1000.0;
-        if (msPerBlock > 0.0)
-            std::this_thread::sleep_for(std::chrono::milliseconds((int)msPerBlock));
-    }
-    
-    // Drain and free both outputs
-    if (virtualSink) {
-        pa_simple_drain(virtualSink, &error);
-        pa_simple_free(virtualSink);
-    }
-    
-    if (headphonesOutput) {
-        pa_simple_drain(headphonesOutput, &error);
-        pa_simple_free(headphonesOutput);
     }
-    
-    qDebug() << "[SoundpadAudio] playbackThreadFunc finished";
-    emit playbackStopped();
+
+    state_ = EngineState::Idle;
+    qCDebug(lcAudio) << "[SoundpadAudio] audio worker finished";
+}
+
+SoundpadAudio::Diagnostics SoundpadAudio::diagnostics() const {
+    Diagnostics diagnostics;
+    diagnostics.triggerToWrite = triggerToWrite_.snapshot();
+    diagnostics.triggerToOutput = triggerToOutput_.snapshot();
+    diagnostics.streamLatency = streamLatency_.snapshot();
+    diagnostics.decodeAhead = decodeAhead_.snapshot();
+    diagnostics.underruns = underruns_;
+    diagnostics.overruns = overruns_;
+    diagnostics.micDropouts = micDropouts_;
+    return diagnostics;
 }
 
+void SoundpadAudio::resetDiagnostics() {
+    triggerToWrite_.reset();
+    triggerToOutput_.reset();
+    streamLatency_.reset();
+    decodeAhead_.reset();
+    underruns_ = 0;
+    overruns_ = 0;
+    micDropouts_ = 0;
+}
 
 bool SoundpadAudio::mergeWithMic(const std::string& sourceName)
 {
-    qDebug() << "[SoundpadAudio] mergeWithMic called for source:" << QString::fromStdString(sourceName);
-    ensureAudioObjectsExist(sinkName_);
-    qDebug() << "Merging source with mic:" << QString::fromStdString(sourceName)
+    qCDebug(lcAudio) << "[SoundpadAudio] mergeWithMic called for source:" << QString::fromStdString(sourceName);
+    qCDebug(lcAudio) << "Merging source with mic:" << QString::fromStdString(sourceName)
              << "into sink:" << QString::fromStdString(sinkName_);
 
-    std::string cmd = "pactl load-module module-loopback source=" + sourceName + " sink=" + sinkName_;
-    int result = std::system(cmd.c_str());
-
-    if (result != 0) {
-        qDebug() << "pactl load-module failed with code:" << result;
+    backend_->checkMicRoutes(sinkName_);
+    if (!sourceName.empty() && !backend_->hasSource(sourceName)) {
+        qCDebug(lcAudio) << "[SoundpadAudio] No such source:" << QString::fromStdString(sourceName);
         return false;
     }
 
-    qDebug() << "Loopback module loaded successfully";
+    {
+        QMutexLocker locker(&mutex_);
+        micSourceName_ = sourceName;
+    }
+    micEnabled_ = !sourceName.empty();
+    // The worker opens the record stream, from Idle too
+    reconfigure_ = true;
+    wakeWorker();
     return true;
 }
 
+void SoundpadAudio::setMicLatencyMs(int ms)
+{
+    micLatencyMs_ = std::clamp(ms, 5, 200);
+    if (micEnabled_) {
+        reconfigure_ = true;
+        wakeWorker();
+    }
+}
+
 } // namespace soundpad
@@ -1,34 +1,121 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
 #include <QObject>
-#include <QThread>
 #include <QMutex>
-#include <QWaitCondition>
+#include "AudioBackend.hpp"
+#include "PcmSource.hpp"
+#include "Histogram.hpp"
+#include "Mixer.hpp"
+#include "SampleBank.hpp"
 
 namespace soundpad {
 
 class SoundpadAudio : public QObject {
     Q_OBJECT
 public:
-    explicit SoundpadAudio(const std::string& sinkName = "SoundpadSink");
-    ~SoundpadAudio();
+    // What the audio worker is doing. Idle: nothing playing, asleep until a
+    // command arrives. Preparing: (re)opening the output streams. Playing:
+    // mixing voices (and the captured mic) into the streams. Draining:
+    // every voice has ended, no mic is captured and the audio still queued
+    // in the server plays out; a new sound goes straight back to Playing.
+    enum class EngineState { Idle, Preparing, Playing, Draining };
 
-    // Воспроизвести WAV-файл (16-bit PCM, 44.1kHz, stereo)
-    bool playWav(const std::string& wavFilePath); // start playback (async)
-    void stop();
+    // Runs on `backend`, or on AudioBackend::createDefault() when none is
+    // given. Nothing is created in the sound server here: the audio worker
+    // sets up the virtual mic once it runs.
+    explicit SoundpadAudio(const std::string& sinkName = "SoundpadSink",
+                           std::unique_ptr<AudioBackend> backend = nullptr);
+    ~SoundpadAudio(); // stops playback and joins the audio worker
+    const char *backendName() const { return backend_->name(); }
+
+    // Воспроизвести WAV-файл (PCM 8/16/24/32-bit или float, 1-8 каналов)
+    // By default the sound replaces the current track; with overlay it is
+    // mixed on top of everything that is playing and does not drive the
+    // progress signals. `gain` (linear) is the voice's own, e.g. the
+    // track's loudness normalisation.
+    bool playWav(const std::string& wavFilePath, bool overlay = false, float gain = 1.0f); // start playback (async)
+    // Воспроизвести файл любого формата (WAV напрямую, остальное через декодер)
+    bool playFile(const std::string& filePath, bool overlay = false, float gain = 1.0f);
+    // Play a sample resident in the bank; false if it is not (yet) loaded
+    bool playSample(const std::string& key, bool overlay = false, float gain = 1.0f);
+    // Pre-roll the track that follows the current one. It is opened now and
+    // spliced in on the frame where the current track ends, or crossfaded
+    // over the last crossfadeMs() of it; trackAdvanced() then announces it.
+    // Queuing again replaces the previous choice. False if nothing is
+    // playing or the file cannot be opened.
+    bool queueFile(const std::string& filePath, float gain = 1.0f);
+    bool queueSample(const std::string& key, float gain = 1.0f);
+    void clearQueue();
+    void setCrossfadeMs(int ms); // 0 plays the next track gaplessly
+    int crossfadeMs() const { return crossfadeMs_; }
+
+    // Pad trigger from outside the GUI (global hotkeys): overlays the bank
+    // sample for `key` or, if it is not resident, the file at `path`.
+    // Safe to call from any thread.
+    bool triggerPad(const std::string& key, const std::string& path, Mixer::Clock::time_point pressed,
+                    float gain = 1.0f);
+
+    // Engine telemetry in microseconds. The audio worker records into
+    // lock-free histograms; reading them never blocks it.
+    struct Diagnostics {
+        Histogram::Snapshot triggerToWrite;  // play request to its first samples written
+        Histogram::Snapshot triggerToOutput; // plus the stream latency right after that write
+        Histogram::Snapshot streamLatency;   // stream latency of the virtual sink, per write
+        Histogram::Snapshot decodeAhead;     // shortest decode-ahead of the playing voices, per write
+        quint64 underruns = 0;               // the server ran dry while sounds were playing
+        quint64 overruns = 0;
+        quint64 micDropouts = 0;             // the captured mic ran short or too far ahead of the sink
+    };
+    Diagnostics diagnostics() const;
+    void resetDiagnostics();
+    void stop(); // stops every voice
+    EngineState engineState() const { return state_; }
+    // Seek, gain and time queries refer to the current track
     void seek(qint64 ms);
+    void setTrackGain(float gain); // linear, ramped to
     qint64 currentTime() const;
     qint64 totalTime() const;
 
+    // The mix goes out on two buses: Virtual, the virtual sink that feeds
+    // the mic, and Monitor, the selected output device we listen on. Each
+    // has its own gain and mute under a master gain (all linear). Safe from
+    // any thread; the audio worker ramps to new levels over its next write,
+    // so moving a fader neither clicks nor waits for the worker.
+    enum class Bus { Virtual = 0, Monitor = 1 };
+    struct OutputLevels {
+        float master = 1.0f;
+        float gain[2] = { 1.0f, 1.0f }; // indexed by Bus
+        bool muted[2] = { false, false };
+    };
+    void setMasterGain(float gain);
+    void setBusGain(Bus bus, float gain);
+    void setBusMuted(Bus bus, bool muted);
+    OutputLevels outputLevels() const;
+
     // Получить список всех источников звука: (имя, описание)
+    // Both lists come from the device registry, not from the server; the
+    // first call waits for it to be filled.
     std::vector<std::pair<std::string, std::string>> getSourceList();
     
     // Получить список всех устройств вывода: (имя, описание)
     std::vector<std::pair<std::string, std::string>> getSinkList();
 
-    // Подключить выбранный source к нашей sink через loopback
+    // Подключить выбранный source к нашей sink
+    // The audio worker records the source itself and mixes it under the
+    // pads into the virtual sink; an empty name stops capturing. Selecting
+    // another source replaces the previous one. Loopback modules into our
+    // sink, e.g. left by older versions, are reported (see
+    // AudioBackend::checkMicRoutes), not unloaded.
     bool mergeWithMic(const std::string& sourceName);
+    // Voice delay added on our side while a mic is merged: half of it is the
+    // capture fragment, half the buffer of the virtual sink stream. Smaller
+    // is snappier, larger survives a busier system. Reopens the streams.
+    void setMicLatencyMs(int ms);
+    int micLatencyMs() const { return micLatencyMs_; }
     
     // Установить устройство вывода для воспроизведения
     void setOutputSink(const std::string& sinkName);
@@ -36,31 +123,81 @@ public:
     // Получить текущее устройство вывода
     std::string getOutputSink() const;
 
+    // Decoded samples of hot pads kept in RAM
+    SampleBank& sampleBank() { return bank_; }
+
 signals:
     void playbackStarted(qint64 totalMs);
     void playbackProgress(qint64 currentMs);
     void playbackStopped();
+    // The queued track took over as the current one
+    void trackAdvanced(qint64 totalMs);
+    // Sinks and sources plugged in, unplugged or renamed while running, as
+    // the two lists above would now report them. Sent from the backend's thread.
+    void deviceAdded(const soundpad::AudioDevice& device);
+    void deviceRemoved(const soundpad::AudioDevice& device);
+    void deviceChanged(const soundpad::AudioDevice& device);
 
 private:
-    void playbackThreadFunc(const std::string& wavFilePath);
+    bool startPlayback(std::shared_ptr<PcmSource> source, const std::string& filePath, bool overlay, float gain,
+                       Mixer::Clock::time_point triggered = Mixer::Clock::now());
+    bool queuePlayback(std::shared_ptr<PcmSource> source, float gain);
+    std::shared_ptr<PcmSource> openFile(const std::string& filePath);
+    void wakeWorker();
+    void releaseRetiredSources(); // audio worker, after each mix
+    void workerLoop();
+
+    bool ensureStreams(const PcmFormat& format);
+    void publishLevels(); // levelsMutex_ held
 
-    // PulseAudio helpers
-    static bool sinkExists(const std::string& sinkName);
-    static bool sourceExists(const std::string& sourceName);
-    static void createNullSink(const std::string& sinkName);
-    static void createRemapSource(const std::string& masterMonitor, const std::string& sourceName);
-    static void ensureAudioObjectsExist(const std::string& sinkName);
+    // What the worker applies per bus: master * gain, 0 when muted. Both
+    // fit in one lock-free atomic, so a write always sees a consistent pair.
+    struct BusGains {
+        float bus[2];
+    };
 
     std::string sinkName_;        // Virtual sink for mic merging
     std::string outputSinkName_;  // Selected output device for playback
-    QThread workerThread_;
+    std::unique_ptr<AudioBackend> backend_;
+    // Streams stay open between sounds. Only the worker replaces them; they
+    // are shared so the GUI can still read the sink list meanwhile.
+    std::shared_ptr<OutputStream> virtualStream_;
+    std::shared_ptr<OutputStream> headphonesStream_;
+    std::shared_ptr<InputStream> micStream_;
+    std::string micSourceName_;   // empty: no mic merged
+    std::atomic<quint64> streamsVersion_{0}; // bumped whenever a stream is replaced
     mutable QMutex mutex_;
-    QWaitCondition seekCond_;
-    bool stopRequested_ = false;
-    qint64 seekToMs_ = -1;
-    qint64 currentMs_ = 0;
-    qint64 totalMs_ = 0;
+    // All voices are summed into one float stream per sink by the audio
+    // worker. It lives as long as the engine; play requests only post a
+    // mixer command and wake it.
+    Mixer mixer_;
+    SampleBank bank_;
+    std::thread worker_;
+    std::atomic<EngineState> state_{EngineState::Idle};
+    std::atomic<bool> quit_{false};
+    std::atomic<bool> reconfigure_{false}; // output sink changed, reopen the streams
+    std::atomic<bool> micEnabled_{false};  // keeps the engine out of Idle
+    std::atomic<int> micLatencyMs_{20};
+    std::atomic<int> mainVoice_{-1}; // voice of the current track
+    std::atomic<int> nextVoice_{-1}; // queued behind it
+    std::atomic<qint64> nextTotalMs_{0};
+    std::atomic<int> crossfadeMs_{0};
+    mutable QMutex levelsMutex_; // setters only, the worker reads busGains_
+    OutputLevels levels_;
+    std::atomic<BusGains> busGains_{BusGains{{1.0f, 1.0f}}};
+    std::atomic<bool> flushRequested_{false};
+    std::atomic<bool> releasePosted_{false}; // a releaseRetired() is queued to our thread
+    std::atomic<qint64> currentMs_{0};
+    std::atomic<qint64> totalMs_{0};
     std::string currentFile_;
+    // Written by the audio worker (see Diagnostics)
+    Histogram triggerToWrite_;
+    Histogram triggerToOutput_;
+    Histogram streamLatency_;
+    Histogram decodeAhead_;
+    std::atomic<quint64> underruns_{0};
+    std::atomic<quint64> overruns_{0};
+    std::atomic<quint64> micDropouts_{0};
 };
 
 } // namespace soundpad
@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace soundpad {
+
+// Wait-free single-producer/single-consumer ring of trivially copyable
+// elements. Positions are monotonic counters, the capacity is rounded up to
+// a power of two. Exactly one thread may call the producer methods and one
+// (other) thread the consumer methods.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t minCapacity)
+    {
+        size_t capacity = 1;
+        while (capacity < minCapacity) {
+            capacity <<= 1;
+        }
+        buffer_.resize(capacity);
+        mask_ = capacity - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return buffer_.size(); }
+
+    // Producer
+    size_t writeAvailable() const
+    {
+        return capacity() - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire));
+    }
+
+    size_t writePosition() const { return head_.load(std::memory_order_relaxed); }
+
+    // Copies as much of `data` as fits, returns the number of elements written
+    size_t push(const T *data, size_t count)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        count = std::min(count, capacity() - (head - tail));
+        copyIn(head, data, count);
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer
+    size_t readAvailable() const
+    {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+    }
+
+    size_t pop(T *out, size_t count)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+        copyOut(tail, out, count);
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Drop the oldest `count` elements, returns how many there were
+    size_t discard(size_t count)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        count = std::min(count, head_.load(std::memory_order_acquire) - tail);
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Drop everything written before `position` (a value of writePosition())
+    void skipTo(size_t position)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (position > tail) {
+            tail_.store(std::min(position, head_.load(std::memory_order_acquire)), std::memory_order_release);
+        }
+    }
+
+private:
+    void copyIn(size_t position, const T *data, size_t count)
+    {
+        const size_t start = position & mask_;
+        const size_t first = std::min(count, capacity() - start);
+        std::copy(data, data + first, buffer_.begin() + static_cast<std::ptrdiff_t>(start));
+        std::copy(data + first, data + count, buffer_.begin());
+    }
+
+    void copyOut(size_t position, T *out, size_t count) const
+    {
+        const size_t start = position & mask_;
+        const size_t first = std::min(count, capacity() - start);
+        std::copy(buffer_.begin() + static_cast<std::ptrdiff_t>(start),
+                  buffer_.begin() + static_cast<std::ptrdiff_t>(start + first), out);
+        std::copy(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(count - first), out + first);
+    }
+
+    std::vector<T> buffer_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0}; // next write position
+    alignas(64) std::atomic<size_t> tail_{0}; // next read position
+};
+
+} // namespace soundpad
@@ -0,0 +1,141 @@
+#include "StreamingDecoder.hpp"
+#include <algorithm>
+
+namespace soundpad {
+
+static constexpr size_t kDecodeChunk = 16384;
+
+StreamingDecoder::StreamingDecoder(size_t aheadBytes)
+    : ring_(std::max(aheadBytes, 2 * kDecodeChunk))
+{
+}
+
+StreamingDecoder::~StreamingDecoder()
+{
+    quit_ = true;
+    wakeDecoder();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool StreamingDecoder::open(const std::string& path)
+{
+    if (!decoder_.open(path)) {
+        return false;
+    }
+    qint64 ms = decoder_.durationMs();
+    if (ms >= 0) {
+        qint64 frames = ms * decoder_.outputRate() / 1000;
+        totalBytes_ = frames * decoder_.frameBytes();
+    }
+    thread_ = std::thread([this]() { decodeLoop(); });
+    return true;
+}
+
+PcmFormat StreamingDecoder::format() const
+{
+    PcmFormat format;
+    format.sampleFormat = SampleFormat::S16;
+    format.rate = decoder_.outputRate();
+    format.channels = decoder_.outputChannels();
+    return format;
+}
+
+void StreamingDecoder::wakeDecoder()
+{
+    decoderWake_.fetch_add(1);
+    decoderWake_.notify_one();
+}
+
+void StreamingDecoder::decodeLoop()
+{
+    // The ring holds whole frames only, so read() never splits one
+    const size_t chunkSize = kDecodeChunk - kDecodeChunk % static_cast<size_t>(decoder_.frameBytes());
+    std::vector<char> chunk(chunkSize);
+    quint32 generation = 0;
+    bool eof = false;
+
+    while (true) {
+        // Read the wake counter before looking at the state, so a wake-up
+        // that arrives in between is not lost
+        const quint32 wake = decoderWake_.load();
+        if (quit_) {
+            break;
+        }
+
+        const quint32 wanted = generation_.load();
+        if (wanted != generation) {
+            decoder_.seek(seekMs_.load());
+            generation = wanted;
+            eof = false;
+            ackPosition_.store(ring_.writePosition());
+            ackGeneration_.store(generation);
+            continue;
+        }
+
+        if (eof || ring_.writeAvailable() < chunkSize) {
+            decoderWake_.wait(wake);
+            continue;
+        }
+
+        size_t n = decoder_.read(chunk.data(), chunk.size());
+        if (generation_.load() != generation) {
+            continue; // a seek happened meanwhile, this audio is stale
+        }
+        if (n == 0) {
+            eof = true;
+            eofGeneration_.store(generation);
+        } else {
+            ring_.push(chunk.data(), n);
+        }
+    }
+}
+
+qint64 StreamingDecoder::bufferedBytes() const
+{
+    const quint32 generation = generation_.load(std::memory_order_relaxed);
+    if (ackGeneration_.load() != generation || skippedGeneration_ != generation) {
+        return 0; // what is queued belongs to the position before a seek
+    }
+    if (eofGeneration_.load() == static_cast<qint64>(generation)) {
+        return -1; // fully decoded, the reader can no longer starve
+    }
+    return static_cast<qint64>(ring_.readAvailable());
+}
+
+size_t StreamingDecoder::read(char *dst, size_t bytes)
+{
+    const quint32 generation = generation_.load(std::memory_order_relaxed);
+    // After a seek, nothing plays until the decoder has acknowledged it;
+    // the stale audio it queued before that is dropped
+    if (ackGeneration_.load() != generation) {
+        starved_ = true;
+        return 0;
+    }
+    if (skippedGeneration_ != generation) {
+        ring_.skipTo(ackPosition_.load());
+        skippedGeneration_ = generation;
+    }
+
+    // End of stream is read before the ring: once it is set, everything
+    // decoded is already in there
+    const bool eof = eofGeneration_.load() == static_cast<qint64>(generation);
+    size_t n = ring_.pop(dst, bytes);
+    starved_ = n == 0 && !eof;
+    if (n > 0) {
+        wakeDecoder();
+    }
+    return n;
+}
+
+bool StreamingDecoder::seekToByte(qint64 byte)
+{
+    qint64 bytesPerSec = static_cast<qint64>(decoder_.outputRate()) * decoder_.frameBytes();
+    seekMs_.store(std::max<qint64>(0, byte) * 1000 / bytesPerSec);
+    generation_.fetch_add(1);
+    wakeDecoder();
+    return true;
+}
+
+} // namespace soundpad
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioDecoder.hpp"
+#include "PcmSource.hpp"
+#include "SpscRing.hpp"
+
+namespace soundpad {
+
+// Plays any format libavformat can open without a transcoded copy on disk.
+// A background thread decodes into a lock-free ring buffer that stays
+// `aheadBytes` ahead of the playhead; read() only copies out of the ring and
+// never waits for the decoder: when the ring is empty (not filled yet, a
+// seek not acknowledged yet, a slow disk) it returns 0 and starved() is set.
+// The decode thread is the ring's only producer and the thread calling
+// read()/seekToByte() its only consumer; neither ever holds a lock the other
+// one needs, the reader wakes the decoder through an atomic counter.
+class StreamingDecoder : public PcmSource {
+public:
+    explicit StreamingDecoder(size_t aheadBytes = 44100 * 4 * 2); // ~2 s of audio
+    ~StreamingDecoder() override;
+
+    bool open(const std::string& path);
+
+    PcmFormat format() const override; // always S16, decoder rate and channels
+    qint64 totalBytes() const override { return totalBytes_; }
+    size_t read(char *dst, size_t bytes) override;
+    bool seekToByte(qint64 byte) override;
+    qint64 bufferedBytes() const override; // decode-ahead depth
+    bool starved() const override { return starved_; }
+
+private:
+    void decodeLoop();
+    void wakeDecoder();
+
+    AudioDecoder decoder_;
+    qint64 totalBytes_ = -1;
+    SpscRing<char> ring_;
+
+    // Seeks: the reader bumps generation_ after storing seekMs_; the decoder
+    // seeks, then publishes the ring position at which the new audio starts
+    // in ackPosition_ and the generation in ackGeneration_. Everything before
+    // that position was decoded for an older generation and is skipped.
+    std::atomic<qint64> seekMs_{0};
+    std::atomic<quint32> generation_{0};
+    std::atomic<size_t> ackPosition_{0};
+    std::atomic<quint32> ackGeneration_{0};
+    std::atomic<qint64> eofGeneration_{-1}; // generation whose audio has been fully decoded
+    quint32 skippedGeneration_ = 0;         // reader only
+    bool starved_ = false;                  // reader only
+
+    std::atomic<quint32> decoderWake_{0}; // bumped when the decoder may have work
+    std::atomic<bool> quit_{false};
+    std::thread thread_;
+};
+
+} // namespace soundpad
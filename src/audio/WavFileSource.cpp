@@ -0,0 +1,104 @@
+#include "WavFileSource.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace soundpad {
+
+WavFileSource::~WavFileSource()
+{
+    if (mapping_) {
+        munmap(mapping_, mappingSize_);
+    }
+}
+
+bool WavFileSource::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < 12) {
+        ::close(fd);
+        return false;
+    }
+    mappingSize_ = static_cast<size_t>(st.st_size);
+    void *mapping = mmap(nullptr, mappingSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (mapping == MAP_FAILED) {
+        mappingSize_ = 0;
+        return false;
+    }
+    mapping_ = mapping;
+
+    WavInfo info;
+    if (!parseWav(static_cast<const uint8_t*>(mapping_), mappingSize_, info)) {
+        munmap(mapping_, mappingSize_);
+        mapping_ = nullptr;
+        mappingSize_ = 0;
+        return false;
+    }
+    madvise(mapping_, mappingSize_, MADV_SEQUENTIAL);
+
+    format_ = info.format;
+    dataOffset_ = static_cast<qint64>(info.dataOffset);
+    data_ = static_cast<const char*>(mapping_) + info.dataOffset;
+    dataSize_ = static_cast<qint64>(info.dataSize);
+    position_ = 0;
+    adviseMark_ = 0;
+    adviseReadAhead();
+    return true;
+}
+
+// Ask the kernel to page in the next window before the playhead gets there
+void WavFileSource::adviseReadAhead()
+{
+    if (position_ < adviseMark_ - kReadAhead / 2) {
+        return;
+    }
+    static const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    qint64 start = dataOffset_ + position_;
+    start -= start % pageSize;
+    qint64 length = std::min<qint64>(kReadAhead, static_cast<qint64>(mappingSize_) - start);
+    if (length > 0) {
+        madvise(static_cast<char*>(mapping_) + start, static_cast<size_t>(length), MADV_WILLNEED);
+    }
+    adviseMark_ = position_ + kReadAhead;
+}
+
+bool WavFileSource::isPlayable(const std::string& path)
+{
+    WavFileSource source;
+    return source.open(path);
+}
+
+size_t WavFileSource::readView(const char **data, size_t bytes)
+{
+    size_t n = static_cast<size_t>(std::min<qint64>(static_cast<qint64>(bytes), dataSize_ - position_));
+    *data = data_ + position_;
+    position_ += static_cast<qint64>(n);
+    adviseReadAhead();
+    return n;
+}
+
+size_t WavFileSource::read(char *dst, size_t bytes)
+{
+    const char *src = nullptr;
+    size_t n = readView(&src, bytes);
+    std::memcpy(dst, src, n);
+    return n;
+}
+
+bool WavFileSource::seekToByte(qint64 byte)
+{
+    position_ = std::clamp<qint64>(byte, 0, dataSize_);
+    adviseMark_ = 0; // re-issue read-ahead at the new position
+    adviseReadAhead();
+    return true;
+}
+
+} // namespace soundpad
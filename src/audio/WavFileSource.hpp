@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include "PcmSource.hpp"
+#include "WavParser.hpp"
+
+namespace soundpad {
+
+// WAV file mapped into memory and played in its own sample format (see
+// parseWav). Reads are slices of the mapping and seeks are pointer
+// arithmetic; the kernel reads ahead of the playhead via madvise.
+class WavFileSource : public PcmSource {
+public:
+    WavFileSource() = default;
+    ~WavFileSource() override;
+
+    WavFileSource(const WavFileSource&) = delete;
+    WavFileSource& operator=(const WavFileSource&) = delete;
+
+    bool open(const std::string& path);
+    // True if the file is a WAV the output streams can play without decoding
+    static bool isPlayable(const std::string& path);
+
+    PcmFormat format() const override { return format_; }
+    qint64 totalBytes() const override { return dataSize_; }
+    size_t read(char *dst, size_t bytes) override;
+    bool seekToByte(qint64 byte) override;
+    bool supportsView() const override { return true; }
+    size_t readView(const char **data, size_t bytes) override;
+
+private:
+    static constexpr qint64 kReadAhead = 1024 * 1024;
+
+    void adviseReadAhead();
+
+    void *mapping_ = nullptr;
+    size_t mappingSize_ = 0;
+    PcmFormat format_;
+    qint64 dataOffset_ = 0;
+    const char *data_ = nullptr;
+    qint64 dataSize_ = 0;
+    qint64 position_ = 0;
+    qint64 adviseMark_ = 0; // next position at which to issue read-ahead
+};
+
+} // namespace soundpad
@@ -0,0 +1,97 @@
+#include "WavParser.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace soundpad {
+
+static constexpr uint16_t kFormatPcm = 0x0001;
+static constexpr uint16_t kFormatFloat = 0x0003;
+static constexpr uint16_t kFormatExtensible = 0xFFFE;
+
+static uint16_t le16(const uint8_t *p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+static uint32_t le32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+         | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+bool parseWav(const uint8_t *data, size_t size, WavInfo& info)
+{
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool haveFmt = false;
+    bool haveData = false;
+    uint16_t formatTag = 0;
+    uint16_t channels = 0;
+    uint32_t rate = 0;
+    uint16_t blockAlign = 0;
+    uint16_t bits = 0;
+
+    uint64_t pos = 12;
+    while (pos + 8 <= size && !(haveFmt && haveData)) {
+        const uint8_t *chunk = data + pos;
+        uint32_t chunkSize = le32(chunk + 4);
+        uint64_t body = pos + 8;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunkSize < 16 || body + 16 > size) {
+                return false;
+            }
+            const uint8_t *fmt = data + body;
+            formatTag = le16(fmt);
+            channels = le16(fmt + 2);
+            rate = le32(fmt + 4);
+            blockAlign = le16(fmt + 12);
+            bits = le16(fmt + 14);
+            // Extensible: the real format tag is the first two bytes of the SubFormat GUID
+            if (formatTag == kFormatExtensible) {
+                if (chunkSize < 40 || body + 40 > size) {
+                    return false;
+                }
+                formatTag = le16(fmt + 24);
+            }
+            haveFmt = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            info.dataOffset = static_cast<size_t>(body);
+            // Truncated files and streamed WAVs (size 0 or 0xFFFFFFFF) play up to the end of file
+            uint64_t available = size > body ? size - body : 0;
+            info.dataSize = static_cast<size_t>(chunkSize == 0 ? available : std::min<uint64_t>(chunkSize, available));
+            haveData = true;
+        }
+
+        pos = body + chunkSize + (chunkSize & 1); // chunks are word aligned
+    }
+
+    if (!haveFmt || !haveData) {
+        return false;
+    }
+
+    PcmFormat& format = info.format;
+    if (formatTag == kFormatPcm) {
+        switch (bits) {
+        case 8:  format.sampleFormat = SampleFormat::U8; break;
+        case 16: format.sampleFormat = SampleFormat::S16; break;
+        case 24: format.sampleFormat = SampleFormat::S24; break;
+        case 32: format.sampleFormat = SampleFormat::S32; break;
+        default: return false;
+        }
+    } else if (formatTag == kFormatFloat && bits == 32) {
+        format.sampleFormat = SampleFormat::F32;
+    } else {
+        return false;
+    }
+    if (channels < 1 || channels > 8 || rate == 0 || rate > 384000) {
+        return false;
+    }
+    format.rate = static_cast<int>(rate);
+    format.channels = channels;
+    if (blockAlign != format.frameBytes()) {
+        return false;
+    }
+
+    info.dataSize -= info.dataSize % blockAlign;
+    return true;
+}
+
+} // namespace soundpad
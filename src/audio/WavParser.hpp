@@ -0,0 +1,21 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "PcmSource.hpp"
+
+namespace soundpad {
+
+struct WavInfo {
+    PcmFormat format;
+    size_t dataOffset = 0; // byte offset of the first sample in the file
+    size_t dataSize = 0;   // whole frames only
+};
+
+// Walks the RIFF chunks of an in-memory WAVE file and reads `fmt ` and
+// `data`, skipping LIST/fact/cue and any other chunk. Accepts PCM
+// 8/16/24/32-bit, IEEE float32 and WAVE_FORMAT_EXTENSIBLE with 1-8 channels
+// at any rate. Returns false for anything the output streams cannot take
+// as-is (those files go through the decoder).
+bool parseWav(const uint8_t *data, size_t size, WavInfo& info);
+
+} // namespace soundpad
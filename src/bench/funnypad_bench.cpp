@@ -0,0 +1,666 @@
+// Benchmarks for the audio, import and persistence hot paths.
+//
+// Runs headless: the mixer output is discarded, or the whole engine plays
+// into the null audio backend, and every file it touches is generated in a
+// temporary directory. Results go to stdout (or --out) as JSON so runs from different
+// releases can be compared; a short summary is printed to stderr.
+//
+//   funnypad_bench [--quick] [--filter <substring>] [--out <file.json>]
+//                  [--import-dir <dir>]
+
+#include "MixKernels.hpp"
+#include "LoudnessMeter.hpp"
+#include "Mixer.hpp"
+#include "NullBackend.hpp"
+#include "PeakPyramid.hpp"
+#include "SoundpadAudio.hpp"
+#include "WavFileSource.hpp"
+#include "WavParser.hpp"
+#include "ImportQueue.hpp"
+#include "MetadataProber.hpp"
+#include "PlaylistManager.hpp"
+#include "SearchIndex.hpp"
+#include "playlist.hpp"
+#include "track.hpp"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace soundpad;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    bool quick = false;
+    QString filter;
+    QString out;
+    QString importDir;
+};
+
+// Runs `body` (which does `items` units of work per call) until at least
+// minSeconds have passed, and records the result.
+class Runner {
+public:
+    explicit Runner(const Options& options) : options_(options) {}
+
+    bool wanted(const QString& name) const
+    {
+        return options_.filter.isEmpty() || name.contains(options_.filter);
+    }
+
+    void run(const QString& name, const QJsonObject& params, double items, const QString& unit,
+             const std::function<void()>& body)
+    {
+        if (!wanted(name)) {
+            return;
+        }
+        const double minSeconds = options_.quick ? 0.05 : 0.5;
+        body(); // warm-up: page faults, lazy init
+        qint64 iterations = 0;
+        const auto start = Clock::now();
+        double seconds = 0;
+        do {
+            body();
+            ++iterations;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < minSeconds);
+        record(name, params, iterations, seconds, items, unit);
+    }
+
+    // For work that is measured once (it is too slow to repeat)
+    void record(const QString& name, const QJsonObject& params, qint64 iterations, double seconds,
+                double items, const QString& unit)
+    {
+        QJsonObject result;
+        result["name"] = name;
+        result["params"] = params;
+        result["iterations"] = iterations;
+        result["seconds"] = seconds;
+        result["ns_per_iteration"] = seconds * 1e9 / static_cast<double>(iterations);
+        result["throughput"] = items * static_cast<double>(iterations) / seconds;
+        result["unit"] = unit;
+        results_.append(result);
+
+        QString paramText = QString::fromUtf8(QJsonDocument(params).toJson(QJsonDocument::Compact));
+        std::fprintf(stderr, "%-28s %-48s %14.1f %s\n", qPrintable(name), qPrintable(paramText),
+                     result["throughput"].toDouble(), qPrintable(unit));
+    }
+
+    QJsonArray results() const { return results_; }
+
+private:
+    const Options& options_;
+    QJsonArray results_;
+};
+
+// Keep the optimiser from dropping work whose result is never used
+volatile float g_sink;
+
+void consume(const float *data, size_t samples)
+{
+    float acc = 0;
+    for (size_t i = 0; i < samples; i += 64) {
+        acc += data[i];
+    }
+    g_sink = acc;
+}
+
+// Quiet noise, so nothing downstream can shortcut on silence or clip
+QByteArray makeNoise(const PcmFormat& format, qint64 frames)
+{
+    std::mt19937 rng(42);
+    QByteArray data(static_cast<qsizetype>(frames * format.frameBytes()), Qt::Uninitialized);
+    if (format.sampleFormat == SampleFormat::F32) {
+        auto *f = reinterpret_cast<float*>(data.data());
+        for (qsizetype i = 0; i < data.size() / 4; ++i) {
+            f[i] = static_cast<float>(rng() % 2000) / 10000.0f - 0.1f;
+        }
+        return data;
+    }
+    for (qsizetype i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(rng() & 0x3f);
+    }
+    return data;
+}
+
+// Canonical RIFF/WAVE file with a LIST chunk before `data`, like most
+// editors write them
+QByteArray makeWav(const PcmFormat& format, qint64 frames)
+{
+    auto put16 = [](QByteArray& b, quint16 v) { b.append(reinterpret_cast<const char*>(&v), 2); };
+    auto put32 = [](QByteArray& b, quint32 v) { b.append(reinterpret_cast<const char*>(&v), 4); };
+
+    const quint32 dataBytes = static_cast<quint32>(frames * format.frameBytes());
+    QByteArray list("INFOISFT\x08\x00\x00\x00" "bench\0\0\0", 20);
+    QByteArray wav;
+    wav.append("RIFF");
+    put32(wav, 4 + 8 + 16 + 8 + static_cast<quint32>(list.size()) + 8 + dataBytes);
+    wav.append("WAVEfmt ");
+    put32(wav, 16);
+    put16(wav, format.sampleFormat == SampleFormat::F32 ? 3 : 1);
+    put16(wav, static_cast<quint16>(format.channels));
+    put32(wav, static_cast<quint32>(format.rate));
+    put32(wav, static_cast<quint32>(format.bytesPerSecond()));
+    put16(wav, static_cast<quint16>(format.frameBytes()));
+    put16(wav, static_cast<quint16>(format.bytesPerSample() * 8));
+    wav.append("LIST");
+    put32(wav, static_cast<quint32>(list.size()));
+    wav.append(list);
+    wav.append("data");
+    put32(wav, dataBytes);
+
+    const QByteArray data = makeNoise(format, frames);
+    wav.append(data);
+    return wav;
+}
+
+PcmFormat pcm(SampleFormat sampleFormat, int channels, int rate = 44100)
+{
+    PcmFormat format;
+    format.sampleFormat = sampleFormat;
+    format.channels = channels;
+    format.rate = rate;
+    return format;
+}
+
+QString formatName(const PcmFormat& format)
+{
+    static const char *names[] = { "u8", "s16", "s24", "s32", "f32" };
+    return QString("%1/%2ch/%3").arg(names[static_cast<int>(format.sampleFormat)]).arg(format.channels).arg(format.rate);
+}
+
+bool writeFile(const QString& path, const QByteArray& data)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+// In-memory source that loops, so a mixer benchmark never runs out of audio
+class LoopSource : public PcmSource {
+public:
+    LoopSource(const PcmFormat& format, QByteArray data) : format_(format), data_(std::move(data)) {}
+
+    PcmFormat format() const override { return format_; }
+    qint64 totalBytes() const override { return -1; }
+    size_t read(char *dst, size_t bytes) override
+    {
+        const char *src = nullptr;
+        size_t n = readView(&src, bytes);
+        std::memcpy(dst, src, n);
+        return n;
+    }
+    bool seekToByte(qint64 byte) override
+    {
+        position_ = static_cast<size_t>(byte) % static_cast<size_t>(data_.size());
+        return true;
+    }
+    bool supportsView() const override { return true; }
+    size_t readView(const char **data, size_t bytes) override
+    {
+        if (position_ == static_cast<size_t>(data_.size())) {
+            position_ = 0;
+        }
+        size_t n = std::min(bytes, static_cast<size_t>(data_.size()) - position_);
+        *data = data_.constData() + position_;
+        position_ += n;
+        return n;
+    }
+
+private:
+    PcmFormat format_;
+    QByteArray data_;
+    size_t position_ = 0;
+};
+
+void benchWav(Runner& runner, const QString& dir, bool quick)
+{
+    const qint64 seconds = quick ? 2 : 20;
+    const PcmFormat formats[] = {
+        pcm(SampleFormat::S16, 2), pcm(SampleFormat::S24, 2, 48000),
+        pcm(SampleFormat::F32, 2, 48000), pcm(SampleFormat::U8, 1, 22050),
+    };
+    for (const PcmFormat& format : formats) {
+        const QByteArray wav = makeWav(format, seconds * format.rate);
+        QJsonObject params{{"format", formatName(format)}, {"bytes", static_cast<qint64>(wav.size())}};
+
+        runner.run("wav.parse", params, 1, "files/s", [&]() {
+            WavInfo info;
+            parseWav(reinterpret_cast<const uint8_t*>(wav.constData()), static_cast<size_t>(wav.size()), info);
+        });
+
+        const QString path = QDir(dir).filePath(QString("read-%1.wav").arg(formatName(format).replace('/', '-')));
+        if (!writeFile(path, wav)) {
+            std::fprintf(stderr, "cannot write %s\n", qPrintable(path));
+            continue;
+        }
+        const double mib = static_cast<double>(wav.size()) / (1024.0 * 1024.0);
+        std::vector<char> buffer(65536);
+        std::vector<float> stereo(buffer.size() * 2);
+        runner.run("wav.read_copy", params, mib, "MiB/s", [&]() {
+            WavFileSource source;
+            source.open(path.toStdString());
+            while (source.read(buffer.data(), buffer.size()) > 0) {
+            }
+        });
+        // What the mixer does: convert straight from the mapping
+        runner.run("wav.read_convert", params, mib, "MiB/s", [&]() {
+            WavFileSource source;
+            source.open(path.toStdString());
+            const size_t frameBytes = static_cast<size_t>(format.frameBytes());
+            const char *data = nullptr;
+            while (size_t n = source.readView(&data, 4096 * frameBytes)) {
+                mix::toStereoFloat(format, data, stereo.data(), n / frameBytes);
+            }
+            consume(stereo.data(), 8192);
+        });
+        // Waveform peaks as computed at import, then drawn across a seek bar
+        PeakPyramid peaks;
+        runner.run("peaks.build", params, mib, "MiB/s", [&]() {
+            WavFileSource source;
+            source.open(path.toStdString());
+            const size_t frameBytes = static_cast<size_t>(format.frameBytes());
+            const char *data = nullptr;
+            peaks.begin(format.rate);
+            while (size_t n = source.readView(&data, 4096 * frameBytes)) {
+                mix::toStereoFloat(format, data, stereo.data(), n / frameBytes);
+                peaks.append(stereo.data(), n / frameBytes);
+            }
+            peaks.finish();
+        });
+        std::vector<PeakPyramid::Peak> columns(1000);
+        runner.run("peaks.render", params, static_cast<double>(columns.size()), "columns/s", [&]() {
+            peaks.render(0, peaks.frames(), static_cast<int>(columns.size()), columns.data());
+        });
+        // Loudness and true peak of the whole file, the other half of the import pass
+        runner.run("loudness.measure", params, static_cast<double>(seconds), "x realtime", [&]() {
+            WavFileSource source;
+            source.open(path.toStdString());
+            const size_t frameBytes = static_cast<size_t>(format.frameBytes());
+            const char *data = nullptr;
+            LoudnessMeter meter;
+            meter.begin(format.rate);
+            while (size_t n = source.readView(&data, 4096 * frameBytes)) {
+                mix::toStereoFloat(format, data, stereo.data(), n / frameBytes);
+                meter.append(stereo.data(), n / frameBytes);
+            }
+            meter.finish();
+        });
+    }
+}
+
+void benchKernels(Runner& runner)
+{
+    constexpr size_t kFrames = 1024;
+    std::vector<float> dst(kFrames * 2, 0.1f);
+    std::vector<float> src(kFrames * 2);
+    std::mt19937 rng(7);
+    for (auto& v : src) {
+        v = static_cast<float>(rng() % 2000) / 1000.0f - 1.0f;
+    }
+    const QJsonObject params{{"frames", static_cast<qint64>(kFrames)}, {"kernels", mix::kernelName()}};
+    const double samples = kFrames * 2;
+
+    runner.run("kernel.accumulate", params, samples, "samples/s", [&]() {
+        mix::accumulate(dst.data(), src.data(), 0.7f, kFrames * 2);
+        consume(dst.data(), kFrames * 2);
+    });
+    runner.run("kernel.accumulate_fade", params, samples, "samples/s", [&]() {
+        mix::accumulateFade(dst.data(), src.data(), 0.7f, kFrames, 0.2f, 1.0f / kFrames);
+        consume(dst.data(), kFrames * 2);
+    });
+    runner.run("kernel.soft_clip", params, samples, "samples/s", [&]() {
+        std::memcpy(dst.data(), src.data(), src.size() * sizeof(float));
+        mix::softClip(dst.data(), kFrames * 2);
+        consume(dst.data(), kFrames * 2);
+    });
+    runner.run("kernel.accumulate_ramp", params, samples, "samples/s", [&]() {
+        mix::accumulateRamp(dst.data(), src.data(), 0.2f, 0.5f / kFrames, kFrames);
+        consume(dst.data(), kFrames * 2);
+    });
+    // Output stage of a bus while its fader moves
+    runner.run("kernel.gain_clip", params, samples, "samples/s", [&]() {
+        mix::gainClip(dst.data(), src.data(), 1.5f, -0.5f / kFrames, kFrames);
+        consume(dst.data(), kFrames * 2);
+    });
+    runner.run("kernel.peak_range", params, samples, "samples/s", [&]() {
+        float range[2] = { src[0], src[0] };
+        mix::peakRange(src.data(), kFrames * 2, &range[0], &range[1]);
+        consume(range, 2);
+    });
+    mix::Biquad stages[2];
+    // K-weighting at 48 kHz, as in BS.1770
+    stages[0] = { 1.53512485958697, -2.69169618940638, 1.19839281085285, -1.69065929318241, 0.73248077421585 };
+    stages[1] = { 1.0, -2.0, 1.0, -1.99004745483398, 0.99007225036621 };
+    mix::CascadeState cascade;
+    runner.run("kernel.filter_energy", params, samples, "samples/s", [&]() {
+        double energy = mix::filterEnergy(stages, cascade, src.data(), kFrames);
+        float sink = static_cast<float>(energy);
+        consume(&sink, 1);
+    });
+
+    const PcmFormat formats[] = {
+        pcm(SampleFormat::S16, 2), pcm(SampleFormat::S16, 1), pcm(SampleFormat::S24, 2),
+        pcm(SampleFormat::S32, 2), pcm(SampleFormat::F32, 2), pcm(SampleFormat::U8, 1),
+    };
+    for (const PcmFormat& format : formats) {
+        std::vector<char> raw(kFrames * static_cast<size_t>(format.frameBytes()));
+        for (auto& b : raw) {
+            b = static_cast<char>(rng() & 0x3f);
+        }
+        QJsonObject convertParams = params;
+        convertParams["format"] = formatName(format);
+        runner.run("kernel.to_stereo_float", convertParams, kFrames, "frames/s", [&]() {
+            mix::toStereoFloat(format, raw.data(), dst.data(), kFrames);
+            consume(dst.data(), kFrames * 2);
+        });
+    }
+}
+
+// One 1024-frame mix() per call; throughput is seconds of audio per second
+// of CPU, i.e. how many times faster than real time the mix runs
+void benchMixer(Runner& runner)
+{
+    constexpr size_t kFrames = 1024;
+    std::vector<float> out(kFrames * Mixer::kChannels);
+    for (int rate : { 44100, 48000 }) {
+        const PcmFormat format = pcm(SampleFormat::S16, 2, rate);
+        const QByteArray data = makeNoise(format, rate); // one second
+        for (int voices : { 1, 4, 16, 32 }) {
+            Mixer mixer;
+            for (int i = 0; i < voices; ++i) {
+                mixer.addVoice(std::make_shared<LoopSource>(format, data), 0.5f);
+            }
+            QJsonObject params{{"voices", voices}, {"source", formatName(format)},
+                               {"resampled", rate != mixer.format().rate}};
+            runner.run("mixer.mix", params, static_cast<double>(kFrames) / mixer.format().rate, "x realtime", [&]() {
+                mixer.mix(out.data(), kFrames);
+                consume(out.data(), out.size());
+            });
+        }
+    }
+}
+
+// A whole track through the engine: the audio worker mixes it, applies the
+// bus gains and writes both outputs of a null backend without a clock, so
+// this is the worker's cost per second of audio, server excluded
+void benchEngine(Runner& runner, const QString& dir, bool quick)
+{
+    const qint64 seconds = quick ? 2 : 10;
+    const PcmFormat format = pcm(SampleFormat::S16, 2, 44100);
+    const QString path = QDir(dir).filePath("engine.wav");
+    if (!writeFile(path, makeWav(format, seconds * format.rate))) {
+        std::fprintf(stderr, "cannot write %s\n", qPrintable(path));
+        return;
+    }
+    NullBackend::Options backendOptions;
+    backendOptions.speed = 0;
+    SoundpadAudio engine("BenchSink", std::make_unique<NullBackend>(backendOptions));
+    engine.setOutputSink("bench-monitor");
+    std::atomic<bool> stopped{false};
+    // Sent from the audio worker
+    QObject::connect(&engine, &SoundpadAudio::playbackStopped, [&stopped]() { stopped = true; });
+
+    QJsonObject params{{"source", formatName(format)}, {"seconds", seconds}, {"backend", engine.backendName()}};
+    runner.run("engine.play", params, static_cast<double>(seconds), "x realtime", [&]() {
+        stopped = false;
+        engine.playWav(path.toStdString());
+        while (!stopped) {
+            // Finished sources are released on this thread
+            QCoreApplication::processEvents();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    });
+}
+
+std::unique_ptr<PlaylistManager> makeLibrary(int tracks)
+{
+    auto manager = std::make_unique<PlaylistManager>();
+    const int perPlaylist = 1000;
+    std::shared_ptr<Playlist> playlist;
+    for (int i = 0; i < tracks; ++i) {
+        if (i % perPlaylist == 0) {
+            playlist = manager->createPlaylist(QString("Playlist %1").arg(i / perPlaylist));
+        }
+        auto track = std::make_shared<Track>(QString("/music/artist %1/album %2/%3 - track title.flac")
+                                                 .arg(i % 97).arg(i % 13).arg(i));
+        track->setArtist(QString("Artist %1").arg(i % 97));
+        track->setDuration(120 + i % 300);
+        track->setHot(i % 50 == 0);
+        playlist->addTrackWithoutProcessing(track);
+    }
+    return manager;
+}
+
+void benchPlaylists(Runner& runner, const QString& dir, bool quick)
+{
+    const bool wantStore = runner.wanted("store.migrate") || runner.wanted("store.open")
+        || runner.wanted("store.save_edit");
+    if (!wantStore && !runner.wanted("playlist.save") && !runner.wanted("playlist.load")) {
+        return;
+    }
+    std::vector<int> sizes = quick ? std::vector<int>{ 10000 } : std::vector<int>{ 10000, 50000, 100000 };
+    for (int tracks : sizes) {
+        auto library = makeLibrary(tracks);
+        const QString path = QDir(dir).filePath(QString("playlists-%1.json").arg(tracks));
+        QJsonObject params{{"tracks", tracks}};
+        runner.run("playlist.save", params, tracks, "tracks/s", [&]() {
+            library->savePlaylists(path);
+        });
+        if (!QFile::exists(path)) {
+            library->savePlaylists(path); // filtered out above
+        }
+        params["bytes"] = QFileInfo(path).size();
+        runner.run("playlist.load", params, tracks, "tracks/s", [&]() {
+            PlaylistManager loaded;
+            loaded.loadPlaylists(path);
+        });
+
+        // The database: migrating the JSON once, reopening (headers only) and
+        // saving a single edit, neither of which should grow with the library
+        if (!wantStore) {
+            continue;
+        }
+        const QString database = QDir(dir).filePath(QString("playlists-%1.db").arg(tracks));
+        const auto start = Clock::now();
+        {
+            PlaylistManager migrated;
+            migrated.open(database, path);
+        }
+        if (runner.wanted("store.migrate")) {
+            runner.record("store.migrate", QJsonObject{{"tracks", tracks}}, 1,
+                          std::chrono::duration<double>(Clock::now() - start).count(), tracks, "tracks/s");
+        }
+        runner.run("store.open", QJsonObject{{"tracks", tracks}}, 1, "opens/s", [&]() {
+            PlaylistManager reopened;
+            reopened.open(database);
+        });
+        PlaylistManager edited;
+        edited.open(database);
+        auto track = edited.getPlaylist(0)->getTrack(0);
+        int edits = 0;
+        runner.run("store.save_edit", QJsonObject{{"tracks", tracks}}, 1, "saves/s", [&]() {
+            track->setTitle(QString("edit %1").arg(++edits));
+            edited.save();
+        });
+    }
+}
+
+// Search-as-you-type over the whole library: every prefix of a query is
+// one keystroke
+void benchSearch(Runner& runner, bool quick)
+{
+    if (!runner.wanted("search.build") && !runner.wanted("search.query")) {
+        return;
+    }
+    std::vector<int> sizes = quick ? std::vector<int>{ 10000 } : std::vector<int>{ 10000, 100000 };
+    for (int tracks : sizes) {
+        auto library = makeLibrary(tracks);
+        SearchIndex index;
+        runner.run("search.build", QJsonObject{{"tracks", tracks}}, tracks, "tracks/s", [&]() {
+            index.rebuild(library->getPlaylists());
+        });
+        for (const char *query : { "t", "tr", "track", "artist 42", "album 7 title", "999", "no such sound" }) {
+            const int hits = static_cast<int>(index.search(query).size());
+            QJsonObject params{{"tracks", tracks}, {"query", query}, {"hits", hits}};
+            runner.run("search.query", params, 1, "queries/s", [&]() {
+                index.search(query);
+            });
+        }
+    }
+}
+
+// Time from enqueueing a batch to ImportQueue reporting it finished, then
+// revalidating the imported tracks whose files did not change
+void benchImport(Runner& runner, const QString& dir, const Options& options)
+{
+    if (!runner.wanted("import.queue") && !runner.wanted("probe.file") && !runner.wanted("probe.revalidate")) {
+        return;
+    }
+    QStringList files;
+    QString source = "generated-wav";
+    if (!options.importDir.isEmpty()) {
+        source = options.importDir;
+        QDirIterator it(options.importDir, QStringList() << "*.mp3" << "*.wav" << "*.ogg" << "*.flac" << "*.m4a",
+                        QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            files << it.next();
+        }
+    } else {
+        const int count = options.quick ? 50 : 500;
+        const QByteArray wav = makeWav(pcm(SampleFormat::S16, 2), 44100);
+        QDir(dir).mkpath("import");
+        for (int i = 0; i < count; ++i) {
+            QString path = QDir(dir).filePath(QString("import/pad %1.wav").arg(i));
+            if (writeFile(path, wav)) {
+                files << path;
+            }
+        }
+    }
+    if (files.isEmpty()) {
+        std::fprintf(stderr, "import: no files\n");
+        return;
+    }
+
+    ImportQueue queue;
+    auto playlist = std::make_shared<Playlist>("import");
+    QEventLoop loop;
+    QObject::connect(&queue, &ImportQueue::allFinished, &loop, &QEventLoop::quit);
+    const auto start = Clock::now();
+    for (const QString& file : files) {
+        queue.enqueue(file, playlist);
+    }
+    loop.exec();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    QJsonObject params{{"files", static_cast<qint64>(files.size())}, {"source", source},
+                       {"threads", queue.maxConcurrent()}};
+    if (runner.wanted("import.queue")) {
+        runner.record("import.queue", params, 1, seconds, files.size(), "files/s");
+    }
+
+    runner.run("probe.file", QJsonObject{{"source", source}}, 1, "files/s", [&files]() {
+        TrackMetadata metadata = Track::probeFile(files.first());
+        (void)metadata;
+    });
+
+    if (runner.wanted("probe.revalidate")) {
+        MetadataProber prober;
+        QEventLoop proberLoop;
+        QObject::connect(&prober, &MetadataProber::allFinished, &proberLoop, &QEventLoop::quit);
+        const QList<std::shared_ptr<Track>> tracks = playlist->getTracks();
+        const auto revalidateStart = Clock::now();
+        prober.revalidate(tracks);
+        if (prober.isBusy()) {
+            proberLoop.exec();
+        }
+        const double revalidateSeconds = std::chrono::duration<double>(Clock::now() - revalidateStart).count();
+        QJsonObject revalidateParams{{"tracks", static_cast<qint64>(tracks.size())}, {"source", source}};
+        runner.record("probe.revalidate", revalidateParams, 1, revalidateSeconds, tracks.size(), "tracks/s");
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setOrganizationName("nrf24l01");
+    QCoreApplication::setApplicationName("FunnyPadBench");
+    // Keeps the audio cache of the bench away from the real one
+    QStandardPaths::setTestModeEnabled(true);
+
+    Options options;
+    const QStringList args = app.arguments();
+    for (int i = 1; i < args.size(); ++i) {
+        if (args[i] == "--quick") {
+            options.quick = true;
+        } else if (args[i] == "--filter" && i + 1 < args.size()) {
+            options.filter = args[++i];
+        } else if (args[i] == "--out" && i + 1 < args.size()) {
+            options.out = args[++i];
+        } else if (args[i] == "--import-dir" && i + 1 < args.size()) {
+            options.importDir = args[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--quick] [--filter <substring>] [--out <file.json>] [--import-dir <dir>]\n",
+                         qPrintable(args[0]));
+            return 2;
+        }
+    }
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        std::fprintf(stderr, "cannot create a temporary directory\n");
+        return 1;
+    }
+
+    Runner runner(options);
+    benchKernels(runner);
+    benchMixer(runner);
+    benchEngine(runner, dir.path(), options.quick);
+    benchWav(runner, dir.path(), options.quick);
+    benchPlaylists(runner, dir.path(), options.quick);
+    benchSearch(runner, options.quick);
+    benchImport(runner, dir.path(), options);
+
+    QJsonObject root;
+    root["schema"] = 1;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["quick"] = options.quick;
+    root["kernels"] = mix::kernelName();
+    root["cpu"] = QSysInfo::currentCpuArchitecture();
+    root["threads"] = QThread::idealThreadCount();
+    root["qt"] = qVersion();
+    root["results"] = runner.results();
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (options.out.isEmpty()) {
+        std::fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+    } else if (!writeFile(options.out, json)) {
+        std::fprintf(stderr, "cannot write %s\n", qPrintable(options.out));
+        return 1;
+    }
+    return 0;
+}
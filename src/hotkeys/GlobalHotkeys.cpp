@@ -0,0 +1,265 @@
+#include "GlobalHotkeys.hpp"
+#include <X11/Xlib.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include <cerrno>
+#include <cstdint>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QLoggingCategory>
+
+namespace soundpad {
+
+// Debug output is off by default, like funnypad.audio; enable it with
+// QT_LOGGING_RULES="funnypad.hotkeys.debug=true"
+Q_LOGGING_CATEGORY(lcHotkeys, "funnypad.hotkeys", QtInfoMsg)
+
+// NumLock and CapsLock must not prevent a hotkey from firing
+static const unsigned kIgnoredModifiers[] = { 0, LockMask, Mod2Mask, LockMask | Mod2Mask };
+
+static int onXError(Display *display, XErrorEvent *error)
+{
+    char text[128];
+    XGetErrorText(display, error->error_code, text, sizeof(text));
+    // BadAccess here means another client already grabbed the key
+    qWarning() << "[GlobalHotkeys] X error:" << text;
+    return 0;
+}
+
+GlobalHotkeys::GlobalHotkeys()
+{
+    display_ = XOpenDisplay(nullptr);
+    if (!display_) {
+        qCDebug(lcHotkeys) << "[GlobalHotkeys] No X display, global hotkeys are disabled";
+        return;
+    }
+    XSetErrorHandler(onXError);
+    // Holding a key then produces repeated presses without fake releases
+    XkbSetDetectableAutoRepeat(display_, True, nullptr);
+
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    thread_ = std::thread([this]() { run(); });
+}
+
+GlobalHotkeys::~GlobalHotkeys()
+{
+    if (!display_) {
+        return;
+    }
+    post(Command(Command::Quit));
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    XCloseDisplay(display_);
+    ::close(wakeFd_);
+}
+
+// Turn QKeySequence::PortableText ("Ctrl+Shift+F5") into an X keysym and modifier mask
+bool GlobalHotkeys::parse(const std::string& sequence, unsigned long& keysym, unsigned& modifiers)
+{
+    static const std::unordered_map<std::string, std::string> qtNames = {
+        {"Esc", "Escape"}, {"Backspace", "BackSpace"}, {"Ins", "Insert"}, {"Del", "Delete"},
+        {"PgUp", "Prior"}, {"PgDown", "Next"}, {"Enter", "KP_Enter"}, {"Space", "space"},
+        {"Print", "Print"}, {"Pause", "Pause"},
+    };
+
+    std::vector<std::string> parts;
+    std::stringstream stream(sequence);
+    std::string part;
+    while (std::getline(stream, part, '+')) {
+        parts.push_back(part);
+    }
+    // "Ctrl++" binds the plus key
+    if (!sequence.empty() && sequence.back() == '+') {
+        parts.push_back("plus");
+    }
+    if (parts.empty()) {
+        return false;
+    }
+
+    modifiers = 0;
+    for (size_t i = 0; i + 1 < parts.size(); ++i) {
+        const std::string& mod = parts[i];
+        if (mod == "Ctrl") {
+            modifiers |= ControlMask;
+        } else if (mod == "Shift") {
+            modifiers |= ShiftMask;
+        } else if (mod == "Alt") {
+            modifiers |= Mod1Mask;
+        } else if (mod == "Meta") {
+            modifiers |= Mod4Mask;
+        } else if (!mod.empty()) {
+            return false;
+        }
+    }
+
+    std::string key = parts.back();
+    auto renamed = qtNames.find(key);
+    if (renamed != qtNames.end()) {
+        key = renamed->second;
+    }
+    keysym = XStringToKeysym(key.c_str());
+    return keysym != NoSymbol;
+}
+
+bool GlobalHotkeys::bind(int id, const std::string& sequence, Action action)
+{
+    if (!display_) {
+        return false;
+    }
+    Command command(Command::Bind);
+    command.id = id;
+    if (!parse(sequence, command.keysym, command.modifiers)) {
+        qCDebug(lcHotkeys) << "[GlobalHotkeys] Unknown key sequence:" << QString::fromStdString(sequence);
+        return false;
+    }
+    command.action = std::move(action);
+    post(std::move(command));
+    return true;
+}
+
+void GlobalHotkeys::unbind(int id)
+{
+    if (!display_) {
+        return;
+    }
+    Command command(Command::Unbind);
+    command.id = id;
+    post(std::move(command));
+}
+
+void GlobalHotkeys::clear()
+{
+    if (display_) {
+        post(Command(Command::Clear));
+    }
+}
+
+void GlobalHotkeys::post(Command command)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands_.push_back(std::move(command));
+    }
+    uint64_t one = 1;
+    ssize_t written = ::write(wakeFd_, &one, sizeof(one));
+    (void)written;
+}
+
+void GlobalHotkeys::grab(const Binding& binding, bool enable)
+{
+    Window root = DefaultRootWindow(display_);
+    for (unsigned extra : kIgnoredModifiers) {
+        if (enable) {
+            XGrabKey(display_, static_cast<int>(binding.keycode), binding.modifiers | extra, root,
+                     False, GrabModeAsync, GrabModeAsync);
+        } else {
+            XUngrabKey(display_, static_cast<int>(binding.keycode), binding.modifiers | extra, root);
+        }
+    }
+}
+
+// Input thread: returns false once asked to quit
+bool GlobalHotkeys::applyCommands()
+{
+    std::vector<Command> commands;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands.swap(commands_);
+    }
+    for (auto& command : commands) {
+        switch (command.type) {
+        case Command::Quit:
+            return false;
+        case Command::Clear:
+            for (auto& entry : bindings_) {
+                grab(entry.second, false);
+            }
+            bindings_.clear();
+            break;
+        case Command::Unbind: {
+            auto it = bindings_.find(command.id);
+            if (it != bindings_.end()) {
+                grab(it->second, false);
+                bindings_.erase(it);
+            }
+            break;
+        }
+        case Command::Bind: {
+            auto it = bindings_.find(command.id);
+            if (it != bindings_.end()) {
+                grab(it->second, false);
+            }
+            Binding binding;
+            binding.keycode = XKeysymToKeycode(display_, command.keysym);
+            binding.modifiers = command.modifiers;
+            binding.action = std::move(command.action);
+            if (binding.keycode == 0) {
+                qCDebug(lcHotkeys) << "[GlobalHotkeys] Key is not on this keyboard, id" << command.id;
+                bindings_.erase(command.id);
+                break;
+            }
+            grab(binding, true);
+            bindings_[command.id] = std::move(binding);
+            break;
+        }
+        }
+    }
+    XSync(display_, False);
+    return true;
+}
+
+void GlobalHotkeys::run()
+{
+    qCDebug(lcHotkeys) << "[GlobalHotkeys] Input thread started";
+    pollfd fds[2];
+    fds[0].fd = ConnectionNumber(display_);
+    fds[0].events = POLLIN;
+    fds[1].fd = wakeFd_;
+    fds[1].events = POLLIN;
+
+    while (true) {
+        while (XPending(display_) > 0) {
+            XEvent event;
+            XNextEvent(display_, &event);
+            const Clock::time_point pressed = Clock::now();
+            if (event.type != KeyPress && event.type != KeyRelease) {
+                continue;
+            }
+            const unsigned keycode = event.xkey.keycode;
+            if (event.type == KeyRelease) {
+                held_.erase(keycode);
+                continue;
+            }
+            if (!held_.insert(keycode).second) {
+                continue; // auto-repeat
+            }
+            const unsigned state = event.xkey.state & ~(LockMask | Mod2Mask);
+            for (auto& entry : bindings_) {
+                const Binding& binding = entry.second;
+                if (binding.keycode == keycode && binding.modifiers == state) {
+                    binding.action(pressed);
+                }
+            }
+        }
+
+        if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+            qCWarning(lcHotkeys) << "[GlobalHotkeys] poll failed, stopping the input thread";
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t n = ::read(wakeFd_, &count, sizeof(count));
+            (void)n;
+            if (!applyCommands()) {
+                break;
+            }
+        }
+    }
+    qCDebug(lcHotkeys) << "[GlobalHotkeys] Input thread finished";
+}
+
+} // namespace soundpad
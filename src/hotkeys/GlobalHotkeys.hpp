@@ -0,0 +1,76 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+typedef struct _XDisplay Display;
+
+namespace soundpad {
+
+// System-wide hotkeys grabbed with XGrabKey on a private X connection.
+// A dedicated input thread waits on that connection and runs the bound action
+// itself, so a key press reaches the audio engine without going through the
+// Qt event loop. On a Wayland session only XWayland focus is covered.
+class GlobalHotkeys {
+public:
+    using Clock = std::chrono::steady_clock;
+    // Runs on the input thread with the time the key press was received
+    using Action = std::function<void(Clock::time_point pressed)>;
+
+    GlobalHotkeys();
+    ~GlobalHotkeys(); // joins the input thread
+
+    GlobalHotkeys(const GlobalHotkeys&) = delete;
+    GlobalHotkeys& operator=(const GlobalHotkeys&) = delete;
+
+    bool isAvailable() const { return display_ != nullptr; }
+
+    // `sequence` uses QKeySequence's portable text, e.g. "Ctrl+Alt+1" or "F13".
+    // Returns false if the key is unknown or there is no X display.
+    bool bind(int id, const std::string& sequence, Action action);
+    void unbind(int id);
+    void clear();
+
+private:
+    struct Binding {
+        unsigned keycode = 0;
+        unsigned modifiers = 0;
+        Action action;
+    };
+
+    struct Command {
+        enum Type { Bind, Unbind, Clear, Quit };
+        explicit Command(Type t) : type(t) {}
+
+        Type type;
+        int id = -1;
+        unsigned long keysym = 0;
+        unsigned modifiers = 0;
+        Action action;
+    };
+
+    static bool parse(const std::string& sequence, unsigned long& keysym, unsigned& modifiers);
+
+    void post(Command command);
+    void run();
+    bool applyCommands();
+    void grab(const Binding& binding, bool enable);
+
+    Display *display_ = nullptr;
+    int wakeFd_ = -1;
+    std::thread thread_;
+
+    std::mutex mutex_; // guards commands_
+    std::vector<Command> commands_;
+
+    // Input thread only
+    std::unordered_map<int, Binding> bindings_;
+    std::unordered_set<unsigned> held_; // keycodes down, to ignore auto-repeat
+};
+
+} // namespace soundpad
@@ -0,0 +1,335 @@
+#include "AudioCache.hpp"
+#include "AudioDecoder.hpp"
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Part of the key: changing the output format must not hit old entries
+static const char kConversionParams[] = "pcm_s16le/44100/2";
+// Bytes hashed at each end of the original
+static const qint64 kKeySpan = 64 * 1024;
+
+// 64-bit FNV-1a, not a security boundary
+static quint64 fnv1a(quint64 hash, const QByteArray& data) {
+    for (char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Largest data chunk a RIFF header can describe: about 6.7 h of 44.1 kHz
+// stereo 16-bit. Longer sources are streamed, never cached.
+static const qint64 kMaxDataBytes = 0xFFFFFFFFLL - 36;
+
+static QByteArray wavHeader(quint32 dataBytes, quint32 rate, quint16 channels, quint16 bits) {
+    QByteArray header(44, '\0');
+    char *h = header.data();
+    quint16 blockAlign = channels * bits / 8;
+    memcpy(h, "RIFF", 4);
+    qToLittleEndian<quint32>(36 + dataBytes, h + 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    qToLittleEndian<quint32>(16, h + 16);
+    qToLittleEndian<quint16>(1, h + 20); // PCM
+    qToLittleEndian<quint16>(channels, h + 22);
+    qToLittleEndian<quint32>(rate, h + 24);
+    qToLittleEndian<quint32>(rate * blockAlign, h + 28);
+    qToLittleEndian<quint16>(blockAlign, h + 32);
+    qToLittleEndian<quint16>(bits, h + 34);
+    memcpy(h + 36, "data", 4);
+    qToLittleEndian<quint32>(dataBytes, h + 40);
+    return header;
+}
+
+AudioCache& AudioCache::instance() {
+    static AudioCache cache;
+    return cache;
+}
+
+AudioCache::AudioCache() {
+    m_dir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/tracks";
+    QDir dir(m_dir);
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+    // One decode at a time is enough, it only runs after a cache miss
+    m_pool.setMaxThreadCount(1);
+    loadIndex();
+}
+
+AudioCache::~AudioCache() {
+    m_pool.waitForDone();
+    QMutexLocker locker(&m_mutex);
+    saveIndexLocked();
+}
+
+QString AudioCache::keyFor(const QString& originalPath) const {
+    QFile file(originalPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot hash file:" << originalPath;
+        return QString();
+    }
+    // Tags are usually edited at the start or the end of the file and the
+    // size pins down the rest; reading everything would cost a full pass
+    // over the library
+    const qint64 size = file.size();
+    quint64 hash = fnv1a(0xcbf29ce484222325ULL, QByteArray::number(size));
+    hash = fnv1a(hash, file.read(kKeySpan));
+    if (size > kKeySpan) {
+        file.seek(std::max(kKeySpan, size - kKeySpan));
+        hash = fnv1a(hash, file.read(kKeySpan));
+    }
+    hash = fnv1a(hash, QByteArray(kConversionParams));
+    return QString::number(hash, 16).rightJustified(16, '0');
+}
+
+void AudioCache::retain(const QString& key, const QString& originalPath) {
+    if (key.isEmpty()) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    Entry& entry = m_entries[key];
+    entry.refs++;
+    if (entry.originalPath.isEmpty()) {
+        entry.originalPath = originalPath;
+    }
+}
+
+void AudioCache::release(const QString& key) {
+    if (key.isEmpty()) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        return;
+    }
+    if (--it->refs <= 0) {
+        removeFileLocked(key, *it);
+        m_entries.erase(it);
+        m_dirty = true;
+    }
+}
+
+void AudioCache::flush() {
+    QMutexLocker locker(&m_mutex);
+    if (m_dirty) {
+        saveIndexLocked();
+    }
+}
+
+QString AudioCache::lookup(const QString& key) {
+    if (key.isEmpty()) {
+        return QString();
+    }
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->bytes == 0) {
+        return QString();
+    }
+    QString path = filePath(key);
+    if (!QFile::exists(path)) {
+        // Deleted behind our back
+        m_used -= it->bytes;
+        it->bytes = 0;
+        return QString();
+    }
+    it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    return path;
+}
+
+void AudioCache::requestMaterialise(const QString& key, const QString& originalPath) {
+    if (key.isEmpty()) {
+        return;
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_entries.find(key);
+        if (m_budget <= 0 || m_inFlight.contains(key) || (it != m_entries.end() && it->bytes > 0)) {
+            return;
+        }
+        m_inFlight.insert(key);
+    }
+    m_pool.start([this, key, originalPath]() {
+        materialise(key, originalPath);
+        QMutexLocker locker(&m_mutex);
+        m_inFlight.remove(key);
+    });
+}
+
+bool AudioCache::materialise(const QString& key, const QString& originalPath) {
+    soundpad::AudioDecoder decoder;
+    if (!decoder.open(originalPath.toStdString())) {
+        return false;
+    }
+    const qint64 durationMs = decoder.durationMs();
+    if (durationMs > 0 && durationMs * decoder.outputRate() / 1000 * decoder.frameBytes() > kMaxDataBytes) {
+        qDebug() << "Not caching" << originalPath << "- too long for a WAV file";
+        return false;
+    }
+
+    QString target = filePath(key);
+    QString partial = target + ".part";
+    QFile out(partial);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write cache file:" << partial;
+        return false;
+    }
+
+    // Header is rewritten with the real sizes once decoding is done
+    out.write(wavHeader(0, decoder.outputRate(), decoder.outputChannels(), 16));
+    std::vector<char> buffer(64 * 1024);
+    qint64 dataBytes = 0;
+    while (size_t n = decoder.read(buffer.data(), buffer.size())) {
+        // The duration was only an estimate
+        if (dataBytes + static_cast<qint64>(n) > kMaxDataBytes) {
+            qDebug() << "Not caching" << originalPath << "- too long for a WAV file";
+            out.close();
+            QFile::remove(partial);
+            return false;
+        }
+        if (out.write(buffer.data(), static_cast<qint64>(n)) != static_cast<qint64>(n)) {
+            qWarning() << "Failed to write cache file:" << out.errorString();
+            out.close();
+            QFile::remove(partial);
+            return false;
+        }
+        dataBytes += static_cast<qint64>(n);
+    }
+    out.seek(0);
+    out.write(wavHeader(static_cast<quint32>(dataBytes), decoder.outputRate(), decoder.outputChannels(), 16));
+    out.close();
+
+    QFile::remove(target);
+    if (!QFile::rename(partial, target)) {
+        QFile::remove(partial);
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) {
+        // Every playlist dropped the track while we were decoding
+        QFile::remove(target);
+        return false;
+    }
+    it->bytes = 44 + dataBytes;
+    it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    m_used += it->bytes;
+    evictLocked(key);
+    saveIndexLocked();
+    qDebug() << "Cached" << originalPath << "as" << target;
+    return true;
+}
+
+void AudioCache::setByteBudget(qint64 bytes) {
+    QMutexLocker locker(&m_mutex);
+    m_budget = bytes;
+    evictLocked(QString());
+    saveIndexLocked();
+}
+
+qint64 AudioCache::byteBudget() const {
+    QMutexLocker locker(&m_mutex);
+    return m_budget;
+}
+
+qint64 AudioCache::usedBytes() const {
+    QMutexLocker locker(&m_mutex);
+    return m_used;
+}
+
+void AudioCache::collectGarbage() {
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->refs <= 0 && !m_inFlight.contains(it.key())) {
+            removeFileLocked(it.key(), *it);
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    saveIndexLocked();
+}
+
+// Drop least recently used files until the budget is met
+void AudioCache::evictLocked(const QString& keep) {
+    while (m_used > m_budget) {
+        auto victim = m_entries.end();
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->bytes > 0 && it.key() != keep
+                && (victim == m_entries.end() || it->lastUsed < victim->lastUsed)) {
+                victim = it;
+            }
+        }
+        if (victim == m_entries.end()) {
+            break;
+        }
+        qDebug() << "Evicting cached audio for" << victim->originalPath;
+        removeFileLocked(victim.key(), *victim);
+    }
+}
+
+void AudioCache::removeFileLocked(const QString& key, Entry& entry) {
+    if (entry.bytes > 0) {
+        QFile::remove(filePath(key));
+        m_used -= entry.bytes;
+        entry.bytes = 0;
+    }
+}
+
+QString AudioCache::filePath(const QString& key) const {
+    return m_dir + "/" + key + ".wav";
+}
+
+void AudioCache::loadIndex() {
+    QFile file(m_dir + "/index.json");
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+
+    QJsonObject entries = root["entries"].toObject();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        QJsonObject obj = it.value().toObject();
+        Entry entry;
+        entry.originalPath = obj["original"].toString();
+        entry.bytes = static_cast<qint64>(obj["bytes"].toDouble());
+        entry.lastUsed = static_cast<qint64>(obj["lastUsed"].toDouble());
+        if (entry.bytes > 0 && !QFile::exists(filePath(it.key()))) {
+            entry.bytes = 0;
+        }
+        m_used += entry.bytes;
+        m_entries.insert(it.key(), entry);
+    }
+}
+
+void AudioCache::saveIndexLocked() {
+    m_dirty = false;
+    QJsonObject entries;
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        QJsonObject obj;
+        obj["original"] = it->originalPath;
+        obj["bytes"] = static_cast<double>(it->bytes);
+        obj["lastUsed"] = static_cast<double>(it->lastUsed);
+        entries[it.key()] = obj;
+    }
+    QJsonObject root;
+    root["entries"] = entries;
+
+    QFile file(m_dir + "/index.json");
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write cache index:" << file.fileName();
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+}
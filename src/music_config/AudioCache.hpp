@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QThreadPool>
+
+// Content-addressed store of decoded PCM (canonical 44.1 kHz stereo WAV) in
+// AppData/tracks. Entries are keyed by a hash of the original file plus the
+// conversion parameters, so the same source imported into several playlists
+// is stored once. Playlists hold references; unreferenced entries are deleted
+// and referenced ones are evicted least-recently-used once the byte budget is
+// exceeded. Evicted entries are re-materialised from the original on demand.
+// Originals are streamed as they are, so the cache is opt-in: with a budget
+// of 0, the default, nothing is materialised and what is on disk is freed.
+class AudioCache {
+public:
+    static AudioCache& instance();
+
+    // Hash of the file size, its first and last 64 KiB and the conversion
+    // parameters: a couple of reads whatever the file's length
+    QString keyFor(const QString& originalPath) const;
+
+    void retain(const QString& key, const QString& originalPath);
+    // Drops the entry with its last reference. The index on disk is only
+    // rewritten by flush(), so clearing a large playlist writes it once.
+    void release(const QString& key);
+    // Write the index if release() changed it (PlaylistManager saves call this)
+    void flush();
+
+    // Path of the materialised WAV or empty if it is not on disk. Marks the entry as used.
+    QString lookup(const QString& key);
+    // Decode the original into the cache on a background thread; a no-op
+    // while the budget is 0
+    void requestMaterialise(const QString& key, const QString& originalPath);
+
+    void setByteBudget(qint64 bytes);
+    qint64 byteBudget() const;
+    qint64 usedBytes() const;
+
+    // Remove entries no playlist refers to (call once all playlists are loaded)
+    void collectGarbage();
+
+private:
+    AudioCache();
+    ~AudioCache();
+
+    struct Entry {
+        QString originalPath;
+        qint64 bytes = 0;       // 0 when not materialised
+        qint64 lastUsed = 0;    // ms since epoch
+        int refs = 0;           // not persisted, rebuilt from the playlists
+    };
+
+    bool materialise(const QString& key, const QString& originalPath);
+    void evictLocked(const QString& keep);
+    void removeFileLocked(const QString& key, Entry& entry);
+    QString filePath(const QString& key) const;
+    void loadIndex();
+    void saveIndexLocked();
+
+    QString m_dir;
+    mutable QMutex m_mutex;
+    QHash<QString, Entry> m_entries;
+    QSet<QString> m_inFlight;
+    bool m_dirty = false; // entries dropped since the index was written
+    qint64 m_budget = 0;
+    qint64 m_used = 0;
+    QThreadPool m_pool;
+};
@@ -0,0 +1,110 @@
+#include "ImportQueue.hpp"
+#include "PeakCache.hpp"
+#include <QThread>
+#include <QMetaObject>
+#include <QDebug>
+
+ImportQueue::ImportQueue(QObject* parent) : QObject(parent) {
+    setMaxConcurrent(0);
+}
+
+ImportQueue::~ImportQueue() {
+    cancelAll();
+    // Running jobs post back to this object, let them finish first
+    m_pool.waitForDone();
+}
+
+void ImportQueue::setMaxConcurrent(int count) {
+    m_pool.setMaxThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
+
+int ImportQueue::maxConcurrent() const {
+    return m_pool.maxThreadCount();
+}
+
+void ImportQueue::enqueue(const QString& filePath, std::shared_ptr<Playlist> playlist) {
+    if (!playlist) {
+        qWarning() << "Cannot import into a null playlist:" << filePath;
+        return;
+    }
+
+    m_total++;
+    emit progressChanged(m_finished, m_total);
+
+    quint64 batch = m_batch;
+    std::weak_ptr<Playlist> target = playlist;
+    m_pool.start([this, batch, filePath, target]() {
+        QMetaObject::invokeMethod(this, [this, batch, filePath]() {
+            if (batch == m_batch) {
+                emit importStarted(filePath);
+            }
+        }, Qt::QueuedConnection);
+
+        auto track = std::make_shared<Track>(filePath);
+        if (!track->processTrack()) {
+            track.reset();
+        } else {
+            // Still private to this job, so the metadata can be set right here
+            TrackMetadata metadata = Track::probeFile(filePath);
+            // Decoded once here for the waveform and the loudness, the seek
+            // bar and rows only read the sidecar later
+            TrackLoudness loudness;
+            metadata.analysed = PeakCache::ensureSidecar(filePath, &loudness);
+            metadata.loudness = loudness.integratedLufs;
+            metadata.truePeak = loudness.truePeakDb;
+            track->applyMetadata(metadata);
+        }
+
+        QMetaObject::invokeMethod(this, [this, batch, filePath, target, track]() {
+            jobDone(batch, filePath, target, track);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ImportQueue::jobDone(quint64 batch, const QString& filePath,
+                          std::weak_ptr<Playlist> playlist, std::shared_ptr<Track> track) {
+    if (batch != m_batch) {
+        return; // cancelled
+    }
+
+    m_finished++;
+    auto target = playlist.lock();
+    if (track && target) {
+        emit trackImported(target, track);
+    } else {
+        qWarning() << "Failed to import track:" << filePath;
+        emit importFailed(filePath);
+    }
+    emit importFinished(filePath);
+    emit progressChanged(m_finished, m_total);
+
+    if (m_finished == m_total) {
+        m_finished = 0;
+        m_total = 0;
+        emit allFinished();
+    }
+}
+
+void ImportQueue::cancelAll() {
+    if (m_total == 0) {
+        return;
+    }
+    m_pool.clear();
+    m_batch++;
+    m_finished = 0;
+    m_total = 0;
+    emit progressChanged(0, 0);
+    emit allFinished();
+}
+
+bool ImportQueue::isBusy() const {
+    return m_total > 0;
+}
+
+int ImportQueue::finishedCount() const {
+    return m_finished;
+}
+
+int ImportQueue::totalCount() const {
+    return m_total;
+}
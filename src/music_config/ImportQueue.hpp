@@ -0,0 +1,48 @@
+#pragma once
+
+#include "playlist.hpp"
+#include <QObject>
+#include <QThreadPool>
+#include <QStringList>
+#include <memory>
+
+// Imports files on a thread pool so the GUI never waits for processTrack().
+// Results are delivered on the thread that owns the queue, in completion order.
+class ImportQueue : public QObject {
+    Q_OBJECT
+public:
+    explicit ImportQueue(QObject* parent = nullptr);
+    ~ImportQueue();
+
+    // Number of files processed at once, 0 = one per CPU core
+    void setMaxConcurrent(int count);
+    int maxConcurrent() const;
+
+    void enqueue(const QString& filePath, std::shared_ptr<Playlist> playlist);
+    // Drop queued files and ignore the results of the ones already running
+    void cancelAll();
+
+    bool isBusy() const;
+    int finishedCount() const;
+    int totalCount() const;
+
+signals:
+    // Per file: importStarted when a worker picks it up, then trackImported
+    // or importFailed, then importFinished either way. Not emitted for files
+    // dropped by cancelAll().
+    void importStarted(const QString& filePath);
+    void trackImported(std::shared_ptr<Playlist> playlist, std::shared_ptr<Track> track);
+    void importFailed(const QString& filePath);
+    void importFinished(const QString& filePath);
+    void progressChanged(int finished, int total);
+    void allFinished();
+
+private:
+    void jobDone(quint64 batch, const QString& filePath,
+                 std::weak_ptr<Playlist> playlist, std::shared_ptr<Track> track);
+
+    QThreadPool m_pool;
+    quint64 m_batch = 0;   // bumped on cancel, results of older batches are dropped
+    int m_finished = 0;
+    int m_total = 0;
+};
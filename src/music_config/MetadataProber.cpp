@@ -0,0 +1,108 @@
+#include "MetadataProber.hpp"
+#include "PeakCache.hpp"
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QThread>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Tracks per pool job: large enough to amortise the hop back to the GUI
+// thread, small enough for the first results to show up quickly
+static const int kBatchSize = 64;
+
+MetadataProber::MetadataProber(QObject* parent) : QObject(parent) {
+    // Mostly waiting on the disk, more threads than cores do not help
+    m_pool.setMaxThreadCount(std::max(2, QThread::idealThreadCount() / 2));
+}
+
+MetadataProber::~MetadataProber() {
+    cancelAll();
+    // Running jobs post back to this object, let them finish first
+    m_pool.waitForDone();
+}
+
+void MetadataProber::revalidate(const QList<std::shared_ptr<Track>>& tracks) {
+    std::vector<Job> jobs;
+    for (const auto& track : tracks) {
+        if (!track || m_queued.contains(track.get())) {
+            continue;
+        }
+        m_queued.insert(track.get());
+        jobs.push_back({ track, track.get(), track->getOriginalPath(), track->getSourceSize(),
+                         track->getSourceModified() });
+    }
+
+    const quint64 generation = m_generation;
+    for (size_t first = 0; first < jobs.size(); first += kBatchSize) {
+        std::vector<Job> batch(jobs.begin() + static_cast<std::ptrdiff_t>(first),
+                               jobs.begin() + static_cast<std::ptrdiff_t>(std::min(jobs.size(), first + kBatchSize)));
+        m_pending++;
+        m_pool.start([this, generation, batch = std::move(batch)]() {
+            QList<const Track*> keys;
+            QList<std::pair<std::weak_ptr<Track>, TrackMetadata>> results;
+            for (const Job& job : batch) {
+                keys.append(job.key);
+                QFileInfo info(job.path);
+                if (!info.exists()) {
+                    continue; // nothing to learn, playback reports the missing file
+                }
+                // Loudness is measured along with every probe, so a file that
+                // could not be measured is not decoded again until it changes
+                if (info.size() == job.size && info.lastModified().toMSecsSinceEpoch() == job.modified) {
+                    continue; // unchanged since the last probe
+                }
+                TrackMetadata metadata = Track::probeFile(job.path);
+                // Decodes the file unless its sidecar is up to date
+                TrackLoudness loudness;
+                metadata.analysed = PeakCache::ensureSidecar(job.path, &loudness);
+                metadata.loudness = loudness.integratedLufs;
+                metadata.truePeak = loudness.truePeakDb;
+                results.append({ job.track, metadata });
+            }
+            QMetaObject::invokeMethod(this, [this, generation, keys, results]() {
+                batchDone(generation, keys, results);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void MetadataProber::batchDone(quint64 generation, const QList<const Track*>& keys,
+                               const QList<std::pair<std::weak_ptr<Track>, TrackMetadata>>& results) {
+    if (generation != m_generation) {
+        return; // cancelled
+    }
+    for (const Track* key : keys) {
+        m_queued.remove(key);
+    }
+
+    QList<std::shared_ptr<Track>> probed;
+    for (const auto& result : results) {
+        if (auto track = result.first.lock()) {
+            track->applyMetadata(result.second);
+            probed.append(track);
+        }
+    }
+    if (!probed.isEmpty()) {
+        emit tracksProbed(probed);
+    }
+
+    if (--m_pending == 0) {
+        emit allFinished();
+    }
+}
+
+void MetadataProber::cancelAll() {
+    if (m_pending == 0) {
+        return;
+    }
+    m_pool.clear();
+    m_generation++;
+    m_pending = 0;
+    m_queued.clear();
+    emit allFinished();
+}
+
+bool MetadataProber::isBusy() const {
+    return m_pending > 0;
+}
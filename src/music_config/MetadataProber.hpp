@@ -0,0 +1,49 @@
+#pragma once
+
+#include "track.hpp"
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+#include <memory>
+
+// Reads duration, tags and format of tracks on a thread pool (see
+// Track::probeFile), measures their loudness (see PeakCache::ensureSidecar)
+// and applies the results on the thread that owns the prober, in batches.
+// A track whose source still has the size and mtime it was last probed with
+// costs one stat() and is left alone, whether or not its loudness could be
+// measured.
+class MetadataProber : public QObject {
+    Q_OBJECT
+public:
+    explicit MetadataProber(QObject* parent = nullptr);
+    ~MetadataProber();
+
+    // Probe those of `tracks` that were never probed or whose file changed
+    void revalidate(const QList<std::shared_ptr<Track>>& tracks);
+    // Drop queued batches and ignore the results of the ones already running
+    void cancelAll();
+    bool isBusy() const;
+
+signals:
+    // The tracks have new metadata (and are dirty)
+    void tracksProbed(const QList<std::shared_ptr<Track>>& tracks);
+    void allFinished();
+
+private:
+    struct Job {
+        std::weak_ptr<Track> track;
+        const Track* key;
+        QString path;
+        qint64 size;
+        qint64 modified;
+    };
+
+    void batchDone(quint64 generation, const QList<const Track*>& keys,
+                   const QList<std::pair<std::weak_ptr<Track>, TrackMetadata>>& results);
+
+    QThreadPool m_pool;
+    quint64 m_generation = 0; // bumped on cancel, results of older batches are dropped
+    int m_pending = 0;        // batches
+    QSet<const Track*> m_queued;
+};
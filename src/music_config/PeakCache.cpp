@@ -0,0 +1,198 @@
+#include "PeakCache.hpp"
+#include "AudioDecoder.hpp"
+#include "LoudnessMeter.hpp"
+#include "MixKernels.hpp"
+#include "WavFileSource.hpp"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <cstring>
+#include <vector>
+
+static const char kMagic[4] = { 'F', 'P', 'P', 'K' };
+static const quint32 kVersion = 3; // 3: multichannel WAVs downmixed instead of cut to L/R
+// magic, version, source size, source mtime, loudness, true peak
+static const int kHeaderBytes = 4 + 4 + 8 + 8 + 8 + 8;
+// Enough for the rows on screen and a few playlists switched back and forth
+static const int kMemoryEntries = 256;
+
+static void putDouble(double value, char *dst) {
+    quint64 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    qToLittleEndian<quint64>(bits, dst);
+}
+
+static double getDouble(const char *src) {
+    quint64 bits = qFromLittleEndian<quint64>(src);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+PeakCache::PeakCache(QObject* parent) : QObject(parent) {
+    // Sidecars load in microseconds; the pool is mostly busy decoding
+    // tracks imported before peaks existed
+    m_pool.setMaxThreadCount(2);
+}
+
+PeakCache::~PeakCache() {
+    m_pool.clear();
+    // Running jobs post back to this object, let them finish first
+    m_pool.waitForDone();
+}
+
+std::shared_ptr<const soundpad::PeakPyramid> PeakCache::peaks(const QString& originalPath) {
+    auto it = m_peaks.find(originalPath);
+    if (it != m_peaks.end()) {
+        m_recent.removeOne(originalPath);
+        m_recent.append(originalPath);
+        return it.value();
+    }
+    if (originalPath.isEmpty() || m_inFlight.contains(originalPath) || m_failed.contains(originalPath)) {
+        return nullptr;
+    }
+
+    m_inFlight.insert(originalPath);
+    m_pool.start([this, originalPath]() {
+        std::shared_ptr<const soundpad::PeakPyramid> peaks = loadSidecar(originalPath);
+        if (!peaks) {
+            peaks = computeSidecar(originalPath);
+        }
+        QMetaObject::invokeMethod(this, [this, originalPath, peaks]() {
+            loaded(originalPath, peaks);
+        }, Qt::QueuedConnection);
+    });
+    return nullptr;
+}
+
+void PeakCache::loaded(const QString& originalPath, std::shared_ptr<const soundpad::PeakPyramid> peaks) {
+    m_inFlight.remove(originalPath);
+    if (!peaks) {
+        m_failed.insert(originalPath);
+        return;
+    }
+    m_peaks.insert(originalPath, peaks);
+    m_recent.append(originalPath);
+    while (m_recent.size() > kMemoryEntries) {
+        m_peaks.remove(m_recent.takeFirst());
+    }
+    emit peaksReady(originalPath);
+}
+
+bool PeakCache::ensureSidecar(const QString& originalPath, TrackLoudness* loudness) {
+    return loadSidecar(originalPath, loudness) || computeSidecar(originalPath, loudness);
+}
+
+QString PeakCache::sidecarPath(const QString& originalPath) {
+    QByteArray hash = QCryptographicHash::hash(originalPath.toUtf8(), QCryptographicHash::Md5);
+    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/peaks/"
+        + QString::fromLatin1(hash.toHex()) + ".peaks";
+}
+
+std::shared_ptr<soundpad::PeakPyramid> PeakCache::loadSidecar(const QString& originalPath, TrackLoudness* loudness) {
+    QFileInfo source(originalPath);
+    QFile file(sidecarPath(originalPath));
+    if (!source.exists() || !file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+    QByteArray data = file.readAll();
+    if (data.size() < kHeaderBytes || memcmp(data.constData(), kMagic, 4) != 0
+        || qFromLittleEndian<quint32>(data.constData() + 4) != kVersion) {
+        return nullptr;
+    }
+    // Computed from an older version of the file
+    if (qFromLittleEndian<qint64>(data.constData() + 8) != source.size()
+        || qFromLittleEndian<qint64>(data.constData() + 16) != source.lastModified().toMSecsSinceEpoch()) {
+        return nullptr;
+    }
+
+    auto peaks = std::make_shared<soundpad::PeakPyramid>();
+    if (!peaks->deserialize(data.constData() + kHeaderBytes, static_cast<size_t>(data.size() - kHeaderBytes))) {
+        qWarning() << "Corrupt peak file:" << file.fileName();
+        return nullptr;
+    }
+    if (loudness) {
+        loudness->integratedLufs = getDouble(data.constData() + 24);
+        loudness->truePeakDb = getDouble(data.constData() + 32);
+    }
+    return peaks;
+}
+
+std::shared_ptr<soundpad::PeakPyramid> PeakCache::computeSidecar(const QString& originalPath, TrackLoudness* loudness) {
+    QFileInfo source(originalPath);
+    if (!source.exists()) {
+        return nullptr;
+    }
+
+    // Same PCM the player would use: the mapped WAV or the decoder output
+    const std::string path = originalPath.toStdString();
+    soundpad::WavFileSource wav;
+    soundpad::AudioDecoder decoder;
+    soundpad::PcmFormat format;
+    if (soundpad::WavFileSource::isPlayable(path) && wav.open(path)) {
+        format = wav.format();
+    } else if (decoder.open(path)) {
+        format.sampleFormat = soundpad::SampleFormat::S16;
+        format.rate = decoder.outputRate();
+        format.channels = decoder.outputChannels();
+    } else {
+        qWarning() << "Cannot compute peaks of:" << originalPath;
+        return nullptr;
+    }
+
+    const size_t chunkFrames = 8192;
+    const size_t frameBytes = static_cast<size_t>(format.frameBytes());
+    std::vector<char> pcm(chunkFrames * frameBytes);
+    std::vector<float> stereo(chunkFrames * 2);
+    auto peaks = std::make_shared<soundpad::PeakPyramid>();
+    soundpad::LoudnessMeter meter;
+    peaks->begin(format.rate);
+    meter.begin(format.rate);
+    while (size_t n = decoder.isOpen() ? decoder.read(pcm.data(), pcm.size()) : wav.read(pcm.data(), pcm.size())) {
+        const size_t frames = n / frameBytes;
+        soundpad::mix::toStereoFloat(format, pcm.data(), stereo.data(), frames);
+        peaks->append(stereo.data(), frames);
+        meter.append(stereo.data(), frames);
+    }
+    peaks->finish();
+    meter.finish();
+    if (peaks->isEmpty()) {
+        return nullptr;
+    }
+    if (loudness) {
+        loudness->integratedLufs = meter.integratedLufs();
+        loudness->truePeakDb = meter.truePeakDb();
+    }
+
+    QString target = sidecarPath(originalPath);
+    QDir().mkpath(QFileInfo(target).absolutePath());
+    QByteArray header(kHeaderBytes, '\0');
+    memcpy(header.data(), kMagic, 4);
+    qToLittleEndian<quint32>(kVersion, header.data() + 4);
+    qToLittleEndian<qint64>(source.size(), header.data() + 8);
+    qToLittleEndian<qint64>(source.lastModified().toMSecsSinceEpoch(), header.data() + 16);
+    putDouble(meter.integratedLufs(), header.data() + 24);
+    putDouble(meter.truePeakDb(), header.data() + 32);
+    const std::vector<char> body = peaks->serialize();
+
+    // Import jobs and the cache may compute the same file at once, each
+    // writes a temporary file and the last rename wins
+    QSaveFile out(target);
+    if (!out.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write peak file:" << target;
+        return peaks;
+    }
+    out.write(header);
+    out.write(body.data(), static_cast<qint64>(body.size()));
+    if (!out.commit()) {
+        qWarning() << "Failed to write peak file:" << target;
+    }
+    return peaks;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "PeakPyramid.hpp"
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+#include <memory>
+
+// Loudness of a track as measured by soundpad::LoudnessMeter
+struct TrackLoudness {
+    double integratedLufs = 0.0;
+    double truePeakDb = 0.0;
+};
+
+// Waveform peaks of tracks (see soundpad::PeakPyramid), computed once from
+// the PCM and kept as small sidecar files in AppData/peaks. The same pass
+// measures the loudness, which the sidecar keeps too. A sidecar remembers
+// the size and mtime of the file it was computed from and is recomputed
+// when they change. Recently drawn peaks stay in memory.
+class PeakCache : public QObject {
+    Q_OBJECT
+public:
+    explicit PeakCache(QObject* parent = nullptr);
+    ~PeakCache();
+
+    // Peaks of the file if they are in memory. Otherwise returns null and
+    // loads or computes them in the background, peaksReady() follows.
+    std::shared_ptr<const soundpad::PeakPyramid> peaks(const QString& originalPath);
+
+    // Write the sidecar for a file unless an up-to-date one exists, and
+    // report the loudness it holds. Decodes the whole file, for import and
+    // probe jobs; safe to call from any thread.
+    static bool ensureSidecar(const QString& originalPath, TrackLoudness* loudness = nullptr);
+
+signals:
+    void peaksReady(const QString& originalPath);
+
+private:
+    static QString sidecarPath(const QString& originalPath);
+    static std::shared_ptr<soundpad::PeakPyramid> loadSidecar(const QString& originalPath,
+                                                              TrackLoudness* loudness = nullptr);
+    static std::shared_ptr<soundpad::PeakPyramid> computeSidecar(const QString& originalPath,
+                                                                 TrackLoudness* loudness = nullptr);
+
+    void loaded(const QString& originalPath, std::shared_ptr<const soundpad::PeakPyramid> peaks);
+
+    QThreadPool m_pool;
+    QHash<QString, std::shared_ptr<const soundpad::PeakPyramid>> m_peaks;
+    QList<QString> m_recent;   // least recently drawn first
+    QSet<QString> m_inFlight;
+    QSet<QString> m_failed;    // not retried on every repaint
+};
@@ -1,4 +1,5 @@
 #include "PlaylistManager.hpp"
+#include "AudioCache.hpp"
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
@@ -10,7 +11,12 @@ PlaylistManager::PlaylistManager() {
 }
 
 PlaylistManager::~PlaylistManager() {
-    // Shared pointers will be automatically cleaned up
+    // Playlists may outlive the manager, their loaders must not outlive the store
+    for (const auto& playlist : m_playlists) {
+        if (!playlist->isLoaded()) {
+            playlist->setLazyTracks(0, nullptr);
+        }
+    }
 }
 
 std::shared_ptr<Playlist> PlaylistManager::createPlaylist(const QString& name) {
@@ -21,6 +27,10 @@ std::shared_ptr<Playlist> PlaylistManager::createPlaylist(const QString& name) {
 
 bool PlaylistManager::removePlaylist(int index) {
     if (index >= 0 && index < m_playlists.size()) {
+        m_playlists[index]->clear(); // release cached audio
+        if (m_playlists[index]->getStoreId() != 0) {
+            m_removedPlaylistIds.append(m_playlists[index]->getStoreId());
+        }
         m_playlists.removeAt(index);
         return true;
     }
@@ -50,7 +60,74 @@ int PlaylistManager::getPlaylistCount() const {
     return m_playlists.size();
 }
 
+bool PlaylistManager::open(const QString& databasePath, const QString& legacyJsonPath) {
+    if (!m_store.open(databasePath)) {
+        return false;
+    }
+
+    if (m_store.isNew()) {
+        if (legacyJsonPath.isEmpty() || !QFile::exists(legacyJsonPath) || !loadPlaylists(legacyJsonPath)) {
+            return true;
+        }
+        if (!save()) {
+            qWarning() << "Failed to migrate playlists to" << databasePath;
+            return false;
+        }
+        // Kept as a backup, but never imported again
+        QFile::remove(legacyJsonPath + ".migrated");
+        QFile::rename(legacyJsonPath, legacyJsonPath + ".migrated");
+        qDebug() << "Migrated playlists from" << legacyJsonPath;
+        return true;
+    }
+
+    m_playlists.clear();
+    m_removedPlaylistIds.clear();
+
+    // Cache references of every track are taken here, whether or not its
+    // playlist is loaded, so the AudioCache can collect garbage right after
+    for (const auto& reference : m_store.loadCacheReferences()) {
+        AudioCache::instance().retain(reference.key, reference.originalPath);
+    }
+
+    PlaylistStore *store = &m_store;
+    for (const auto& header : m_store.loadHeaders()) {
+        auto playlist = std::make_shared<Playlist>(header.name);
+        playlist->setCreatedDate(header.created);
+        playlist->setStoreId(header.id);
+        playlist->setDirty(false);
+        const qint64 id = header.id;
+        playlist->setLazyTracks(header.trackCount, [store, id]() { return store->loadTracks(id); });
+        if (header.pinned) {
+            playlist->getTracks(); // loads them
+        }
+        m_playlists.append(playlist);
+    }
+    return true;
+}
+
+bool PlaylistManager::isOpen() const {
+    return m_store.isOpen();
+}
+
+bool PlaylistManager::save() {
+    // Cache entries released by the edits being saved
+    AudioCache::instance().flush();
+    if (!m_store.isOpen()) {
+        return false;
+    }
+    if (!m_store.save(m_playlists, m_removedPlaylistIds)) {
+        return false;
+    }
+    m_removedPlaylistIds.clear();
+    return true;
+}
+
+QList<PlaylistStore::TrackText> PlaylistManager::loadTrackTexts() {
+    return m_store.isOpen() ? m_store.loadTrackTexts() : QList<PlaylistStore::TrackText>();
+}
+
 bool PlaylistManager::savePlaylists(const QString& filePath) {
+    AudioCache::instance().flush();
     QJsonArray playlistsArray;
     
     // Serialize each playlist
@@ -68,6 +145,22 @@ bool PlaylistManager::savePlaylists(const QString& filePath) {
             trackObj["processedPath"] = track->getProcessedPath();
             trackObj["addedDate"] = track->getAddedDate().toString(Qt::ISODate);
             trackObj["duration"] = track->getDuration();
+            trackObj["cacheKey"] = track->getCacheKey();
+            trackObj["hot"] = track->isHot();
+            trackObj["hotkey"] = track->getHotkey();
+            trackObj["album"] = track->getAlbum();
+            trackObj["sampleRate"] = track->getSampleRate();
+            trackObj["channels"] = track->getChannels();
+            trackObj["channelLayout"] = track->getChannelLayout();
+            trackObj["sourceSize"] = track->getSourceSize();
+            trackObj["sourceModified"] = track->getSourceModified();
+            if (track->hasLoudness()) {
+                trackObj["loudness"] = track->getLoudness();
+                trackObj["truePeak"] = track->getTruePeak();
+            }
+            if (track->getGainDb() != 0.0) {
+                trackObj["gainDb"] = track->getGainDb();
+            }
             
             tracksArray.append(trackObj);
         }
@@ -113,6 +206,9 @@ bool PlaylistManager::loadPlaylists(const QString& filePath) {
         QString name = playlistObj["name"].toString();
         QDateTime createdDate = QDateTime::fromString(playlistObj["created"].toString(), Qt::ISODate);
         auto playlist = std::make_shared<Playlist>(name);
+        if (createdDate.isValid()) {
+            playlist->setCreatedDate(createdDate);
+        }
         
         // Load tracks
         QJsonArray tracksArray = playlistObj["tracks"].toArray();
@@ -135,6 +231,28 @@ bool PlaylistManager::loadPlaylists(const QString& filePath) {
                 track->setDuration(trackObj["duration"].toInt());
             }
             
+            if (trackObj.contains("cacheKey")) {
+                track->setCacheKey(trackObj["cacheKey"].toString());
+            }
+            
+            track->setHot(trackObj["hot"].toBool());
+            track->setHotkey(trackObj["hotkey"].toString());
+            track->setAlbum(trackObj["album"].toString());
+            track->setSampleRate(trackObj["sampleRate"].toInt());
+            track->setChannels(trackObj["channels"].toInt());
+            track->setChannelLayout(trackObj["channelLayout"].toString());
+            
+            // Files from before probing existed have no stamp and are probed when shown
+            if (trackObj.contains("sourceSize")) {
+                track->setSourceStamp(trackObj["sourceSize"].toInteger(), trackObj["sourceModified"].toInteger());
+            }
+            if (trackObj.contains("loudness")) {
+                track->setLoudness(trackObj["loudness"].toDouble(), trackObj["truePeak"].toDouble());
+            }
+            if (trackObj.contains("gainDb")) {
+                track->setGainDb(trackObj["gainDb"].toDouble());
+            }
+            
             if (trackObj.contains("addedDate")) {
                 track->setAddedDate(QDateTime::fromString(trackObj["addedDate"].toString(), Qt::ISODate));
             }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "playlist.hpp"
+#include "PlaylistStore.hpp"
 #include <QList>
 #include <memory>
 
@@ -19,10 +20,23 @@ public:
     std::shared_ptr<Playlist> getPlaylist(int index) const;
     int getPlaylistCount() const;
     
-    // Serialization
+    // Library database. open() reads the playlist headers; tracks are read
+    // when a playlist is first used, except for playlists with hot pads or
+    // hotkeys, which are needed right away. A database that does not exist
+    // yet is filled from legacyJsonPath, if given, once.
+    bool open(const QString& databasePath, const QString& legacyJsonPath = QString());
+    bool isOpen() const;
+    // Writes what changed since the last save()
+    bool save();
+    // Stored tracks for the search index, see PlaylistStore::loadTrackTexts()
+    QList<PlaylistStore::TrackText> loadTrackTexts();
+
+    // JSON export/import, the only format before the database
     bool savePlaylists(const QString& filePath);
     bool loadPlaylists(const QString& filePath);
     
 private:
     QList<std::shared_ptr<Playlist>> m_playlists;
+    PlaylistStore m_store;
+    QList<qint64> m_removedPlaylistIds;
 };
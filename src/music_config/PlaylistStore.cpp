@@ -0,0 +1,407 @@
+#include "PlaylistStore.hpp"
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QDebug>
+#include <utility>
+#include <vector>
+
+// Bumped whenever the schema changes; open() refuses newer files
+static const int kSchemaVersion = 4;
+
+// Columns added to `tracks` after version 1, with the version that added
+// them: 2 probed metadata, 3 loudness (NULL until measured), 4 the user's
+// track gain. Also part of a new schema.
+struct AddedColumn {
+    int version;
+    const char *definition;
+};
+static const AddedColumn kAddedColumns[] = {
+    { 2, "album TEXT NOT NULL DEFAULT ''" },
+    { 2, "sample_rate INTEGER NOT NULL DEFAULT 0" },
+    { 2, "channels INTEGER NOT NULL DEFAULT 0" },
+    { 2, "channel_layout TEXT NOT NULL DEFAULT ''" },
+    { 2, "source_size INTEGER NOT NULL DEFAULT -1" },
+    { 2, "source_modified INTEGER NOT NULL DEFAULT 0" },
+    { 3, "loudness REAL" },
+    { 3, "true_peak REAL" },
+    { 4, "gain_db REAL NOT NULL DEFAULT 0" },
+};
+
+PlaylistStore::PlaylistStore()
+    : m_connection(QString("playlist-store-%1").arg(reinterpret_cast<quintptr>(this))) {
+}
+
+PlaylistStore::~PlaylistStore() {
+    close();
+}
+
+bool PlaylistStore::open(const QString& filePath) {
+    close();
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", m_connection);
+        db.setDatabaseName(filePath);
+        if (!db.open()) {
+            qWarning() << "Failed to open playlist database:" << filePath << db.lastError().text();
+            db = QSqlDatabase();
+            QSqlDatabase::removeDatabase(m_connection);
+            return false;
+        }
+    }
+
+    int fileVersion = -1;
+    {
+        QSqlQuery version(QSqlDatabase::database(m_connection));
+        if (version.exec("PRAGMA user_version") && version.next()) {
+            fileVersion = version.value(0).toInt();
+        }
+    }
+    if (fileVersion < 0) {
+        qWarning() << "Not a playlist database:" << filePath;
+        close();
+        return false;
+    }
+    if (fileVersion > kSchemaVersion) {
+        qWarning() << "Playlist database was written by a newer version:" << filePath;
+        close();
+        return false;
+    }
+
+    // WAL keeps a save from blocking on fsync of the whole file
+    exec("PRAGMA journal_mode=WAL");
+    exec("PRAGMA synchronous=NORMAL");
+
+    m_new = fileVersion == 0;
+    if (m_new) {
+        QString addedColumns;
+        for (const AddedColumn& column : kAddedColumns) {
+            addedColumns += QString(", ") + column.definition;
+        }
+        // Dates are milliseconds since the epoch, cheaper to read back than ISO text
+        const bool created = exec("BEGIN")
+            && exec("CREATE TABLE playlists ("
+                    "id INTEGER PRIMARY KEY, name TEXT NOT NULL, created INTEGER NOT NULL, "
+                    "track_count INTEGER NOT NULL DEFAULT 0)")
+            && exec("CREATE TABLE tracks ("
+                    "id INTEGER PRIMARY KEY, playlist_id INTEGER NOT NULL, position INTEGER NOT NULL, "
+                    "title TEXT NOT NULL, artist TEXT NOT NULL, original_path TEXT NOT NULL, "
+                    "processed_path TEXT NOT NULL, added INTEGER NOT NULL, duration INTEGER NOT NULL, "
+                    "cache_key TEXT NOT NULL, hot INTEGER NOT NULL, hotkey TEXT NOT NULL" + addedColumns + ")")
+            && exec("CREATE INDEX tracks_by_playlist ON tracks (playlist_id, position)")
+            // Small partial indexes for the startup queries, which must not scan every track
+            && exec("CREATE INDEX tracks_pinned ON tracks (playlist_id) WHERE hot <> 0 OR hotkey <> ''")
+            && exec("CREATE INDEX tracks_cached ON tracks (cache_key, original_path) WHERE cache_key <> ''")
+            && exec(QString("PRAGMA user_version = %1").arg(kSchemaVersion))
+            && exec("COMMIT");
+        if (!created) {
+            exec("ROLLBACK");
+            close();
+            return false;
+        }
+    } else if (fileVersion < kSchemaVersion) {
+        bool upgraded = exec("BEGIN");
+        for (const AddedColumn& column : kAddedColumns) {
+            if (column.version > fileVersion) {
+                upgraded = upgraded && exec(QString("ALTER TABLE tracks ADD COLUMN ") + column.definition);
+            }
+        }
+        if (fileVersion == 2) {
+            // Probed before loudness existed: forget the stamps so every
+            // track is probed, and measured, once more
+            upgraded = upgraded && exec("UPDATE tracks SET source_size = -1");
+        }
+        upgraded = upgraded && exec(QString("PRAGMA user_version = %1").arg(kSchemaVersion)) && exec("COMMIT");
+        if (!upgraded) {
+            exec("ROLLBACK");
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void PlaylistStore::close() {
+    if (!QSqlDatabase::contains(m_connection)) {
+        return;
+    }
+    {
+        QSqlDatabase db = QSqlDatabase::database(m_connection, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(m_connection);
+}
+
+bool PlaylistStore::isOpen() const {
+    return QSqlDatabase::contains(m_connection) && QSqlDatabase::database(m_connection, false).isOpen();
+}
+
+bool PlaylistStore::isNew() const {
+    return m_new;
+}
+
+QList<PlaylistStore::Header> PlaylistStore::loadHeaders() {
+    QList<Header> headers;
+    QSqlDatabase db = QSqlDatabase::database(m_connection);
+
+    QSqlQuery pinned(db);
+    pinned.setForwardOnly(true);
+    QList<qint64> pinnedIds;
+    if (pinned.exec("SELECT DISTINCT playlist_id FROM tracks WHERE hot <> 0 OR hotkey <> ''")) {
+        while (pinned.next()) {
+            pinnedIds.append(pinned.value(0).toLongLong());
+        }
+    }
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, name, created, track_count FROM playlists ORDER BY id")) {
+        qWarning() << "Failed to read playlists:" << query.lastError().text();
+        return headers;
+    }
+    while (query.next()) {
+        Header header;
+        header.id = query.value(0).toLongLong();
+        header.name = query.value(1).toString();
+        header.created = QDateTime::fromMSecsSinceEpoch(query.value(2).toLongLong());
+        header.trackCount = query.value(3).toInt();
+        header.pinned = pinnedIds.contains(header.id);
+        headers.append(header);
+    }
+    return headers;
+}
+
+QList<std::shared_ptr<Track>> PlaylistStore::loadTracks(qint64 playlistId) {
+    QList<std::shared_ptr<Track>> tracks;
+    QSqlQuery query(QSqlDatabase::database(m_connection));
+    query.setForwardOnly(true);
+    query.prepare("SELECT id, position, title, artist, original_path, processed_path, added, duration, "
+                  "cache_key, hot, hotkey, album, sample_rate, channels, channel_layout, source_size, "
+                  "source_modified, loudness, true_peak, gain_db FROM tracks WHERE playlist_id = ? ORDER BY position");
+    query.addBindValue(playlistId);
+    if (!query.exec()) {
+        qWarning() << "Failed to read tracks of playlist" << playlistId << query.lastError().text();
+        return tracks;
+    }
+    while (query.next()) {
+        auto track = std::make_shared<Track>(query.value(4).toString());
+        track->setStoreId(query.value(0).toLongLong());
+        track->setStorePosition(query.value(1).toLongLong());
+        track->setTitle(query.value(2).toString());
+        track->setArtist(query.value(3).toString());
+        track->setProcessedPath(query.value(5).toString());
+        track->setAddedDate(QDateTime::fromMSecsSinceEpoch(query.value(6).toLongLong()));
+        track->setDuration(query.value(7).toInt());
+        track->setCacheKey(query.value(8).toString());
+        track->setHot(query.value(9).toBool());
+        track->setHotkey(query.value(10).toString());
+        track->setAlbum(query.value(11).toString());
+        track->setSampleRate(query.value(12).toInt());
+        track->setChannels(query.value(13).toInt());
+        track->setChannelLayout(query.value(14).toString());
+        track->setSourceStamp(query.value(15).toLongLong(), query.value(16).toLongLong());
+        if (!query.value(17).isNull()) {
+            track->setLoudness(query.value(17).toDouble(), query.value(18).toDouble());
+        }
+        track->setGainDb(query.value(19).toDouble());
+        track->setDirty(false);
+        tracks.append(track);
+    }
+    return tracks;
+}
+
+QList<PlaylistStore::CacheReference> PlaylistStore::loadCacheReferences() {
+    QList<CacheReference> references;
+    QSqlQuery query(QSqlDatabase::database(m_connection));
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT cache_key, original_path FROM tracks WHERE cache_key <> ''")) {
+        qWarning() << "Failed to read cache references:" << query.lastError().text();
+        return references;
+    }
+    while (query.next()) {
+        references.append({ query.value(0).toString(), query.value(1).toString() });
+    }
+    return references;
+}
+
+QList<PlaylistStore::TrackText> PlaylistStore::loadTrackTexts() {
+    QList<TrackText> texts;
+    QSqlQuery query(QSqlDatabase::database(m_connection));
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, playlist_id, title, artist, original_path FROM tracks ORDER BY playlist_id, position")) {
+        qWarning() << "Failed to read track texts:" << query.lastError().text();
+        return texts;
+    }
+    while (query.next()) {
+        TrackText text;
+        text.id = query.value(0).toLongLong();
+        text.playlistId = query.value(1).toLongLong();
+        text.title = query.value(2).toString();
+        text.artist = query.value(3).toString();
+        text.originalPath = query.value(4).toString();
+        texts.append(std::move(text));
+    }
+    return texts;
+}
+
+bool PlaylistStore::save(const QList<std::shared_ptr<Playlist>>& playlists, const QList<qint64>& removedPlaylistIds) {
+    QSqlDatabase db = QSqlDatabase::database(m_connection);
+    if (!db.isOpen()) {
+        return false;
+    }
+
+    QSqlQuery deletePlaylist(db);
+    QSqlQuery deletePlaylistTracks(db);
+    QSqlQuery deleteTrack(db);
+    QSqlQuery insertPlaylist(db);
+    QSqlQuery updatePlaylist(db);
+    QSqlQuery insertTrack(db);
+    QSqlQuery updateTrack(db);
+    deletePlaylist.prepare("DELETE FROM playlists WHERE id = ?");
+    deletePlaylistTracks.prepare("DELETE FROM tracks WHERE playlist_id = ?");
+    deleteTrack.prepare("DELETE FROM tracks WHERE id = ?");
+    insertPlaylist.prepare("INSERT INTO playlists (name, created, track_count) VALUES (?, ?, ?)");
+    updatePlaylist.prepare("UPDATE playlists SET name = ?, created = ?, track_count = ? WHERE id = ?");
+    insertTrack.prepare("INSERT INTO tracks (playlist_id, position, title, artist, original_path, processed_path, "
+                        "added, duration, cache_key, hot, hotkey, album, sample_rate, channels, channel_layout, "
+                        "source_size, source_modified, loudness, true_peak, gain_db) "
+                        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    updateTrack.prepare("UPDATE tracks SET playlist_id = ?, position = ?, title = ?, artist = ?, original_path = ?, "
+                        "processed_path = ?, added = ?, duration = ?, cache_key = ?, hot = ?, hotkey = ?, album = ?, "
+                        "sample_rate = ?, channels = ?, channel_layout = ?, source_size = ?, source_modified = ?, "
+                        "loudness = ?, true_peak = ?, gain_db = ? WHERE id = ?");
+
+    auto run = [](QSqlQuery& query) {
+        if (!query.exec()) {
+            qWarning() << "Failed to save playlists:" << query.lastError().text();
+            return false;
+        }
+        return true;
+    };
+
+    // Ids and flags are only touched once the transaction has committed
+    std::vector<std::pair<std::shared_ptr<Playlist>, qint64>> savedPlaylists;
+    std::vector<std::pair<std::shared_ptr<Track>, qint64>> savedTracks;
+
+    if (!db.transaction()) {
+        qWarning() << "Failed to save playlists:" << db.lastError().text();
+        return false;
+    }
+    bool ok = true;
+    for (qint64 id : removedPlaylistIds) {
+        deletePlaylistTracks.addBindValue(id);
+        deletePlaylist.addBindValue(id);
+        ok = ok && run(deletePlaylistTracks) && run(deletePlaylist);
+    }
+
+    for (const auto& playlist : playlists) {
+        if (!ok) {
+            break;
+        }
+        // An unloaded playlist cannot have changed beyond its header
+        const QList<std::shared_ptr<Track>> tracks = playlist->isLoaded() ? playlist->getTracks()
+                                                                           : QList<std::shared_ptr<Track>>();
+        const QList<qint64> removedTracks = playlist->getRemovedTrackIds();
+        bool changed = playlist->isDirty() || playlist->getStoreId() == 0 || !removedTracks.isEmpty();
+        for (const auto& track : tracks) {
+            if (track->isDirty() || track->getStoreId() == 0) {
+                changed = true;
+                break;
+            }
+        }
+        if (!changed) {
+            continue;
+        }
+
+        qint64 playlistId = playlist->getStoreId();
+        QSqlQuery& header = playlistId == 0 ? insertPlaylist : updatePlaylist;
+        header.addBindValue(playlist->getName());
+        header.addBindValue(playlist->getCreatedDate().toMSecsSinceEpoch());
+        header.addBindValue(playlist->getTrackCount());
+        if (playlistId != 0) {
+            header.addBindValue(playlistId);
+        }
+        if (!run(header)) {
+            ok = false;
+            break;
+        }
+        if (playlistId == 0) {
+            playlistId = header.lastInsertId().toLongLong();
+        }
+        savedPlaylists.emplace_back(playlist, playlistId);
+
+        for (qint64 id : removedTracks) {
+            deleteTrack.addBindValue(id);
+            if (!run(deleteTrack)) {
+                ok = false;
+                break;
+            }
+        }
+        for (const auto& track : tracks) {
+            if (!ok) {
+                break;
+            }
+            const bool inserting = track->getStoreId() == 0;
+            if (!inserting && !track->isDirty()) {
+                continue;
+            }
+            QSqlQuery& row = inserting ? insertTrack : updateTrack;
+            row.addBindValue(playlistId);
+            row.addBindValue(track->getStorePosition());
+            row.addBindValue(track->getTitle());
+            row.addBindValue(track->getArtist());
+            row.addBindValue(track->getOriginalPath());
+            row.addBindValue(track->getProcessedPath());
+            row.addBindValue(track->getAddedDate().toMSecsSinceEpoch());
+            row.addBindValue(track->getDuration());
+            row.addBindValue(track->getCacheKey());
+            row.addBindValue(track->isHot() ? 1 : 0);
+            row.addBindValue(track->getHotkey());
+            row.addBindValue(track->getAlbum());
+            row.addBindValue(track->getSampleRate());
+            row.addBindValue(track->getChannels());
+            row.addBindValue(track->getChannelLayout());
+            row.addBindValue(track->getSourceSize());
+            row.addBindValue(track->getSourceModified());
+            row.addBindValue(track->hasLoudness() ? QVariant(track->getLoudness()) : QVariant());
+            row.addBindValue(track->hasLoudness() ? QVariant(track->getTruePeak()) : QVariant());
+            row.addBindValue(track->getGainDb());
+            if (!inserting) {
+                row.addBindValue(track->getStoreId());
+            }
+            if (!run(row)) {
+                ok = false;
+                break;
+            }
+            savedTracks.emplace_back(track, inserting ? row.lastInsertId().toLongLong() : track->getStoreId());
+        }
+    }
+
+    if (!ok || !db.commit()) {
+        if (ok) {
+            qWarning() << "Failed to save playlists:" << db.lastError().text();
+        }
+        db.rollback();
+        return false;
+    }
+
+    for (auto& [playlist, id] : savedPlaylists) {
+        playlist->setStoreId(id);
+        playlist->setDirty(false);
+        playlist->clearRemovedTrackIds();
+    }
+    for (auto& [track, id] : savedTracks) {
+        track->setStoreId(id);
+        track->setDirty(false);
+    }
+    return true;
+}
+
+bool PlaylistStore::exec(const QString& statement) {
+    QSqlQuery query(QSqlDatabase::database(m_connection));
+    if (!query.exec(statement)) {
+        qWarning() << "Playlist database error:" << query.lastError().text() << "in" << statement;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "playlist.hpp"
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <memory>
+
+// SQLite database behind PlaylistManager. Playlists are rows with a track
+// count, tracks are rows keyed by playlist and a sort position, so a save
+// only writes what changed since the previous one (see Track::isDirty())
+// and opening the library reads the playlist headers, not every track.
+// Used from the GUI thread only.
+class PlaylistStore {
+public:
+    struct Header {
+        qint64 id = 0;
+        QString name;
+        QDateTime created;
+        int trackCount = 0;
+        // Holds hot pads or hotkeys, which are needed at startup
+        bool pinned = false;
+    };
+
+    struct CacheReference {
+        QString key;
+        QString originalPath;
+    };
+
+    // What the SearchIndex needs of a stored track
+    struct TrackText {
+        qint64 id = 0;
+        qint64 playlistId = 0;
+        QString title;
+        QString artist;
+        QString originalPath;
+    };
+
+    PlaylistStore();
+    ~PlaylistStore();
+
+    PlaylistStore(const PlaylistStore&) = delete;
+    PlaylistStore& operator=(const PlaylistStore&) = delete;
+
+    // Creates the file and schema if needed
+    bool open(const QString& filePath);
+    void close();
+    bool isOpen() const;
+    // True if open() had to create the schema, i.e. there is nothing to load
+    bool isNew() const;
+
+    QList<Header> loadHeaders();
+    QList<std::shared_ptr<Track>> loadTracks(qint64 playlistId);
+    // AudioCache keys of every stored track, without building Track objects
+    QList<CacheReference> loadCacheReferences();
+    // Searchable text of every stored track in one query, in playlist order,
+    // without building Track objects
+    QList<TrackText> loadTrackTexts();
+
+    // Writes new and dirty playlists and tracks in one transaction, deletes
+    // the given playlists and the tracks their playlists report as removed
+    bool save(const QList<std::shared_ptr<Playlist>>& playlists, const QList<qint64>& removedPlaylistIds);
+
+private:
+    bool exec(const QString& statement);
+
+    QString m_connection;
+    bool m_new = false;
+};
@@ -0,0 +1,316 @@
+#include "SearchIndex.hpp"
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+
+// Dead entries are only dropped from the posting lists in bulk
+static const int kMinDeadToCompact = 1024;
+
+void SearchIndex::rebuild(const QList<std::shared_ptr<Playlist>>& playlists,
+                          const QList<PlaylistStore::TrackText>& stored) {
+    clear();
+    QHash<qint64, QList<const PlaylistStore::TrackText*>> rows;
+    for (const auto& text : stored) {
+        rows[text.playlistId].append(&text);
+    }
+    for (const auto& playlist : playlists) {
+        if (playlist->isLoaded() || playlist->getStoreId() == 0) {
+            for (const auto& track : playlist->getTracks()) {
+                addTrack(playlist, track);
+            }
+            continue;
+        }
+        for (const PlaylistStore::TrackText* row : rows.value(playlist->getStoreId())) {
+            Entry entry;
+            entry.playlist = playlist;
+            entry.storeId = row->id;
+            entry.text = textOf(row->title, row->artist, row->originalPath);
+            add(std::move(entry));
+        }
+    }
+}
+
+void SearchIndex::clear() {
+    m_entries.clear();
+    m_byTrack.clear();
+    m_byStoreId.clear();
+    m_postings.clear();
+    m_dead = 0;
+}
+
+void SearchIndex::addTrack(const std::shared_ptr<Playlist>& playlist, const std::shared_ptr<Track>& track) {
+    // Replaces its old entry, or the stored row it was indexed from
+    const int existing = entryOf(track.get());
+    if (existing >= 0) {
+        kill(static_cast<quint32>(existing));
+    }
+    Entry entry;
+    entry.playlist = playlist;
+    entry.track = track;
+    entry.key = track.get();
+    entry.storeId = track->getStoreId();
+    entry.text = textOf(*track);
+    add(std::move(entry));
+}
+
+void SearchIndex::removeTrack(const Track* track) {
+    const int id = entryOf(track);
+    if (id >= 0) {
+        kill(static_cast<quint32>(id));
+        compactIfNeeded();
+    }
+}
+
+// A stored row is replaced by an entry for the Track loaded from it
+void SearchIndex::updateTrack(const std::shared_ptr<Track>& track) {
+    const int id = entryOf(track.get());
+    if (id < 0) {
+        return;
+    }
+    auto playlist = m_entries[id].playlist.lock();
+    if (playlist) {
+        addTrack(playlist, track);
+    } else {
+        kill(static_cast<quint32>(id));
+        compactIfNeeded();
+    }
+}
+
+void SearchIndex::removePlaylist(const Playlist* playlist) {
+    for (quint32 id = 0; id < m_entries.size(); ++id) {
+        const Entry& entry = m_entries[id];
+        if (!entry.alive) {
+            continue;
+        }
+        auto owner = entry.playlist.lock();
+        if (!owner || owner.get() == playlist) {
+            kill(id);
+        }
+    }
+    compactIfNeeded();
+}
+
+QList<SearchIndex::Hit> SearchIndex::search(const QString& query, int limit) const {
+    QList<Hit> hits;
+    const QStringList words = fold(query).split(' ', Qt::SkipEmptyParts);
+    if (words.isEmpty() || limit == 0) {
+        return hits;
+    }
+
+    // Every key of every word must be present; a missing one means no match
+    std::vector<const Postings*> lists;
+    QStringList verify; // words whose trigrams may match out of order
+    for (const QString& word : words) {
+        if (word.size() < 3) {
+            auto it = m_postings.constFind(prefixKey(word.constData(), static_cast<int>(word.size())));
+            if (it == m_postings.constEnd()) {
+                return hits;
+            }
+            lists.push_back(&it.value());
+            continue;
+        }
+        for (qsizetype i = 0; i + 3 <= word.size(); ++i) {
+            auto it = m_postings.constFind(trigramKey(word.constData() + i));
+            if (it == m_postings.constEnd()) {
+                return hits;
+            }
+            lists.push_back(&it.value());
+        }
+        verify.append(word);
+    }
+    std::sort(lists.begin(), lists.end(), [](const Postings* a, const Postings* b) {
+        return a->size() != b->size() ? a->size() < b->size() : a < b;
+    });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+
+    // Walk the shortest list; candidates only grow, so each other list is
+    // searched from where the previous candidate left it
+    std::vector<Postings::const_iterator> cursors;
+    for (const Postings* list : lists) {
+        cursors.push_back(list->begin());
+    }
+    for (quint32 id : *lists.front()) {
+        bool inAll = true;
+        for (size_t l = 1; l < lists.size(); ++l) {
+            cursors[l] = std::lower_bound(cursors[l], lists[l]->end(), id);
+            if (cursors[l] == lists[l]->end()) {
+                return hits; // no later candidate can be in this list either
+            }
+            if (*cursors[l] != id) {
+                inAll = false;
+                break;
+            }
+        }
+        if (!inAll) {
+            continue;
+        }
+        const Entry& entry = m_entries[id];
+        if (!entry.alive) {
+            continue;
+        }
+        bool matches = true;
+        for (const QString& word : verify) {
+            if (!entry.text.contains(word)) {
+                matches = false;
+                break;
+            }
+        }
+        if (!matches) {
+            continue;
+        }
+        auto playlist = entry.playlist.lock();
+        auto track = entry.track.lock();
+        if (!playlist || (!track && entry.key)) {
+            continue;
+        }
+        hits.append({ playlist, track, entry.storeId });
+        if (limit > 0 && hits.size() >= limit) {
+            break;
+        }
+    }
+    return hits;
+}
+
+int SearchIndex::trackCount() const {
+    return static_cast<int>(m_byTrack.size() + m_byStoreId.size());
+}
+
+// Case-folded, with accents stripped ("Beyoncé" is found by "beyonce") and
+// any run of separators turned into one space
+QString SearchIndex::fold(const QString& text) {
+    const QString decomposed = text.normalized(QString::NormalizationForm_KD);
+    QString folded;
+    folded.reserve(decomposed.size());
+    bool space = true;
+    for (const QChar c : decomposed) {
+        if (c.category() == QChar::Mark_NonSpacing) {
+            continue;
+        }
+        if (c.isSpace() || c == '_') {
+            if (!space) {
+                folded.append(' ');
+                space = true;
+            }
+            continue;
+        }
+        folded.append(c.toCaseFolded());
+        space = false;
+    }
+    if (folded.endsWith(' ')) {
+        folded.chop(1);
+    }
+    return folded;
+}
+
+QString SearchIndex::textOf(const QString& title, const QString& artist, const QString& path) {
+    return fold(title + ' ' + artist + ' ' + QFileInfo(path).fileName());
+}
+
+QString SearchIndex::textOf(const Track& track) {
+    return textOf(track.getTitle(), track.getArtist(), track.getOriginalPath());
+}
+
+quint64 SearchIndex::trigramKey(const QChar *c) {
+    return (quint64(1) << 48) | (quint64(c[0].unicode()) << 32) | (quint64(c[1].unicode()) << 16) | c[2].unicode();
+}
+
+quint64 SearchIndex::prefixKey(const QChar *c, int length) {
+    return (quint64(1 + length) << 48) | (quint64(c[0].unicode()) << 16) | (length > 1 ? c[1].unicode() : 0);
+}
+
+void SearchIndex::index(quint32 id) {
+    const QString& text = m_entries[id].text;
+    const QChar *c = text.constData();
+    const qsizetype size = text.size();
+
+    std::vector<quint64> keys;
+    keys.reserve(static_cast<size_t>(size) + 16);
+    for (qsizetype i = 0; i < size; ++i) {
+        if (c[i] == ' ') {
+            continue;
+        }
+        if (i + 3 <= size && c[i + 1] != ' ' && c[i + 2] != ' ') {
+            keys.push_back(trigramKey(c + i));
+        }
+        // Word starts: after a separator or punctuation, e.g. "(live)" or "01-intro"
+        if (i == 0 || !c[i - 1].isLetterOrNumber()) {
+            keys.push_back(prefixKey(c + i, 1));
+            if (i + 1 < size && c[i + 1] != ' ') {
+                keys.push_back(prefixKey(c + i, 2));
+            }
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    // Ids only grow, so appending keeps every list sorted
+    for (quint64 key : keys) {
+        m_postings[key].push_back(id);
+    }
+}
+
+void SearchIndex::add(Entry entry) {
+    const auto id = static_cast<quint32>(m_entries.size());
+    if (entry.key) {
+        m_byTrack.insert(entry.key, id);
+    }
+    if (entry.storeId != 0) {
+        m_byStoreId.insert(entry.storeId, id);
+    }
+    m_entries.push_back(std::move(entry));
+    index(id);
+    compactIfNeeded();
+}
+
+// Live entry of the track, or of the stored row it was loaded from; -1 if none
+int SearchIndex::entryOf(const Track* track) const {
+    auto it = m_byTrack.constFind(track);
+    if (it != m_byTrack.constEnd()) {
+        return static_cast<int>(it.value());
+    }
+    const qint64 storeId = track->getStoreId();
+    auto stored = storeId != 0 ? m_byStoreId.constFind(storeId) : m_byStoreId.constEnd();
+    return stored != m_byStoreId.constEnd() ? static_cast<int>(stored.value()) : -1;
+}
+
+void SearchIndex::kill(quint32 id) {
+    Entry& entry = m_entries[id];
+    if (!entry.alive) {
+        return;
+    }
+    entry.alive = false;
+    ++m_dead;
+    if (entry.key && m_byTrack.value(entry.key, id + 1) == id) {
+        m_byTrack.remove(entry.key);
+    }
+    if (entry.storeId != 0 && m_byStoreId.value(entry.storeId, id + 1) == id) {
+        m_byStoreId.remove(entry.storeId);
+    }
+}
+
+void SearchIndex::compactIfNeeded() {
+    if (m_dead < kMinDeadToCompact || m_dead * 2 < static_cast<int>(m_entries.size())) {
+        return;
+    }
+    std::vector<Entry> entries;
+    entries.reserve(m_entries.size() - static_cast<size_t>(m_dead));
+    for (Entry& entry : m_entries) {
+        if (entry.alive) {
+            entries.push_back(std::move(entry));
+        }
+    }
+    m_entries.swap(entries);
+    m_byTrack.clear();
+    m_byStoreId.clear();
+    m_postings.clear();
+    m_dead = 0;
+    for (quint32 id = 0; id < m_entries.size(); ++id) {
+        const Entry& entry = m_entries[id];
+        if (entry.key && !entry.track.expired()) {
+            m_byTrack.insert(entry.key, id);
+        }
+        if (entry.storeId != 0) {
+            m_byStoreId.insert(entry.storeId, id);
+        }
+        index(id);
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "playlist.hpp"
+#include "PlaylistStore.hpp"
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <memory>
+#include <vector>
+
+// In-memory index over the title, artist and file name of tracks in any
+// number of playlists, for search-as-you-type. Every trigram of the folded
+// text maps to a sorted posting list of entries; a query intersects the
+// lists of its words' trigrams, starting with the shortest, and checks the
+// few survivors with a substring test. Words shorter than three characters
+// match the beginning of a word instead, through a second set of lists keyed
+// by one- and two-character word prefixes.
+//
+// Playlists that are not loaded are indexed from their rows in the
+// PlaylistStore, so searching never loads one; their hits carry the track's
+// store id instead of a Track until the playlist is loaded.
+//
+// Updates are incremental: a track that is added or changed gets a new
+// entry, the old one is only marked dead and the lists are compacted once
+// most of the index is dead. GUI thread only.
+class SearchIndex {
+public:
+    struct Hit {
+        std::shared_ptr<Playlist> playlist;
+        std::shared_ptr<Track> track; // null for a row of a playlist that is not loaded
+        qint64 trackId = 0;           // PlaylistStore id, 0 if never saved
+    };
+
+    // Index every track of the given playlists, replacing what was there.
+    // Loaded playlists are read from memory, the others from `stored`
+    // (PlaylistStore::loadTrackTexts()).
+    void rebuild(const QList<std::shared_ptr<Playlist>>& playlists,
+                 const QList<PlaylistStore::TrackText>& stored = {});
+    void clear();
+
+    void addTrack(const std::shared_ptr<Playlist>& playlist, const std::shared_ptr<Track>& track);
+    void removeTrack(const Track* track);
+    // Re-read the track's title, artist and path after they changed
+    void updateTrack(const std::shared_ptr<Track>& track);
+    void removePlaylist(const Playlist* playlist);
+
+    // Tracks whose text contains every whitespace-separated word of the query
+    // (case-insensitive), in indexing order. An empty query matches nothing.
+    // limit < 0 returns every match.
+    QList<Hit> search(const QString& query, int limit = -1) const;
+
+    int trackCount() const;
+
+private:
+    struct Entry {
+        std::weak_ptr<Playlist> playlist;
+        std::weak_ptr<Track> track;
+        const Track* key = nullptr; // m_byTrack key, null for stored rows
+        qint64 storeId = 0;         // m_byStoreId key of stored rows
+        QString text; // folded
+        bool alive = true;
+    };
+    using Postings = std::vector<quint32>;
+
+    static QString fold(const QString& text);
+    static QString textOf(const QString& title, const QString& artist, const QString& path);
+    static QString textOf(const Track& track);
+    static quint64 trigramKey(const QChar *c);
+    static quint64 prefixKey(const QChar *c, int length);
+
+    void add(Entry entry);
+    int entryOf(const Track* track) const;
+    void index(quint32 id);
+    void kill(quint32 id);
+    void compactIfNeeded();
+
+    std::vector<Entry> m_entries;
+    QHash<const Track*, quint32> m_byTrack; // live entry of each track
+    QHash<qint64, quint32> m_byStoreId;     // live entry of each stored row
+    QHash<quint64, Postings> m_postings;
+    int m_dead = 0;
+};
@@ -1,4 +1,5 @@
 #include "playlist.hpp"
+#include "AudioCache.hpp"
 #include <QDebug>
 
 Playlist::Playlist() {
@@ -10,7 +11,8 @@ Playlist::Playlist(const QString& name) : m_name(name) {
 }
 
 Playlist::~Playlist() {
-    // Shared pointers will be automatically cleaned up
+    // Cache references are only dropped by explicit removal, not when the
+    // playlist object goes away at shutdown
 }
 
 QString Playlist::getName() const {
@@ -22,10 +24,12 @@ QDateTime Playlist::getCreatedDate() const {
 }
 
 QList<std::shared_ptr<Track>> Playlist::getTracks() const {
+    ensureLoaded();
     return m_tracks;
 }
 
 std::shared_ptr<Track> Playlist::getTrack(int index) const {
+    ensureLoaded();
     if (index >= 0 && index < m_tracks.size()) {
         return m_tracks[index];
     }
@@ -33,15 +37,18 @@ std::shared_ptr<Track> Playlist::getTrack(int index) const {
 }
 
 int Playlist::getTrackCount() const {
-    return m_tracks.size();
+    // Known from the header, no need to load the tracks
+    return m_loader ? m_lazyCount : m_tracks.size();
 }
 
 void Playlist::setName(const QString& name) {
     m_name = name;
+    m_dirty = true;
 }
 
 void Playlist::setCreatedDate(const QDateTime& date) {
     m_createdDate = date;
+    m_dirty = true;
 }
 
 bool Playlist::addTrack(const QString& trackPath) {
@@ -61,7 +68,8 @@ bool Playlist::addTrack(std::shared_ptr<Track> track) {
         return false;
     }
     
-    m_tracks.append(track);
+    appendTrack(track);
+    AudioCache::instance().retain(track->getCacheKey(), track->getOriginalPath());
     return true;
 }
 
@@ -72,12 +80,16 @@ bool Playlist::addTrackWithoutProcessing(std::shared_ptr<Track> track) {
     }
     
     // Add without processing
-    m_tracks.append(track);
+    appendTrack(track);
+    AudioCache::instance().retain(track->getCacheKey(), track->getOriginalPath());
     return true;
 }
 
 bool Playlist::removeTrack(int index) {
+    ensureLoaded();
     if (index >= 0 && index < m_tracks.size()) {
+        AudioCache::instance().release(m_tracks[index]->getCacheKey());
+        forgetTrack(m_tracks[index]);
         m_tracks.removeAt(index);
         return true;
     }
@@ -85,21 +97,82 @@ bool Playlist::removeTrack(int index) {
 }
 
 void Playlist::clear() {
+    ensureLoaded();
+    for (const auto& track : m_tracks) {
+        AudioCache::instance().release(track->getCacheKey());
+        forgetTrack(track);
+    }
     m_tracks.clear();
 }
 
 bool Playlist::moveTrackUp(int index) {
-    if (index > 0 && index < m_tracks.size()) {
-        m_tracks.swapItemsAt(index, index - 1);
-        return true;
-    }
-    return false;
+    return index > 0 && moveTrackDown(index - 1);
 }
 
 bool Playlist::moveTrackDown(int index) {
+    ensureLoaded();
     if (index >= 0 && index < m_tracks.size() - 1) {
+        // Only the two store positions change, the rest of the playlist is untouched
+        const qint64 position = m_tracks[index]->getStorePosition();
+        m_tracks[index]->setStorePosition(m_tracks[index + 1]->getStorePosition());
+        m_tracks[index + 1]->setStorePosition(position);
         m_tracks.swapItemsAt(index, index + 1);
         return true;
     }
     return false;
 }
+
+void Playlist::setLazyTracks(int count, TrackLoader loader) {
+    m_tracks.clear();
+    m_lazyCount = count;
+    m_loader = std::move(loader);
+}
+
+bool Playlist::isLoaded() const {
+    return !m_loader;
+}
+
+qint64 Playlist::getStoreId() const {
+    return m_storeId;
+}
+
+void Playlist::setStoreId(qint64 id) {
+    m_storeId = id;
+}
+
+bool Playlist::isDirty() const {
+    return m_dirty;
+}
+
+void Playlist::setDirty(bool dirty) {
+    m_dirty = dirty;
+}
+
+QList<qint64> Playlist::getRemovedTrackIds() const {
+    return m_removedTrackIds;
+}
+
+void Playlist::clearRemovedTrackIds() {
+    m_removedTrackIds.clear();
+}
+
+void Playlist::ensureLoaded() const {
+    if (m_loader) {
+        TrackLoader loader;
+        loader.swap(m_loader);
+        m_tracks = loader();
+    }
+}
+
+void Playlist::appendTrack(const std::shared_ptr<Track>& track) {
+    ensureLoaded();
+    track->setStorePosition(m_tracks.isEmpty() ? 0 : m_tracks.last()->getStorePosition() + 1);
+    m_tracks.append(track);
+}
+
+void Playlist::forgetTrack(const std::shared_ptr<Track>& track) {
+    if (track->getStoreId() != 0) {
+        m_removedTrackIds.append(track->getStoreId());
+        track->setStoreId(0);
+    }
+}
@@ -4,6 +4,7 @@
 #include <QString>
 #include <QList>
 #include <QDateTime>
+#include <functional>
 #include <memory>
 
 class Playlist {
@@ -12,6 +13,10 @@ public:
     Playlist(const QString& name);
     ~Playlist();
 
+    // Tracks hold AudioCache references, so a playlist is never copied
+    Playlist(const Playlist&) = delete;
+    Playlist& operator=(const Playlist&) = delete;
+
     // Getters
     QString getName() const;
     QDateTime getCreatedDate() const;
@@ -34,8 +39,33 @@ public:
     bool moveTrackUp(int index);
     bool moveTrackDown(int index);
 
+    // Lazy loading: a playlist read from the PlaylistStore starts as a header
+    // with a track count, `loader` fetches the tracks on first access. Their
+    // AudioCache references are taken by whoever creates the header.
+    using TrackLoader = std::function<QList<std::shared_ptr<Track>>()>;
+    void setLazyTracks(int count, TrackLoader loader);
+    bool isLoaded() const;
+
+    // Bookkeeping for the PlaylistStore, see Track::getStoreId()
+    qint64 getStoreId() const;
+    void setStoreId(qint64 id);
+    bool isDirty() const;
+    void setDirty(bool dirty);
+    // Store ids of the tracks removed since the last save
+    QList<qint64> getRemovedTrackIds() const;
+    void clearRemovedTrackIds();
+
 private:
+    void ensureLoaded() const;
+    void appendTrack(const std::shared_ptr<Track>& track);
+    void forgetTrack(const std::shared_ptr<Track>& track);
+
     QString m_name;
     QDateTime m_createdDate;
-    QList<std::shared_ptr<Track>> m_tracks;
+    mutable QList<std::shared_ptr<Track>> m_tracks;
+    mutable TrackLoader m_loader;
+    int m_lazyCount = 0;
+    qint64 m_storeId = 0;
+    bool m_dirty = true;
+    QList<qint64> m_removedTrackIds;
 };
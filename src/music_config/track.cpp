@@ -1,10 +1,16 @@
 #include "track.hpp"
-#include <QProcess>
-#include <QStandardPaths>
-#include <QDir>
+#include "AudioCache.hpp"
+#include "AudioDecoder.hpp"
+#include "WavFileSource.hpp"
+#include <QFile>
 #include <QFileInfo>
-#include <QUuid>
 #include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+// Limits of the loudness normalisation gain, see Track::playbackGain()
+static const double kMaxBoostDb = 12.0;
+static const double kPeakCeilingDb = -1.0;
 
 Track::Track() : m_duration(0) {
     m_addedDate = QDateTime::currentDateTime();
@@ -30,6 +36,10 @@ QString Track::getArtist() const {
     return m_artist;
 }
 
+QString Track::getAlbum() const {
+    return m_album;
+}
+
 QString Track::getProcessedPath() const {
     return m_processedPath;
 }
@@ -46,24 +56,215 @@ int Track::getDuration() const {
     return m_duration;
 }
 
+QString Track::getCacheKey() const {
+    return m_cacheKey;
+}
+
+QString Track::getCachedPath() const {
+    return AudioCache::instance().lookup(m_cacheKey);
+}
+
+bool Track::isHot() const {
+    return m_hot;
+}
+
+QString Track::getHotkey() const {
+    return m_hotkey;
+}
+
+int Track::getSampleRate() const {
+    return m_sampleRate;
+}
+
+int Track::getChannels() const {
+    return m_channels;
+}
+
+QString Track::getChannelLayout() const {
+    return m_channelLayout;
+}
+
+qint64 Track::getSourceSize() const {
+    return m_sourceSize;
+}
+
+qint64 Track::getSourceModified() const {
+    return m_sourceModified;
+}
+
+bool Track::hasLoudness() const {
+    return !std::isnan(m_loudness);
+}
+
+double Track::getLoudness() const {
+    return m_loudness;
+}
+
+double Track::getTruePeak() const {
+    return m_truePeak;
+}
+
+float Track::playbackGain(double targetLufs) const {
+    if (!hasLoudness()) {
+        return 1.0f;
+    }
+    double gainDb = std::min(targetLufs - m_loudness, kMaxBoostDb);
+    // Quiet tracks with loud peaks are only boosted as far as the peaks allow
+    gainDb = std::min(gainDb, std::max(0.0, kPeakCeilingDb - m_truePeak));
+    return static_cast<float>(std::pow(10.0, gainDb / 20.0));
+}
+
+double Track::getGainDb() const {
+    return m_gainDb;
+}
+
 void Track::setTitle(const QString& title) {
     m_title = title;
+    m_dirty = true;
 }
 
 void Track::setArtist(const QString& artist) {
     m_artist = artist;
+    m_dirty = true;
+}
+
+void Track::setAlbum(const QString& album) {
+    m_album = album;
+    m_dirty = true;
 }
 
 void Track::setProcessedPath(const QString& path) {
     m_processedPath = path;
+    m_dirty = true;
 }
 
 void Track::setDuration(int duration) {
     m_duration = duration;
+    m_dirty = true;
 }
 
 void Track::setAddedDate(const QDateTime& date) {
     m_addedDate = date;
+    m_dirty = true;
+}
+
+void Track::setCacheKey(const QString& key) {
+    m_cacheKey = key;
+    m_dirty = true;
+}
+
+void Track::setHot(bool hot) {
+    m_hot = hot;
+    m_dirty = true;
+}
+
+void Track::setHotkey(const QString& hotkey) {
+    m_hotkey = hotkey;
+    m_dirty = true;
+}
+
+void Track::setSampleRate(int rate) {
+    m_sampleRate = rate;
+    m_dirty = true;
+}
+
+void Track::setChannels(int channels) {
+    m_channels = channels;
+    m_dirty = true;
+}
+
+void Track::setChannelLayout(const QString& layout) {
+    m_channelLayout = layout;
+    m_dirty = true;
+}
+
+void Track::setSourceStamp(qint64 size, qint64 modified) {
+    m_sourceSize = size;
+    m_sourceModified = modified;
+    m_dirty = true;
+}
+
+void Track::setLoudness(double lufs, double truePeakDb) {
+    m_loudness = lufs;
+    m_truePeak = truePeakDb;
+    m_dirty = true;
+}
+
+void Track::setGainDb(double gainDb) {
+    m_gainDb = gainDb;
+    m_dirty = true;
+}
+
+TrackMetadata Track::probeFile(const QString& path) {
+    TrackMetadata metadata;
+    QFileInfo info(path);
+    if (!info.exists()) {
+        return metadata;
+    }
+    metadata.exists = true;
+    metadata.size = info.size();
+    metadata.modified = info.lastModified().toMSecsSinceEpoch();
+    metadata.probed = soundpad::probeMedia(path.toStdString(), metadata.media);
+    return metadata;
+}
+
+void Track::applyMetadata(const TrackMetadata& metadata) {
+    if (!metadata.exists) {
+        return;
+    }
+    // Recorded even if the headers were unreadable, so the file is not probed again until it changes
+    setSourceStamp(metadata.size, metadata.modified);
+    if (metadata.analysed) {
+        setLoudness(metadata.loudness, metadata.truePeak);
+    }
+    if (!metadata.probed) {
+        return;
+    }
+    const soundpad::MediaInfo& media = metadata.media;
+    if (media.durationMs >= 0) {
+        m_duration = static_cast<int>((media.durationMs + 500) / 1000);
+    }
+    m_sampleRate = media.sampleRate;
+    m_channels = media.channels;
+    m_channelLayout = QString::fromStdString(media.channelLayout);
+    // Tags only fill in text that is still the default, so a re-probe
+    // never undoes a rename
+    if (!media.title.empty() && (m_title.isEmpty() || m_title == QFileInfo(m_originalPath).baseName())) {
+        m_title = QString::fromStdString(media.title);
+    }
+    if (!media.artist.empty() && m_artist.isEmpty()) {
+        m_artist = QString::fromStdString(media.artist);
+    }
+    if (!media.album.empty() && m_album.isEmpty()) {
+        m_album = QString::fromStdString(media.album);
+    }
+}
+
+qint64 Track::getStoreId() const {
+    return m_storeId;
+}
+
+void Track::setStoreId(qint64 id) {
+    m_storeId = id;
+}
+
+qint64 Track::getStorePosition() const {
+    return m_storePosition;
+}
+
+void Track::setStorePosition(qint64 position) {
+    if (m_storePosition != position) {
+        m_storePosition = position;
+        m_dirty = true;
+    }
+}
+
+bool Track::isDirty() const {
+    return m_dirty;
+}
+
+void Track::setDirty(bool dirty) {
+    m_dirty = dirty;
 }
 
 bool Track::processTrack() {
@@ -72,64 +273,31 @@ bool Track::processTrack() {
         return false;
     }
 
-    // If the track has already been processed and the file exists, don't process again
-    if (!m_processedPath.isEmpty() && QFile::exists(m_processedPath)) {
+    // Tracks imported by older versions keep playing from their WAV copy
+    if (hasProcessedFile()) {
         qDebug() << "Track already processed, skipping:" << m_processedPath;
         return true;
     }
+    m_processedPath.clear();
 
-    // Create app data directory if it doesn't exist
-    QString appDataPath = getAppDataPath();
-    QDir dir(appDataPath);
-    if (!dir.exists()) {
-        dir.mkpath(".");
+    // WAVs the output can take directly are played from the original, no cache needed
+    if (soundpad::WavFileSource::isPlayable(m_originalPath.toStdString())) {
+        return true;
     }
 
-    // Generate a unique filename for the processed track
-    QString outputFilename = generateUniqueFilename();
-    m_processedPath = appDataPath + "/" + outputFilename;
-
-    // Prepare ffmpeg command with properly quoted paths
-    QProcess ffmpeg;
-    QStringList arguments;
-    
-    // Input file
-    arguments << "-i" << QDir::toNativeSeparators(m_originalPath);
-    
-    // Output format: WAV, 44100Hz, 16-bit stereo
-    arguments << "-acodec" << "pcm_s16le"
-              << "-ar" << "44100"
-              << "-ac" << "2"
-              << "-y"  // Overwrite output file if it exists
-              << QDir::toNativeSeparators(m_processedPath);
-    
-    qDebug() << "Running ffmpeg with args:" << arguments.join(" ");
-    
-    // Execute ffmpeg
-    ffmpeg.start("ffmpeg", arguments);
-    if (!ffmpeg.waitForStarted()) {
-        qWarning() << "Failed to start ffmpeg process";
-        return false;
-    }
-    
-    if (!ffmpeg.waitForFinished(-1)) {
-        qWarning() << "ffmpeg process failed:" << ffmpeg.errorString();
+    soundpad::AudioDecoder decoder;
+    if (!decoder.open(m_originalPath.toStdString())) {
+        qWarning() << "Track cannot be decoded:" << m_originalPath;
         return false;
     }
-    
-    if (ffmpeg.exitCode() != 0) {
-        qWarning() << "ffmpeg exited with error:" << ffmpeg.readAllStandardError();
-        return false;
+
+    // Same content imported twice shares one cache entry
+    if (m_cacheKey.isEmpty()) {
+        m_cacheKey = AudioCache::instance().keyFor(m_originalPath);
     }
-    
     return true;
 }
 
-QString Track::generateUniqueFilename() const {
-    QString uuid = QUuid::createUuid().toString(QUuid::WithoutBraces);
-    return uuid + ".wav";
-}
-
-QString Track::getAppDataPath() const {
-    return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/tracks";
+bool Track::hasProcessedFile() const {
+    return !m_processedPath.isEmpty() && QFile::exists(m_processedPath);
 }
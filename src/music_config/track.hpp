@@ -2,6 +2,20 @@
 
 #include <QString>
 #include <QDateTime>
+#include <limits>
+#include "MediaProbe.hpp"
+
+// What a probe found out about a track's source file, see Track::probeFile()
+struct TrackMetadata {
+    bool exists = false;  // size and modified are valid
+    bool probed = false;  // media holds the file's headers
+    qint64 size = 0;
+    qint64 modified = 0;  // ms since epoch
+    soundpad::MediaInfo media;
+    bool analysed = false; // loudness and truePeak are valid (PeakCache::ensureSidecar)
+    double loudness = 0.0; // LUFS
+    double truePeak = 0.0; // dBTP
+};
 
 class Track {
 public:
@@ -12,31 +26,100 @@ public:
     // Getters
     QString getTitle() const;
     QString getArtist() const;
+    QString getAlbum() const;
     QString getProcessedPath() const;
     QString getOriginalPath() const;
     QDateTime getAddedDate() const;
     int getDuration() const; // in seconds
+    QString getCacheKey() const;
+    // Decoded copy in the AudioCache, empty if it is not materialised
+    QString getCachedPath() const;
+    // Hot pads are kept decoded in RAM for instant triggering
+    bool isHot() const;
+    // Global hotkey in QKeySequence portable text, empty if none
+    QString getHotkey() const;
+    // Format of the source file, 0/empty until it has been probed
+    int getSampleRate() const;
+    int getChannels() const;
+    QString getChannelLayout() const;
+    // Size and mtime (ms since epoch) of the source when it was last probed,
+    // -1/0 if it never was. A probe is only repeated when these change.
+    qint64 getSourceSize() const;
+    qint64 getSourceModified() const;
+    // Integrated loudness (LUFS) and true peak (dBTP) of the decoded audio,
+    // measured once at import or probing
+    bool hasLoudness() const;
+    double getLoudness() const;
+    double getTruePeak() const;
+    // Linear gain that brings the track to targetLufs, 1 while its loudness
+    // is unknown. Boosts stop at +12 dB and where the true peak would pass -1 dBTP.
+    float playbackGain(double targetLufs) const;
+    // The user's own gain for this track in dB, on top of the normalisation
+    double getGainDb() const;
 
     // Setters
     void setTitle(const QString& title);
     void setArtist(const QString& artist);
+    void setAlbum(const QString& album);
     void setProcessedPath(const QString& path);
     void setDuration(int duration);
     void setAddedDate(const QDateTime& date);
+    void setCacheKey(const QString& key);
+    void setHot(bool hot);
+    void setHotkey(const QString& hotkey);
+    void setSampleRate(int rate);
+    void setChannels(int channels);
+    void setChannelLayout(const QString& layout);
+    void setSourceStamp(qint64 size, qint64 modified);
+    void setLoudness(double lufs, double truePeakDb);
+    void setGainDb(double gainDb);
+
+    // Stat the file and read its headers (no decoding). Any thread.
+    static TrackMetadata probeFile(const QString& path);
+    // Take over what probeFile() found. Duration, format and loudness are
+    // replaced; tags only fill in a title still equal to the file name and
+    // an empty artist or album.
+    void applyMetadata(const TrackMetadata& metadata);
+
+    // Bookkeeping for the PlaylistStore. The id is the track's row, 0 until
+    // it has been saved. The position orders tracks within their playlist and
+    // is not the index, so adding or removing a track never renumbers others.
+    // Every setter marks the track dirty; the store clears the flag once the
+    // row is written.
+    qint64 getStoreId() const;
+    void setStoreId(qint64 id);
+    qint64 getStorePosition() const;
+    void setStorePosition(qint64 position);
+    bool isDirty() const;
+    void setDirty(bool dirty);
     
-    // Process the track using ffmpeg and store it in the app data location
-    // Returns true if processing was successful
+    // Check that the track can be decoded in-process. Nothing is transcoded:
+    // playback streams straight from the original file.
+    // Returns true if the track is playable
     bool processTrack();
+    // Transcoded WAV left by older versions, if it is still on disk
+    bool hasProcessedFile() const;
 
 private:
     QString m_title;
     QString m_artist;
+    QString m_album;
     QString m_originalPath;  // Original file path
-    QString m_processedPath; // Path after processing with ffmpeg
+    QString m_processedPath; // Legacy transcoded WAV (empty for new imports)
     QDateTime m_addedDate;
     int m_duration;          // Track duration in seconds
-    
-    // Helper methods
-    QString generateUniqueFilename() const;
-    QString getAppDataPath() const;
+    QString m_cacheKey;      // AudioCache key (content hash of the original)
+    bool m_hot = false;
+    QString m_hotkey;
+    int m_sampleRate = 0;
+    int m_channels = 0;
+    QString m_channelLayout;
+    qint64 m_sourceSize = -1;
+    qint64 m_sourceModified = 0;
+    double m_loudness = std::numeric_limits<double>::quiet_NaN(); // NaN until measured
+    double m_truePeak = 0.0;
+    double m_gainDb = 0.0;
+    qint64 m_storeId = 0;
+    qint64 m_storePosition = 0;
+    bool m_dirty = true;
 };
@@ -0,0 +1,38 @@
+#include "TrackFilterProxyModel.hpp"
+
+TrackFilterProxyModel::TrackFilterProxyModel(QObject* parent)
+    : QSortFilterProxyModel(parent)
+{
+}
+
+void TrackFilterProxyModel::setTracks(const QSet<const Track*>& tracks)
+{
+    m_tracks = tracks;
+    m_filtering = true;
+    invalidateFilter();
+}
+
+void TrackFilterProxyModel::clearTracks()
+{
+    if (!m_filtering) {
+        return;
+    }
+    m_tracks.clear();
+    m_filtering = false;
+    invalidateFilter();
+}
+
+bool TrackFilterProxyModel::isFiltering() const
+{
+    return m_filtering;
+}
+
+bool TrackFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const
+{
+    if (!m_filtering || sourceParent.isValid()) {
+        return true;
+    }
+    auto* tracks = static_cast<TrackTableModel*>(sourceModel());
+    auto track = tracks->trackAt(sourceRow);
+    return track && m_tracks.contains(track.get());
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "TrackTableModel.hpp"
+#include <QSet>
+#include <QSortFilterProxyModel>
+
+// Shows only the rows of a TrackTableModel whose track is in a given set,
+// e.g. the hits of a SearchIndex query. Without a filter every row passes.
+class TrackFilterProxyModel : public QSortFilterProxyModel {
+    Q_OBJECT
+public:
+    explicit TrackFilterProxyModel(QObject* parent = nullptr);
+
+    void setTracks(const QSet<const Track*>& tracks);
+    void clearTracks();
+    bool isFiltering() const;
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+
+private:
+    QSet<const Track*> m_tracks;
+    bool m_filtering = false;
+};
@@ -0,0 +1,202 @@
+#include "TrackTableModel.hpp"
+#include <QBrush>
+#include <QColor>
+#include <QFont>
+
+TrackTableModel::TrackTableModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+std::shared_ptr<Playlist> TrackTableModel::playlist() const
+{
+    return m_playlist;
+}
+
+void TrackTableModel::setPlaylist(std::shared_ptr<Playlist> playlist)
+{
+    beginResetModel();
+    m_playlist = std::move(playlist);
+    m_currentRow = -1;
+    endResetModel();
+}
+
+int TrackTableModel::currentRow() const
+{
+    return m_currentRow;
+}
+
+void TrackTableModel::setCurrentRow(int row)
+{
+    if (row == m_currentRow) {
+        return;
+    }
+    const int previous = m_currentRow;
+    m_currentRow = row;
+    // Only the two rows whose highlight changed are repainted
+    if (previous >= 0 && previous < rowCount()) {
+        emit dataChanged(index(previous, 0), index(previous, ColumnCount - 1), {Qt::BackgroundRole});
+    }
+    if (row >= 0 && row < rowCount()) {
+        emit dataChanged(index(row, 0), index(row, ColumnCount - 1), {Qt::BackgroundRole});
+    }
+}
+
+std::shared_ptr<Track> TrackTableModel::trackAt(int row) const
+{
+    return m_playlist ? m_playlist->getTrack(row) : nullptr;
+}
+
+bool TrackTableModel::appendTrack(std::shared_ptr<Track> track)
+{
+    if (!m_playlist || !track) {
+        return false;
+    }
+    const int row = m_playlist->getTrackCount();
+    beginInsertRows(QModelIndex(), row, row);
+    const bool added = m_playlist->addTrackWithoutProcessing(std::move(track));
+    endInsertRows();
+    return added;
+}
+
+bool TrackTableModel::removeTrack(int row)
+{
+    if (!m_playlist || row < 0 || row >= rowCount()) {
+        return false;
+    }
+    beginRemoveRows(QModelIndex(), row, row);
+    const bool removed = m_playlist->removeTrack(row);
+    if (m_currentRow == row) {
+        m_currentRow = -1;
+    } else if (m_currentRow > row) {
+        m_currentRow--;
+    }
+    endRemoveRows();
+    return removed;
+}
+
+void TrackTableModel::trackChanged(int row)
+{
+    if (row >= 0 && row < rowCount()) {
+        emit dataChanged(index(row, 0), index(row, ColumnCount - 1));
+    }
+}
+
+void TrackTableModel::tracksChanged()
+{
+    if (rowCount() > 0) {
+        emit dataChanged(index(0, 0), index(rowCount() - 1, ColumnCount - 1));
+    }
+}
+
+int TrackTableModel::rowCount(const QModelIndex& parent) const
+{
+    // The count comes from the playlist header, tracks load on the first data() call
+    return parent.isValid() || !m_playlist ? 0 : m_playlist->getTrackCount();
+}
+
+int TrackTableModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant TrackTableModel::data(const QModelIndex& index, int role) const
+{
+    if (!m_playlist || !index.isValid()) {
+        return QVariant();
+    }
+    auto track = m_playlist->getTrack(index.row());
+    if (!track) {
+        return QVariant();
+    }
+
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case IdColumn:
+            return index.row() + 1;
+        case TitleColumn:
+            return track->getTitle();
+        case DurationColumn: {
+            int sec = track->getDuration();
+            return QString("%1:%2").arg(sec/60,2,10,QChar('0')).arg(sec%60,2,10,QChar('0'));
+        }
+        }
+        break;
+    case Qt::ToolTipRole:
+        if (index.column() == IdColumn && !track->getHotkey().isEmpty()) {
+            return tr("Hotkey: %1").arg(track->getHotkey());
+        }
+        if (index.column() == TitleColumn) {
+            QStringList lines;
+            if (!track->getArtist().isEmpty()) {
+                lines << track->getArtist();
+            }
+            if (!track->getAlbum().isEmpty()) {
+                lines << track->getAlbum();
+            }
+            if (track->isHot()) {
+                lines << tr("Kept in memory");
+            }
+            if (!lines.isEmpty()) {
+                return lines.join("\n");
+            }
+        }
+        if (index.column() == DurationColumn) {
+            QStringList lines;
+            if (track->getSampleRate() > 0) {
+                QString layout = track->getChannelLayout();
+                if (layout.isEmpty()) {
+                    layout = tr("%1 channels").arg(track->getChannels());
+                }
+                lines << tr("%1 Hz, %2").arg(track->getSampleRate()).arg(layout);
+            }
+            if (track->hasLoudness()) {
+                lines << tr("%1 LUFS, true peak %2 dBTP")
+                             .arg(track->getLoudness(), 0, 'f', 1)
+                             .arg(track->getTruePeak(), 0, 'f', 1);
+            }
+            if (track->getGainDb() != 0.0) {
+                lines << tr("Gain %1 dB").arg(track->getGainDb(), 0, 'f', 1);
+            }
+            if (!lines.isEmpty()) {
+                return lines.join("\n");
+            }
+        }
+        break;
+    case Qt::FontRole:
+        if (index.column() == TitleColumn && track->isHot()) {
+            QFont font;
+            font.setBold(true);
+            return font;
+        }
+        break;
+    case OriginalPathRole:
+        return track->getOriginalPath();
+    case Qt::BackgroundRole:
+        // Highlight the current track
+        if (index.row() == m_currentRow) {
+            return QBrush(QColor(200, 230, 255));
+        }
+        break;
+    }
+    return QVariant();
+}
+
+QVariant TrackTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (role != Qt::DisplayRole || orientation != Qt::Horizontal) {
+        return QVariant();
+    }
+    switch (section) {
+    case IdColumn:
+        return tr("ID");
+    case TitleColumn:
+        return tr("Title");
+    case WaveformColumn:
+        return tr("Waveform");
+    case DurationColumn:
+        return tr("Duration");
+    }
+    return QVariant();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../music_config/playlist.hpp"
+#include <QAbstractTableModel>
+#include <memory>
+
+// The tracks of one playlist for the sound table. Nothing is copied out of
+// the playlist: cells are formatted when the view asks for them, which it
+// only does for visible rows, and a track change repaints a single row.
+// Changes to the playlist must go through the model (appendTrack,
+// removeTrack) or be announced (trackChanged, setPlaylist) so the view
+// stays in sync.
+class TrackTableModel : public QAbstractTableModel {
+    Q_OBJECT
+public:
+    enum Column { IdColumn, TitleColumn, WaveformColumn, DurationColumn, ColumnCount };
+    // Original path of the row's track, what WaveformDelegate draws from
+    enum Role { OriginalPathRole = Qt::UserRole };
+
+    explicit TrackTableModel(QObject* parent = nullptr);
+
+    std::shared_ptr<Playlist> playlist() const;
+    void setPlaylist(std::shared_ptr<Playlist> playlist);
+
+    // Highlighted row, -1 for none
+    int currentRow() const;
+    void setCurrentRow(int row);
+
+    std::shared_ptr<Track> trackAt(int row) const;
+    bool appendTrack(std::shared_ptr<Track> track);
+    bool removeTrack(int row);
+    // Repaint a row after its track was edited
+    void trackChanged(int row);
+    // Repaint everything, e.g. after a batch of tracks was probed
+    void tracksChanged();
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    std::shared_ptr<Playlist> m_playlist;
+    int m_currentRow = -1;
+};
@@ -0,0 +1,26 @@
+#include "WaveformDelegate.hpp"
+#include "TrackTableModel.hpp"
+#include "WaveformSlider.hpp"
+#include <QPainter>
+
+WaveformDelegate::WaveformDelegate(PeakCache* peaks, QObject* parent)
+    : QStyledItemDelegate(parent)
+    , m_peaks(peaks)
+{
+}
+
+void WaveformDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    // Background, current-track highlight and selection
+    QStyledItemDelegate::paint(painter, option, index);
+
+    auto peaks = m_peaks->peaks(index.data(TrackTableModel::OriginalPathRole).toString());
+    if (!peaks) {
+        return;
+    }
+    painter->save();
+    const bool selected = option.state & QStyle::State_Selected;
+    painter->setPen(option.palette.color(selected ? QPalette::HighlightedText : QPalette::Mid));
+    WaveformSlider::drawPeaks(*painter, option.rect.adjusted(2, 2, -2, -2), *peaks);
+    painter->restore();
+}
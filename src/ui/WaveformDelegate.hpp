@@ -0,0 +1,17 @@
+#pragma once
+
+#include "../music_config/PeakCache.hpp"
+#include <QStyledItemDelegate>
+
+// Draws the waveform of a track row from the PeakCache. Rows whose peaks are
+// not in memory yet stay empty until PeakCache::peaksReady repaints them.
+class WaveformDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+public:
+    WaveformDelegate(PeakCache* peaks, QObject* parent = nullptr);
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+private:
+    PeakCache* m_peaks;
+};
@@ -0,0 +1,100 @@
+#include "WaveformSlider.hpp"
+#include <QLine>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QStyle>
+#include <QVector>
+#include <vector>
+
+WaveformSlider::WaveformSlider(QWidget* parent)
+    : QSlider(Qt::Horizontal, parent)
+{
+}
+
+void WaveformSlider::setPeaks(std::shared_ptr<const soundpad::PeakPyramid> peaks)
+{
+    m_peaks = std::move(peaks);
+    update();
+}
+
+void WaveformSlider::drawPeaks(QPainter& painter, const QRect& rect, const soundpad::PeakPyramid& peaks)
+{
+    const int columns = rect.width();
+    if (columns <= 0 || rect.height() <= 0) {
+        return;
+    }
+    std::vector<soundpad::PeakPyramid::Peak> column(static_cast<size_t>(columns));
+    peaks.render(0, peaks.frames(), columns, column.data());
+
+    const double mid = rect.top() + rect.height() / 2.0;
+    const double scale = rect.height() / 2.0 / 127.0;
+    QVector<QLine> lines;
+    lines.reserve(columns);
+    for (int x = 0; x < columns; ++x) {
+        const int top = static_cast<int>(mid - column[static_cast<size_t>(x)].max * scale);
+        const int bottom = static_cast<int>(mid - column[static_cast<size_t>(x)].min * scale);
+        lines.append(QLine(rect.left() + x, top, rect.left() + x, bottom));
+    }
+    painter.drawLines(lines);
+}
+
+void WaveformSlider::paintEvent(QPaintEvent* event)
+{
+    if (!m_peaks) {
+        QSlider::paintEvent(event);
+        return;
+    }
+
+    QPainter painter(this);
+    const QRect area = contentsRect();
+    const int played = QStyle::sliderPositionFromValue(minimum(), maximum(), value(), area.width());
+
+    painter.setPen(palette().color(QPalette::Mid));
+    drawPeaks(painter, area, *m_peaks);
+    // Same picture again over the played part, in the highlight colour
+    painter.setClipRect(QRect(area.left(), area.top(), played, area.height()));
+    painter.setPen(palette().color(QPalette::Highlight));
+    drawPeaks(painter, area, *m_peaks);
+    painter.setClipping(false);
+
+    painter.setPen(palette().color(QPalette::WindowText));
+    painter.drawLine(area.left() + played, area.top(), area.left() + played, area.bottom());
+}
+
+int WaveformSlider::valueAt(int x) const
+{
+    const QRect area = contentsRect();
+    return QStyle::sliderValueFromPosition(minimum(), maximum(), x - area.left(), area.width());
+}
+
+// With a waveform the whole bar is the handle: press and drag seek directly
+void WaveformSlider::mousePressEvent(QMouseEvent* event)
+{
+    if (!m_peaks || event->button() != Qt::LeftButton) {
+        QSlider::mousePressEvent(event);
+        return;
+    }
+    setSliderDown(true);
+    setSliderPosition(valueAt(event->position().toPoint().x()));
+    event->accept();
+}
+
+void WaveformSlider::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!m_peaks || !isSliderDown()) {
+        QSlider::mouseMoveEvent(event);
+        return;
+    }
+    setSliderPosition(valueAt(event->position().toPoint().x()));
+    event->accept();
+}
+
+void WaveformSlider::mouseReleaseEvent(QMouseEvent* event)
+{
+    if (!m_peaks || !isSliderDown()) {
+        QSlider::mouseReleaseEvent(event);
+        return;
+    }
+    setSliderDown(false);
+    event->accept();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "PeakPyramid.hpp"
+#include <QSlider>
+#include <memory>
+
+class QPainter;
+
+// Seek bar that draws the waveform of the playing track behind the playhead,
+// the part already played in the highlight colour. Clicking anywhere seeks
+// there (sliderMoved). Without peaks it is a plain QSlider.
+class WaveformSlider : public QSlider {
+    Q_OBJECT
+public:
+    explicit WaveformSlider(QWidget* parent = nullptr);
+
+    // Null shows the plain slider, e.g. while the peaks are being computed
+    void setPeaks(std::shared_ptr<const soundpad::PeakPyramid> peaks);
+
+    // One vertical line per pixel column of `rect`, the whole track
+    static void drawPeaks(QPainter& painter, const QRect& rect, const soundpad::PeakPyramid& peaks);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+
+private:
+    int valueAt(int x) const;
+
+    std::shared_ptr<const soundpad::PeakPyramid> m_peaks;
+};
@@ -9,6 +9,21 @@
 #include <QMimeData>
 #include <QUrl>
 #include <QInputDialog>
+#include <QGuiApplication>
+#include <QMenu>
+#include <QTimer>
+#include <QToolButton>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QSignalBlocker>
+#include <cmath>
+#include "../music_config/AudioCache.hpp"
+#include "WaveformDelegate.hpp"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -26,6 +41,12 @@ MainWindow::MainWindow(QWidget *parent)
     settings = new QSettings("nrf24l01", "FunnyPad");
     qDebug() << "Settings path:" << settings->fileName();
 
+    // Device selectors follow hot-plugging. Connected before they are filled:
+    // a device reported in between arrives twice and is only added once.
+    connect(&audio, &soundpad::SoundpadAudio::deviceAdded, this, &MainWindow::onDeviceAdded);
+    connect(&audio, &soundpad::SoundpadAudio::deviceRemoved, this, &MainWindow::onDeviceRemoved);
+    connect(&audio, &soundpad::SoundpadAudio::deviceChanged, this, &MainWindow::onDeviceChanged);
+
     // Setup mic input selector
     auto sources = audio.getSourceList();
 
@@ -51,6 +72,14 @@ MainWindow::MainWindow(QWidget *parent)
         settings->setValue("audio_source", sourceName);
     });
 
+    // Set before a source is merged, so the mic stream opens only once
+    ui->micLatencySpin->setValue(settings->value("mic_latency_ms", 20).toInt());
+    audio.setMicLatencyMs(ui->micLatencySpin->value());
+    connect(ui->micLatencySpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int ms) {
+        audio.setMicLatencyMs(ms);
+        settings->setValue("mic_latency_ms", ms);
+    });
+
     QString savedSource = settings->value("audio_source", "").toString();
     if (!savedSource.isEmpty()) {
         int index = ui->outputSelect->findData(savedSource);
@@ -91,9 +120,87 @@ MainWindow::MainWindow(QWidget *parent)
     connect(&audio, &soundpad::SoundpadAudio::playbackStarted, this, &MainWindow::on_playbackStarted);
     connect(&audio, &soundpad::SoundpadAudio::playbackProgress, this, &MainWindow::on_playbackProgress);
     connect(&audio, &soundpad::SoundpadAudio::playbackStopped, this, &MainWindow::on_playbackStopped);
+    connect(&audio, &soundpad::SoundpadAudio::trackAdvanced, this, &MainWindow::onTrackAdvanced);
+
+    // Crossfade between playlist tracks, 0 splices them gaplessly
+    ui->crossfadeSpin->setValue(settings->value("crossfade_ms", 0).toInt());
+    audio.setCrossfadeMs(ui->crossfadeSpin->value());
+    connect(ui->crossfadeSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int ms) {
+        audio.setCrossfadeMs(ms);
+        settings->setValue("crossfade_ms", ms);
+        // The queued track carries the old length, queue it again
+        if (isPlaying) {
+            queueNextTrack();
+        }
+    });
+
+    // Output levels in percent: master, the virtual mic and the monitor device
+    ui->masterVolumeSlider->setValue(settings->value("master_volume", 100).toInt());
+    ui->micVolumeSlider->setValue(settings->value("mic_volume", 100).toInt());
+    ui->monitorVolumeSlider->setValue(settings->value("monitor_volume", 100).toInt());
+    ui->micMuteCheck->setChecked(settings->value("mic_muted", false).toBool());
+    ui->monitorMuteCheck->setChecked(settings->value("monitor_muted", false).toBool());
+    audio.setMasterGain(ui->masterVolumeSlider->value() / 100.0f);
+    audio.setBusGain(soundpad::SoundpadAudio::Bus::Virtual, ui->micVolumeSlider->value() / 100.0f);
+    audio.setBusGain(soundpad::SoundpadAudio::Bus::Monitor, ui->monitorVolumeSlider->value() / 100.0f);
+    audio.setBusMuted(soundpad::SoundpadAudio::Bus::Virtual, ui->micMuteCheck->isChecked());
+    audio.setBusMuted(soundpad::SoundpadAudio::Bus::Monitor, ui->monitorMuteCheck->isChecked());
+    connect(ui->masterVolumeSlider, &QSlider::valueChanged, this, [this](int percent) {
+        audio.setMasterGain(percent / 100.0f);
+        settings->setValue("master_volume", percent);
+    });
+    connect(ui->micVolumeSlider, &QSlider::valueChanged, this, [this](int percent) {
+        audio.setBusGain(soundpad::SoundpadAudio::Bus::Virtual, percent / 100.0f);
+        settings->setValue("mic_volume", percent);
+    });
+    connect(ui->monitorVolumeSlider, &QSlider::valueChanged, this, [this](int percent) {
+        audio.setBusGain(soundpad::SoundpadAudio::Bus::Monitor, percent / 100.0f);
+        settings->setValue("monitor_volume", percent);
+    });
+    connect(ui->micMuteCheck, &QCheckBox::toggled, this, [this](bool muted) {
+        audio.setBusMuted(soundpad::SoundpadAudio::Bus::Virtual, muted);
+        settings->setValue("mic_muted", muted);
+    });
+    connect(ui->monitorMuteCheck, &QCheckBox::toggled, this, [this](bool muted) {
+        audio.setBusMuted(soundpad::SoundpadAudio::Bus::Monitor, muted);
+        settings->setValue("monitor_muted", muted);
+    });
 
     connect(ui->musicProgress, &QSlider::sliderMoved, this, &MainWindow::on_musicProgress_sliderMoved);
 
+    // Import progress lives in the status bar and is hidden while idle
+    importProgress = new QProgressBar(this);
+    importProgress->setMaximumWidth(200);
+    importProgress->setVisible(false);
+    cancelImportButton = new QPushButton(tr("Cancel"), this);
+    cancelImportButton->setVisible(false);
+    ui->statusbar->addPermanentWidget(importProgress);
+    ui->statusbar->addPermanentWidget(cancelImportButton);
+
+    // Sample bank usage, refreshed while there is anything to show
+    bankStatus = new QLabel(this);
+    bankStatus->setVisible(false);
+    ui->statusbar->addPermanentWidget(bankStatus);
+    latencyStatus = new QLabel(this);
+    latencyStatus->setVisible(false);
+    ui->statusbar->addPermanentWidget(latencyStatus);
+    setupDiagnosticsDock();
+    QTimer* statusTimer = new QTimer(this);
+    connect(statusTimer, &QTimer::timeout, this, &MainWindow::updateBankStatus);
+    connect(statusTimer, &QTimer::timeout, this, &MainWindow::updateLatencyStatus);
+    connect(statusTimer, &QTimer::timeout, this, &MainWindow::updateDiagnostics);
+    statusTimer->start(1000);
+
+    connect(cancelImportButton, &QPushButton::clicked, &importQueue, &ImportQueue::cancelAll);
+    connect(&importQueue, &ImportQueue::importStarted, this, &MainWindow::onImportStarted);
+    connect(&importQueue, &ImportQueue::trackImported, this, &MainWindow::onTrackImported);
+    connect(&importQueue, &ImportQueue::importFailed, this, &MainWindow::onImportFailed);
+    connect(&importQueue, &ImportQueue::importFinished, this, &MainWindow::onImportFileFinished);
+    connect(&importQueue, &ImportQueue::progressChanged, this, &MainWindow::onImportProgress);
+    connect(&importQueue, &ImportQueue::allFinished, this, &MainWindow::onImportFinished);
+    connect(&metadataProber, &MetadataProber::tracksProbed, this, &MainWindow::onTracksProbed);
+    connect(&metadataProber, &MetadataProber::allFinished, this, &MainWindow::savePlaylistsToSettings);
+
     data_path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     QDir dir(data_path);
     if (!dir.exists()) {
@@ -102,16 +209,59 @@ MainWindow::MainWindow(QWidget *parent)
 
     qDebug() << "Data path:" << data_path;
 
-    // Set up soundTable
-    ui->soundTable->setColumnCount(3);
-    ui->soundTable->setHorizontalHeaderLabels(QStringList() << "ID" << "Title" << "Duration");
-    ui->soundTable->horizontalHeader()->setSectionResizeMode(1, QHeaderView::Stretch);
+    // Set up soundTable: a view over the current playlist, so switching
+    // tracks repaints two rows instead of rebuilding the table
+    trackModel = new TrackTableModel(this);
+    trackProxy = new TrackFilterProxyModel(this);
+    trackProxy->setSourceModel(trackModel);
+    ui->soundTable->setModel(trackProxy);
+    ui->soundTable->horizontalHeader()->setSectionResizeMode(TrackTableModel::TitleColumn, QHeaderView::Stretch);
+    ui->soundTable->setItemDelegateForColumn(TrackTableModel::WaveformColumn, new WaveformDelegate(&peakCache, this));
+    ui->soundTable->horizontalHeader()->resizeSection(TrackTableModel::WaveformColumn, 160);
+    connect(&peakCache, &PeakCache::peaksReady, this, [this](const QString& originalPath) {
+        if (originalPath == waveformPath) {
+            ui->musicProgress->setPeaks(peakCache.peaks(originalPath));
+        }
+        ui->soundTable->viewport()->update();
+    });
+    // Fixed row heights: the view never measures rows it does not show
+    ui->soundTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->soundTable->verticalHeader()->setDefaultSectionSize(ui->soundTable->fontMetrics().height() + 8);
+    ui->soundTable->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(ui->soundTable, &QWidget::customContextMenuRequested, this, &MainWindow::onSoundTableContextMenu);
+    ui->playlistList->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(ui->playlistList, &QWidget::customContextMenuRequested, this, &MainWindow::onPlaylistListContextMenu);
     
     // Clear playlistList
     ui->playlistList->clear();
     
+    // Decoded audio cache, budget in megabytes. Off unless set: originals
+    // are streamed, a decoded copy only helps slow disks or weak CPUs
+    AudioCache::instance().setByteBudget(settings->value("cache_budget_mb", 0).toLongLong() * 1024 * 1024);
+
+    // Hot pads stay decoded in RAM, budget in megabytes
+    audio.sampleBank().setByteBudget(settings->value("sample_bank_mb", 256).toLongLong() * 1024 * 1024);
+    audio.sampleBank().setLocked(settings->value("sample_bank_mlock", false).toBool());
+
+    // Tracks are played at a common loudness, measured at import
+    normalizeLoudness = settings->value("loudness_normalize", true).toBool();
+    loudnessTarget = settings->value("loudness_target_lufs", -16.0).toDouble();
+
     // Load playlists from settings
     loadPlaylistsFromSettings();
+    AudioCache::instance().collectGarbage();
+    for (int i = 0; i < playlistManager.getPlaylistCount(); i++) {
+        auto playlist = playlistManager.getPlaylist(i);
+        if (!playlist->isLoaded()) {
+            continue; // playlists with hot pads are loaded up front
+        }
+        for (int j = 0; j < playlist->getTrackCount(); j++) {
+            if (playlist->getTrack(j)->isHot()) {
+                preloadTrack(playlist->getTrack(j));
+            }
+        }
+    }
+    registerHotkeys();
     
     // Update UI
     updatePlaylistsList();
@@ -124,6 +274,11 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    // Drop pending imports without reporting them back to a closing window
+    disconnect(&importQueue, nullptr, this, nullptr);
+    importQueue.cancelAll();
+    disconnect(&metadataProber, nullptr, this, nullptr);
+    metadataProber.cancelAll();
     audio.stop();
     
     // Save playlists to settings
@@ -217,6 +372,17 @@ void MainWindow::on_playbackStopped()
     }
 }
 
+void MainWindow::onTrackAdvanced(qint64 totalMs)
+{
+    on_playbackStarted(totalMs);
+    if (queuedTrackIndex >= 0) {
+        currentTrackIndex = queuedTrackIndex;
+        trackModel->setCurrentRow(currentTrackIndex);
+        showWaveform(trackModel->trackAt(currentTrackIndex));
+    }
+    queueNextTrack();
+}
+
 void MainWindow::on_previousButton_clicked()
 {
     if (currentPlaylistIndex >= 0 && currentTrackIndex > 0) {
@@ -239,15 +405,19 @@ void MainWindow::on_playlistList_currentRowChanged(int currentRow)
     // Don't stop playback when changing playlists
     currentPlaylistIndex = currentRow;
     currentTrackIndex = -1; // Reset track index but don't stop current playback
+    // Nothing follows the current track any more
+    queuedTrackIndex = -1;
+    audio.clearQueue();
     updateTracksList();
 }
 
-void MainWindow::on_soundTable_cellDoubleClicked(int row, int column)
+void MainWindow::on_soundTable_doubleClicked(const QModelIndex& index)
 {
-    Q_UNUSED(column);
-    
+    int row = trackProxy->mapToSource(index).row();
     if (currentPlaylistIndex >= 0 && row >= 0) {
-        playTrack(row);
+        // Ctrl+double-click layers the sound over whatever is already playing
+        bool overlay = QGuiApplication::keyboardModifiers() & Qt::ControlModifier;
+        playTrack(row, overlay);
     }
 }
 
@@ -304,53 +474,118 @@ void MainWindow::updatePlaylistsList()
         auto playlist = playlistManager.createPlaylist("Default Playlist");
         ui->playlistList->addItem(playlist->getName());
     }
+    
+    // New items are visible, hide them again if a search is active
+    if (trackProxy->isFiltering()) {
+        applySearch();
+    }
 }
 
 void MainWindow::updateTracksList()
 {
-    ui->soundTable->setRowCount(0);
-    
-    if (currentPlaylistIndex >= 0) {
-        auto playlist = playlistManager.getPlaylist(currentPlaylistIndex);
+    auto playlist = currentPlaylistIndex >= 0 ? playlistManager.getPlaylist(currentPlaylistIndex) : nullptr;
+    if (playlist != trackModel->playlist()) {
+        trackModel->setPlaylist(playlist);
         if (playlist) {
-            ui->soundTable->setRowCount(playlist->getTrackCount());
-            
-            for (int i = 0; i < playlist->getTrackCount(); i++) {
-                auto track = playlist->getTrack(i);
-                
-                // ID
-                QTableWidgetItem* idItem = new QTableWidgetItem(QString::number(i + 1));
-                ui->soundTable->setItem(i, 0, idItem);
-                
-                // Title
-                QTableWidgetItem* titleItem = new QTableWidgetItem(track->getTitle());
-                ui->soundTable->setItem(i, 1, titleItem);
-                
-                // Duration
-                int sec = track->getDuration();
-                QString duration = QString("%1:%2").arg(sec/60,2,10,QChar('0')).arg(sec%60,2,10,QChar('0'));
-                QTableWidgetItem* durationItem = new QTableWidgetItem(duration);
-                ui->soundTable->setItem(i, 2, durationItem);
-                
-                // Highlight the current track
-                if (i == currentTrackIndex) {
-                    idItem->setBackground(QColor(200, 230, 255));
-                    titleItem->setBackground(QColor(200, 230, 255));
-                    durationItem->setBackground(QColor(200, 230, 255));
-                }
+            // Unchanged files cost a stat() each, the rest is probed in the background
+            metadataProber.revalidate(playlist->getTracks());
+        }
+    }
+    trackModel->setCurrentRow(currentTrackIndex);
+}
+
+void MainWindow::onTracksProbed(const QList<std::shared_ptr<Track>>& tracks)
+{
+    trackModel->tracksChanged();
+    // Hotkey actions carry their gain, rebind them once it is known
+    for (const auto& track : tracks) {
+        if (!track->getHotkey().isEmpty()) {
+            registerHotkeys();
+            break;
+        }
+    }
+    if (searchIndexBuilt) {
+        for (const auto& track : tracks) {
+            searchIndex.updateTrack(track);
+        }
+        if (trackProxy->isFiltering()) {
+            applySearch();
+        }
+    }
+}
+
+void MainWindow::on_searchEdit_textChanged(const QString& text)
+{
+    Q_UNUSED(text);
+    applySearch();
+}
+
+// Filter the sound table to the hits in the current playlist and hide the
+// playlists without any
+void MainWindow::applySearch()
+{
+    QString query = ui->searchEdit->text().trimmed();
+    if (query.isEmpty()) {
+        trackProxy->clearTracks();
+        for (int i = 0; i < ui->playlistList->count(); i++) {
+            ui->playlistList->item(i)->setHidden(false);
+        }
+        return;
+    }
+    
+    if (!searchIndexBuilt) {
+        // Playlists that are not loaded are indexed from the database and stay unloaded
+        searchIndex.rebuild(playlistManager.getPlaylists(), playlistManager.loadTrackTexts());
+        searchIndexBuilt = true;
+    }
+    auto shown = trackModel->playlist();
+    QSet<const Track*> tracks;
+    QSet<qint64> storedHits; // of the shown playlist, indexed before it was loaded
+    QSet<const Playlist*> playlists;
+    for (const auto& hit : searchIndex.search(query)) {
+        if (hit.track) {
+            tracks.insert(hit.track.get());
+        } else if (hit.playlist == shown) {
+            storedHits.insert(hit.trackId);
+        }
+        playlists.insert(hit.playlist.get());
+    }
+    if (!storedHits.isEmpty()) {
+        for (const auto& track : shown->getTracks()) {
+            if (storedHits.contains(track->getStoreId())) {
+                tracks.insert(track.get());
             }
         }
     }
+    trackProxy->setTracks(tracks);
+    
+    int firstMatch = -1;
+    for (int i = 0; i < ui->playlistList->count(); i++) {
+        auto playlist = playlistManager.getPlaylist(i);
+        bool matches = playlist && playlists.contains(playlist.get());
+        ui->playlistList->item(i)->setHidden(!matches);
+        if (matches && firstMatch < 0) {
+            firstMatch = i;
+        }
+    }
+    // Jump to a playlist that has hits if the current one has none
+    auto current = playlistManager.getPlaylist(currentPlaylistIndex);
+    if (firstMatch >= 0 && (!current || !playlists.contains(current.get()))) {
+        ui->playlistList->setCurrentRow(firstMatch);
+    }
+    ui->statusbar->showMessage(tr("%1 matching tracks").arg(tracks.size()), 3000);
 }
 
 void MainWindow::loadPlaylistsFromSettings()
 {
+    // playlists.json of older versions is migrated into the database once
     QString playlistsPath = data_path + "/playlists.json";
-    QFile file(playlistsPath);
-    
-    if (file.exists()) {
+    if (!playlistManager.open(data_path + "/playlists.db", playlistsPath) && QFile::exists(playlistsPath)) {
+        // No usable database, keep working from the JSON file
         playlistManager.loadPlaylists(playlistsPath);
-    } else {
+    }
+    
+    if (playlistManager.getPlaylistCount() == 0) {
         // Create a default playlist if none exists
         playlistManager.createPlaylist("Default Playlist");
     }
@@ -358,45 +593,103 @@ void MainWindow::loadPlaylistsFromSettings()
 
 void MainWindow::savePlaylistsToSettings()
 {
-    QString playlistsPath = data_path + "/playlists.json";
-    playlistManager.savePlaylists(playlistsPath);
+    // Only writes what changed, cheap enough to call after every edit
+    if (playlistManager.isOpen()) {
+        playlistManager.save();
+    } else {
+        playlistManager.savePlaylists(data_path + "/playlists.json");
+    }
 }
 
-void MainWindow::playTrack(int trackIndex)
+void MainWindow::playTrack(int trackIndex, bool overlay)
 {
-    // Always stop any currently playing audio, regardless of isPlaying flag
-    audio.stop();
-    
+    // The new track replaces the current one in the mixer, overlaid sounds keep playing
     if (currentPlaylistIndex >= 0 && trackIndex >= 0) {
         auto playlist = playlistManager.getPlaylist(currentPlaylistIndex);
         if (playlist && trackIndex < playlist->getTrackCount()) {
             auto track = playlist->getTrack(trackIndex);
             
-            QString filePath = track->getProcessedPath();
-            if (QFile::exists(filePath)) {
-                if (audio.playWav(filePath.toStdString())) {
-                    currentTrackIndex = trackIndex;
-                    updateTracksList(); // Update to highlight the current track
-                    // Note: isPlaying will be set to true by the playbackStarted signal
-                } else {
-                    QMessageBox::warning(this, tr("Error"), tr("Failed to play file:\n") + filePath);
-                }
+            bool started = false;
+            const float gain = trackGain(track);
+            QString filePath = track->getOriginalPath();
+            if (track->isHot() && audio.playSample(filePath.toStdString(), overlay, gain)) {
+                // Resident in the sample bank, no file is touched
+                started = true;
+            } else if (!(filePath = track->getCachedPath()).isEmpty()) {
+                started = audio.playWav(filePath.toStdString(), overlay, gain);
+            } else if (track->hasProcessedFile()) {
+                filePath = track->getProcessedPath();
+                started = audio.playWav(filePath.toStdString(), overlay, gain);
             } else {
-                // If processed file doesn't exist, try to process it again
-                if (track->processTrack()) {
-                    filePath = track->getProcessedPath();
-                    if (audio.playWav(filePath.toStdString())) {
-                        currentTrackIndex = trackIndex;
-                        updateTracksList();
-                    } else {
-                        QMessageBox::warning(this, tr("Error"), tr("Failed to play file:\n") + filePath);
-                    }
-                } else {
-                    QMessageBox::warning(this, tr("Error"), tr("File not found and processing failed:\n") + filePath);
+                // Decode the original on the fly; with a cache budget set, keep
+                // a decoded copy for the next time
+                filePath = track->getOriginalPath();
+                if (!QFile::exists(filePath)) {
+                    QMessageBox::warning(this, tr("Error"), tr("File not found:\n") + filePath);
+                    return;
                 }
+                started = audio.playFile(filePath.toStdString(), overlay, gain);
+                // Native WAVs have no cache key and are never materialised
+                AudioCache::instance().requestMaterialise(track->getCacheKey(), filePath);
+            }
+            
+            if (started && overlay) {
+                return;
             }
+            if (started) {
+                currentTrackIndex = trackIndex;
+                trackModel->setCurrentRow(currentTrackIndex); // Highlight the current track
+                showWaveform(track);
+                queueNextTrack();
+                // Note: isPlaying will be set to true by the playbackStarted signal
+            } else {
+                QMessageBox::warning(this, tr("Error"), tr("Failed to play file:\n") + filePath);
+            }
+        }
+    }
+}
+
+// Hand the following playlist track to the engine while the current one is
+// still playing, so it can be spliced in or crossfaded without a gap
+void MainWindow::queueNextTrack()
+{
+    queuedTrackIndex = -1;
+    auto playlist = currentPlaylistIndex >= 0 ? playlistManager.getPlaylist(currentPlaylistIndex) : nullptr;
+    if (!playlist || currentTrackIndex < 0 || currentTrackIndex + 1 >= playlist->getTrackCount()) {
+        audio.clearQueue();
+        return;
+    }
+    auto track = playlist->getTrack(currentTrackIndex + 1);
+
+    const float gain = trackGain(track);
+    bool queued = track->isHot() && audio.queueSample(track->getOriginalPath().toStdString(), gain);
+    if (!queued) {
+        QString filePath = track->getCachedPath();
+        if (filePath.isEmpty()) {
+            filePath = track->hasProcessedFile() ? track->getProcessedPath() : track->getOriginalPath();
         }
+        queued = QFile::exists(filePath) && audio.queueFile(filePath.toStdString(), gain);
     }
+    if (queued) {
+        queuedTrackIndex = currentTrackIndex + 1;
+    } else {
+        // on_playbackStopped starts it the old way
+        audio.clearQueue();
+    }
+}
+
+// Loudness normalisation of a track (unless switched off) and its own gain
+float MainWindow::trackGain(const std::shared_ptr<Track>& track) const
+{
+    const float gain = static_cast<float>(std::pow(10.0, track->getGainDb() / 20.0));
+    return normalizeLoudness ? gain * track->playbackGain(loudnessTarget) : gain;
+}
+
+// Null peaks until the cache has them, peaksReady fills them in
+void MainWindow::showWaveform(const std::shared_ptr<Track>& track)
+{
+    waveformPath = track ? track->getOriginalPath() : QString();
+    ui->musicProgress->setPeaks(peakCache.peaks(waveformPath));
 }
 
 void MainWindow::processAudioFile(const QString& filePath)
@@ -414,15 +707,539 @@ void MainWindow::processAudioFile(const QString& filePath)
     
     auto playlist = playlistManager.getPlaylist(currentPlaylistIndex);
     if (playlist) {
-        // Create a track and add it to the playlist
-        if (playlist->addTrack(filePath)) {
-            updateTracksList();
-            
-            // Select the newly added track
-            int newTrackIndex = playlist->getTrackCount() - 1;
-            ui->soundTable->selectRow(newTrackIndex);
-        } else {
-            QMessageBox::warning(this, tr("Error"), tr("Failed to add track:\n") + filePath);
+        // Tracks are appended as soon as their import finishes
+        importQueue.enqueue(filePath, playlist);
+    }
+}
+
+void MainWindow::onTrackImported(std::shared_ptr<Playlist> playlist, std::shared_ptr<Track> track)
+{
+    if (playlist != trackModel->playlist()) {
+        playlist->addTrackWithoutProcessing(track);
+    } else {
+        // Through the model, so the view inserts one row
+        trackModel->appendTrack(track);
+    }
+    
+    if (searchIndexBuilt) {
+        searchIndex.addTrack(playlist, track);
+        if (trackProxy->isFiltering()) {
+            applySearch();
+        }
+    }
+    
+    if (playlist == trackModel->playlist()) {
+        // Select the newly added track, unless the search hides it
+        int newTrackIndex = playlist->getTrackCount() - 1;
+        QModelIndex shown = trackProxy->mapFromSource(trackModel->index(newTrackIndex, 0));
+        if (shown.isValid()) {
+            ui->soundTable->selectRow(shown.row());
+        }
+    }
+}
+
+void MainWindow::onImportStarted(const QString& filePath)
+{
+    importingFiles.append(filePath);
+    showImportingFiles();
+}
+
+void MainWindow::onImportFailed(const QString& filePath)
+{
+    failedImports.append(filePath);
+}
+
+void MainWindow::onImportFileFinished(const QString& filePath)
+{
+    importingFiles.removeOne(filePath);
+    showImportingFiles();
+}
+
+// Name the files being imported right now in the status bar
+void MainWindow::showImportingFiles()
+{
+    if (importingFiles.isEmpty()) {
+        ui->statusbar->clearMessage();
+        return;
+    }
+    QString name = QFileInfo(importingFiles.first()).fileName();
+    if (importingFiles.size() == 1) {
+        ui->statusbar->showMessage(tr("Importing %1").arg(name));
+    } else {
+        ui->statusbar->showMessage(tr("Importing %1 and %n more", nullptr, importingFiles.size() - 1).arg(name));
+    }
+}
+
+void MainWindow::onImportProgress(int finished, int total)
+{
+    bool busy = total > 0;
+    importProgress->setVisible(busy);
+    cancelImportButton->setVisible(busy);
+    importProgress->setMaximum(total);
+    importProgress->setValue(finished);
+}
+
+void MainWindow::onImportFinished()
+{
+    savePlaylistsToSettings();
+    importingFiles.clear(); // cancelled files never finish
+    ui->statusbar->clearMessage();
+    importProgress->setVisible(false);
+    cancelImportButton->setVisible(false);
+    
+    if (!failedImports.isEmpty()) {
+        QMessageBox::warning(this, tr("Error"), tr("Failed to add tracks:\n") + failedImports.join("\n"));
+        failedImports.clear();
+    }
+}
+
+void MainWindow::onSoundTableContextMenu(const QPoint& pos)
+{
+    int row = trackProxy->mapToSource(ui->soundTable->indexAt(pos)).row();
+    auto playlist = playlistManager.getPlaylist(currentPlaylistIndex);
+    if (!playlist || row < 0 || row >= playlist->getTrackCount()) {
+        return;
+    }
+    auto track = playlist->getTrack(row);
+    
+    QMenu menu(this);
+    QAction* hotAction = menu.addAction(tr("Keep in memory (hot pad)"));
+    hotAction->setCheckable(true);
+    hotAction->setChecked(track->isHot());
+    QAction* hotkeyAction = menu.addAction(tr("Set global hotkey..."));
+    hotkeyAction->setEnabled(hotkeys.isAvailable());
+    QAction* gainAction = menu.addAction(tr("Set gain..."));
+    menu.addSeparator();
+    QAction* renameAction = menu.addAction(tr("Rename..."));
+    QAction* removeAction = menu.addAction(tr("Remove from playlist"));
+    QAction* chosen = menu.exec(ui->soundTable->viewport()->mapToGlobal(pos));
+    if (chosen == renameAction) {
+        bool ok;
+        QString title = QInputDialog::getText(this, tr("Rename Track"), tr("Title:"),
+                                              QLineEdit::Normal, track->getTitle(), &ok).trimmed();
+        if (!ok || title.isEmpty() || title == track->getTitle()) {
+            return;
+        }
+        track->setTitle(title);
+        if (searchIndexBuilt) {
+            searchIndex.updateTrack(track);
+            if (trackProxy->isFiltering()) {
+                applySearch();
+            }
+        }
+        savePlaylistsToSettings();
+        trackModel->trackChanged(row);
+        return;
+    }
+    if (chosen == removeAction) {
+        if (searchIndexBuilt) {
+            searchIndex.removeTrack(track.get());
+        }
+        if (track->isHot()) {
+            audio.sampleBank().unload(track->getOriginalPath().toStdString());
+        }
+        trackModel->removeTrack(row);
+        // A playing track keeps playing, it is just no longer in the list
+        if (row == currentTrackIndex) {
+            currentTrackIndex = -1;
+        } else if (row < currentTrackIndex) {
+            currentTrackIndex--;
+        }
+        if (isPlaying) {
+            queueNextTrack();
+        }
+        if (!track->getHotkey().isEmpty()) {
+            registerHotkeys();
+        }
+        if (trackProxy->isFiltering()) {
+            applySearch();
+        }
+        savePlaylistsToSettings();
+        return;
+    }
+    if (chosen == gainAction) {
+        bool ok;
+        double gainDb = QInputDialog::getDouble(this, tr("Track Gain"),
+                                                tr("Gain in dB, on top of loudness normalisation:"),
+                                                track->getGainDb(), -30.0, 12.0, 1, &ok);
+        if (!ok || gainDb == track->getGainDb()) {
+            return;
+        }
+        track->setGainDb(gainDb);
+        // Playing and queued voices ramp to it, hotkey actions carry it
+        if (isPlaying && row == currentTrackIndex) {
+            audio.setTrackGain(trackGain(track));
+        } else if (isPlaying && row == queuedTrackIndex) {
+            queueNextTrack();
+        }
+        if (!track->getHotkey().isEmpty()) {
+            registerHotkeys();
+        }
+        savePlaylistsToSettings();
+        trackModel->trackChanged(row);
+        return;
+    }
+    if (chosen == hotkeyAction) {
+        bool ok;
+        QString hotkey = QInputDialog::getText(this, tr("Global Hotkey"),
+                                               tr("Key sequence, e.g. Ctrl+Alt+1 or F13 (empty to remove):"),
+                                               QLineEdit::Normal, track->getHotkey(), &ok);
+        if (!ok) {
+            return;
+        }
+        track->setHotkey(hotkey.trimmed());
+        registerHotkeys();
+        savePlaylistsToSettings();
+        trackModel->trackChanged(row);
+        return;
+    }
+    if (chosen != hotAction) {
+        return;
+    }
+    
+    track->setHot(hotAction->isChecked());
+    if (track->isHot()) {
+        preloadTrack(track);
+    } else {
+        audio.sampleBank().unload(track->getOriginalPath().toStdString());
+    }
+    savePlaylistsToSettings();
+    trackModel->trackChanged(row);
+}
+
+void MainWindow::onPlaylistListContextMenu(const QPoint& pos)
+{
+    QListWidgetItem* item = ui->playlistList->itemAt(pos);
+    if (!item) {
+        return;
+    }
+    int index = ui->playlistList->row(item);
+    auto playlist = playlistManager.getPlaylist(index);
+    if (!playlist) {
+        return;
+    }
+
+    QMenu menu(this);
+    QAction* renameAction = menu.addAction(tr("Rename..."));
+    QAction* removeAction = menu.addAction(tr("Delete playlist"));
+    QAction* chosen = menu.exec(ui->playlistList->viewport()->mapToGlobal(pos));
+    if (chosen == renameAction) {
+        bool ok;
+        QString name = QInputDialog::getText(this, tr("Rename Playlist"), tr("Enter playlist name:"),
+                                             QLineEdit::Normal, playlist->getName(), &ok).trimmed();
+        if (!ok || name.isEmpty() || name == playlist->getName()) {
+            return;
+        }
+        // Playlist names are not indexed, the search is unaffected
+        playlistManager.renamePlaylist(index, name);
+        item->setText(name);
+        savePlaylistsToSettings();
+        return;
+    }
+    if (chosen != removeAction) {
+        return;
+    }
+    if (QMessageBox::question(this, tr("Delete Playlist"),
+                              tr("Delete the playlist \"%1\" and its %n track(s)?", nullptr,
+                                 playlist->getTrackCount()).arg(playlist->getName()))
+        != QMessageBox::Yes) {
+        return;
+    }
+
+    if (searchIndexBuilt) {
+        searchIndex.removePlaylist(playlist.get());
+    }
+    bool hadHotkeys = false;
+    if (playlist->isLoaded()) {
+        for (int i = 0; i < playlist->getTrackCount(); i++) {
+            auto track = playlist->getTrack(i);
+            if (track->isHot()) {
+                audio.sampleBank().unload(track->getOriginalPath().toStdString());
+            }
+            hadHotkeys = hadHotkeys || !track->getHotkey().isEmpty();
+        }
+    }
+    if (playlist == trackModel->playlist()) {
+        // Detach the view before the playlist empties under it
+        trackModel->setPlaylist(nullptr);
+    }
+    playlistManager.removePlaylist(index);
+    if (hadHotkeys) {
+        registerHotkeys();
+    }
+    updatePlaylistsList();
+    ui->playlistList->setCurrentRow(qMin(index, ui->playlistList->count() - 1));
+    savePlaylistsToSettings();
+}
+
+void MainWindow::onDeviceAdded(const soundpad::AudioDevice& device)
+{
+    const bool sink = device.kind == soundpad::AudioDevice::Sink;
+    QComboBox* select = sink ? ui->audioOutputSelect : ui->outputSelect;
+    const QString name = QString::fromStdString(device.name);
+    if (select->findData(name) != -1) {
+        return;
+    }
+    select->addItem(QString::fromStdString(device.description), name);
+    // The headphones or the mic we were set to use are back: use them again
+    if (name == settings->value(sink ? "audio_output_sink" : "audio_source", "").toString()) {
+        select->setCurrentIndex(select->count() - 1);
+    }
+}
+
+void MainWindow::onDeviceRemoved(const soundpad::AudioDevice& device)
+{
+    const bool sink = device.kind == soundpad::AudioDevice::Sink;
+    QComboBox* select = sink ? ui->audioOutputSelect : ui->outputSelect;
+    const int index = select->findData(QString::fromStdString(device.name));
+    if (index == -1) {
+        return;
+    }
+    // Without the signal: neither merge another source nor forget the saved
+    // device, so that it is picked again when it comes back
+    QSignalBlocker blocker(select);
+    const bool current = index == select->currentIndex();
+    select->removeItem(index);
+    if (sink && current) {
+        select->setCurrentIndex(0);
+        audio.setOutputSink("");
+    }
+}
+
+void MainWindow::onDeviceChanged(const soundpad::AudioDevice& device)
+{
+    QComboBox* select = device.kind == soundpad::AudioDevice::Sink ? ui->audioOutputSelect : ui->outputSelect;
+    const int index = select->findData(QString::fromStdString(device.name));
+    if (index != -1) {
+        select->setItemText(index, QString::fromStdString(device.description));
+    }
+}
+
+void MainWindow::preloadTrack(const std::shared_ptr<Track>& track)
+{
+    // Keyed by the original, loaded from the cheapest copy on disk
+    QString source = track->getCachedPath();
+    if (source.isEmpty()) {
+        source = track->hasProcessedFile() ? track->getProcessedPath() : track->getOriginalPath();
+    }
+    audio.sampleBank().preload(track->getOriginalPath().toStdString(), source.toStdString());
+}
+
+void MainWindow::updateBankStatus()
+{
+    auto stats = audio.sampleBank().stats();
+    bool busy = stats.samples > 0 || stats.loading > 0;
+    bankStatus->setVisible(busy);
+    if (!busy) {
+        return;
+    }
+    
+    const double mib = 1024.0 * 1024.0;
+    QString text = tr("Hot pads: %1 MiB").arg(stats.residentBytes / mib, 0, 'f', 1);
+    if (stats.residentBytes > 0 && stats.lockedBytes == stats.residentBytes) {
+        text += tr(" (locked)");
+    }
+    if (stats.loading > 0) {
+        text += tr(", loading %1").arg(stats.loading);
+    }
+    quint64 lookups = stats.hits + stats.misses;
+    if (lookups > 0) {
+        text += tr(", hit rate %1%").arg(100.0 * stats.hits / lookups, 0, 'f', 0);
+    }
+    bankStatus->setText(text);
+    bankStatus->setToolTip(tr("%1 samples, %2 of %3 MiB, %4 MiB locked\n%5 hits, %6 misses")
+                               .arg(stats.samples)
+                               .arg(stats.residentBytes / mib, 0, 'f', 1)
+                               .arg(stats.budgetBytes / mib, 0, 'f', 0)
+                               .arg(stats.lockedBytes / mib, 0, 'f', 1)
+                               .arg(stats.hits)
+                               .arg(stats.misses));
+}
+
+// Hotkeys play straight from the input thread, so each action carries
+// everything it needs instead of looking the track up in the GUI state
+void MainWindow::registerHotkeys()
+{
+    hotkeys.clear();
+    int id = 0;
+    for (int i = 0; i < playlistManager.getPlaylistCount(); i++) {
+        auto playlist = playlistManager.getPlaylist(i);
+        if (!playlist->isLoaded()) {
+            continue; // nothing in it has a hotkey, or it would have been loaded
+        }
+        for (int j = 0; j < playlist->getTrackCount(); j++) {
+            auto track = playlist->getTrack(j);
+            if (track->getHotkey().isEmpty()) {
+                continue;
+            }
+            std::string path = track->getOriginalPath().toStdString();
+            soundpad::SoundpadAudio* engine = &audio;
+            const float gain = trackGain(track);
+            bool bound = hotkeys.bind(id++, track->getHotkey().toStdString(),
+                                      [engine, path, gain](soundpad::GlobalHotkeys::Clock::time_point pressed) {
+                engine->triggerPad(path, path, pressed, gain);
+            });
+            if (!bound) {
+                qWarning() << "Could not bind hotkey" << track->getHotkey() << "for" << track->getTitle();
+            }
+        }
+    }
+}
+
+void MainWindow::updateLatencyStatus()
+{
+    auto trigger = audio.diagnostics().triggerToWrite;
+    latencyStatus->setVisible(trigger.count > 0);
+    if (trigger.count == 0) {
+        return;
+    }
+    
+    latencyStatus->setText(tr("Trigger: %1 ms (p95 %2 ms)")
+                               .arg(trigger.last / 1000.0, 0, 'f', 1)
+                               .arg(trigger.percentile(95) / 1000.0, 0, 'f', 1));
+    latencyStatus->setToolTip(tr("Request to first written sample over %1 triggers\nmin %2 ms, mean %3 ms, max %4 ms")
+                                  .arg(trigger.count)
+                                  .arg(trigger.min / 1000.0, 0, 'f', 1)
+                                  .arg(trigger.mean / 1000.0, 0, 'f', 1)
+                                  .arg(trigger.max / 1000.0, 0, 'f', 1));
+}
+
+void MainWindow::setupDiagnosticsDock()
+{
+    diagnosticsDock = new QDockWidget(tr("Audio Diagnostics"), this);
+    diagnosticsDock->setObjectName("diagnosticsDock");
+    QWidget* panel = new QWidget(diagnosticsDock);
+    QVBoxLayout* layout = new QVBoxLayout(panel);
+
+    diagnosticsTable = new QTableWidget(4, 7, panel);
+    diagnosticsTable->setHorizontalHeaderLabels(QStringList() << tr("Count") << tr("Min") << tr("p50")
+                                                              << tr("p95") << tr("p99") << tr("Max") << tr("Mean"));
+    diagnosticsTable->setVerticalHeaderLabels(QStringList() << tr("Trigger → write") << tr("Trigger → output")
+                                                            << tr("Stream latency") << tr("Decode-ahead"));
+    diagnosticsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    diagnosticsTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    diagnosticsTable->setToolTip(tr("Milliseconds. Percentiles are bucket upper bounds, within a quarter octave."));
+    layout->addWidget(diagnosticsTable);
+
+    diagnosticsCounters = new QLabel(panel);
+    layout->addWidget(diagnosticsCounters);
+
+    QHBoxLayout* buttons = new QHBoxLayout();
+    QPushButton* resetButton = new QPushButton(tr("Reset"), panel);
+    QPushButton* dumpButton = new QPushButton(tr("Dump to File..."), panel);
+    buttons->addStretch();
+    buttons->addWidget(resetButton);
+    buttons->addWidget(dumpButton);
+    layout->addLayout(buttons);
+    connect(resetButton, &QPushButton::clicked, this, [this]() {
+        audio.resetDiagnostics();
+        updateDiagnostics();
+    });
+    connect(dumpButton, &QPushButton::clicked, this, &MainWindow::onDumpDiagnostics);
+
+    diagnosticsDock->setWidget(panel);
+    addDockWidget(Qt::BottomDockWidgetArea, diagnosticsDock);
+    diagnosticsDock->hide();
+    connect(diagnosticsDock, &QDockWidget::visibilityChanged, this, &MainWindow::updateDiagnostics);
+
+    QToolButton* toggle = new QToolButton(this);
+    toggle->setDefaultAction(diagnosticsDock->toggleViewAction());
+    ui->statusbar->addPermanentWidget(toggle);
+}
+
+static const char* engineStateName(soundpad::SoundpadAudio::EngineState state)
+{
+    switch (state) {
+    case soundpad::SoundpadAudio::EngineState::Idle: return "idle";
+    case soundpad::SoundpadAudio::EngineState::Preparing: return "preparing";
+    case soundpad::SoundpadAudio::EngineState::Playing: return "playing";
+    case soundpad::SoundpadAudio::EngineState::Draining: return "draining";
+    }
+    return "unknown";
+}
+
+void MainWindow::updateDiagnostics()
+{
+    if (!diagnosticsDock->isVisible()) {
+        return;
+    }
+    auto diagnostics = audio.diagnostics();
+    const soundpad::Histogram::Snapshot* rows[] = {
+        &diagnostics.triggerToWrite, &diagnostics.triggerToOutput,
+        &diagnostics.streamLatency, &diagnostics.decodeAhead,
+    };
+    for (int row = 0; row < 4; row++) {
+        const auto& h = *rows[row];
+        const double values[] = { h.min / 1000.0, h.percentile(50) / 1000.0, h.percentile(95) / 1000.0,
+                                  h.percentile(99) / 1000.0, h.max / 1000.0, h.mean / 1000.0 };
+        diagnosticsTable->setItem(row, 0, new QTableWidgetItem(QString::number(h.count)));
+        for (int column = 1; column < 7; column++) {
+            QString text = h.count > 0 ? QString::number(values[column - 1], 'f', 1) : QString("-");
+            diagnosticsTable->setItem(row, column, new QTableWidgetItem(text));
+        }
+    }
+    diagnosticsCounters->setText(tr("Underruns: %1   Overruns: %2   Mic dropouts: %3   Engine: %4 (%5)")
+                                     .arg(diagnostics.underruns)
+                                     .arg(diagnostics.overruns)
+                                     .arg(diagnostics.micDropouts)
+                                     .arg(QString::fromLatin1(engineStateName(audio.engineState())))
+                                     .arg(QString::fromLatin1(audio.backendName())));
+}
+
+static QJsonObject histogramToJson(const soundpad::Histogram::Snapshot& h)
+{
+    QJsonObject object;
+    object["count"] = static_cast<qint64>(h.count);
+    object["min_us"] = static_cast<qint64>(h.min);
+    object["max_us"] = static_cast<qint64>(h.max);
+    object["mean_us"] = h.mean;
+    object["p50_us"] = h.percentile(50);
+    object["p95_us"] = h.percentile(95);
+    object["p99_us"] = h.percentile(99);
+    // Only the occupied buckets, [lower, upper) in microseconds
+    QJsonArray buckets;
+    for (int i = 0; i < soundpad::Histogram::kBuckets; i++) {
+        if (h.buckets[i] == 0) {
+            continue;
         }
+        QJsonObject bucket;
+        bucket["lower_us"] = soundpad::Histogram::lowerBound(i);
+        bucket["upper_us"] = soundpad::Histogram::upperBound(i);
+        bucket["count"] = static_cast<qint64>(h.buckets[i]);
+        buckets.append(bucket);
     }
-}
\ No newline at end of file
+    object["buckets"] = buckets;
+    return object;
+}
+
+void MainWindow::onDumpDiagnostics()
+{
+    QString defaultName = QDir(data_path).filePath(
+        QString("diagnostics-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")));
+    QString path = QFileDialog::getSaveFileName(this, tr("Dump Diagnostics"), defaultName, tr("JSON (*.json)"));
+    if (path.isEmpty()) {
+        return;
+    }
+
+    auto diagnostics = audio.diagnostics();
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    root["engine_state"] = engineStateName(audio.engineState());
+    root["backend"] = audio.backendName();
+    root["crossfade_ms"] = audio.crossfadeMs();
+    root["underruns"] = static_cast<qint64>(diagnostics.underruns);
+    root["overruns"] = static_cast<qint64>(diagnostics.overruns);
+    root["mic_dropouts"] = static_cast<qint64>(diagnostics.micDropouts);
+    root["mic_latency_ms"] = audio.micLatencyMs();
+    root["trigger_to_write"] = histogramToJson(diagnostics.triggerToWrite);
+    root["trigger_to_output"] = histogramToJson(diagnostics.triggerToOutput);
+    root["stream_latency"] = histogramToJson(diagnostics.streamLatency);
+    root["decode_ahead"] = histogramToJson(diagnostics.decodeAhead);
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        QMessageBox::warning(this, tr("Error"), tr("Could not write %1").arg(path));
+        return;
+    }
+    file.write(QJsonDocument(root).toJson());
+}
@@ -7,8 +7,20 @@
 #include <QDropEvent>
 #include <QMimeData>
 #include <QComboBox>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QLabel>
+#include <QDockWidget>
+#include <QTableWidget>
 #include "SoundpadAudio.hpp"
+#include "GlobalHotkeys.hpp"
+#include "TrackTableModel.hpp"
+#include "TrackFilterProxyModel.hpp"
 #include "../music_config/PlaylistManager.hpp"
+#include "../music_config/ImportQueue.hpp"
+#include "../music_config/SearchIndex.hpp"
+#include "../music_config/MetadataProber.hpp"
+#include "../music_config/PeakCache.hpp"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -31,16 +43,35 @@ private slots:
     void on_playbackStarted(qint64 totalMs);
     void on_playbackProgress(qint64 currentMs);
     void on_playbackStopped();
+    void onTrackAdvanced(qint64 totalMs);
     void on_previousButton_clicked();
     void on_nextButton_clicked();
     void on_playlistList_currentRowChanged(int currentRow);
-    void on_soundTable_cellDoubleClicked(int row, int column);
+    void on_soundTable_doubleClicked(const QModelIndex& index);
+    void on_searchEdit_textChanged(const QString& text);
     void on_addPlaylistButton_clicked();
     void on_importButton_clicked();
+    void onTrackImported(std::shared_ptr<Playlist> playlist, std::shared_ptr<Track> track);
+    void onImportStarted(const QString& filePath);
+    void onImportFailed(const QString& filePath);
+    void onImportFileFinished(const QString& filePath);
+    void onImportProgress(int finished, int total);
+    void onImportFinished();
+    void onTracksProbed(const QList<std::shared_ptr<Track>>& tracks);
+    void onSoundTableContextMenu(const QPoint& pos);
+    void onPlaylistListContextMenu(const QPoint& pos);
+    void onDeviceAdded(const soundpad::AudioDevice& device);
+    void onDeviceRemoved(const soundpad::AudioDevice& device);
+    void onDeviceChanged(const soundpad::AudioDevice& device);
+    void updateBankStatus();
+    void updateLatencyStatus();
+    void updateDiagnostics();
+    void onDumpDiagnostics();
 
 private:
     Ui::MainWindow *ui;
     soundpad::SoundpadAudio audio;
+    soundpad::GlobalHotkeys hotkeys; // after audio: its input thread stops first
     bool isPlaying = false;
 
     QSettings* settings;
@@ -50,14 +81,55 @@ private:
     PlaylistManager playlistManager;
     int currentPlaylistIndex = -1;
     int currentTrackIndex = -1;
+    int queuedTrackIndex = -1; // pre-rolled behind the current track
+    bool normalizeLoudness = true;
+    double loudnessTarget = -16.0; // LUFS
+    TrackTableModel* trackModel;
+    TrackFilterProxyModel* trackProxy; // what soundTable shows
+
+    // Built on the first search. Playlists that are not loaded are indexed
+    // from their stored rows (PlaylistManager::loadTrackTexts), not loaded
+    SearchIndex searchIndex;
+    bool searchIndexBuilt = false;
+
+    // Background import
+    ImportQueue importQueue;
+    QProgressBar* importProgress;
+    QPushButton* cancelImportButton;
+    QStringList failedImports;
+    QStringList importingFiles; // started and not yet finished, in start order
+
+    // Re-reads tags and durations of shown playlists whose files changed
+    MetadataProber metadataProber;
+
+    // Waveforms of the seek bar and the sound table rows
+    PeakCache peakCache;
+    QString waveformPath; // original of the track shown in the seek bar
+
+    // Sample bank usage in the status bar
+    QLabel* bankStatus;
+    QLabel* latencyStatus;
+
+    // Engine latency/underrun histograms, hidden until toggled from the status bar
+    QDockWidget* diagnosticsDock;
+    QTableWidget* diagnosticsTable;
+    QLabel* diagnosticsCounters;
 
     // Helper methods
     void updatePlaylistsList();
     void updateTracksList();
+    void applySearch();
     void loadPlaylistsFromSettings();
     void savePlaylistsToSettings();
-    void playTrack(int trackIndex);
+    void playTrack(int trackIndex, bool overlay = false);
+    void queueNextTrack();
+    void showWaveform(const std::shared_ptr<Track>& track);
+    void showImportingFiles();
+    float trackGain(const std::shared_ptr<Track>& track) const;
     void processAudioFile(const QString& filePath);
+    void preloadTrack(const std::shared_ptr<Track>& track);
+    void registerHotkeys();
+    void setupDiagnosticsDock();
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file